@@ -287,12 +287,9 @@ fn gen_squares(n) {
 }
 
 fn bench_generators(n) {
-  let xs = gen_squares(n);
-  let i = 0;
   let acc = 0;
-  while (i < len(xs)) {
-    acc = acc + xs[i];
-    i = i + 1;
+  for x in gen_squares(n) {
+    acc = acc + x;
   }
   return acc;
 }
@@ -11,5 +11,18 @@ fn fib(n) {
   }
 }
 
-let xs = fib(8);
+let xs = collect(fib(8));
 print(xs);
+
+// Generators are lazy, so they can stream without a bound.
+fn naturals() {
+  let i = 0;
+  while (true) {
+    yield i;
+    i += 1;
+  }
+}
+
+let it = naturals();
+print(next(it), next(it), next(it));
+print(collect(take(filter(naturals(), fn(x) => x % 3 == 0), 5)));
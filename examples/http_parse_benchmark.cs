@@ -0,0 +1,48 @@
+// HTTP head parsing throughput: a typical response and one with large headers.
+// Run: bin/cupidscript examples/http_parse_benchmark.cs
+// CS_BENCH_ROUNDS sets the messages parsed per case (default 20000).
+//
+// "map" builds the header map; "lookup" keeps the raw head and reads one header
+// with http_header, which is what a script checking only the status needs.
+
+set_timeout(0);
+set_instruction_limit(0);
+
+let rounds = to_int(getenv("CS_BENCH_ROUNDS") ?? "20000");
+if (rounds == nil || rounds < 1) { rounds = 20000; }
+
+fn response(headers) {
+  let head = "HTTP/1.1 200 OK\r\n";
+  for h in headers { head = head + h + "\r\n"; }
+  return head + "Content-Length: 2\r\n\r\nok";
+}
+
+let typical = response([
+  "Date: Sun, 18 Oct 2026 12:00:00 GMT", "Server: nginx/1.25.3",
+  "Content-Type: application/json; charset=utf-8", "Connection: keep-alive",
+  "Cache-Control: no-cache, no-store, must-revalidate", "Vary: Accept-Encoding",
+  "X-Request-Id: 4f1c2a9e-7d3b-4c55-9a61-0e2b8f6d1c3a", "ETag: \"33a64df551425fcc55e4d42a148795d9f25f89d4\""
+]);
+
+let many = [];
+for i in range(48) { push(many, "X-Trace-" + to_str(i) + ": " + str_repeat("t", 40)); }
+push(many, "Set-Cookie: session=" + str_repeat("c", 4000) + "; Path=/; HttpOnly");
+let large = response(many);
+
+fn run(name, msg, opts, lookup) {
+  let t0 = now_ns();
+  for i in range(rounds) {
+    let r = http_parse(msg, opts);
+    if (lookup) { http_header(r, "content-type"); }
+  }
+  let secs = (now_ns() - t0) / 1000000000.0;
+  print(str_pad_end(name, 16) + to_str(floor(rounds / secs)) + " msg/s, " +
+        to_str(floor(len(msg) * rounds / secs / 1048576)) + " MiB/s");
+}
+
+print("=== http parse benchmark (" + to_str(rounds) + " messages, " + to_str(len(typical)) +
+      " and " + to_str(len(large)) + " bytes) ===");
+run("typical map", typical, nil, false);
+run("typical lookup", typical, {headers: false}, true);
+run("large map", large, nil, false);
+run("large lookup", large, {headers: false}, true);
@@ -0,0 +1,29 @@
+// Worker for http_serve_benchmark.cs: the load generator. Each client runs its
+// requests back to back, so with max_per_host >= clients every client keeps one
+// connection for the whole run.
+
+async fn client(url, n) {
+  let bytes = 0;
+  for i in range(n) {
+    let r = await http_request_async({url: url});
+    if (r.status != 200) { throw "unexpected status " + to_str(r.status); }
+    bytes += len(r.body);
+  }
+  return bytes;
+}
+
+async fn run(msg) {
+  http_pool_config({max_per_host: msg.clients});
+  let base = "http://127.0.0.1:" + to_str(msg.port);
+  let ps = [];
+  for i in range(msg.clients) { push(ps, client(base + msg.path, msg.per_client)); }
+  let t0 = now_ns();
+  let sizes = await await_all(ps);
+  let elapsed = now_ns() - t0;
+  await http_get_async(base + "/stop");
+  let bytes = 0;
+  for b in sizes { bytes += b; }
+  return {elapsed_ns: elapsed, bytes: bytes, pool: http_pool_stats()};
+}
+
+on_message(fn(msg) { return run(msg); });
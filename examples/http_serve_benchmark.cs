@@ -0,0 +1,45 @@
+// Keep-alive throughput of http_serve, measured wrk-style from a worker thread.
+// Run: bin/cupidscript examples/http_serve_benchmark.cs
+// CS_BENCH_CLIENTS sets the concurrent connections (default 8) and
+// CS_BENCH_REQUESTS the requests each one sends (default 2000).
+//
+// The server runs in the main VM; http_serve_bench_worker.cs drives the load
+// with http_request_async and sends /stop when done.
+
+set_timeout(0);
+set_instruction_limit(0);
+
+fn env_int(name, dflt) {
+  let v = to_int(getenv(name) ?? "");
+  return (v == nil || v < 1) ? dflt : v;
+}
+
+let clients = env_int("CS_BENCH_CLIENTS", 8);
+let per_client = env_int("CS_BENCH_REQUESTS", 2000);
+let payload = str_repeat("x", 128);
+
+fn handler(req) {
+  if (req.path == "/stop") { http_serve_stop(); return "bye"; }
+  return {headers: {"Content-Type": "text/plain"}, body: payload};
+}
+
+print("=== http_serve benchmark (" + net_poll_backend() + ", " + to_str(clients) +
+      " clients x " + to_str(per_client) + " requests) ===");
+
+let w = worker_spawn("http_serve_bench_worker.cs");
+let reply = nil;
+let stats = http_serve(0, handler, {
+  on_listen: fn(port) {
+    reply = worker_post(w, {port: port, clients: clients, per_client: per_client, path: "/bench"});
+  }
+});
+let load = await reply;
+worker_terminate(w);
+
+let total = clients * per_client;
+let secs = load.elapsed_ns / 1000000000.0;
+print("requests:    " + to_str(stats.requests) + " (" + to_str(stats.connections) + " connections)");
+print("throughput:  " + to_str(floor(total / secs)) + " req/s");
+print("latency:     " + to_str(floor(load.elapsed_ns / per_client / 1000)) + "us mean per request per client");
+print("transfer:    " + to_str(floor(load.bytes / secs / 1024)) + " KiB/s of body");
+print("client pool: " + to_str(load.pool.hits) + " reused, " + to_str(load.pool.misses) + " opened");
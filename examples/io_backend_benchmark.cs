@@ -0,0 +1,79 @@
+// Echo throughput on the readiness backend (epoll/poll) versus io_uring.
+// Run: bin/cupidscript examples/io_backend_benchmark.cs
+// CS_BENCH_CONNS sets the number of connections (default 64), CS_BENCH_ROUNDS the
+// number of request/reply rounds over all of them (default 300).
+//
+// Each round parks a recv on every server socket, sends one request per client,
+// then echoes every request back, so each backend has a full batch of waiting
+// operations to complete per turn of the scheduler.
+
+set_timeout(0);
+set_instruction_limit(0);
+
+let conns = to_int(getenv("CS_BENCH_CONNS") ?? "64");
+if (conns == nil || conns < 1) { conns = 64; }
+let rounds = to_int(getenv("CS_BENCH_ROUNDS") ?? "300");
+if (rounds == nil || rounds < 1) { rounds = 300; }
+
+fn echo_run(port) {
+  let srv = tcp_listen("127.0.0.1", port);
+  let pairs = [];
+  for i in range(conns) {
+    let c = await tcp_connect("127.0.0.1", port);
+    push(pairs, [c, await socket_accept(srv)]);
+  }
+
+  let msg = "request-payload-0123456789abcdef";
+  let t0 = now_ns();
+  for r in range(rounds) {
+    let reqs = [];
+    for p in pairs { push(reqs, socket_recv(p[1], 256)); }
+    for p in pairs { socket_send(p[0], msg); }
+    let replies = [];
+    for i in range(conns) {
+      let got = await reqs[i];
+      push(replies, socket_recv(pairs[i][0], 256));
+      socket_send(pairs[i][1], got);
+    }
+    for rp in replies { await rp; }
+  }
+  let elapsed = now_ns() - t0;
+
+  for p in pairs { socket_close(p[0]); socket_close(p[1]); }
+  socket_close(srv);
+  return elapsed;
+}
+
+fn file_run(path) {
+  let t0 = now_ns();
+  for r in range(20) {
+    let reads = [];
+    for i in range(conns) { push(reads, read_file_async(path)); }
+    for p in reads { await p; }
+  }
+  return now_ns() - t0;
+}
+
+let path = "/tmp/cs_io_bench_" + to_str(random_int(0, 1000000)) + ".txt";
+let body = "";
+for i in range(4096) { body = body + "0123456789abcdef"; }
+write_file(path, body);
+
+print("=== io backend benchmark (" + to_str(conns) + " connections, " + to_str(rounds) + " rounds) ===");
+let readiness = net_poll_backend();
+let base = 46000 + random_int(0, 1000);
+for name in [readiness, "io_uring"] {
+  let got = net_set_poll_backend(name);
+  if (got != name) {
+    print(name + ": not available, skipped");
+    continue;
+  }
+  let ns = echo_run(base);
+  base += 1;
+  let reqs = conns * rounds;
+  print(name + " echo: " + to_str(floor(reqs * 1000000000 / ns)) + " req/s (" + to_str(floor(ns / 1000000)) + " ms)");
+  let fns = file_run(path);
+  print(name + " read_file_async 64KB: " + to_str(floor(20 * conns * 1000000000 / fns)) + " reads/s");
+}
+net_set_poll_backend(readiness);
+rm(path);
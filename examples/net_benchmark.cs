@@ -0,0 +1,60 @@
+// Event loop benchmark: many idle connections with a pending recv each, plus a set of
+// active connections doing request/response rounds.
+// Run: bin/cupidscript examples/net_benchmark.cs
+// CS_BENCH_IDLE / CS_BENCH_ACTIVE / CS_BENCH_ROUNDS size the run (default 10000 / 1000 / 20).
+// Both ends live in this process, so it needs about 2 * (idle + active) descriptors:
+// raise the limit first, e.g. `ulimit -n 25000`. Build with `make CS_NO_EPOLL=1` to
+// compare against the poll backend.
+
+set_timeout(0);
+set_instruction_limit(0);
+net_set_default_timeout(600000);
+
+fn env_int(name, dflt) {
+  let v = to_int(getenv(name) ?? "");
+  return v == nil ? dflt : v;
+}
+
+let idle_n = env_int("CS_BENCH_IDLE", 10000);
+let active_n = env_int("CS_BENCH_ACTIVE", 1000);
+let rounds = env_int("CS_BENCH_ROUNDS", 20);
+
+let port = 43000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+
+fn pair() {
+  let c = await tcp_connect("127.0.0.1", port);
+  let s = await socket_accept(srv);
+  return [c, s];
+}
+
+print("=== net benchmark (" + net_poll_backend() + ") ===");
+
+let t0 = now_ms();
+let idle = [];
+let parked = [];
+for i in range(idle_n) {
+  let p = pair();
+  push(idle, p);
+  push(parked, socket_recv(p[1], 16));
+}
+let active = [];
+for i in range(active_n) { push(active, pair()); }
+print("connections: idle =", idle_n, "active =", active_n, "setup ms =", now_ms() - t0);
+
+let t1 = now_ms();
+for r in range(rounds) {
+  let waits = [];
+  for p in active {
+    socket_send(p[0], "ping");
+    push(waits, socket_recv(p[1], 16));
+  }
+  for w in waits { await w; }
+}
+let ms = now_ms() - t1;
+let ops = rounds * active_n;
+print("rounds =", rounds, "messages =", ops, "ms =", ms, "msg/s =", ms > 0 ? floor(ops * 1000 / ms) : ops);
+
+for p in active { socket_close(p[0]); socket_close(p[1]); }
+for p in idle { socket_close(p[0]); socket_close(p[1]); }
+socket_close(srv);
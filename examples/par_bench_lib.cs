@@ -0,0 +1,17 @@
+// Work function for par_benchmark.cs
+
+export collatz_steps = fn(n) {
+  let steps = 0;
+  let total = 0;
+  for k in range(n, n + 20) {
+    let x = k;
+    while (x != 1) {
+      if (x % 2 == 0) { x = floor(x / 2); } else { x = 3 * x + 1; }
+      steps += 1;
+    }
+    total += steps;
+  }
+  return total;
+};
+
+export add = fn(a, b) { return a + b; };
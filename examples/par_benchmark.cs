@@ -0,0 +1,44 @@
+// par_map scaling: the same job on 1..N pool workers.
+// Run: bin/cupidscript examples/par_benchmark.cs
+// CS_BENCH_MAX_WORKERS sets N (default 8).
+
+set_timeout(0);
+set_instruction_limit(0);
+
+let max_workers = to_int(getenv("CS_BENCH_MAX_WORKERS") ?? "8");
+if (max_workers == nil || max_workers < 1) { max_workers = 8; }
+let items = [i + 1 for i in range(800)];
+let lib = "par_bench_lib.cs";
+
+fn same(a, b) {
+  if (len(a) != len(b)) { return false; }
+  for i in range(len(a)) {
+    if (a[i] != b[i]) { return false; }
+  }
+  return true;
+}
+
+// Sequential baseline in this VM
+let work = require(lib);
+let t0 = now_ms();
+let expect = [work.collatz_steps(x) for x in items];
+let base = now_ms() - t0;
+print("=== par_map benchmark ===");
+print("items =", len(items), "sequential ms =", base);
+
+let w = 1;
+while (w <= max_workers) {
+  // First call loads the module into any new pool VMs; time the second
+  par_map(items, "collatz_steps", lib, {workers: w});
+  let t1 = now_ms();
+  let got = par_map(items, "collatz_steps", lib, {workers: w});
+  let ms = now_ms() - t1;
+  assert(same(got, expect), "par_map must match the sequential result");
+  let speedup = ms > 0 ? floor(base * 100 / ms) / 100.0 : 0;
+  print("workers =", w, "ms =", ms, "speedup =", speedup);
+  w *= 2;
+}
+
+let t2 = now_ms();
+let sum = par_reduce(expect, "add", lib, {workers: max_workers});
+print("par_reduce sum =", sum, "ms =", now_ms() - t2);
@@ -0,0 +1,48 @@
+// Sort benchmark: sequential merge sort vs. parallel sort.
+// Run: bin/cupidscript examples/sort_benchmark.cs
+
+set_timeout(0);
+
+fn make_ints(n) {
+  let xs = [];
+  for i in range(n) {
+    push(xs, random_int(0, 1000000000));
+  }
+  return xs;
+}
+
+fn make_strs(n) {
+  let xs = [];
+  for i in range(n) {
+    push(xs, "key-${random_int(0, 1000000000)}");
+  }
+  return xs;
+}
+
+fn same(a, b) {
+  if (len(a) != len(b)) { return false; }
+  for i in range(len(a)) {
+    if (a[i] != b[i]) { return false; }
+  }
+  return true;
+}
+
+fn bench(label, xs) {
+  let a = copy(xs);
+  let b = copy(xs);
+
+  let t0 = now_ms();
+  sort(a, "merge");
+  let t1 = now_ms();
+  sort(b, "parallel");
+  let t2 = now_ms();
+
+  assert(same(a, b), "parallel sort must match merge");
+  print(label, "n =", len(xs), "merge ms =", t1 - t0, "parallel ms =", t2 - t1);
+}
+
+let N = 1000000;
+
+print("=== sort benchmark ===");
+bench("ints   ", make_ints(N));
+bench("strings", make_strs(N));
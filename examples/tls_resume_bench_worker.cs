@@ -0,0 +1,4 @@
+// Worker for tls_resume_benchmark.cs: runs the server script in the foreground so this
+// process stays its parent and reaps it once it is killed.
+
+on_message(fn(msg) { return subprocess("sh", [msg.script]).code; });
@@ -0,0 +1,80 @@
+// TLS connection latency with and without session resumption.
+// Run: bin/cupidscript examples/tls_resume_benchmark.cs
+// CS_BENCH_ROUNDS sets the connections per case (default 200). Needs the openssl
+// command line tool, which serves the page (s_server -www) on a local port.
+
+set_timeout(0);
+set_instruction_limit(0);
+
+let rounds = to_int(getenv("CS_BENCH_ROUNDS") ?? "200");
+if (rounds == nil || rounds < 1) { rounds = 200; }
+
+fn sh(cmd) { return subprocess("sh", ["-c", cmd]); }
+
+fn report(name, samples) {
+  sort(samples);
+  let n = len(samples);
+  let total = 0;
+  for v in samples { total += v; }
+  print(str_pad_end(name, 10) + "median " + to_str(floor(samples[floor(n / 2)] / 1000)) + "us, p99 " +
+        to_str(floor(samples[floor(n * 99 / 100)] / 1000)) + "us, mean " + to_str(floor(total / n / 1000)) + "us");
+}
+
+// Connect, fetch the status page and close; tickets arrive with the response
+async fn fetch(port) {
+  let s = await tls_connect("127.0.0.1", port);
+  let resumed = tls_info(s).resumed;
+  await socket_send(s, "GET / HTTP/1.0\r\n\r\n");
+  let got = "";
+  while (str_find(got, "</HTML>") < 0) { got = got + await socket_recv(s, 65536); }
+  socket_close(s);
+  return resumed;
+}
+
+async fn run(name, port) {
+  let samples = [];
+  let resumed = 0;
+  for i in range(rounds) {
+    let t0 = now_ns();
+    if (await fetch(port)) { resumed += 1; }
+    push(samples, now_ns() - t0);
+  }
+  report(name, samples);
+  return resumed;
+}
+
+if (sh("command -v openssl").code != 0) {
+  print("tls resume benchmark skipped (no openssl)");
+} else {
+  let dir = temp_dir("tls_bench_");
+  sh("cd '" + dir + "' && openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 " +
+     "-nodes -keyout key.pem -out cert.pem -days 1 -subj /CN=127.0.0.1 2>&1");
+  tls_config({ca_file: dir + "/cert.pem"});
+  let port = 46000 + random_int(0, 2000);
+  // serve.sh execs s_server from the worker's subprocess call, so the pid it writes is
+  // the server's and the worker's shell reaps it once it is killed
+  write_file(dir + "/serve.sh", "cd '" + dir + "' && echo $$ > pid && exec openssl s_server -accept 127.0.0.1:" +
+             to_str(port) + " -cert cert.pem -key key.pem -www -quiet >/dev/null 2>&1\n");
+  let server = worker_spawn("tls_resume_bench_worker.cs");
+  let served = server.post({script: dir + "/serve.sh"});
+  try {
+    for i in range(100) {
+      let up = false;
+      try { socket_close(await tcp_connect("127.0.0.1", port)); up = true; } catch (e) { await sleep(50); }
+      if (up) { break; }
+    }
+
+    print("=== TLS resumption benchmark (" + to_str(rounds) + " connections per case) ===");
+    tls_config({session_cache: false});
+    await run("full", port);
+    tls_config({session_cache: true});
+    let resumed = await run("resumed", port);
+    print(to_str(resumed) + " of " + to_str(rounds) + " handshakes resumed");
+  } catch (e) {
+    throw e;
+  } finally {
+    if (exists(dir + "/pid")) { sh("kill " + str_trim(read_file(dir + "/pid"))); }
+    await served;
+    server.terminate();
+  }
+}
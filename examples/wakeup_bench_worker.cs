@@ -0,0 +1,3 @@
+// Worker for wakeup_benchmark.cs: echoes every request.
+
+on_message(fn(msg) { return msg; });
@@ -0,0 +1,58 @@
+// Scheduler wakeup latency and idle cost.
+// Run: bin/cupidscript examples/wakeup_benchmark.cs
+// CS_BENCH_ROUNDS sets the number of round trips per case (default 2000).
+//
+// 1. main thread awaits a task run by the background event loop thread
+// 2. worker request/reply while a socket recv is parked in the poller
+
+set_timeout(0);
+set_instruction_limit(0);
+
+let rounds = to_int(getenv("CS_BENCH_ROUNDS") ?? "2000");
+if (rounds == nil || rounds < 1) { rounds = 2000; }
+
+fn report(name, samples) {
+  sort(samples);
+  let s = samples;
+  let n = len(s);
+  let total = 0;
+  for v in s { total += v; }
+  print(name + ": median " + to_str(floor(s[floor(n / 2)] / 1000)) + "us, p99 " +
+        to_str(floor(s[floor(n * 99 / 100)] / 1000)) + "us, mean " +
+        to_str(floor(total / n / 1000)) + "us");
+}
+
+print("=== wakeup benchmark (" + net_poll_backend() + ", " + to_str(rounds) + " rounds) ===");
+
+async fn noop() { return 1; }
+
+event_loop_start();
+let samples = [];
+for i in range(rounds) {
+  let t0 = now_ns();
+  await noop();
+  push(samples, now_ns() - t0);
+}
+report("loop thread task", samples);
+
+event_loop_stop();
+
+let port = 45000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+let c = await tcp_connect("127.0.0.1", port);
+let s = await socket_accept(srv);
+let parked = socket_recv(s, 16);
+
+let w = worker_spawn("wakeup_bench_worker.cs");
+samples = [];
+for i in range(rounds) {
+  let t0 = now_ns();
+  await worker_post(w, i);
+  push(samples, now_ns() - t0);
+}
+report("worker reply with I/O pending", samples);
+worker_terminate(w);
+
+socket_close(c);
+socket_close(s);
+socket_close(srv);
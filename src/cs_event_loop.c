@@ -1,30 +1,61 @@
 #include "cs_event_loop.h"
 #include "cs_vm.h"
+#include "cs_net.h"
 #include "cs_tls.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#ifdef CS_USE_EPOLL
+#include <sys/epoll.h>
+#endif
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#ifdef CS_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
 
-// Platform init/cleanup
+// Platform init/cleanup (process-wide; VMs on several threads may race to call these)
 static int g_event_initialized = 0;
+#ifdef _WIN32
+static SRWLOCK g_event_lock = SRWLOCK_INIT;
+#define EVENT_LOCK() AcquireSRWLockExclusive(&g_event_lock)
+#define EVENT_UNLOCK() ReleaseSRWLockExclusive(&g_event_lock)
+#else
+static pthread_mutex_t g_event_lock = PTHREAD_MUTEX_INITIALIZER;
+#define EVENT_LOCK() pthread_mutex_lock(&g_event_lock)
+#define EVENT_UNLOCK() pthread_mutex_unlock(&g_event_lock)
+#endif
 
 int cs_event_init(void) {
-    if (g_event_initialized) return 0;
+    int rc = 0;
+    EVENT_LOCK();
+    if (!g_event_initialized) {
 #ifdef _WIN32
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return -1;
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) rc = -1;
 #endif
-    g_event_initialized = 1;
-    return 0;
+        if (rc == 0) g_event_initialized = 1;
+    }
+    EVENT_UNLOCK();
+    return rc;
 }
 
 void cs_event_cleanup(void) {
-    if (!g_event_initialized) return;
+    EVENT_LOCK();
+    if (g_event_initialized) {
 #ifdef _WIN32
-    WSACleanup();
+        WSACleanup();
 #endif
-    g_event_initialized = 0;
+        g_event_initialized = 0;
+    }
+    EVENT_UNLOCK();
 }
 
 int cs_socket_set_nonblocking(cs_socket_t fd) {
@@ -74,39 +105,396 @@ static uint64_t get_time_ms(void) {
 #endif
 }
 
-void cs_add_pending_io(cs_vm* vm, cs_socket_t fd, int events, cs_value promise, cs_value context, uint64_t timeout_ms) {
-    if (!vm) return;
+// ---------- pending I/O table ----------
+// Pending operations live on vm->pending_io (for timeouts and teardown) and, on POSIX,
+// in a table indexed by fd so a ready fd finds its operations without a scan. With
+// epoll the fd stays registered between operations; its interest is only changed when
+// the set of waiting operations changes.
+
+typedef struct cs_io_slot {
+    cs_pending_io* ops;       // fd_next chain
+    int registered;           // epoll interest currently set; -1 = not in the epoll set
+} cs_io_slot;
+
+struct cs_io_table {
+#ifndef _WIN32
+    cs_io_slot* slots;
+    size_t slot_cap;
+#endif
+#ifdef CS_USE_EPOLL
+    int epfd;
+    struct epoll_event* events;
+    int events_cap;
+#elif defined(CS_USE_POLL)
+    struct pollfd* pfds;      // scratch reused across turns
+    cs_pending_io** pios;
+    size_t pcap;
+#endif
+    uint64_t next_deadline;   // earliest deadline_ms; the timeout sweep waits for it
+    int wake_rd;              // eventfd (or self-pipe) polled with the sockets; -1 = none
+    int wake_wr;
+    struct cs_uring* ring;    // io_uring completion backend; NULL = readiness polling
+};
+
+const char* cs_poll_backend_name(void) {
+#if defined(CS_USE_EPOLL)
+    return "epoll";
+#elif defined(CS_USE_POLL)
+    return "poll";
+#else
+    return "select";
+#endif
+}
+
+// The wake fd lets another thread cut a poll short (cs_io_wake). Without one the
+// scheduler falls back to short poll timeouts.
+static void io_open_wake(struct cs_io_table* t) {
+    t->wake_rd = t->wake_wr = -1;
+#if defined(__linux__)
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd >= 0) t->wake_rd = t->wake_wr = fd;
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int i = 0; i < 2; i++) {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+        t->wake_rd = fds[0];
+        t->wake_wr = fds[1];
+    }
+#endif
+#ifdef CS_USE_EPOLL
+    if (t->wake_rd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = t->wake_rd;
+        epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->wake_rd, &ev);
+    }
+#endif
+}
+
+static void io_drain_wake(struct cs_io_table* t) {
+#ifndef _WIN32
+    char buf[64];
+    while (read(t->wake_rd, buf, sizeof(buf)) > 0) {}
+#else
+    (void)t;
+#endif
+}
+
+static struct cs_io_table* io_table(cs_vm* vm) {
+    if (vm->io_table) return vm->io_table;
+    struct cs_io_table* t = (struct cs_io_table*)calloc(1, sizeof(struct cs_io_table));
+    if (!t) return NULL;
+#ifdef CS_USE_EPOLL
+    t->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (t->epfd < 0) { free(t); return NULL; }
+#endif
+    io_open_wake(t);
+    t->next_deadline = UINT64_MAX;
+    vm->io_table = t;
+#ifdef CS_USE_IO_URING
+    const char* env = getenv("CS_IO_BACKEND");
+    if (env && strcmp(env, "io_uring") == 0) cs_io_set_backend(vm, "io_uring");
+#endif
+    return t;
+}
+
+int cs_io_wakeable(cs_vm* vm) {
+    return vm && vm->io_table && vm->io_table->wake_wr >= 0;
+}
+
+void cs_io_wake(cs_vm* vm) {
+#ifndef _WIN32
+    if (!cs_io_wakeable(vm)) return;
+    uint64_t one = 1;
+    ssize_t n = write(vm->io_table->wake_wr, &one, sizeof(one));
+    (void)n;  // EAGAIN: a wakeup is already pending
+#else
+    (void)vm;
+#endif
+}
+
+#ifndef _WIN32
+static cs_io_slot* io_slot(struct cs_io_table* t, cs_socket_t fd, int grow) {
+    if (fd < 0) return NULL;
+    if ((size_t)fd >= t->slot_cap) {
+        if (!grow) return NULL;
+        size_t nc = t->slot_cap ? t->slot_cap : 64;
+        while (nc <= (size_t)fd) nc *= 2;
+        cs_io_slot* ns = (cs_io_slot*)realloc(t->slots, nc * sizeof(cs_io_slot));
+        if (!ns) return NULL;
+        for (size_t i = t->slot_cap; i < nc; i++) {
+            ns[i].ops = NULL;
+            ns[i].registered = -1;
+        }
+        t->slots = ns;
+        t->slot_cap = nc;
+    }
+    return &t->slots[fd];
+}
+#endif
+
+#ifdef CS_USE_EPOLL
+// Level-triggered: a handler performs one recv/send/accept per wakeup and TLS may hold
+// decrypted bytes of its own, so an edge could be consumed without being acted on.
+static void io_update_interest(struct cs_io_table* t, cs_socket_t fd, cs_io_slot* slot) {
+    int want = 0;
+    for (cs_pending_io* io = slot->ops; io; io = io->fd_next) want |= io->events;
+    if (want == slot->registered) return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (want & CS_POLL_READ) ev.events |= EPOLLIN;
+    if (want & CS_POLL_WRITE) ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+
+    int op = slot->registered < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    int rc = epoll_ctl(t->epfd, op, fd, &ev);
+    // The fd number may have been closed and reused since it was registered
+    if (rc != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) rc = epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev);
+    if (rc != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) rc = epoll_ctl(t->epfd, EPOLL_CTL_MOD, fd, &ev);
+    slot->registered = rc == 0 ? want : -1;
+}
+
+static void io_forget_fd(struct cs_io_table* t, cs_socket_t fd, cs_io_slot* slot) {
+    if (slot->registered >= 0) epoll_ctl(t->epfd, EPOLL_CTL_DEL, fd, NULL);
+    slot->registered = -1;
+}
+#endif
+
+static void io_unlink(cs_vm* vm, cs_pending_io* io) {
+    if (io->prev) io->prev->next = io->next;
+    else vm->pending_io = io->next;
+    if (io->next) io->next->prev = io->prev;
+#ifndef _WIN32
+    struct cs_io_table* t = vm->io_table;
+    cs_io_slot* slot = t ? io_slot(t, io->fd, 0) : NULL;
+    if (slot) {
+        cs_pending_io** pp = &slot->ops;
+        while (*pp && *pp != io) pp = &(*pp)->fd_next;
+        if (*pp) *pp = io->fd_next;
+#ifdef CS_USE_EPOLL
+        if (!t->ring) io_update_interest(t, io->fd, slot);
+#endif
+    }
+#endif
+    vm->pending_io_count--;
+}
+
+static void io_free(cs_pending_io* io) {
+    cs_value_release(io->promise);
+    cs_value_release(io->context);
+    free(io->buf);
+    if (io->state_free) io->state_free(io->state);
+    if (io->sock) cs_socket_decref(io->sock);
+#ifndef _WIN32
+    if (io->owns_fd) close(io->fd);
+#endif
+    free(io);
+}
+
+static uint64_t pending_timeout_ms(cs_vm* vm, const cs_pending_io* io);
+#ifdef CS_USE_IO_URING
+static void uring_start(cs_vm* vm, struct cs_io_table* t, cs_pending_io* io);
+static int uring_cancel(struct cs_io_table* t, cs_pending_io* io);
+static void uring_shutdown(struct cs_io_table* t);
+#endif
+
+static cs_pending_io* io_new(cs_vm* vm, struct cs_io_table* t, cs_socket_t fd, int events, cs_value promise, cs_value context, uint64_t timeout_ms) {
+#ifndef _WIN32
+    cs_io_slot* slot = io_slot(t, fd, 1);
+    if (!slot) return NULL;
+#endif
 
     cs_pending_io* io = (cs_pending_io*)calloc(1, sizeof(cs_pending_io));
-    if (!io) return;
+    if (!io) return NULL;
 
     io->fd = fd;
     io->events = events;
     io->promise = cs_value_copy(promise);
     io->context = cs_value_copy(context);
     io->timeout_ms = timeout_ms;
-    io->start_ms = get_time_ms();
+    io->deadline_ms = timeout_ms == CS_IO_NO_DEADLINE ? CS_IO_NO_DEADLINE : get_time_ms() + pending_timeout_ms(vm, io);
+    if (io->deadline_ms < t->next_deadline) t->next_deadline = io->deadline_ms;
+
     io->next = vm->pending_io;
+    if (vm->pending_io) vm->pending_io->prev = io;
     vm->pending_io = io;
     vm->pending_io_count++;
+#ifndef _WIN32
+    io->fd_next = slot->ops;
+    slot->ops = io;
+#endif
+    return io;
+}
+
+#ifndef CS_NO_TLS
+// state_free for a handshake's SSL until it is handed to the socket
+static void io_ssl_free(void* ssl) {
+    cs_tls_close((SSL*)ssl);
+}
+#endif
+
+void cs_add_socket_op(cs_vm* vm, cs_socket* sock, int op, int events, cs_value promise,
+                      cs_value context, size_t max, void* ssl) {
+    struct cs_io_table* t = vm ? io_table(vm) : NULL;
+    cs_pending_io* io = t ? io_new(vm, t, sock->fd, events, promise, context, 0) : NULL;
+    if (!io) {
+#ifndef CS_NO_TLS
+        if (ssl) cs_tls_close((SSL*)ssl);
+#endif
+        return;
+    }
+    cs_socket_incref(sock);
+    io->sock = sock;
+    io->sock_op = op;
+    io->buf_len = max;
+#ifndef CS_NO_TLS
+    if (ssl) {
+        io->state = ssl;
+        io->state_free = io_ssl_free;
+    }
+#else
+    (void)ssl;
+#endif
+#ifdef CS_USE_IO_URING
+    if (t->ring) {
+        uring_start(vm, t, io);
+        return;
+    }
+#endif
+#ifdef CS_USE_EPOLL
+    io_update_interest(t, sock->fd, io_slot(t, sock->fd, 0));
+#endif
+}
+
+int cs_add_pending_op(cs_vm* vm, cs_socket_t fd, int events, cs_value promise, void* state,
+                      cs_io_ready_fn on_ready, void (*state_free)(void* state), uint64_t timeout_ms) {
+    struct cs_io_table* t = vm ? io_table(vm) : NULL;
+    cs_pending_io* io = t ? io_new(vm, t, fd, events, promise, cs_nil(), timeout_ms) : NULL;
+    if (!io) {
+        if (state_free) state_free(state);
+        return -1;
+    }
+    io->on_ready = on_ready;
+    io->state = state;
+    io->state_free = state_free;
+#ifdef CS_USE_IO_URING
+    if (t->ring) {
+        uring_start(vm, t, io);
+        return 0;
+    }
+#endif
+#ifdef CS_USE_EPOLL
+    io_update_interest(t, fd, io_slot(t, fd, 0));
+#endif
+    return 0;
+}
+
+void cs_pending_io_move(cs_vm* vm, cs_pending_io* io, cs_socket_t fd) {
+#ifndef _WIN32
+    struct cs_io_table* t = vm->io_table;
+    cs_io_slot* slot = io_slot(t, io->fd, 0);
+    if (slot) {
+        cs_pending_io** pp = &slot->ops;
+        while (*pp && *pp != io) pp = &(*pp)->fd_next;
+        if (*pp) *pp = io->fd_next;
+#ifdef CS_USE_EPOLL
+        // The old descriptor is normally closed by the caller next
+        if (!t->ring && !slot->ops) io_forget_fd(t, io->fd, slot);
+#endif
+    }
+    slot = io_slot(t, fd, 1);
+    io->fd = fd;
+    io->fd_next = NULL;
+    if (!slot) return;
+    io->fd_next = slot->ops;
+    slot->ops = io;
+#ifdef CS_USE_EPOLL
+    if (!t->ring) io_update_interest(t, fd, slot);
+#endif
+#else
+    (void)vm;
+    io->fd = fd;
+#endif
+}
+
+void cs_pending_io_touch(cs_vm* vm, cs_pending_io* io) {
+    if (io->deadline_ms == CS_IO_NO_DEADLINE) return;
+    // Only ever later: the sweep finds the new deadline when the old one passes
+    io->deadline_ms = get_time_ms() + pending_timeout_ms(vm, io);
+}
+
+// Unlinks an unsettled operation. One the kernel still owns (io_uring) is cancelled
+// and freed when its completion arrives, since the kernel may still write to it.
+static void io_drop(cs_vm* vm, cs_pending_io* io) {
+    io_unlink(vm, io);
+#ifdef CS_USE_IO_URING
+    if (vm->io_table && vm->io_table->ring && uring_cancel(vm->io_table, io)) return;
+#endif
+    io_free(io);
 }
 
 void cs_remove_pending_io(cs_vm* vm, cs_socket_t fd) {
     if (!vm) return;
-
-    cs_pending_io** pp = &vm->pending_io;
-    while (*pp) {
-        if ((*pp)->fd == fd) {
-            cs_pending_io* dead = *pp;
-            *pp = dead->next;
-            cs_value_release(dead->promise);
-            cs_value_release(dead->context);
-            free(dead);
-            vm->pending_io_count--;
-            continue;
+#ifndef _WIN32
+    struct cs_io_table* t = vm->io_table;
+    cs_io_slot* slot = t ? io_slot(t, fd, 0) : NULL;
+    if (!slot) return;
+    while (slot->ops) io_drop(vm, slot->ops);
+#ifdef CS_USE_EPOLL
+    // Called before the socket is closed: drop it from the epoll set now, since a
+    // duplicated descriptor would keep the registration alive past close()
+    io_forget_fd(t, fd, slot);
+#endif
+#else
+    cs_pending_io* io = vm->pending_io;
+    while (io) {
+        cs_pending_io* next = io->next;
+        if (io->fd == fd) {
+            io_unlink(vm, io);
+            io_free(io);
         }
-        pp = &(*pp)->next;
+        io = next;
+    }
+#endif
+}
+
+void cs_free_pending_io(cs_vm* vm) {
+    if (!vm) return;
+    struct cs_io_table* t = vm->io_table;
+    while (vm->pending_io) {
+        cs_pending_io* io = vm->pending_io;
+        vm->pending_io = io->next;
+#ifdef CS_USE_IO_URING
+        if (t && t->ring && uring_cancel(t, io)) continue;
+#endif
+        io_free(io);
     }
+    vm->pending_io_count = 0;
+    if (!t) return;
+#ifdef CS_USE_IO_URING
+    if (t->ring) uring_shutdown(t);
+#endif
+#ifndef _WIN32
+    free(t->slots);
+#endif
+#ifndef _WIN32
+    if (t->wake_rd >= 0) close(t->wake_rd);
+    if (t->wake_wr >= 0 && t->wake_wr != t->wake_rd) close(t->wake_wr);
+#endif
+#ifdef CS_USE_EPOLL
+    close(t->epfd);
+    free(t->events);
+#elif defined(CS_USE_POLL)
+    free(t->pfds);
+    free(t->pios);
+#endif
+    free(t);
+    vm->io_table = NULL;
 }
 
 static cs_value make_error(cs_vm* vm, const char* msg, const char* code) {
@@ -143,167 +531,61 @@ static int reject_pending(cs_vm* vm, cs_pending_io* io, const char* msg, const c
 }
 
 static int handle_send_ready(cs_vm* vm, cs_pending_io* io) {
-    cs_value ctx = io->context;
-    cs_value sock = cs_map_get(ctx, "sock");
-    cs_value data_val = cs_map_get(ctx, "data");
-    if (sock.type != CS_T_MAP || data_val.type != CS_T_STR) {
-        cs_value_release(sock);
-        cs_value_release(data_val);
-        return reject_pending(vm, io, "socket_send() invalid context", "NET_SEND");
-    }
-
-    const char* data = cs_to_cstr(data_val);
-    size_t len = strlen(data);
-
-    ssize_t sent = -1;
-#ifndef CS_NO_TLS
-    cs_value tls_val = cs_map_get(sock, "_tls");
-    if (tls_val.type == CS_T_INT && tls_val.as.i != 0) {
-        SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
-        sent = SSL_write(ssl, data, (int)len);
-        if (sent <= 0) {
-            int err = SSL_get_error(ssl, (int)sent);
-            cs_value_release(tls_val);
-            cs_value_release(sock);
-            cs_value_release(data_val);
-            if (err == SSL_ERROR_WANT_READ) {
-                io->events = CS_POLL_READ;
-                return 0;
-            }
-            if (err == SSL_ERROR_WANT_WRITE) {
-                io->events = CS_POLL_WRITE;
-                return 0;
-            }
-            return reject_pending(vm, io, "TLS write failed", "TLS_WRITE");
-        }
-        cs_value_release(tls_val);
-    } else {
-        cs_value_release(tls_val);
-        sent = send(io->fd, data, len, 0);
-    }
-#else
-    sent = send(io->fd, data, len, 0);
-#endif
-
-    cs_value_release(sock);
-    cs_value_release(data_val);
-
+    const cs_string* data = (const cs_string*)io->context.as.p;
+    int wait = 0;
+    ssize_t sent = cs_socket_send(io->sock, data->data, data->len, &wait);
     if (sent >= 0) {
         return resolve_pending(vm, io, cs_int(sent));
     }
-
-#ifdef _WIN32
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK) return 0;
-#else
-    if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
-#endif
-
+    if (wait) {
+        io->events = wait;
+        return 0;
+    }
+    if (io->sock->ssl) return reject_pending(vm, io, "TLS write failed", "TLS_WRITE");
     return reject_pending(vm, io, "socket_send() failed", "NET_SEND");
 }
 
 static int handle_recv_ready(cs_vm* vm, cs_pending_io* io) {
-    cs_value ctx = io->context;
-    cs_value sock = cs_map_get(ctx, "sock");
-    cs_value max_val = cs_map_get(ctx, "max");
-    if (sock.type != CS_T_MAP || max_val.type != CS_T_INT) {
-        cs_value_release(sock);
-        cs_value_release(max_val);
-        return reject_pending(vm, io, "socket_recv() invalid context", "NET_RECV");
-    }
-
-    int max_bytes = (int)max_val.as.i;
-    if (max_bytes <= 0 || max_bytes > 1024 * 1024) max_bytes = 4096;
-
-    char* buf = (char*)malloc((size_t)max_bytes + 1);
-    if (!buf) {
-        cs_value_release(sock);
-        cs_value_release(max_val);
-        return reject_pending(vm, io, "out of memory", "NET_RECV");
-    }
-
-    ssize_t received = -1;
-#ifndef CS_NO_TLS
-    cs_value tls_val = cs_map_get(sock, "_tls");
-    if (tls_val.type == CS_T_INT && tls_val.as.i != 0) {
-        SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
-        received = SSL_read(ssl, buf, max_bytes);
-        if (received <= 0) {
-            int err = SSL_get_error(ssl, (int)received);
-            cs_value_release(tls_val);
-            cs_value_release(sock);
-            cs_value_release(max_val);
-            free(buf);
-            if (err == SSL_ERROR_WANT_READ) {
-                io->events = CS_POLL_READ;
-                return 0;
-            }
-            if (err == SSL_ERROR_WANT_WRITE) {
-                io->events = CS_POLL_WRITE;
-                return 0;
-            }
-            return reject_pending(vm, io, "TLS read failed", "TLS_READ");
-        }
-        cs_value_release(tls_val);
-    } else {
-        cs_value_release(tls_val);
-        received = recv(io->fd, buf, (size_t)max_bytes, 0);
+    // The buffer is kept across wakeups that find nothing to read
+    if (!io->buf) {
+        io->buf = (char*)malloc(io->buf_len + 1);
+        if (!io->buf) return reject_pending(vm, io, "out of memory", "NET_RECV");
     }
-#else
-    received = recv(io->fd, buf, (size_t)max_bytes, 0);
-#endif
-
-    cs_value_release(sock);
-    cs_value_release(max_val);
 
+    int wait = 0;
+    ssize_t received = cs_socket_recv(io->sock, io->buf, io->buf_len, &wait);
     if (received > 0) {
-        buf[received] = '\0';
-        return resolve_pending(vm, io, cs_str_take(vm, buf, (uint64_t)received));
+        char* data = io->buf;
+        data[received] = '\0';
+        io->buf = NULL;
+        return resolve_pending(vm, io, cs_str_take(vm, data, (uint64_t)received));
     }
-    free(buf);
-
     if (received == 0) {
         return reject_pending(vm, io, "socket closed", "NET_CLOSED");
     }
-
-#ifdef _WIN32
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK) return 0;
-#else
-    if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
-#endif
-
+    if (wait) {
+        io->events = wait;
+        return 0;
+    }
+    if (io->sock->ssl) return reject_pending(vm, io, "TLS read failed", "TLS_READ");
     return reject_pending(vm, io, "socket_recv() failed", "NET_RECV");
 }
 
-static int handle_accept_ready(cs_vm* vm, cs_pending_io* io) {
-    cs_value ctx = io->context;
-    cs_value server = cs_map_get(ctx, "sock");
-    if (server.type != CS_T_MAP) {
-        cs_value_release(server);
-        return reject_pending(vm, io, "socket_accept() invalid context", "NET_CONNECT");
-    }
+static cs_value make_accepted_socket(cs_vm* vm, cs_socket_t client, const struct sockaddr_in* addr) {
+    char ipbuf[64];
+    const char* ip = inet_ntop(AF_INET, &addr->sin_addr, ipbuf, sizeof(ipbuf));
+    return cs_make_socket_map(vm, client, "tcp", ip, (int)ntohs(addr->sin_port), NULL);
+}
 
+static int handle_accept_ready(cs_vm* vm, cs_pending_io* io) {
     struct sockaddr_in addr;
     socklen_t addrlen = sizeof(addr);
     cs_socket_t client = accept(io->fd, (struct sockaddr*)&addr, &addrlen);
     if (client != CS_INVALID_SOCKET) {
         cs_socket_set_nonblocking(client);
-        char ipbuf[64];
-        const char* ip = inet_ntop(AF_INET, &addr.sin_addr, ipbuf, sizeof(ipbuf));
-        cs_value sock = cs_map(vm);
-        if (sock.as.p) {
-            cs_map_set(sock, "_fd", cs_int((int64_t)client));
-            cs_map_set(sock, "_type", cs_str(vm, "tcp"));
-            if (ip) cs_map_set(sock, "host", cs_str(vm, ip));
-            cs_map_set(sock, "port", cs_int((int)ntohs(addr.sin_port)));
-        }
-        cs_value_release(server);
-        return resolve_pending(vm, io, sock);
+        return resolve_pending(vm, io, make_accepted_socket(vm, client, &addr));
     }
 
-    cs_value_release(server);
-
 #ifdef _WIN32
     int err = WSAGetLastError();
     if (err == WSAEWOULDBLOCK) return 0;
@@ -313,176 +595,699 @@ static int handle_accept_ready(cs_vm* vm, cs_pending_io* io) {
     return reject_pending(vm, io, "socket_accept() failed", "NET_CONNECT");
 }
 
+// A connect that fails takes its socket with it: the script never saw the handle
 static int handle_connect_ready(cs_vm* vm, cs_pending_io* io) {
-    cs_value ctx = io->context;
-    cs_value sock = cs_map_get(ctx, "sock");
-    if (sock.type != CS_T_MAP) {
-        cs_value_release(sock);
-        return reject_pending(vm, io, "tcp_connect() invalid context", "NET_CONNECT");
-    }
-
     int err = cs_socket_get_error(io->fd);
     if (err != 0) {
-        cs_value_release(sock);
-        return reject_pending(vm, io, cs_socket_error_str(err), "NET_CONNECT");
+        reject_pending(vm, io, cs_socket_error_str(err), "NET_CONNECT");
+        cs_socket_discard(vm, io->sock);
+        return 1;
     }
 
-    return resolve_pending(vm, io, sock);
+    return resolve_pending(vm, io, cs_value_copy(io->context));
+}
+
+#ifndef CS_NO_TLS
+// Shuts down the handshake's SSL before the socket tls_connect opened is closed
+static int tls_handshake_fail(cs_vm* vm, cs_pending_io* io, int is_upgrade, const char* msg, const char* code) {
+    if (io->state) {
+        cs_tls_close((SSL*)io->state);
+        io->state = NULL;
+        io->state_free = NULL;
+    }
+    reject_pending(vm, io, msg, code);
+    if (!is_upgrade) cs_socket_discard(vm, io->sock);
+    return 1;
 }
+#endif
 
 static int handle_tls_handshake(cs_vm* vm, cs_pending_io* io, int is_upgrade) {
 #ifdef CS_NO_TLS
-    (void)vm; (void)io; (void)is_upgrade;
+    (void)is_upgrade;
     return reject_pending(vm, io, "TLS disabled", "HTTP_NO_TLS");
 #else
-    cs_value ctx = io->context;
-    cs_value sock = cs_map_get(ctx, "sock");
-    if (sock.type != CS_T_MAP) {
-        cs_value_release(sock);
-        return reject_pending(vm, io, "tls handshake invalid context", "TLS_HANDSHAKE");
-    }
-
+    cs_socket* s = io->sock;
     if (!is_upgrade) {
         int err = cs_socket_get_error(io->fd);
-        if (err != 0) {
-            cs_value_release(sock);
-            return reject_pending(vm, io, cs_socket_error_str(err), "NET_CONNECT");
-        }
-    }
-
-    SSL* ssl = NULL;
-    cs_value ssl_val = cs_map_get(ctx, "_ssl");
-    if (ssl_val.type == CS_T_INT && ssl_val.as.i != 0) {
-        ssl = (SSL*)(uintptr_t)ssl_val.as.i;
+        if (err != 0) return tls_handshake_fail(vm, io, 0, cs_socket_error_str(err), "NET_CONNECT");
     }
 
-    if (!ssl) {
-        cs_value host_val = cs_map_get(ctx, "host");
-        const char* host = (host_val.type == CS_T_STR) ? cs_to_cstr(host_val) : NULL;
-        ssl = cs_tls_new_ssl(io->fd, host);
-        cs_value_release(host_val);
-        if (!ssl) {
-            cs_value_release(ssl_val);
-            cs_value_release(sock);
-            return reject_pending(vm, io, "TLS init failed", "TLS_INIT");
-        }
-        cs_map_set(ctx, "_ssl", cs_int((int64_t)(uintptr_t)ssl));
+    // The SSL belongs to the operation until the handshake succeeds
+    if (!io->state) {
+        SSL* created = cs_tls_new_ssl(io->fd, s->host, s->port);
+        if (!created) return tls_handshake_fail(vm, io, is_upgrade, "TLS init failed", "TLS_INIT");
+        io->state = created;
+        io->state_free = io_ssl_free;
     }
-    cs_value_release(ssl_val);
+    SSL* ssl = (SSL*)io->state;
 
     int ret = SSL_connect(ssl);
     if (ret == 1) {
         if (cs_tls_verify_cert(ssl) != 0) {
-            cs_tls_close(ssl);
-            if (!is_upgrade) cs_socket_close(io->fd);
-            cs_value_release(sock);
-            return reject_pending(vm, io, "certificate verification failed", "TLS_CERT");
-        }
-        cs_map_set(sock, "_tls", cs_int((int64_t)(uintptr_t)ssl));
-        cs_map_set(sock, "_secure", cs_bool(1));
-        if (is_upgrade) {
-            cs_value_release(sock);
-            return resolve_pending(vm, io, cs_nil());
+            return tls_handshake_fail(vm, io, is_upgrade, "certificate verification failed", "TLS_CERT");
         }
-        return resolve_pending(vm, io, sock);
+        io->state = NULL;
+        io->state_free = NULL;
+        s->ssl = ssl;
+        return resolve_pending(vm, io, is_upgrade ? cs_nil() : cs_value_copy(io->context));
     }
 
     int err = SSL_get_error(ssl, ret);
     if (err == SSL_ERROR_WANT_READ) {
         io->events = CS_POLL_READ;
-        cs_value_release(sock);
         return 0;
     }
     if (err == SSL_ERROR_WANT_WRITE) {
         io->events = CS_POLL_WRITE;
-        cs_value_release(sock);
         return 0;
     }
-
-    cs_tls_close(ssl);
-    if (!is_upgrade) cs_socket_close(io->fd);
-    cs_value_release(sock);
-    return reject_pending(vm, io, "TLS handshake failed", "TLS_HANDSHAKE");
+    return tls_handshake_fail(vm, io, is_upgrade, "TLS handshake failed", "TLS_HANDSHAKE");
 #endif
 }
 
 static int handle_ready_io(cs_vm* vm, cs_pending_io* io) {
-    if (!io || io->context.type != CS_T_MAP) {
-        return resolve_pending(vm, io, cs_value_copy(io->context));
+    if (io->on_ready) return io->on_ready(vm, io);
+    switch (io->sock_op) {
+        case CS_SOCK_SEND:        return handle_send_ready(vm, io);
+        case CS_SOCK_RECV:        return handle_recv_ready(vm, io);
+        case CS_SOCK_ACCEPT:      return handle_accept_ready(vm, io);
+        case CS_SOCK_CONNECT:     return handle_connect_ready(vm, io);
+        case CS_SOCK_TLS_CONNECT: return handle_tls_handshake(vm, io, 0);
+        case CS_SOCK_TLS_UPGRADE: return handle_tls_handshake(vm, io, 1);
     }
+    return resolve_pending(vm, io, cs_value_copy(io->context));
+}
 
-    cs_value op_val = cs_map_get(io->context, "_op");
-    if (op_val.type != CS_T_STR) {
-        cs_value_release(op_val);
-        return resolve_pending(vm, io, cs_value_copy(io->context));
+// Settles an operation its fd reported ready for; returns 1 if it was resolved or rejected.
+static int io_dispatch(cs_vm* vm, cs_pending_io* io) {
+    if (!handle_ready_io(vm, io)) return 0;
+    io_unlink(vm, io);
+    io_free(io);
+    return 1;
+}
+
+static int io_sweep_timeouts(cs_vm* vm, uint64_t now) {
+    struct cs_io_table* t = vm->io_table;
+    if (!t || now < t->next_deadline) return 0;
+    int count = 0;
+    uint64_t next = UINT64_MAX;
+    for (cs_pending_io* io = vm->pending_io; io; ) {
+        cs_pending_io* following = io->next;
+        if (now >= io->deadline_ms) {
+            reject_pending(vm, io, "operation timed out", "NET_TIMEOUT");
+            io_drop(vm, io);
+            count++;
+        } else if (io->deadline_ms < next) {
+            next = io->deadline_ms;
+        }
+        io = following;
     }
+    t->next_deadline = next;
+    return count;
+}
+
+#ifdef CS_USE_IO_URING
+// ---------- io_uring ----------
+// Completion backend: each pending operation is an SQE and its CQE settles the
+// promise, so a waiting recv/send/accept costs no readiness round trip and no retry
+// syscall of its own. SQEs queued while scripts run reach the kernel together in the
+// io_uring_enter the scheduler makes when it next polls. TLS sockets, connects and
+// handshakes still go by readiness (OpenSSL does its own reads and writes): they are
+// one-shot POLL_ADDs that run the usual handler. Kernels without IORING_FEAT_EXT_ARG
+// (timed waits, 5.11) are not used.
+
+long syscall(long number, ...);  // not declared under _POSIX_C_SOURCE
 
-    const char* op = cs_to_cstr(op_val);
-    int result = 0;
-    if (strcmp(op, "send") == 0) result = handle_send_ready(vm, io);
-    else if (strcmp(op, "recv") == 0) result = handle_recv_ready(vm, io);
-    else if (strcmp(op, "accept") == 0) result = handle_accept_ready(vm, io);
-    else if (strcmp(op, "connect") == 0) result = handle_connect_ready(vm, io);
-    else if (strcmp(op, "tls_connect") == 0) result = handle_tls_handshake(vm, io, 0);
-    else if (strcmp(op, "tls_upgrade") == 0) result = handle_tls_handshake(vm, io, 1);
-    else result = resolve_pending(vm, io, cs_value_copy(io->context));
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+#define URING_TAG_WAKE   1   // user_data of the wake fd poll; operations use their address
+#define URING_TAG_CANCEL 2
 
-    cs_value_release(op_val);
-    return result;
+enum { URING_POLL, URING_RECV, URING_SEND, URING_ACCEPT, URING_FILE_READ, URING_FILE_WRITE };
+enum { URING_IDLE, URING_INFLIGHT, URING_ORPHAN };  // ORPHAN: dropped, waiting for its CQE
+
+typedef struct {
+    struct sockaddr_in addr;
+    socklen_t len;
+} uring_accept_buf;
+
+struct cs_uring {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_sqe* sqes;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;             // sq_map itself with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_len;
+    size_t sqes_len;
+    int inflight;             // operations the kernel still owns, orphans included
+    int wake_polled;          // a POLL_ADD on the wake fd is outstanding
+};
+
+static void uring_close(struct cs_uring* r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map) munmap(r->sq_map, r->sq_map_len);
+    close(r->fd);
+    free(r);
 }
 
-int cs_poll_pending_io(cs_vm* vm, int timeout_ms) {
-    if (!vm || !vm->pending_io) return 0;
+static struct cs_uring* uring_open(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+    int fd = (int)syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p);
+    if (fd < 0) return NULL;  // ENOSYS, or disabled by policy (EPERM)
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return NULL;
+    }
 
-    int ready_count = 0;
-    uint64_t now = get_time_ms();
+    struct cs_uring* r = (struct cs_uring*)calloc(1, sizeof(struct cs_uring));
+    if (!r) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        uring_close(r);
+        return NULL;
+    }
+    r->cq_map = single ? r->sq_map : mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED) {
+        r->cq_map = NULL;
+        uring_close(r);
+        return NULL;
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uring_close(r);
+        return NULL;
+    }
 
-#ifdef CS_USE_POLL
-    int nfds = 0;
-    for (cs_pending_io* io = vm->pending_io; io; io = io->next) nfds++;
-    if (nfds == 0) return 0;
+    char* sq = (char*)r->sq_map;
+    char* cq = (char*)r->cq_map;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return r;
+}
 
-    struct pollfd* fds = (struct pollfd*)calloc((size_t)nfds, sizeof(struct pollfd));
-    cs_pending_io** ios = (cs_pending_io**)calloc((size_t)nfds, sizeof(cs_pending_io*));
-    if (!fds || !ios) { free(fds); free(ios); return 0; }
+// Submits every queued SQE; with wait set, also blocks until a completion arrives or
+// timeout_ms passes (-1 = no limit)
+static void uring_enter(struct cs_uring* r, int wait, int timeout_ms) {
+    unsigned queued = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (!wait && queued == 0) return;
+
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    unsigned flags = 0;
+    if (wait) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+    // EBUSY/EINTR leave the SQEs queued for the next call
+    syscall(__NR_io_uring_enter, r->fd, queued, wait ? 1u : 0u, flags,
+            wait ? &arg : NULL, wait ? sizeof(arg) : (size_t)0);
+}
 
-    int i = 0;
-    for (cs_pending_io* io = vm->pending_io; io; io = io->next, i++) {
-        fds[i].fd = io->fd;
-        fds[i].events = 0;
-        if (io->events & CS_POLL_READ) fds[i].events |= POLLIN;
-        if (io->events & CS_POLL_WRITE) fds[i].events |= POLLOUT;
-        if (io->events & CS_POLL_ERROR) fds[i].events |= POLLERR;
-        ios[i] = io;
+static struct io_uring_sqe* uring_sqe(struct cs_uring* r) {
+    unsigned tail = *r->sq_tail;
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+        uring_enter(r, 0, 0);  // full: hand this batch over now
+        if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) return NULL;
     }
+    struct io_uring_sqe* sqe = &r->sqes[tail & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
 
-    int ret = poll(fds, (nfds_t)nfds, timeout_ms);
+static void uring_push(struct cs_uring* r) {
+    unsigned tail = *r->sq_tail;
+    r->sq_array[tail & r->sq_mask] = tail & r->sq_mask;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
 
-    if (ret > 0) {
-        for (i = 0; i < nfds; i++) {
-            if (!fds[i].revents) continue;
-            cs_pending_io* io = ios[i];
-            int resolved = handle_ready_io(vm, io);
-            if (resolved) {
-                cs_remove_pending_io(vm, io->fd);
-                ready_count++;
+static unsigned uring_poll_mask(int events) {
+    unsigned mask = 0;
+    if (events & CS_POLL_READ) mask |= POLLIN;
+    if (events & CS_POLL_WRITE) mask |= POLLOUT;
+    return mask;  // POLLERR and POLLHUP are always reported
+}
+
+// Queues the next step of io; 0 if the submission queue is full
+static int uring_submit(struct cs_uring* r, cs_pending_io* io) {
+    struct io_uring_sqe* sqe = uring_sqe(r);
+    if (!sqe) return 0;
+    sqe->fd = io->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)io;
+    if (io->uring_kind == URING_POLL || io->uring_poll_first) {
+        int want = io->events;
+        if (io->uring_kind == URING_RECV || io->uring_kind == URING_ACCEPT) want = CS_POLL_READ;
+        else if (io->uring_kind == URING_SEND) want = CS_POLL_WRITE;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = uring_poll_mask(want);
+    } else {
+        switch (io->uring_kind) {
+            case URING_RECV:
+                sqe->opcode = IORING_OP_RECV;
+                sqe->addr = (uint64_t)(uintptr_t)io->buf;
+                sqe->len = (unsigned)io->buf_len;
+                break;
+            case URING_SEND:
+                sqe->opcode = IORING_OP_SEND;
+                sqe->addr = (uint64_t)(uintptr_t)io->buf;
+                sqe->len = (unsigned)io->buf_len;
+                break;
+            case URING_ACCEPT: {
+                uring_accept_buf* ab = (uring_accept_buf*)io->buf;
+                ab->len = sizeof(ab->addr);
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->addr = (uint64_t)(uintptr_t)&ab->addr;
+                sqe->addr2 = (uint64_t)(uintptr_t)&ab->len;
+                sqe->accept_flags = SOCK_NONBLOCK;
+                break;
             }
+            case URING_FILE_READ:
+            case URING_FILE_WRITE:
+                sqe->opcode = io->uring_kind == URING_FILE_READ ? IORING_OP_READ : IORING_OP_WRITE;
+                sqe->addr = (uint64_t)(uintptr_t)(io->buf + io->buf_done);
+                sqe->len = (unsigned)(io->buf_len - io->buf_done);
+                sqe->off = (uint64_t)io->buf_done;
+                break;
         }
     }
+    uring_push(r);
+    io->uring_state = URING_INFLIGHT;
+    r->inflight++;
+    return 1;
+}
 
-    for (cs_pending_io* io = vm->pending_io; io; ) {
-        cs_pending_io* next = io->next;
-        uint64_t timeout = pending_timeout_ms(vm, io);
-        if (timeout > 0 && (now - io->start_ms) >= timeout) {
-            reject_pending(vm, io, "operation timed out", "NET_TIMEOUT");
-            cs_remove_pending_io(vm, io->fd);
-            ready_count++;
+// Picks the SQE for a socket operation queued by cs_add_socket_op; 0 on OOM. TLS
+// sockets and handshakes wait for readiness and go through handle_ready_io.
+static int uring_prepare(cs_pending_io* io) {
+    io->uring_kind = URING_POLL;
+    int plain = io->sock && !io->sock->ssl;
+    if (plain && io->sock_op == CS_SOCK_RECV) {
+        io->buf = (char*)malloc(io->buf_len + 1);
+        io->uring_kind = URING_RECV;
+        return io->buf != NULL;
+    }
+    if (plain && io->sock_op == CS_SOCK_SEND) {
+        const cs_string* data = (const cs_string*)io->context.as.p;
+        io->buf_len = data->len;
+        io->buf = (char*)malloc(io->buf_len + 1);
+        if (io->buf) memcpy(io->buf, data->data, io->buf_len + 1);
+        io->uring_kind = URING_SEND;
+        return io->buf != NULL;
+    }
+    if (io->sock_op == CS_SOCK_ACCEPT) {
+        io->buf = (char*)calloc(1, sizeof(uring_accept_buf));
+        io->uring_kind = URING_ACCEPT;
+        return io->buf != NULL;
+    }
+    return 1;
+}
+
+static void uring_start(cs_vm* vm, struct cs_io_table* t, cs_pending_io* io) {
+    const char* fail = NULL;
+    if (!uring_prepare(io)) fail = "out of memory";
+    else if (!uring_submit(t->ring, io)) fail = "io_uring submission queue full";
+    if (!fail) return;
+    reject_pending(vm, io, fail, "NET_IO");
+    io_unlink(vm, io);
+    io_free(io);
+}
+
+// Returns 1 if the kernel still owns io: it is cancelled and freed by its completion.
+// 0 means the caller frees it.
+static int uring_cancel(struct cs_io_table* t, cs_pending_io* io) {
+    struct cs_uring* r = t->ring;
+    if (io->uring_state != URING_INFLIGHT) return 0;
+    io->uring_state = URING_ORPHAN;
+    struct io_uring_sqe* sqe = uring_sqe(r);
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)io;
+        sqe->user_data = URING_TAG_CANCEL;
+        uring_push(r);
+        // Now, not at the next poll: the socket is usually closed right after this and
+        // a pending recv would keep it open in the kernel
+        uring_enter(r, 0, 0);
+    }
+    return 1;
+}
+
+// Settles io from its completion; returns 1 when settled, 0 when it went back to the
+// kernel for another step
+static int uring_complete(cs_vm* vm, struct cs_io_table* t, cs_pending_io* io, int res) {
+    if (io->uring_kind == URING_POLL) {
+        if (res < 0 && res != -EINTR) {
+            reject_pending(vm, io, strerror(-res), "NET_IO");
+            return 1;
         }
-        io = next;
+        if (handle_ready_io(vm, io)) return 1;
+    } else if (io->uring_poll_first) {
+        io->uring_poll_first = 0;  // ready: make the real attempt
+    } else if (res == -EAGAIN || res == -EINTR) {
+        // Older kernels hand EAGAIN back for nonblocking sockets instead of waiting
+        io->uring_poll_first = 1;
+    } else {
+        switch (io->uring_kind) {
+            case URING_RECV:
+                if (res > 0) {
+                    char* data = io->buf;
+                    data[res] = '\0';
+                    io->buf = NULL;
+                    io->sock->recvs++;
+                    io->sock->bytes_received += (uint64_t)res;
+                    resolve_pending(vm, io, cs_str_take(vm, data, (uint64_t)res));
+                } else if (res == 0) {
+                    reject_pending(vm, io, "socket closed", "NET_CLOSED");
+                } else {
+                    reject_pending(vm, io, "socket_recv() failed", "NET_RECV");
+                }
+                return 1;
+            case URING_SEND:
+                if (res >= 0) {
+                    io->sock->sends++;
+                    io->sock->bytes_sent += (uint64_t)res;
+                    resolve_pending(vm, io, cs_int(res));
+                } else {
+                    reject_pending(vm, io, "socket_send() failed", "NET_SEND");
+                }
+                return 1;
+            case URING_ACCEPT:
+                if (res >= 0) resolve_pending(vm, io, make_accepted_socket(vm, res, &((uring_accept_buf*)io->buf)->addr));
+                else reject_pending(vm, io, "socket_accept() failed", "NET_CONNECT");
+                return 1;
+            case URING_FILE_READ:
+                if (res < 0) {
+                    resolve_pending(vm, io, cs_nil());
+                    return 1;
+                }
+                io->buf_done += (size_t)res;
+                if (res == 0 || io->buf_done == io->buf_len) {
+                    char* data = io->buf;
+                    data[io->buf_done] = '\0';
+                    io->buf = NULL;
+                    resolve_pending(vm, io, cs_str_take(vm, data, (uint64_t)io->buf_done));
+                    return 1;
+                }
+                break;  // short read: continue at the new offset
+            case URING_FILE_WRITE:
+                if (res > 0) io->buf_done += (size_t)res;
+                if (res <= 0 || io->buf_done == io->buf_len) {
+                    resolve_pending(vm, io, cs_bool(io->buf_done == io->buf_len));
+                    return 1;
+                }
+                break;
+        }
+    }
+    if (uring_submit(t->ring, io)) return 0;
+    reject_pending(vm, io, "io_uring submission queue full", "NET_IO");
+    return 1;
+}
+
+static int uring_reap(cs_vm* vm, struct cs_io_table* t) {
+    struct cs_uring* r = t->ring;
+    int settled = 0;
+    for (;;) {
+        unsigned head = *r->cq_head;
+        if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) break;
+        struct io_uring_cqe* cqe = &r->cqes[head & r->cq_mask];
+        uint64_t tag = cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (tag == URING_TAG_WAKE) {
+            io_drain_wake(t);
+            r->wake_polled = 0;
+            continue;
+        }
+        if (tag == URING_TAG_CANCEL) continue;
+        cs_pending_io* io = (cs_pending_io*)(uintptr_t)tag;
+        r->inflight--;
+        if (io->uring_state == URING_ORPHAN) {
+            io_free(io);
+            continue;
+        }
+        io->uring_state = URING_IDLE;
+        if (uring_complete(vm, t, io, res)) {
+            io_unlink(vm, io);
+            io_free(io);
+            settled++;
+        }
+    }
+    return settled;
+}
+
+static int uring_poll(cs_vm* vm, struct cs_io_table* t, int timeout_ms) {
+    struct cs_uring* r = t->ring;
+    // The wake fd is watched only while the scheduler might block on the ring
+    if (timeout_ms != 0 && t->wake_rd >= 0 && !r->wake_polled) {
+        struct io_uring_sqe* sqe = uring_sqe(r);
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = t->wake_rd;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = URING_TAG_WAKE;
+            uring_push(r);
+            r->wake_polled = 1;
+        }
+    }
+    int have = *r->cq_head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    uring_enter(r, timeout_ms != 0 && !have, timeout_ms);
+    return uring_reap(vm, t);
+}
+
+// Gives the kernel a bounded time to return cancelled operations (their buffers must
+// outlive them), then closes the ring. Anything still outstanding is leaked.
+static void uring_shutdown(struct cs_io_table* t) {
+    struct cs_uring* r = t->ring;
+    uint64_t give_up = get_time_ms() + 1000;
+    uring_enter(r, 0, 0);
+    while (r->inflight > 0 && get_time_ms() < give_up) {
+        uring_enter(r, 1, 50);
+        uring_reap(NULL, t);
+    }
+    uring_close(r);
+    t->ring = NULL;
+}
+
+static int uring_file_op(cs_vm* vm, int fd, int kind, char* buf, size_t len, cs_value promise) {
+    struct cs_io_table* t = vm ? io_table(vm) : NULL;
+    if (!t || !t->ring) return 0;
+    cs_pending_io* io = io_new(vm, t, fd, 0, promise, cs_nil(), CS_IO_NO_DEADLINE);
+    if (!io) return 0;
+    io->uring_kind = kind;
+    io->buf = buf;
+    io->buf_len = len;
+    if (!uring_submit(t->ring, io)) {
+        io->buf = NULL;  // still the caller's
+        io_unlink(vm, io);
+        io_free(io);
+        return 0;
+    }
+    io->owns_fd = 1;
+    return 1;
+}
+
+int cs_io_file_read(cs_vm* vm, int fd, size_t size, cs_value promise) {
+    char* buf = (char*)malloc(size + 1);
+    if (!buf) return 0;
+    if (uring_file_op(vm, fd, URING_FILE_READ, buf, size, promise)) return 1;
+    free(buf);
+    return 0;
+}
+
+int cs_io_file_write(cs_vm* vm, int fd, const char* data, size_t len, cs_value promise) {
+    char* buf = (char*)malloc(len ? len : 1);
+    if (!buf) return 0;
+    memcpy(buf, data, len);
+    if (uring_file_op(vm, fd, URING_FILE_WRITE, buf, len, promise)) return 1;
+    free(buf);
+    return 0;
+}
+
+int cs_io_set_backend(cs_vm* vm, const char* name) {
+    struct cs_io_table* t = vm ? io_table(vm) : NULL;
+    if (!t || !name) return -2;
+    int uring = strcmp(name, "io_uring") == 0;
+    if (!uring && strcmp(name, cs_poll_backend_name()) != 0) return -2;
+    if ((t->ring != NULL) == uring) return 1;
+    if (vm->pending_io) return -1;
+    if (!uring) {
+        uring_shutdown(t);
+        return 1;
+    }
+    t->ring = uring_open();
+    if (!t->ring) return 0;
+#ifdef CS_USE_EPOLL
+    // Idle registrations from earlier operations would otherwise linger in the set
+    for (size_t fd = 0; fd < t->slot_cap; fd++) io_forget_fd(t, (cs_socket_t)fd, &t->slots[fd]);
+#endif
+    return 1;
+}
+
+const char* cs_io_backend_name(cs_vm* vm) {
+    struct cs_io_table* t = vm ? io_table(vm) : NULL;  // applies CS_IO_BACKEND
+    if (t && t->ring) return "io_uring";
+    return cs_poll_backend_name();
+}
+#else
+int cs_io_file_read(cs_vm* vm, int fd, size_t size, cs_value promise) {
+    (void)vm; (void)fd; (void)size; (void)promise;
+    return 0;
+}
+
+int cs_io_file_write(cs_vm* vm, int fd, const char* data, size_t len, cs_value promise) {
+    (void)vm; (void)fd; (void)data; (void)len; (void)promise;
+    return 0;
+}
+
+int cs_io_set_backend(cs_vm* vm, const char* name) {
+    if (!name) return -2;
+    if (strcmp(name, cs_poll_backend_name()) == 0) return 1;
+    if (strcmp(name, "io_uring") != 0) return -2;
+    return vm && vm->pending_io ? -1 : 0;
+}
+
+const char* cs_io_backend_name(cs_vm* vm) {
+    (void)vm;
+    return cs_poll_backend_name();
+}
+#endif
+
+int cs_poll_pending_io(cs_vm* vm, int timeout_ms) {
+    if (!vm || !vm->pending_io || !vm->io_table) return 0;
+
+    struct cs_io_table* t = vm->io_table;
+    int ready_count = 0;
+
+    // Never sleep past the earliest I/O deadline
+    uint64_t now = get_time_ms();
+    if (t->next_deadline != UINT64_MAX && timeout_ms != 0) {
+        uint64_t left = t->next_deadline > now ? t->next_deadline - now : 0;
+        if (timeout_ms < 0 || left < (uint64_t)timeout_ms) timeout_ms = (int)left;
+    }
+
+#ifdef CS_USE_IO_URING
+    if (t->ring) {
+        ready_count = uring_poll(vm, t, timeout_ms);
+        return ready_count + io_sweep_timeouts(vm, get_time_ms());
+    }
+#endif
+
+#if defined(CS_USE_EPOLL)
+    if (t->events_cap < vm->pending_io_count + 1) {
+        int nc = t->events_cap ? t->events_cap : 64;
+        while (nc < vm->pending_io_count + 1) nc *= 2;
+        struct epoll_event* ne = (struct epoll_event*)realloc(t->events, (size_t)nc * sizeof(struct epoll_event));
+        if (ne) {
+            t->events = ne;
+            t->events_cap = nc;
+        }
+    }
+    if (!t->events) return 0;
+
+    int ret = epoll_wait(t->epfd, t->events, t->events_cap, timeout_ms);
+    for (int i = 0; i < ret; i++) {
+        cs_socket_t fd = t->events[i].data.fd;
+        if (fd == t->wake_rd) {
+            io_drain_wake(t);
+            continue;
+        }
+        cs_io_slot* slot = io_slot(t, fd, 0);
+        if (!slot) continue;
+        if (!slot->ops) {
+            // Idle registration reporting hangup/error: stop listening until reused
+            io_forget_fd(t, fd, slot);
+            continue;
+        }
+        uint32_t ev = t->events[i].events;
+        int ready = 0;
+        if (ev & EPOLLIN) ready |= CS_POLL_READ;
+        if (ev & EPOLLOUT) ready |= CS_POLL_WRITE;
+        if (ev & (EPOLLERR | EPOLLHUP)) ready |= CS_POLL_READ | CS_POLL_WRITE | CS_POLL_ERROR;
+        for (cs_pending_io* io = slot->ops; io; ) {
+            cs_pending_io* next = io->fd_next;
+            if (io->events & ready) ready_count += io_dispatch(vm, io);
+            io = next;
+        }
+        // A handler may have switched direction (TLS want-read/want-write), or queued
+        // an operation that grew the table
+        slot = io_slot(t, fd, 0);
+        if (slot && slot->ops) io_update_interest(t, fd, slot);
+    }
+#elif defined(CS_USE_POLL)
+    size_t nfds = (size_t)vm->pending_io_count;
+    if (t->pcap < nfds + 1) {
+        size_t nc = t->pcap ? t->pcap : 64;
+        while (nc < nfds + 1) nc *= 2;
+        struct pollfd* np = (struct pollfd*)realloc(t->pfds, nc * sizeof(struct pollfd));
+        if (np) t->pfds = np;
+        cs_pending_io** ni = (cs_pending_io**)realloc(t->pios, nc * sizeof(cs_pending_io*));
+        if (ni) t->pios = ni;
+        if (!np || !ni) return 0;
+        t->pcap = nc;
+    }
+
+    size_t i = 0;
+    for (cs_pending_io* io = vm->pending_io; io && i < nfds; io = io->next, i++) {
+        t->pfds[i].fd = io->fd;
+        t->pfds[i].events = 0;
+        t->pfds[i].revents = 0;
+        if (io->events & CS_POLL_READ) t->pfds[i].events |= POLLIN;
+        if (io->events & CS_POLL_WRITE) t->pfds[i].events |= POLLOUT;
+        if (io->events & CS_POLL_ERROR) t->pfds[i].events |= POLLERR;
+        t->pios[i] = io;
+    }
+    size_t n = i;
+    if (t->wake_rd >= 0) {
+        t->pfds[n].fd = t->wake_rd;
+        t->pfds[n].events = POLLIN;
+        t->pfds[n].revents = 0;
+        n++;
     }
 
-    free(fds);
-    free(ios);
+    int ret = poll(t->pfds, (nfds_t)n, timeout_ms);
+    if (ret > 0 && n > i && t->pfds[i].revents) io_drain_wake(t);
+    // Each entry is settled at most once and only the settled entry is freed, so the
+    // rest of pios stays valid while handlers run
+    for (size_t k = 0; ret > 0 && k < i; k++) {
+        if (t->pfds[k].revents) ready_count += io_dispatch(vm, t->pios[k]);
+    }
 #else
     fd_set read_fds, write_fds, error_fds;
     FD_ZERO(&read_fds);
@@ -496,12 +1301,21 @@ int cs_poll_pending_io(cs_vm* vm, int timeout_ms) {
         if (io->events & CS_POLL_ERROR) FD_SET(io->fd, &error_fds);
         if (io->fd > max_fd) max_fd = io->fd;
     }
+#ifndef _WIN32
+    if (t->wake_rd >= 0) {
+        FD_SET(t->wake_rd, &read_fds);
+        if (t->wake_rd > max_fd) max_fd = t->wake_rd;
+    }
+#endif
 
     struct timeval tv;
     tv.tv_sec = timeout_ms / 1000;
     tv.tv_usec = (timeout_ms % 1000) * 1000;
 
     int ret = select((int)(max_fd + 1), &read_fds, &write_fds, &error_fds, &tv);
+#ifndef _WIN32
+    if (ret > 0 && t->wake_rd >= 0 && FD_ISSET(t->wake_rd, &read_fds)) io_drain_wake(t);
+#endif
 
     if (ret > 0) {
         for (cs_pending_io* io = vm->pending_io; io; ) {
@@ -510,28 +1324,12 @@ int cs_poll_pending_io(cs_vm* vm, int timeout_ms) {
             if ((io->events & CS_POLL_READ) && FD_ISSET(io->fd, &read_fds)) ready = 1;
             if ((io->events & CS_POLL_WRITE) && FD_ISSET(io->fd, &write_fds)) ready = 1;
             if ((io->events & CS_POLL_ERROR) && FD_ISSET(io->fd, &error_fds)) ready = 1;
-            if (ready) {
-                int resolved = handle_ready_io(vm, io);
-                if (resolved) {
-                    cs_remove_pending_io(vm, io->fd);
-                    ready_count++;
-                }
-            }
+            if (ready) ready_count += io_dispatch(vm, io);
             io = next;
         }
     }
-
-    for (cs_pending_io* io = vm->pending_io; io; ) {
-        cs_pending_io* next = io->next;
-        uint64_t timeout = pending_timeout_ms(vm, io);
-        if (timeout > 0 && (now - io->start_ms) >= timeout) {
-            reject_pending(vm, io, "operation timed out", "NET_TIMEOUT");
-            cs_remove_pending_io(vm, io->fd);
-            ready_count++;
-        }
-        io = next;
-    }
 #endif
 
+    ready_count += io_sweep_timeouts(vm, get_time_ms());
     return ready_count;
-}
\ No newline at end of file
+}
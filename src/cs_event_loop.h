@@ -29,20 +29,56 @@
     #define CS_SOCKET_ERROR (-1)
 #endif
 
+// Linux waits with epoll (build with CS_NO_EPOLL to use poll instead)
+#if defined(__linux__) && !defined(CS_NO_EPOLL)
+    #define CS_USE_EPOLL 1
+#endif
+
+// Linux can also complete operations through io_uring, chosen per VM at run time
+// (build with CS_NO_IO_URING to leave it out)
+#if defined(__linux__) && !defined(CS_NO_IO_URING) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define CS_USE_IO_URING 1
+    #endif
+#endif
+
 // Poll event flags
 #define CS_POLL_READ   1
 #define CS_POLL_WRITE  2
 #define CS_POLL_ERROR  4
 
+struct cs_pending_io;
+struct cs_socket;
+// Drives a native operation (cs_add_pending_op): runs whenever the fd is ready for
+// io->events, may change them, and returns 1 once io->promise is settled
+typedef int (*cs_io_ready_fn)(cs_vm* vm, struct cs_pending_io* io);
+
 // Pending I/O operation
 typedef struct cs_pending_io {
     struct cs_pending_io* next;
+    struct cs_pending_io* prev;
+    struct cs_pending_io* fd_next;  // other operations waiting on the same fd
     cs_socket_t fd;
     int events;              // CS_POLL_READ, CS_POLL_WRITE
     cs_value promise;        // promise to resolve when ready
-    cs_value context;        // socket map or other context
+    cs_value context;        // socket map a connect resolves with, or the string being sent
     uint64_t timeout_ms;     // 0 = use default
-    uint64_t start_ms;       // when this I/O was scheduled
+    uint64_t deadline_ms;    // when this I/O times out
+    int owns_fd;             // file operations close their descriptor when freed
+    // io_uring completion state (cs_event_loop.c)
+    int uring_kind;
+    int uring_state;
+    int uring_poll_first;    // wait for readiness before the next attempt
+    char* buf;               // data being received, sent, read or written
+    size_t buf_len;
+    size_t buf_done;
+    // Socket operations (cs_add_socket_op)
+    struct cs_socket* sock;  // referenced while the operation exists
+    int sock_op;             // CS_SOCK_*
+    // Native operations keep C state instead of a context map
+    cs_io_ready_fn on_ready;
+    void* state;
+    void (*state_free)(void* state);
 } cs_pending_io;
 
 // Platform init/cleanup
@@ -55,9 +91,49 @@ int cs_socket_close(cs_socket_t fd);
 int cs_socket_get_error(cs_socket_t fd);
 const char* cs_socket_error_str(int err);
 
-// I/O scheduling (called from cs_vm.c)
-void cs_add_pending_io(cs_vm* vm, cs_socket_t fd, int events, cs_value promise, cs_value context, uint64_t timeout_ms);
+// Socket operations queued by cs_net.c and cs_tls.c
+enum {
+    CS_SOCK_CONNECT = 1,
+    CS_SOCK_SEND,
+    CS_SOCK_RECV,
+    CS_SOCK_ACCEPT,
+    CS_SOCK_TLS_CONNECT,
+    CS_SOCK_TLS_UPGRADE
+};
+
+// Queue op on sock's descriptor. context: the socket map a connect resolves with, or
+// the string being sent. max: the most bytes a recv returns. A TLS handshake takes
+// ssl (the SSL* it continues, or NULL to create one).
+void cs_add_socket_op(cs_vm* vm, struct cs_socket* sock, int op, int events, cs_value promise,
+                      cs_value context, size_t max, void* ssl);
 void cs_remove_pending_io(cs_vm* vm, cs_socket_t fd);
+#define CS_IO_NO_DEADLINE UINT64_MAX  // timeout_ms for operations that wait indefinitely
+
+// Queue a native operation. Takes state (released with state_free when the operation
+// ends, however it ends); returns 0, or -1 with state already released.
+int cs_add_pending_op(cs_vm* vm, cs_socket_t fd, int events, cs_value promise, void* state,
+                      cs_io_ready_fn on_ready, void (*state_free)(void* state), uint64_t timeout_ms);
+// From inside on_ready: wait on another descriptor from now on (io->events applies)
+void cs_pending_io_move(cs_vm* vm, cs_pending_io* io, cs_socket_t fd);
+// From inside on_ready: restart the operation's timeout, as for an idle timeout
+void cs_pending_io_touch(cs_vm* vm, cs_pending_io* io);
 int cs_poll_pending_io(cs_vm* vm, int timeout_ms);
+void cs_free_pending_io(cs_vm* vm);   // drops every operation and the poller (cs_vm_free)
+const char* cs_poll_backend_name(void); // "epoll", "poll" or "select"
+// Per-VM backend: "io_uring" or cs_poll_backend_name(). Returns 1 when name is in
+// effect, 0 if io_uring is unavailable (the readiness backend stays), -1 if
+// operations are pending, -2 for an unknown name. CS_IO_BACKEND=io_uring in the
+// environment selects io_uring for new VMs.
+int cs_io_set_backend(cs_vm* vm, const char* name);
+const char* cs_io_backend_name(cs_vm* vm);
+// Read size bytes / write len bytes of an open file through io_uring, settling
+// promise with a string (nil on error) / true or false. Takes fd on success. 0 when
+// the VM is not on io_uring and the caller should do the I/O itself.
+int cs_io_file_read(cs_vm* vm, int fd, size_t size, cs_value promise);
+int cs_io_file_write(cs_vm* vm, int fd, const char* data, size_t len, cs_value promise);
+// Wake a thread blocked in cs_poll_pending_io from any thread. Only valid while the
+// VM has an I/O table; cs_io_wakeable says whether a wake fd could be opened.
+void cs_io_wake(cs_vm* vm);
+int cs_io_wakeable(cs_vm* vm);
 
 #endif
\ No newline at end of file
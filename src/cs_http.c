@@ -6,12 +6,22 @@
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <zlib.h>
+#include <time.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #if !defined(_WIN32)
 #include <strings.h>
+#include <pthread.h>
+#include <netinet/tcp.h>
 #endif
 
 #if defined(_WIN32)
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #endif
 
 static char* dup_n(const char* s, size_t n) {
@@ -42,66 +52,248 @@ void cs_http_parser_init(cs_http_parser* p, cs_vm* vm) {
     memset(p, 0, sizeof(*p));
     p->state = HTTP_PARSE_STATUS_LINE;
     p->vm = vm;
-    p->headers = cs_map(vm);
     p->body_cap = 1024;
     p->body = (char*)malloc(p->body_cap);
     p->line_cap = 256;
     p->line_buf = (char*)malloc(p->line_cap);
 }
 
+static void inflater_free(cs_http_parser* p) {
+    if (!p->inflater) return;
+    inflateEnd((z_stream*)p->inflater);
+    free(p->inflater);
+    p->inflater = NULL;
+}
+
 void cs_http_parser_free(cs_http_parser* p) {
     if (!p) return;
-    cs_value_release(p->headers);
+    inflater_free(p);
     free(p->body);
+    free(p->head);
+    free(p->refs);
     free(p->line_buf);
     memset(p, 0, sizeof(*p));
 }
 
-static int parse_status_line(cs_http_parser* p, const char* line) {
+// Index of the first byte of s[0..n) that ends a run of head text: a control
+// character other than HT (CR and LF among them) or DEL. Lines are checked for stray
+// control bytes in the same pass that finds their end, a vector at a time.
+static size_t http_scan_ctl(const char* s, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i lim32 = _mm256_set1_epi8(0x1f);
+    const __m256i tab32 = _mm256_set1_epi8('\t');
+    const __m256i del32 = _mm256_set1_epi8(0x7f);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, lim32), v);
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab32), ctl);
+        ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del32));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(ctl);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i lim = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, lim), v);  // v <= 0x1f, unsigned
+        ctl = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl);
+        ctl = _mm_or_si128(ctl, _mm_cmpeq_epi8(v, del));
+        unsigned mask = (unsigned)_mm_movemask_epi8(ctl);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if ((c < 0x20 && c != '\t') || c == 0x7f) return i;
+    }
+    return n;
+}
+
+static int parse_status_line(cs_http_parser* p, const char* line, size_t n) {
     // HTTP/1.1 200 OK
-    const char* sp = strchr(line, ' ');
+    const char* end = line + n;
+    if (n > 7 && memcmp(line, "HTTP/1.", 7) == 0) p->http_minor = line[7] - '0';
+    const char* sp = (const char*)memchr(line, ' ', n);
     if (!sp) return -1;
-    while (*sp == ' ') sp++;
-    p->status_code = atoi(sp);
-    const char* sp2 = strchr(sp, ' ');
-    if (sp2) {
-        while (*sp2 == ' ') sp2++;
-        strncpy(p->status_text, sp2, sizeof(p->status_text) - 1);
-        p->status_text[sizeof(p->status_text) - 1] = 0;
-    } else {
-        strncpy(p->status_text, "", sizeof(p->status_text));
-    }
+    while (sp < end && *sp == ' ') sp++;
+    int code = 0;
+    while (sp < end && isdigit((unsigned char)*sp) && code < 1000) code = code * 10 + (*sp++ - '0');
+    p->status_code = code;
+    while (sp < end && *sp != ' ') sp++;
+    while (sp < end && *sp == ' ') sp++;
+    size_t text_len = (size_t)(end - sp);
+    if (text_len > sizeof(p->status_text) - 1) text_len = sizeof(p->status_text) - 1;
+    memcpy(p->status_text, sp, text_len);
+    p->status_text[text_len] = 0;
     return 0;
 }
 
-static void parse_header_line(cs_http_parser* p, cs_vm* vm, const char* line) {
-    const char* colon = strchr(line, ':');
-    if (!colon) return;
-    size_t key_len = (size_t)(colon - line);
-    while (key_len > 0 && isspace((unsigned char)line[key_len - 1])) key_len--;
+static int parse_request_line(cs_http_parser* p, const char* line, size_t n) {
+    // GET /path?query HTTP/1.1
+    const char* end = line + n;
+    const char* sp = (const char*)memchr(line, ' ', n);
+    if (!sp || sp == line) return -1;
+    const char* target = sp + 1;
+    const char* sp2 = (const char*)memchr(target, ' ', (size_t)(end - target));
+    if (!sp2 || sp2 == target) return -1;
+    if (end - sp2 != 9 || memcmp(sp2 + 1, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)sp2[8])) return -1;
+    p->http_minor = sp2[8] - '0';
+    p->method_len = (size_t)(sp - line);
+    p->target_off = (size_t)(target - line);
+    p->target_len = (size_t)(sp2 - target);
+    return 0;
+}
 
-    const char* val = colon + 1;
-    while (*val && isspace((unsigned char)*val)) val++;
+// Whether a comma-separated header value lists token (case-insensitive)
+static int header_has_token(const char* val, size_t len, const char* token) {
+    size_t n = strlen(token);
+    const char* stop = val + len;
+    while (val < stop) {
+        while (val < stop && (*val == ' ' || *val == '\t' || *val == ',')) val++;
+        const char* end = val;
+        while (end < stop && *end != ',') end++;
+        const char* last = end;
+        while (last > val && (last[-1] == ' ' || last[-1] == '\t')) last--;
+        if ((size_t)(last - val) == n && strncasecmp(val, token, n) == 0) return 1;
+        val = end;
+    }
+    return 0;
+}
 
-    char* key = (char*)malloc(key_len + 1);
-    if (!key) return;
-    memcpy(key, line, key_len);
-    key[key_len] = 0;
+// Content-Length: digits, or a list repeating one value (RFC 9110 section 8.6). 0 if
+// the value is empty, malformed, too large for size_t or lists different lengths.
+static int parse_content_length(const char* val, size_t len, size_t* out) {
+    const char* stop = val + len;
+    int have = 0;
+    while (val < stop) {
+        while (val < stop && (*val == ' ' || *val == '\t')) val++;
+        const char* d = val;
+        size_t cl = 0;
+        while (d < stop && isdigit((unsigned char)*d)) {
+            size_t digit = (size_t)(*d++ - '0');
+            if (cl > (SIZE_MAX - digit) / 10) return 0;
+            cl = cl * 10 + digit;
+        }
+        if (d == val) return 0;
+        while (d < stop && (*d == ' ' || *d == '\t')) d++;
+        if (d < stop && *d != ',') return 0;
+        if (have && cl != *out) return 0;
+        *out = cl;
+        have = 1;
+        val = d < stop ? d + 1 : d;
+    }
+    return have;
+}
 
-    cs_map_set(p->headers, key, cs_str(vm, val));
+static int name_is(const char* name, size_t len, const char* want) {
+    return strlen(want) == len && strncasecmp(name, want, len) == 0;
+}
 
-    if (strcasecmp(key, "content-length") == 0) {
-        p->content_length = (size_t)atoll(val);
+// Records the header line at head + off. Only the headers that frame the message are
+// looked at here; the rest stay offsets until cs_http_parser_headers is asked for them.
+static int parse_header_line(cs_http_parser* p, size_t off, size_t n) {
+    const char* line = p->head + off;
+    const char* colon = (const char*)memchr(line, ':', n);
+    if (!colon) return p->is_request ? -1 : 0;  // responses: skipped, as before
+    size_t name_len = (size_t)(colon - line);
+    if (p->is_request) {
+        // No whitespace before the colon (RFC 9112 section 5.1)
+        if (name_len == 0 || line[name_len - 1] == ' ' || line[name_len - 1] == '\t') return -1;
+    } else {
+        while (name_len > 0 && (line[name_len - 1] == ' ' || line[name_len - 1] == '\t')) name_len--;
     }
-    if (strcasecmp(key, "transfer-encoding") == 0 && strcasecmp(val, "chunked") == 0) {
-        p->chunked = 1;
+    const char* val = colon + 1;
+    const char* val_end = line + n;
+    while (val < val_end && (*val == ' ' || *val == '\t')) val++;
+    while (val_end > val && (val_end[-1] == ' ' || val_end[-1] == '\t')) val_end--;
+    size_t val_len = (size_t)(val_end - val);
+
+    if (p->ref_count == p->ref_cap) {
+        size_t nc = p->ref_cap ? p->ref_cap * 2 : 16;
+        cs_http_header_ref* nr = (cs_http_header_ref*)realloc(p->refs, nc * sizeof(*nr));
+        if (!nr) return -1;
+        p->refs = nr;
+        p->ref_cap = nc;
+    }
+    cs_http_header_ref* r = &p->refs[p->ref_count++];
+    r->name_off = off;
+    r->name_len = name_len;
+    r->value_off = (size_t)(val - p->head);
+    r->value_len = val_len;
+
+    if (name_is(line, name_len, "content-length")) {
+        // A length that is malformed, wraps around or disagrees with an earlier one would
+        // frame the body differently than a proxy in front of us: request smuggling
+        size_t cl = 0;
+        if (!parse_content_length(val, val_len, &cl)) return -1;
+        if (p->has_content_length && cl != p->content_length) return -1;
+        p->content_length = cl;
+        p->has_content_length = 1;
+    } else if (name_is(line, name_len, "transfer-encoding")) {
+        p->has_transfer_encoding = 1;
+        if (header_has_token(val, val_len, "chunked")) p->chunked = 1;
+    } else if (name_is(line, name_len, "content-encoding")) {
+        if (header_has_token(val, val_len, "gzip") || header_has_token(val, val_len, "x-gzip") ||
+            header_has_token(val, val_len, "deflate")) {
+            p->encoded = 1;
+        }
+    } else if (name_is(line, name_len, "connection")) {
+        if (header_has_token(val, val_len, "close")) p->conn_close = 1;
+        if (header_has_token(val, val_len, "keep-alive")) p->conn_keep_alive = 1;
+    } else if (p->is_request && name_is(line, name_len, "expect")) {
+        if (header_has_token(val, val_len, "100-continue")) p->expect_continue = 1;
     }
+    return 0;
+}
 
-    free(key);
+static cs_value str_n(cs_vm* vm, const char* s, size_t n) {
+    char* copy = dup_n(s, n);
+    return copy ? cs_str_take(vm, copy, (uint64_t)n) : cs_nil();
 }
 
-static int append_body(cs_http_parser* p, const char* data, size_t len) {
-    if (len == 0) return 1;
+cs_value cs_http_parser_headers(cs_http_parser* p, int lower) {
+    cs_vm* vm = p->vm;
+    cs_value map = cs_map(vm);
+    char buf[256];
+    for (size_t i = 0; map.as.p && i < p->ref_count; i++) {
+        const cs_http_header_ref* r = &p->refs[i];
+        const char* name = p->head + r->name_off;
+        const char* val = p->head + r->value_off;
+        char* key = r->name_len < sizeof(buf) ? buf : (char*)malloc(r->name_len + 1);
+        if (!key) continue;
+        for (size_t k = 0; k < r->name_len; k++) key[k] = lower ? (char)tolower((unsigned char)name[k]) : name[k];
+        key[r->name_len] = 0;
+        cs_value prev = lower ? cs_map_get(map, key) : cs_nil();
+        cs_value v;
+        if (prev.type == CS_T_STR) {
+            size_t pn = ((cs_string*)prev.as.p)->len;
+            char* joined = (char*)malloc(pn + 2 + r->value_len + 1);
+            v = cs_nil();
+            if (joined) {
+                memcpy(joined, cs_to_cstr(prev), pn);
+                memcpy(joined + pn, ", ", 2);
+                memcpy(joined + pn + 2, val, r->value_len);
+                joined[pn + 2 + r->value_len] = 0;
+                v = cs_str_take(vm, joined, (uint64_t)(pn + 2 + r->value_len));
+            }
+        } else {
+            v = str_n(vm, val, r->value_len);
+        }
+        if (v.type == CS_T_STR) cs_map_set(map, key, v);
+        cs_value_release(v);
+        cs_value_release(prev);
+        if (key != buf) free(key);
+    }
+    return map;
+}
+
+static int deliver_body(cs_http_parser* p, const char* data, size_t len) {
+    p->body_total += len;
+    if (p->on_body) return p->on_body(p->on_body_ud, data, len);
     if (!ensure_buf(&p->body, &p->body_cap, p->body_len + len + 1)) return 0;
     memcpy(p->body + p->body_len, data, len);
     p->body_len += len;
@@ -109,20 +301,157 @@ static int append_body(cs_http_parser* p, const char* data, size_t len) {
     return 1;
 }
 
-static int parse_line(cs_http_parser* p, const char* line) {
+// Inflates through a fixed buffer, so a streamed body never sits whole in memory
+static int inflate_body(cs_http_parser* p, const char* data, size_t len) {
+    z_stream* z = (z_stream*)p->inflater;
+    char out[16384];
+    z->next_in = (Bytef*)data;
+    z->avail_in = (uInt)len;
+    for (;;) {
+        z->next_out = (Bytef*)out;
+        z->avail_out = sizeof(out);
+        int rc = inflate(z, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) return 0;
+        size_t n = sizeof(out) - z->avail_out;
+        if (n > 0 && !deliver_body(p, out, n)) return 0;
+        if (rc == Z_STREAM_END) {
+            if (z->avail_in == 0) return 1;
+            if (inflateReset(z) != Z_OK) return 0;  // another gzip member follows
+            continue;
+        }
+        if (z->avail_in == 0 && z->avail_out > 0) return 1;
+        if (n == 0 && rc == Z_BUF_ERROR) return 0;
+    }
+}
+
+static int append_body(cs_http_parser* p, const char* data, size_t len) {
+    if (len == 0) return 1;
+    if (p->inflater) return inflate_body(p, data, len);
+    return deliver_body(p, data, len);
+}
+
+// Decides how the body is delimited once the headers are in (RFC 9112 section 6.3)
+static int headers_done(cs_http_parser* p) {
+    if (p->is_request) {
+        // Framed both ways, or by a coding other than chunked, the body's end is ambiguous
+        // (RFC 9112 section 6.1): reject rather than guess
+        if (p->has_transfer_encoding && (p->has_content_length || !p->chunked)) return -1;
+        // A request without Content-Length or chunked encoding has no body
+        if (p->chunked) p->state = HTTP_PARSE_BODY;
+        else p->state = p->content_length > 0 ? HTTP_PARSE_BODY : HTTP_PARSE_DONE;
+        return 0;
+    }
+    int code = p->status_code;
+    if (code >= 100 && code < 200 && code != 101) {
+        // Interim response (100 Continue): the real one follows
+        p->head_len = p->line_off = p->ref_count = 0;
+        p->chunked = p->has_content_length = p->has_transfer_encoding = 0;
+        p->conn_close = p->conn_keep_alive = p->encoded = 0;
+        p->content_length = 0;
+        p->state = HTTP_PARSE_STATUS_LINE;
+        return 0;
+    }
+    // Transfer-Encoding overrides Content-Length, but the connection is not reused after
+    // a response framed both ways
+    if (p->has_transfer_encoding && p->has_content_length) p->conn_close = 1;
+    if (p->no_body || code == 204 || code == 304 || code == 101) p->state = HTTP_PARSE_DONE;
+    else if (p->chunked) p->state = HTTP_PARSE_BODY;
+    else if (p->has_content_length) p->state = p->content_length > 0 ? HTTP_PARSE_BODY : HTTP_PARSE_DONE;
+    else {
+        p->until_close = 1;  // delimited by the server closing the connection
+        p->state = HTTP_PARSE_BODY;
+    }
+    if (p->state == HTTP_PARSE_BODY && p->decode && p->encoded) {
+        z_stream* z = (z_stream*)calloc(1, sizeof(z_stream));
+        if (!z) return -1;
+        // 32 + 15: gzip or zlib header, detected from the data
+        if (inflateInit2(z, 32 + 15) != Z_OK) {
+            free(z);
+            return -1;
+        }
+        p->inflater = z;
+    }
+    return 0;
+}
+
+// Handles the line that ends at head_len, its CRLF already appended
+static int parse_line(cs_http_parser* p) {
+    size_t off = p->line_off;
+    size_t n = p->head_len - off - 2;
+    p->line_off = p->head_len;
     if (p->state == HTTP_PARSE_STATUS_LINE) {
-        if (parse_status_line(p, line) != 0) return -1;
+        if (p->is_request && n == 0) {
+            p->head_len = p->line_off = 0;  // blank lines before a request are ignored (RFC 9112 section 2.2)
+            return 0;
+        }
+        const char* line = p->head + off;
+        if ((p->is_request ? parse_request_line(p, line, n) : parse_status_line(p, line, n)) != 0) return -1;
         p->state = HTTP_PARSE_HEADERS;
         return 0;
     }
-    if (p->state == HTTP_PARSE_HEADERS) {
-        if (line[0] == 0) {
-            if (p->chunked || p->content_length > 0) p->state = HTTP_PARSE_BODY;
-            else p->state = HTTP_PARSE_DONE;
+    if (n == 0) return headers_done(p);
+    return parse_header_line(p, off, n);
+}
+
+// Copies head bytes into head up to the end of a line: 1 with a line ending in CRLF
+// at head_len, 0 once data runs out first, -1 on a stray control byte or max_head
+static int take_head(cs_http_parser* p, const char* data, size_t len, size_t* used) {
+    size_t n = 0;
+    int end = 0;
+    if (p->pending_cr) {
+        if (data[0] != '\n') return -1;
+        p->pending_cr = 0;
+        *used = 1;
+        end = 1;
+    } else {
+        n = http_scan_ctl(data, len);
+        if (n < len) {
+            if (data[n] == '\n') {
+                *used = n + 1;
+                end = 1;
+            } else if (data[n] != '\r') {
+                return -1;
+            } else if (n + 1 == len) {
+                p->pending_cr = 1;
+                *used = len;
+            } else if (data[n + 1] == '\n') {
+                *used = n + 2;
+                end = 1;
+            } else {
+                return -1;
+            }
         } else {
-            parse_header_line(p, p->vm, line);
+            *used = len;
         }
     }
+    if (p->max_head && p->head_len + n + 2 > p->max_head) {
+        p->head_too_large = 1;
+        return -1;
+    }
+    if (!ensure_buf(&p->head, &p->head_cap, p->head_len + n + 3)) return -1;
+    memcpy(p->head + p->head_len, data, n);
+    p->head_len += n;
+    if (end) {
+        memcpy(p->head + p->head_len, "\r\n", 2);
+        p->head_len += 2;
+    }
+    p->head[p->head_len] = 0;
+    return end;
+}
+
+#define HTTP_MAX_CHUNK_LINE 8192
+
+// Collects one CRLF- or LF-terminated chunk line; 1 once line_buf holds a complete line
+static int take_line(cs_http_parser* p, char c) {
+    if (c == '\n') {
+        if (p->line_len > 0 && p->line_buf[p->line_len - 1] == '\r') p->line_len--;
+        p->line_buf[p->line_len] = 0;
+        p->line_len = 0;
+        return 1;
+    }
+    if (p->is_request && p->line_len >= HTTP_MAX_CHUNK_LINE) return -1;
+    if (!ensure_buf(&p->line_buf, &p->line_cap, p->line_len + 2)) return -1;
+    p->line_buf[p->line_len++] = c;
     return 0;
 }
 
@@ -130,79 +459,71 @@ int cs_http_parser_feed(cs_http_parser* p, const char* data, size_t len) {
     if (!p || !data || p->state == HTTP_PARSE_ERROR || p->state == HTTP_PARSE_DONE) return 0;
 
     size_t i = 0;
-    while (i < len) {
+    while (i < len && p->state != HTTP_PARSE_DONE) {
         if (p->state == HTTP_PARSE_STATUS_LINE || p->state == HTTP_PARSE_HEADERS) {
-            char c = data[i++];
-            if (c == '\n') {
-                if (p->line_len > 0 && p->line_buf[p->line_len - 1] == '\r') p->line_len--;
-                p->line_buf[p->line_len] = 0;
-                if (parse_line(p, p->line_buf) != 0) { p->state = HTTP_PARSE_ERROR; return -1; }
-                p->line_len = 0;
-                if (p->state == HTTP_PARSE_DONE) return 1;
-            } else {
-                if (!ensure_buf(&p->line_buf, &p->line_cap, p->line_len + 2)) { p->state = HTTP_PARSE_ERROR; return -1; }
-                p->line_buf[p->line_len++] = c;
-            }
+            size_t used = 0;
+            int got = take_head(p, data + i, len - i, &used);
+            i += used;
+            if (got < 0 || (got > 0 && parse_line(p) != 0)) { p->state = HTTP_PARSE_ERROR; return -1; }
             continue;
         }
 
-        if (p->state == HTTP_PARSE_BODY) {
-            if (!p->chunked) {
-                size_t need = (p->content_length > p->body_len) ? (p->content_length - p->body_len) : 0;
-                size_t take = (need > 0 && need < (len - i)) ? need : (len - i);
-                if (!append_body(p, data + i, take)) { p->state = HTTP_PARSE_ERROR; return -1; }
-                i += take;
-                if (p->content_length > 0 && p->body_len >= p->content_length) {
-                    p->state = HTTP_PARSE_DONE;
-                    return 1;
-                }
-                continue;
-            }
-
-            // Chunked parsing
-            if (!p->in_chunk) {
-                char c = data[i++];
-                if (c == '\n') {
-                    if (p->line_len > 0 && p->line_buf[p->line_len - 1] == '\r') p->line_len--;
-                    p->line_buf[p->line_len] = 0;
-                    p->chunk_remaining = (size_t)strtoul(p->line_buf, NULL, 16);
-                    p->line_len = 0;
-                    if (p->chunk_remaining == 0) {
-                        p->state = HTTP_PARSE_DONE;
-                        return 1;
-                    }
-                    p->in_chunk = 1;
-                } else {
-                    if (!ensure_buf(&p->line_buf, &p->line_cap, p->line_len + 2)) { p->state = HTTP_PARSE_ERROR; return -1; }
-                    p->line_buf[p->line_len++] = c;
-                }
-                continue;
-            }
+        if (!p->chunked) {
+            size_t take = len - i;
+            if (!p->until_close && take > p->content_length - p->body_len) take = p->content_length - p->body_len;
+            if (!append_body(p, data + i, take)) { p->state = HTTP_PARSE_ERROR; return -1; }
+            i += take;
+            if (!p->until_close && p->body_len >= p->content_length) p->state = HTTP_PARSE_DONE;
+            continue;
+        }
 
+        // Chunked: size line, data, CRLF, ... then a zero size, trailers and a blank line
+        if (p->chunk_phase == HTTP_CHUNK_DATA) {
             size_t take = p->chunk_remaining;
-            if (take > (len - i)) take = (len - i);
-            if (take > 0) {
-                if (!append_body(p, data + i, take)) { p->state = HTTP_PARSE_ERROR; return -1; }
-                i += take;
-                p->chunk_remaining -= take;
-            }
-            if (p->chunk_remaining == 0) {
-                p->in_chunk = 0;
-                // Skip CRLF after chunk if present
-                if (i < len && data[i] == '\r') i++;
-                if (i < len && data[i] == '\n') i++;
-            }
+            if (take > len - i) take = len - i;
+            if (!append_body(p, data + i, take)) { p->state = HTTP_PARSE_ERROR; return -1; }
+            i += take;
+            p->chunk_remaining -= take;
+            if (p->chunk_remaining == 0) p->chunk_phase = HTTP_CHUNK_DATA_END;
             continue;
         }
+        int got = take_line(p, data[i++]);
+        if (got < 0) { p->state = HTTP_PARSE_ERROR; return -1; }
+        if (got == 0) continue;
+        if (p->chunk_phase == HTTP_CHUNK_SIZE) {
+            char* end = NULL;
+            p->chunk_remaining = (size_t)strtoul(p->line_buf, &end, 16);
+            if (end == p->line_buf) { p->state = HTTP_PARSE_ERROR; return -1; }
+            p->chunk_phase = p->chunk_remaining == 0 ? HTTP_CHUNK_TRAILER : HTTP_CHUNK_DATA;
+        } else if (p->chunk_phase == HTTP_CHUNK_DATA_END) {
+            p->chunk_phase = HTTP_CHUNK_SIZE;
+        } else if (p->line_buf[0] == 0) {
+            p->state = HTTP_PARSE_DONE;  // end of trailers
+        }
     }
 
-    return 1;
+    p->excess = len - i;
+    return p->state == HTTP_PARSE_DONE ? 1 : 0;
+}
+
+int cs_http_parser_finish(cs_http_parser* p) {
+    if (p && p->state == HTTP_PARSE_BODY && p->until_close) p->state = HTTP_PARSE_DONE;
+    return cs_http_parser_is_done(p);
 }
 
 int cs_http_parser_is_done(cs_http_parser* p) {
     return p && p->state == HTTP_PARSE_DONE;
 }
 
+int cs_http_parser_keep_alive(cs_http_parser* p) {
+    if (!cs_http_parser_is_done(p) || p->conn_close) return 0;
+    // A client may pipeline its next request in the same read
+    if (p->is_request) return p->http_minor >= 1 || p->conn_keep_alive;
+    if (p->until_close || p->excess) return 0;
+    if (p->status_code == 101) return 0;  // the connection now speaks another protocol
+    return p->http_minor >= 1 || p->conn_keep_alive;
+}
+
 static const char* find_str(const char* s, const char* pat) {
     return strstr(s, pat);
 }
@@ -339,42 +660,211 @@ cs_value cs_url_build(cs_vm* vm, cs_value parts) {
     return cs_str(vm, buf);
 }
 
-static int http_send_all(int fd, const char* data, size_t len) {
-    size_t sent = 0;
-    while (sent < len) {
-        ssize_t n = send(fd, data + sent, len - sent, 0);
-        if (n <= 0) return -1;
-        sent += (size_t)n;
+// Request built from an options map ({url, method, headers, body}), ready to send
+typedef struct {
+    char* host;
+    int port;
+    int use_tls;
+    int keep_alive;      // the connection may go back to the pool
+    int head;            // HEAD: the response has no body
+    int decode;          // opts.decompress: ask for and inflate gzip/deflate bodies
+    int raw_head;        // opts.raw_head: the response carries its header block, not a map
+    cs_value on_chunk;   // opts.on_chunk: called with each body chunk instead of buffering
+    char* output;        // opts.output: the body is written to this file instead
+    char* req;           // request head followed by the body
+    size_t req_len;
+    size_t req_cap;
+} http_target;
+
+static int req_append(http_target* t, const char* s, size_t n) {
+    if (!ensure_buf(&t->req, &t->req_cap, t->req_len + n + 1)) return 0;
+    memcpy(t->req + t->req_len, s, n);
+    t->req_len += n;
+    t->req[t->req_len] = 0;
+    return 1;
+}
+
+static int req_append_cstr(http_target* t, const char* s) {
+    return req_append(t, s, strlen(s));
+}
+
+static void http_target_free(http_target* t) {
+    cs_value_release(t->on_chunk);
+    free(t->output);
+    free(t->host);
+    free(t->req);
+    memset(t, 0, sizeof(*t));
+}
+
+// ---------- connection pool ----------
+// A response framed by Content-Length or chunked encoding leaves its connection
+// open, and the next request to the same scheme, host and port reuses it instead of
+// connecting again. Each VM parks idle connections most recent first, closes them
+// after idle_timeout and keeps at most max_per_host for each key.
+
+#define HTTP_POOL_MAX_PER_HOST 8
+#define HTTP_POOL_IDLE_TIMEOUT_MS 30000
+
+typedef struct {
+    cs_socket_t fd;
+#ifndef CS_NO_TLS
+    SSL* ssl;
+#endif
+} http_conn;
+
+typedef struct http_idle {
+    struct http_idle* next;
+    http_conn conn;
+    char* host;
+    int port;
+    int use_tls;
+    uint64_t since_ns;
+} http_idle;
+
+struct cs_http_pool {
+    http_idle* idle;           // most recently parked first
+    int idle_count;
+    int max_per_host;          // 0 turns pooling off
+    uint64_t idle_timeout_ns;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stale;            // parked connections the server had already closed
+    uint64_t tls_resumed;      // new TLS connections that resumed a cached session
+};
+
+static struct cs_http_pool* http_pool(cs_vm* vm) {
+    if (!vm->http_pool) {
+        struct cs_http_pool* p = (struct cs_http_pool*)calloc(1, sizeof(struct cs_http_pool));
+        if (!p) return NULL;
+        p->max_per_host = HTTP_POOL_MAX_PER_HOST;
+        p->idle_timeout_ns = (uint64_t)HTTP_POOL_IDLE_TIMEOUT_MS * 1000000ull;
+        vm->http_pool = p;
     }
-    return 0;
+    return vm->http_pool;
 }
 
-static int tls_send_all(SSL* ssl, const char* data, size_t len) {
-    size_t sent = 0;
-    while (sent < len) {
-        int n = SSL_write(ssl, data + sent, (int)(len - sent));
-        if (n <= 0) return -1;
-        sent += (size_t)n;
+// notify sends TLS close_notify first. Pooled connections skip it: the server may be
+// gone, and writing to it would raise SIGPIPE.
+static void http_conn_close(http_conn* c, int notify) {
+#ifndef CS_NO_TLS
+    if (c->ssl) {
+        if (notify) cs_tls_close(c->ssl);
+        else SSL_free(c->ssl);
+        c->ssl = NULL;
     }
-    return 0;
+#else
+    (void)notify;
+#endif
+    if (c->fd != CS_INVALID_SOCKET) cs_socket_close(c->fd);
+    c->fd = CS_INVALID_SOCKET;
 }
 
-// Internal: perform HTTP request
-static int nf_http_request(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
-    (void)ud;
-    if (argc < 1 || argv[0].type != CS_T_MAP) {
-        cs_error(vm, "http_request() requires options map");
-        return 1;
+static void http_idle_free(http_idle* e) {
+    http_conn_close(&e->conn, 0);
+    free(e->host);
+    free(e);
+}
+
+static int http_idle_same(const http_idle* a, const http_idle* b) {
+    return a->port == b->port && a->use_tls == b->use_tls && strcmp(a->host, b->host) == 0;
+}
+
+// An idle connection has nothing to read; readable means the server closed it
+static int http_conn_alive(const http_conn* c) {
+#ifndef CS_NO_TLS
+    if (c->ssl && SSL_pending(c->ssl) > 0) return 0;
+#endif
+#ifdef _WIN32
+    WSAPOLLFD p;
+    p.fd = c->fd;
+    p.events = POLLRDNORM;
+    p.revents = 0;
+    return WSAPoll(&p, 1, 0) == 0;
+#else
+    struct pollfd p;
+    p.fd = c->fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    return poll(&p, 1, 0) == 0;
+#endif
+}
+
+// Closes connections idle past the timeout or beyond the per-host limit
+static void http_pool_prune(struct cs_http_pool* p, uint64_t now) {
+    http_idle** pp = &p->idle;
+    while (*pp) {
+        http_idle* e = *pp;
+        int keep = p->max_per_host > 0 && now - e->since_ns < p->idle_timeout_ns;
+        if (keep) {
+            int newer = 0;
+            for (http_idle* x = p->idle; x != e; x = x->next) newer += http_idle_same(x, e);
+            keep = newer < p->max_per_host;
+        }
+        if (keep) {
+            pp = &e->next;
+            continue;
+        }
+        *pp = e->next;
+        p->idle_count--;
+        http_idle_free(e);
+    }
+}
+
+void cs_http_pool_free(cs_vm* vm) {
+    struct cs_http_pool* p = vm->http_pool;
+    if (!p) return;
+    while (p->idle) {
+        http_idle* e = p->idle;
+        p->idle = e->next;
+        http_idle_free(e);
     }
+    free(p);
+    vm->http_pool = NULL;
+}
+
+static void http_socket_set_blocking(cs_socket_t fd, int blocking) {
+#ifdef _WIN32
+    u_long mode = blocking ? 0 : 1;
+    ioctlsocket(fd, FIONBIO, &mode);
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+}
+
+// opts.output is relative to the script's directory, like the file functions
+static char* http_output_path(cs_vm* vm, const char* path) {
+    int absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+    if (absolute || vm->dir_count == 0) return dup_cstr(path);
+    const char* dir = vm->dir_stack[vm->dir_count - 1];
+    size_t nd = strlen(dir);
+    size_t np = strlen(path);
+    char* out = (char*)malloc(nd + np + 2);
+    if (!out) return NULL;
+    memcpy(out, dir, nd);
+    out[nd] = '/';
+    memcpy(out + nd + 1, path, np + 1);
+    return out;
+}
 
-    cs_value url_val = cs_map_get(argv[0], "url");
+// Returns 0, or 1 after raising a script error; fname names the native in messages
+static int http_target_init(cs_vm* vm, cs_value opts, const char* fname, http_target* t) {
+    memset(t, 0, sizeof(*t));
+    char msg[128];
+    if (opts.type != CS_T_MAP) {
+        snprintf(msg, sizeof(msg), "%s requires options map", fname);
+        cs_error(vm, msg);
+        return 1;
+    }
+    cs_value url_val = cs_map_get(opts, "url");
     if (url_val.type != CS_T_STR) {
         cs_value_release(url_val);
-        cs_error(vm, "http_request() requires url");
+        snprintf(msg, sizeof(msg), "%s requires url", fname);
+        cs_error(vm, msg);
         return 1;
     }
 
-    cs_value method_val = cs_map_get(argv[0], "method");
+    cs_value method_val = cs_map_get(opts, "method");
     const char* method = (method_val.type == CS_T_STR) ? cs_to_cstr(method_val) : "GET";
 
     cs_value parts = cs_url_parse(vm, cs_to_cstr(url_val));
@@ -383,31 +873,40 @@ static int nf_http_request(cs_vm* vm, void* ud, int argc, const cs_value* argv,
     cs_value port = cs_map_get(parts, "port");
     cs_value path = cs_map_get(parts, "path");
     cs_value query = cs_map_get(parts, "query");
-
-    const char* host_str = (host.type == CS_T_STR) ? cs_to_cstr(host) : "";
-    int port_num = (port.type == CS_T_INT) ? (int)port.as.i : 80;
-    const char* scheme_str = (scheme.type == CS_T_STR) ? cs_to_cstr(scheme) : "http";
-
-    char pathbuf[1024];
-    pathbuf[0] = 0;
-    if (path.type == CS_T_STR) snprintf(pathbuf, sizeof(pathbuf), "%s", cs_to_cstr(path));
-    else snprintf(pathbuf, sizeof(pathbuf), "/");
-    if (query.type == CS_T_STR) {
-        strncat(pathbuf, "?", sizeof(pathbuf) - strlen(pathbuf) - 1);
-        strncat(pathbuf, cs_to_cstr(query), sizeof(pathbuf) - strlen(pathbuf) - 1);
+    cs_value headers_val = cs_map_get(opts, "headers");
+    cs_value body_val = cs_map_get(opts, "body");
+    cs_value keep_val = cs_map_get(opts, "keep_alive");
+    cs_value decode_val = cs_map_get(opts, "decompress");
+    cs_value output_val = cs_map_get(opts, "output");
+    cs_value raw_val = cs_map_get(opts, "raw_head");
+    struct cs_http_pool* pool = http_pool(vm);
+
+    t->host = dup_cstr((host.type == CS_T_STR) ? cs_to_cstr(host) : "");
+    t->port = (port.type == CS_T_INT) ? (int)port.as.i : 80;
+    t->use_tls = scheme.type == CS_T_STR && strcmp(cs_to_cstr(scheme), "https") == 0;
+    t->keep_alive = pool && pool->max_per_host > 0 && !(keep_val.type == CS_T_BOOL && !keep_val.as.b);
+    t->head = strcmp(method, "HEAD") == 0;
+    t->decode = decode_val.type == CS_T_BOOL && decode_val.as.b;
+    t->raw_head = raw_val.type == CS_T_BOOL && raw_val.as.b;
+    t->on_chunk = cs_map_get(opts, "on_chunk");
+    if (t->on_chunk.type != CS_T_FUNC && t->on_chunk.type != CS_T_NATIVE) {
+        cs_value_release(t->on_chunk);
+        t->on_chunk = cs_nil();
     }
 
-    cs_value headers_val = cs_map_get(argv[0], "headers");
-    cs_value body_val = cs_map_get(argv[0], "body");
-
-    char req[4096];
-    size_t w = 0;
-    w += (size_t)snprintf(req + w, sizeof(req) - w, "%s %s HTTP/1.1\r\n", method, pathbuf);
-    w += (size_t)snprintf(req + w, sizeof(req) - w, "Host: %s\r\n", host_str);
-    w += (size_t)snprintf(req + w, sizeof(req) - w, "Connection: close\r\n");
+    int ok = t->host != NULL;
+    if (output_val.type == CS_T_STR) ok = ok && (t->output = http_output_path(vm, cs_to_cstr(output_val))) != NULL;
+    ok = ok && req_append_cstr(t, method) && req_append_cstr(t, " ");
+    ok = ok && req_append_cstr(t, path.type == CS_T_STR ? cs_to_cstr(path) : "/");
+    if (query.type == CS_T_STR) ok = ok && req_append_cstr(t, "?") && req_append_cstr(t, cs_to_cstr(query));
+    ok = ok && req_append_cstr(t, " HTTP/1.1\r\nHost: ") && req_append_cstr(t, t->host ? t->host : "");
+    ok = ok && req_append_cstr(t, t->keep_alive ? "\r\n" : "\r\nConnection: close\r\n");
     if (body_val.type == CS_T_STR) {
-        w += (size_t)snprintf(req + w, sizeof(req) - w, "Content-Length: %zu\r\n", strlen(cs_to_cstr(body_val)));
+        char line[64];
+        snprintf(line, sizeof(line), "Content-Length: %zu\r\n", strlen(cs_to_cstr(body_val)));
+        ok = ok && req_append_cstr(t, line);
     }
+    int accept_encoding = 0;
     if (headers_val.type == CS_T_MAP) {
         cs_value keys = cs_map_keys(vm, headers_val);
         if (keys.type == CS_T_LIST) {
@@ -416,155 +915,792 @@ static int nf_http_request(cs_vm* vm, void* ud, int argc, const cs_value* argv,
                 cs_value k = l->items[i];
                 cs_value v = cs_map_get(headers_val, cs_to_cstr(k));
                 if (k.type == CS_T_STR && v.type == CS_T_STR) {
-                    w += (size_t)snprintf(req + w, sizeof(req) - w, "%s: %s\r\n", cs_to_cstr(k), cs_to_cstr(v));
+                    if (strcasecmp(cs_to_cstr(k), "accept-encoding") == 0) accept_encoding = 1;
+                    ok = ok && req_append_cstr(t, cs_to_cstr(k)) && req_append_cstr(t, ": ") &&
+                         req_append_cstr(t, cs_to_cstr(v)) && req_append_cstr(t, "\r\n");
                 }
                 cs_value_release(v);
             }
         }
         cs_value_release(keys);
     }
-    w += (size_t)snprintf(req + w, sizeof(req) - w, "\r\n");
+    if (t->decode && !accept_encoding) ok = ok && req_append_cstr(t, "Accept-Encoding: gzip, deflate\r\n");
+    ok = ok && req_append_cstr(t, "\r\n");
+    if (body_val.type == CS_T_STR) ok = ok && req_append_cstr(t, cs_to_cstr(body_val));
 
-    int use_tls = (strcmp(scheme_str, "https") == 0);
-
-    cs_event_init();
-
-    cs_socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd == CS_INVALID_SOCKET) {
-        cs_error(vm, "http_request() failed to create socket");
+    cs_value_release(url_val);
+    cs_value_release(method_val);
+    cs_value_release(parts);
+    cs_value_release(scheme);
+    cs_value_release(host);
+    cs_value_release(port);
+    cs_value_release(path);
+    cs_value_release(query);
+    cs_value_release(headers_val);
+    cs_value_release(body_val);
+    cs_value_release(keep_val);
+    cs_value_release(decode_val);
+    cs_value_release(output_val);
+    cs_value_release(raw_val);
+
+    if (!ok) {
+        http_target_free(t);
+        cs_error(vm, "out of memory");
         return 1;
     }
+    return 0;
+}
 
-    struct sockaddr_in addr;
-    if (cs_resolve_host(host_str, port_num, &addr) != 0) {
-        cs_socket_close(fd);
-        cs_error(vm, "http_request() failed to resolve host");
-        return 1;
+// ---------- streamed bodies ----------
+// With opts.on_chunk or opts.output the parser hands each body chunk on as it is
+// decoded instead of collecting it, so memory stays bounded by the read and inflate
+// buffers however large the body is.
+
+typedef struct {
+    cs_vm* vm;
+    cs_value on_chunk;         // borrowed from the target
+    FILE* file;
+    const char* fail;          // why delivery stopped, with code
+    const char* code;
+} http_stream;
+
+static int http_stream_body(void* ud, const char* data, size_t len) {
+    http_stream* s = (http_stream*)ud;
+    if (s->file) {
+        if (fwrite(data, 1, len, s->file) == len) return 1;
+        s->fail = "http_request() failed writing output";
+        s->code = "HTTP_OUTPUT";
+        return 0;
+    }
+    char* copy = dup_n(data, len);
+    if (!copy) {
+        s->fail = "out of memory";
+        s->code = "HTTP_OUTPUT";
+        return 0;
+    }
+    cs_value chunk = cs_str_take(s->vm, copy, (uint64_t)len);
+    cs_value ret = cs_nil();
+    int rc = cs_call_value(s->vm, s->on_chunk, 1, &chunk, &ret);
+    cs_value_release(chunk);
+    cs_value_release(ret);
+    if (rc != 0) {
+        s->fail = cs_vm_last_error(s->vm);
+        s->code = "HTTP_CALLBACK";
+        return 0;
     }
+    return 1;
+}
 
-    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
-        cs_socket_close(fd);
-        cs_error(vm, "http_request() connect failed");
-        return 1;
+// Returns 0, or -1 if the output file can't be created
+static int http_stream_open(cs_vm* vm, const http_target* t, http_stream* s) {
+    memset(s, 0, sizeof(*s));
+    s->vm = vm;
+    s->on_chunk = t->on_chunk;
+    if (t->output && !(s->file = fopen(t->output, "wb"))) return -1;
+    return 0;
+}
+
+static void http_stream_close(http_stream* s) {
+    if (s->file) fclose(s->file);
+    s->file = NULL;
+}
+
+// Starts a response parser for t; a retried request begins again with a fresh one
+static void http_parser_start(cs_http_parser* p, cs_vm* vm, const http_target* t, http_stream* s) {
+    cs_http_parser_init(p, vm);
+    p->no_body = t->head;
+    p->decode = t->decode;
+    if (s->file || s->on_chunk.type != CS_T_NIL) {
+        p->on_body = http_stream_body;
+        p->on_body_ud = s;
     }
+}
 
-    SSL* ssl = NULL;
-#ifndef CS_NO_TLS
-    if (use_tls) {
-        if (cs_tls_init() != 0) {
-            cs_socket_close(fd);
-            cs_error(vm, "http_request() TLS init failed");
-            return 1;
-        }
-        ssl = cs_tls_new_ssl(fd, host_str);
-        if (!ssl) {
-            cs_socket_close(fd);
-            cs_error(vm, "http_request() failed to create SSL");
-            return 1;
-        }
-        if (SSL_connect(ssl) != 1) {
-            cs_tls_close(ssl);
-            cs_socket_close(fd);
-            cs_error(vm, "http_request() TLS handshake failed");
-            return 1;
-        }
-        if (cs_tls_verify_cert(ssl) != 0) {
-            cs_tls_close(ssl);
-            cs_socket_close(fd);
-            cs_error(vm, "http_request() TLS verify failed");
-            return 1;
-        }
+// Response map {status, status_text, headers or head, body}; takes the parser's body.
+// A streamed response has an empty body and size, the bytes delivered.
+static cs_value http_make_response(cs_vm* vm, cs_http_parser* p, int raw_head) {
+    cs_value resp = cs_map(vm);
+    if (!resp.as.p) return resp;
+    cs_value text = cs_str(vm, p->status_text);
+    if (p->body) p->body[p->body_len] = 0;  // nothing may have been appended
+    cs_value body = cs_str_take(vm, p->body ? p->body : dup_cstr(""), (uint64_t)p->body_len);
+    p->body = NULL;
+    p->body_len = 0;
+    cs_map_set(resp, "status", cs_int(p->status_code));
+    cs_map_set(resp, "status_text", text);
+    if (raw_head) {
+        // Header lines only, without the status line or the blank line that ends them
+        const char* eol = (const char*)memchr(p->head, '\n', p->head_len);
+        size_t off = eol ? (size_t)(eol - p->head) + 1 : p->head_len;
+        size_t n = p->head_len - off >= 2 ? p->head_len - off - 2 : 0;
+        cs_value head = str_n(vm, p->head + off, n);
+        cs_map_set(resp, "head", head);
+        cs_value_release(head);
+    } else {
+        cs_value headers = cs_http_parser_headers(p, 0);
+        cs_map_set(resp, "headers", headers);
+        cs_value_release(headers);
     }
+    cs_map_set(resp, "body", body);
+    if (p->on_body) cs_map_set(resp, "size", cs_int((int64_t)p->body_total));
+    cs_value_release(text);
+    cs_value_release(body);
+    return resp;
+}
+
+#ifdef MSG_NOSIGNAL
+#define HTTP_SEND_FLAGS MSG_NOSIGNAL
 #else
-    if (use_tls) {
-        cs_socket_close(fd);
-        cs_error(vm, "http_request() TLS disabled");
-        return 1;
-    }
+#define HTTP_SEND_FLAGS 0
 #endif
 
-    int send_ok = 0;
-    if (use_tls && ssl) send_ok = (tls_send_all(ssl, req, w) == 0);
-    else send_ok = (http_send_all(fd, req, w) == 0);
-    if (!send_ok) {
+static int http_send_all(int fd, const char* data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, data + sent, len - sent, HTTP_SEND_FLAGS);
+        if (n <= 0) return -1;
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
 #ifndef CS_NO_TLS
-        if (ssl) cs_tls_close(ssl);
-#endif
-        cs_socket_close(fd);
-        cs_error(vm, "http_request() send failed");
-        return 1;
+static int tls_send_all(SSL* ssl, const char* data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        int n = SSL_write(ssl, data + sent, (int)(len - sent));
+        if (n <= 0) return -1;
+        sent += (size_t)n;
     }
+    return 0;
+}
+#endif
 
-    if (body_val.type == CS_T_STR) {
-        const char* body = cs_to_cstr(body_val);
-        size_t body_len = strlen(body);
-        if (body_len > 0) {
-            if (use_tls && ssl) {
-                if (tls_send_all(ssl, body, body_len) != 0) {
+// Takes the most recently parked live connection for t; 1 on a hit
+static int http_pool_take(cs_vm* vm, const http_target* t, http_conn* out) {
+    struct cs_http_pool* p = vm->http_pool;
+    if (!t->keep_alive || !p) return 0;
+    http_pool_prune(p, cs_monotonic_ns());
+    http_idle** pp = &p->idle;
+    while (*pp) {
+        http_idle* e = *pp;
+        if (e->port != t->port || e->use_tls != t->use_tls || strcmp(e->host, t->host) != 0) {
+            pp = &e->next;
+            continue;
+        }
+        *pp = e->next;
+        p->idle_count--;
+        if (http_conn_alive(&e->conn)) {
+            *out = e->conn;
+            e->conn.fd = CS_INVALID_SOCKET;
 #ifndef CS_NO_TLS
-                    if (ssl) cs_tls_close(ssl);
+            e->conn.ssl = NULL;
 #endif
-                    cs_socket_close(fd);
-                    cs_error(vm, "http_request() send body failed");
-                    return 1;
-                }
-            } else {
-                if (http_send_all(fd, body, body_len) != 0) {
-                    cs_socket_close(fd);
-                    cs_error(vm, "http_request() send body failed");
-                    return 1;
-                }
-            }
+            http_idle_free(e);
+            p->hits++;
+            return 1;
         }
+        p->stale++;
+        http_idle_free(e);
     }
+    p->misses++;
+    return 0;
+}
 
-    cs_http_parser http_parser;
-    cs_http_parser_init(&http_parser, vm);
-
-    char buf[4096];
-    for (;;) {
-        int n = 0;
-        if (use_tls && ssl) {
-            n = SSL_read(ssl, buf, sizeof(buf));
-        } else {
-            n = (int)recv(fd, buf, sizeof(buf), 0);
-        }
-        if (n <= 0) break;
-        cs_http_parser_feed(&http_parser, buf, (size_t)n);
-        if (cs_http_parser_is_done(&http_parser)) break;
+// Parks c after a complete response when the connection can carry another request,
+// otherwise closes it. c is empty afterwards.
+static void http_conn_release(cs_vm* vm, const http_target* t, cs_http_parser* parser, http_conn* c) {
+    struct cs_http_pool* p = vm->http_pool;
+    int reuse = p && t->keep_alive && cs_http_parser_keep_alive(parser);
+#ifndef CS_NO_TLS
+    if (c->ssl && SSL_pending(c->ssl) > 0) reuse = 0;
+#endif
+    http_idle* e = reuse ? (http_idle*)calloc(1, sizeof(http_idle)) : NULL;
+    if (e && !(e->host = dup_cstr(t->host))) {
+        free(e);
+        e = NULL;
+    }
+    if (!e) {
+        http_conn_close(c, 1);
+        return;
     }
+    e->conn = *c;
+    e->port = t->port;
+    e->use_tls = t->use_tls;
+    e->since_ns = cs_monotonic_ns();
+    e->next = p->idle;
+    p->idle = e;
+    p->idle_count++;
+    c->fd = CS_INVALID_SOCKET;
+#ifndef CS_NO_TLS
+    c->ssl = NULL;
+#endif
+    http_pool_prune(p, e->since_ns);
+}
 
+// Opens a blocking connection for t; NULL or the error message
+static const char* http_connect(const http_target* t, http_conn* c) {
+    c->fd = CS_INVALID_SOCKET;
 #ifndef CS_NO_TLS
-    if (ssl) cs_tls_close(ssl);
+    c->ssl = NULL;
 #endif
-    cs_socket_close(fd);
+    cs_socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == CS_INVALID_SOCKET) return "http_request() failed to create socket";
 
-    cs_value resp = cs_map(vm);
-    if (resp.as.p) {
-        cs_map_set(resp, "status", cs_int(http_parser.status_code));
-        cs_map_set(resp, "status_text", cs_str(vm, http_parser.status_text));
-        cs_map_set(resp, "headers", http_parser.headers);
-        cs_map_set(resp, "body", cs_str_take(vm, http_parser.body ? http_parser.body : dup_cstr(""), (uint64_t)http_parser.body_len));
-        http_parser.body = NULL;
-        http_parser.body_len = 0;
+    struct sockaddr_in addr;
+    if (cs_resolve_host(t->host, t->port, &addr) != 0) {
+        cs_socket_close(fd);
+        return "http_request() failed to resolve host";
     }
-
-    cs_value_release(url_val);
-    cs_value_release(method_val);
-    cs_value_release(parts);
-    cs_value_release(scheme);
-    cs_value_release(host);
-    cs_value_release(port);
-    cs_value_release(path);
-    cs_value_release(query);
-    cs_value_release(headers_val);
-    cs_value_release(body_val);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        cs_socket_close(fd);
+        return "http_request() connect failed";
+    }
+    c->fd = fd;
+
+#ifndef CS_NO_TLS
+    if (t->use_tls) {
+        const char* fail = NULL;
+        if (cs_tls_init() != 0) fail = "http_request() TLS init failed";
+        else if (!(c->ssl = cs_tls_new_ssl(fd, t->host, t->port))) fail = "http_request() failed to create SSL";
+        else if (SSL_connect(c->ssl) != 1) fail = "http_request() TLS handshake failed";
+        else if (cs_tls_verify_cert(c->ssl) != 0) fail = "http_request() TLS verify failed";
+        if (fail) http_conn_close(c, 1);
+        return fail;
+    }
+#else
+    if (t->use_tls) {
+        http_conn_close(c, 0);
+        return "http_request() TLS disabled";
+    }
+#endif
+    return NULL;
+}
+
+// Sends t's request on c and reads the response; 0, or -1 if the send failed.
+// *received counts response bytes, telling a reused connection the server had
+// already closed apart from a short response.
+static int http_exchange(http_conn* c, const http_target* t, cs_http_parser* parser, size_t* received) {
+    *received = 0;
+    int send_ok;
+#ifndef CS_NO_TLS
+    if (c->ssl) send_ok = tls_send_all(c->ssl, t->req, t->req_len) == 0;
+    else
+#endif
+    send_ok = http_send_all(c->fd, t->req, t->req_len) == 0;
+    if (!send_ok) return -1;
+
+    char buf[4096];
+    for (;;) {
+        int n = 0;
+#ifndef CS_NO_TLS
+        if (c->ssl) n = SSL_read(c->ssl, buf, sizeof(buf));
+        else
+#endif
+        n = (int)recv(c->fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            cs_http_parser_finish(parser);
+            break;
+        }
+        *received += (size_t)n;
+        if (cs_http_parser_feed(parser, buf, (size_t)n) != 0) break;
+    }
+    return 0;
+}
+
+// Internal: perform HTTP request
+static int nf_http_request(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    http_target t;
+    if (http_target_init(vm, argc >= 1 ? argv[0] : cs_nil(), "http_request()", &t) != 0) return 1;
+
+    cs_event_init();
+
+    http_stream stream;
+    if (http_stream_open(vm, &t, &stream) != 0) {
+        http_target_free(&t);
+        cs_error(vm, "http_request() cannot open output file");
+        return 1;
+    }
+
+    http_conn conn;
+    cs_http_parser http_parser;
+    int reused = http_pool_take(vm, &t, &conn);
+    for (;;) {
+        if (reused) {
+            http_socket_set_blocking(conn.fd, 1);
+        } else {
+            const char* fail = http_connect(&t, &conn);
+            if (fail) {
+                http_stream_close(&stream);
+                http_target_free(&t);
+                cs_error(vm, fail);
+                return 1;
+            }
+#ifndef CS_NO_TLS
+            if (conn.ssl && SSL_session_reused(conn.ssl) && vm->http_pool) vm->http_pool->tls_resumed++;
+#endif
+        }
+        http_parser_start(&http_parser, vm, &t, &stream);
+        size_t received = 0;
+        int rc = http_exchange(&conn, &t, &http_parser, &received);
+        if (reused && (rc != 0 || received == 0)) {
+            // The server closed the parked connection: send again on a new one
+            http_conn_close(&conn, 0);
+            cs_http_parser_free(&http_parser);
+            vm->http_pool->stale++;
+            reused = 0;
+            continue;
+        }
+        if (rc != 0 || stream.fail) {
+            http_conn_close(&conn, 1);
+            cs_http_parser_free(&http_parser);
+            http_stream_close(&stream);
+            http_target_free(&t);
+            // A failed on_chunk call has already raised its error
+            if (rc != 0) cs_error(vm, "http_request() send failed");
+            else if (strcmp(stream.code, "HTTP_CALLBACK") != 0) cs_error(vm, stream.fail);
+            return 1;
+        }
+        break;
+    }
+
+    http_conn_release(vm, &t, &http_parser, &conn);
+    http_stream_close(&stream);
+
+    cs_value resp = http_make_response(vm, &http_parser, t.raw_head);
+    http_target_free(&t);
     cs_http_parser_free(&http_parser);
 
     if (out) *out = resp;
     return 0;
 }
 
+// ---------- asynchronous requests ----------
+// http_request_async runs a request as one pending operation that moves through
+// resolve, connect, TLS handshake, send and receive as its descriptor becomes ready,
+// so many requests overlap on one event loop. Host names that are not literal
+// addresses are resolved on a short-lived thread whose pipe the loop waits on like a
+// socket. The operation's deadline covers the whole request. A pooled connection
+// starts the operation at the send phase.
+
+typedef enum {
+    HTTP_ASYNC_RESOLVE,
+    HTTP_ASYNC_CONNECT,
+    HTTP_ASYNC_HANDSHAKE,
+    HTTP_ASYNC_SEND,
+    HTTP_ASYNC_RECV
+} http_async_phase;
+
+#ifndef _WIN32
+// Shared by the loop and the resolver thread; whichever lets go last frees it
+typedef struct {
+    int refs;
+    int result;                // 0 while running, then 1 resolved / -1 failed
+    struct sockaddr_in addr;
+    char* host;
+    int port;
+    int wr;                    // closed by the thread when done: the read end sees EOF
+} http_resolver;
+
+static void http_resolver_release(http_resolver* r) {
+    if (__atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    free(r->host);
+    free(r);
+}
+
+static void* http_resolver_main(void* arg) {
+    http_resolver* r = (http_resolver*)arg;
+    int ok = cs_resolve_host(r->host, r->port, &r->addr) == 0;
+    __atomic_store_n(&r->result, ok ? 1 : -1, __ATOMIC_RELEASE);
+    close(r->wr);
+    http_resolver_release(r);
+    return NULL;
+}
+#endif
+
+typedef struct {
+    http_async_phase phase;
+    http_target target;
+    cs_socket_t fd;
+#ifndef _WIN32
+    http_resolver* resolver;
+    int resolve_rd;
+#endif
+#ifndef CS_NO_TLS
+    SSL* ssl;
+#endif
+    size_t sent;
+    size_t received;
+    int reused;                // came from the pool; peer is its address
+    struct sockaddr_in peer;
+    http_stream stream;
+    cs_http_parser parser;
+} http_async;
+
+static void http_async_free(void* state) {
+    http_async* h = (http_async*)state;
+#ifndef _WIN32
+    if (h->resolver) http_resolver_release(h->resolver);
+    if (h->resolve_rd >= 0) close(h->resolve_rd);
+#endif
+#ifndef CS_NO_TLS
+    if (h->ssl) cs_tls_close(h->ssl);
+#endif
+    if (h->fd != CS_INVALID_SOCKET) cs_socket_close(h->fd);
+    cs_http_parser_free(&h->parser);
+    http_stream_close(&h->stream);
+    http_target_free(&h->target);
+    free(h);
+}
+
+static void http_reject(cs_vm* vm, cs_value promise, const char* msg, const char* code) {
+    cs_value err = cs_map(vm);
+    cs_value m = cs_str(vm, msg);
+    cs_value c = cs_str(vm, code);
+    cs_map_set(err, "msg", m);
+    cs_map_set(err, "code", c);
+    cs_promise_reject(vm, promise, err);
+    cs_value_release(m);
+    cs_value_release(c);
+    cs_value_release(err);
+}
+
+static int http_async_fail(cs_vm* vm, cs_pending_io* io, const char* msg, const char* code) {
+    http_reject(vm, io->promise, msg, code);
+    return 1;
+}
+
+static int socket_would_block(void) {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static const char* http_async_connect(http_async* h, const struct sockaddr_in* addr);
+
+// The server closed a reused connection before answering: send the request again
+// on a new connection to the same address
+static int http_async_retry(cs_vm* vm, cs_pending_io* io, http_async* h) {
+    http_conn old;
+    old.fd = h->fd;
+#ifndef CS_NO_TLS
+    old.ssl = h->ssl;
+    h->ssl = NULL;
+#endif
+    h->reused = 0;
+    h->sent = 0;
+    h->received = 0;
+    cs_http_parser_free(&h->parser);
+    http_parser_start(&h->parser, vm, &h->target, &h->stream);
+    if (vm->http_pool) vm->http_pool->stale++;
+    const char* err = http_async_connect(h, &h->peer);
+    if (err) {
+        http_conn_close(&old, 0);
+        return http_async_fail(vm, io, err, "NET_CONNECT");
+    }
+    io->events = CS_POLL_WRITE;
+    cs_pending_io_move(vm, io, h->fd);
+    http_conn_close(&old, 0);
+    return 0;
+}
+
+// Starts a nonblocking connect on h->fd; NULL or the error message
+static const char* http_async_connect(http_async* h, const struct sockaddr_in* addr) {
+    h->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (h->fd == CS_INVALID_SOCKET) return "http_request() failed to create socket";
+    cs_socket_set_nonblocking(h->fd);
+    if (connect(h->fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0) {
+#ifdef _WIN32
+        if (WSAGetLastError() != WSAEWOULDBLOCK) return "http_request() connect failed";
+#else
+        if (errno != EINPROGRESS) return cs_socket_error_str(errno);
+#endif
+    }
+    h->phase = HTTP_ASYNC_CONNECT;
+    return NULL;
+}
+
+static int http_async_ready(cs_vm* vm, cs_pending_io* io) {
+    http_async* h = (http_async*)io->state;
+    for (;;) {
+        switch (h->phase) {
+#ifndef _WIN32
+            case HTTP_ASYNC_RESOLVE: {
+                char c;
+                if (read(h->resolve_rd, &c, 1) < 0 && socket_would_block()) return 0;
+                int result = __atomic_load_n(&h->resolver->result, __ATOMIC_ACQUIRE);
+                if (result == 0) return 0;  // not the thread's EOF yet
+                struct sockaddr_in addr = h->resolver->addr;
+                http_resolver_release(h->resolver);
+                h->resolver = NULL;
+                if (result < 0) return http_async_fail(vm, io, "http_request() failed to resolve host", "NET_RESOLVE");
+                const char* err = http_async_connect(h, &addr);
+                if (err) return http_async_fail(vm, io, err, "NET_CONNECT");
+                io->events = CS_POLL_WRITE;
+                cs_pending_io_move(vm, io, h->fd);
+                close(h->resolve_rd);
+                h->resolve_rd = -1;
+                return 0;
+            }
+#else
+            case HTTP_ASYNC_RESOLVE:
+                return http_async_fail(vm, io, "http_request() failed to resolve host", "NET_RESOLVE");
+#endif
+            case HTTP_ASYNC_CONNECT: {
+                int err = cs_socket_get_error(h->fd);
+                if (err != 0) return http_async_fail(vm, io, cs_socket_error_str(err), "NET_CONNECT");
+                h->phase = h->target.use_tls ? HTTP_ASYNC_HANDSHAKE : HTTP_ASYNC_SEND;
+                break;
+            }
+            case HTTP_ASYNC_HANDSHAKE: {
+#ifndef CS_NO_TLS
+                if (!h->ssl && !(h->ssl = cs_tls_new_ssl(h->fd, h->target.host, h->target.port))) {
+                    return http_async_fail(vm, io, "TLS init failed", "TLS_INIT");
+                }
+                int ret = SSL_connect(h->ssl);
+                if (ret != 1) {
+                    int err = SSL_get_error(h->ssl, ret);
+                    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                        io->events = err == SSL_ERROR_WANT_READ ? CS_POLL_READ : CS_POLL_WRITE;
+                        return 0;
+                    }
+                    return http_async_fail(vm, io, "TLS handshake failed", "TLS_HANDSHAKE");
+                }
+                if (cs_tls_verify_cert(h->ssl) != 0) {
+                    return http_async_fail(vm, io, "certificate verification failed", "TLS_CERT");
+                }
+                if (SSL_session_reused(h->ssl) && vm->http_pool) vm->http_pool->tls_resumed++;
+                h->phase = HTTP_ASYNC_SEND;
+                break;
+#else
+                return http_async_fail(vm, io, "TLS disabled", "HTTP_NO_TLS");
+#endif
+            }
+            case HTTP_ASYNC_SEND: {
+                while (h->sent < h->target.req_len) {
+                    const char* data = h->target.req + h->sent;
+                    size_t left = h->target.req_len - h->sent;
+                    ssize_t n;
+#ifndef CS_NO_TLS
+                    if (h->ssl) {
+                        n = SSL_write(h->ssl, data, (int)left);
+                        if (n <= 0) {
+                            int err = SSL_get_error(h->ssl, (int)n);
+                            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                                io->events = err == SSL_ERROR_WANT_READ ? CS_POLL_READ : CS_POLL_WRITE;
+                                return 0;
+                            }
+                            if (h->reused) return http_async_retry(vm, io, h);
+                            return http_async_fail(vm, io, "TLS write failed", "TLS_WRITE");
+                        }
+                    } else
+#endif
+                    {
+                        n = send(h->fd, data, left, HTTP_SEND_FLAGS);
+                        if (n < 0) {
+                            if (socket_would_block()) {
+                                io->events = CS_POLL_WRITE;
+                                return 0;
+                            }
+                            if (h->reused) return http_async_retry(vm, io, h);
+                            return http_async_fail(vm, io, "http_request() send failed", "NET_SEND");
+                        }
+                    }
+                    h->sent += (size_t)n;
+                }
+                h->phase = HTTP_ASYNC_RECV;
+                io->events = CS_POLL_READ;
+                break;
+            }
+            case HTTP_ASYNC_RECV: {
+                char buf[16384];
+                for (;;) {
+                    ssize_t n;
+                    int eof = 0;
+#ifndef CS_NO_TLS
+                    if (h->ssl) {
+                        n = SSL_read(h->ssl, buf, (int)sizeof(buf));
+                        if (n <= 0) {
+                            int err = SSL_get_error(h->ssl, (int)n);
+                            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                                io->events = err == SSL_ERROR_WANT_READ ? CS_POLL_READ : CS_POLL_WRITE;
+                                return 0;
+                            }
+                            eof = 1;  // close_notify, or the peer just closed
+                        }
+                    } else
+#endif
+                    {
+                        n = recv(h->fd, buf, sizeof(buf), 0);
+                        if (n < 0) {
+                            if (socket_would_block()) return 0;
+                            if (h->reused && h->received == 0) return http_async_retry(vm, io, h);
+                            return http_async_fail(vm, io, "http_request() recv failed", "NET_RECV");
+                        }
+                        eof = n == 0;
+                    }
+                    if (eof) {
+                        if (h->reused && h->received == 0) return http_async_retry(vm, io, h);
+                        // Like http_request: a response cut short keeps what arrived
+                        cs_http_parser_finish(&h->parser);
+                        if (h->parser.status_code == 0) {
+                            return http_async_fail(vm, io, "connection closed before a response", "NET_CLOSED");
+                        }
+                        break;
+                    }
+                    h->received += (size_t)n;
+                    int done = cs_http_parser_feed(&h->parser, buf, (size_t)n);
+                    if (done < 0 && h->stream.fail) return http_async_fail(vm, io, h->stream.fail, h->stream.code);
+                    if (done < 0) return http_async_fail(vm, io, "malformed HTTP response", "HTTP_PARSE");
+                    if (done) break;
+                }
+                http_conn conn;
+                conn.fd = h->fd;
+#ifndef CS_NO_TLS
+                conn.ssl = h->ssl;
+                h->ssl = NULL;
+#endif
+                h->fd = CS_INVALID_SOCKET;
+                http_conn_release(vm, &h->target, &h->parser, &conn);
+                cs_value resp = http_make_response(vm, &h->parser, h->target.raw_head);
+                cs_promise_resolve(vm, io->promise, resp);
+                cs_value_release(resp);
+                return 1;
+            }
+        }
+    }
+}
+
+// Native function: http_request_async(opts) -> promise<response>
+// opts is the http_request map; opts.timeout (ms) overrides net_set_default_timeout.
+static int nf_http_request_async(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    cs_value opts = argc >= 1 ? argv[0] : cs_nil();
+    http_async* h = (http_async*)calloc(1, sizeof(http_async));
+    if (!h) {
+        cs_error(vm, "out of memory");
+        return 1;
+    }
+    if (http_target_init(vm, opts, "http_request_async()", &h->target) != 0) {
+        free(h);
+        return 1;
+    }
+    h->fd = CS_INVALID_SOCKET;
+#ifndef _WIN32
+    h->resolve_rd = -1;
+#endif
+    int stream_ok = http_stream_open(vm, &h->target, &h->stream) == 0;
+    http_parser_start(&h->parser, vm, &h->target, &h->stream);
+
+    cs_value timeout_val = cs_map_get(opts, "timeout");
+    uint64_t timeout_ms = (timeout_val.type == CS_T_INT && timeout_val.as.i > 0) ? (uint64_t)timeout_val.as.i : 0;
+    cs_value_release(timeout_val);
+
+    cs_event_init();
+    cs_value promise = cs_promise_new(vm);
+    const char* fail = NULL;
+    const char* code = "NET_CONNECT";
+    int events = CS_POLL_WRITE;
+    cs_socket_t wait_fd = CS_INVALID_SOCKET;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)h->target.port);
+    http_conn conn;
+    if (!stream_ok) {
+        fail = "http_request() cannot open output file";
+        code = "HTTP_OUTPUT";
+    } else if (http_pool_take(vm, &h->target, &conn)) {
+        socklen_t peer_len = sizeof(h->peer);
+        getpeername(conn.fd, (struct sockaddr*)&h->peer, &peer_len);
+        h->fd = conn.fd;
+#ifndef CS_NO_TLS
+        h->ssl = conn.ssl;
+#endif
+        h->reused = 1;
+        h->phase = HTTP_ASYNC_SEND;
+        http_socket_set_blocking(h->fd, 0);
+        wait_fd = h->fd;
+    } else
+#ifndef CS_NO_TLS
+    if (h->target.use_tls && cs_tls_init() != 0) {
+        fail = "TLS init failed";
+        code = "TLS_INIT";
+    } else
+#else
+    if (h->target.use_tls) {
+        fail = "TLS disabled";
+        code = "HTTP_NO_TLS";
+    } else
+#endif
+    if (inet_pton(AF_INET, h->target.host, &addr.sin_addr) == 1) {
+        fail = http_async_connect(h, &addr);
+        wait_fd = h->fd;
+    } else {
+#ifndef _WIN32
+        int fds[2];
+        http_resolver* r = (http_resolver*)calloc(1, sizeof(http_resolver));
+        if (r && pipe(fds) == 0) {
+            fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            r->refs = 2;
+            r->host = dup_cstr(h->target.host);
+            r->port = h->target.port;
+            r->wr = fds[1];
+            pthread_t tid;
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            if (r->host && pthread_create(&tid, &attr, http_resolver_main, r) == 0) {
+                h->resolver = r;
+                h->resolve_rd = fds[0];
+                h->phase = HTTP_ASYNC_RESOLVE;
+                wait_fd = fds[0];
+                events = CS_POLL_READ;
+                r = NULL;
+            } else {
+                close(fds[0]);
+                close(fds[1]);
+            }
+            pthread_attr_destroy(&attr);
+        }
+        if (r) {
+            free(r->host);
+            free(r);
+        }
+        if (wait_fd == CS_INVALID_SOCKET) {
+            fail = "http_request() failed to start resolver";
+            code = "NET_RESOLVE";
+        }
+#else
+        if (cs_resolve_host(h->target.host, h->target.port, &addr) != 0) {
+            fail = "http_request() failed to resolve host";
+            code = "NET_RESOLVE";
+        } else {
+            fail = http_async_connect(h, &addr);
+            wait_fd = h->fd;
+        }
+#endif
+    }
+
+    if (!fail && cs_add_pending_op(vm, wait_fd, events, promise, h, http_async_ready, http_async_free, timeout_ms) != 0) {
+        h = NULL;  // released by cs_add_pending_op
+        fail = "out of memory";
+    }
+    if (fail) {
+        if (h) http_async_free(h);
+        http_reject(vm, promise, fail, code);
+    }
+    if (out) *out = promise;
+    else cs_value_release(promise);
+    return 0;
+}
+
 static int nf_http_get(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (argc < 1 || argv[0].type != CS_T_STR) {
@@ -608,6 +1744,1013 @@ static int nf_http_delete(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
     return ret;
 }
 
+// Native function: http_get_async(url) -> promise<response>
+static int nf_http_get_async(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    if (argc < 1 || argv[0].type != CS_T_STR) {
+        cs_error(vm, "http_get_async() requires url string");
+        return 1;
+    }
+    cs_value opts = cs_map(vm);
+    cs_map_set(opts, "url", argv[0]);
+    int ret = nf_http_request_async(vm, ud, 1, &opts, out);
+    cs_value_release(opts);
+    return ret;
+}
+
+// Native function: http_post_async(url, body?) -> promise<response>
+static int nf_http_post_async(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    if (argc < 1 || argv[0].type != CS_T_STR) {
+        cs_error(vm, "http_post_async() requires url string");
+        return 1;
+    }
+    cs_value opts = cs_map(vm);
+    cs_value method = cs_str(vm, "POST");
+    cs_map_set(opts, "url", argv[0]);
+    cs_map_set(opts, "method", method);
+    cs_value_release(method);
+    if (argc >= 2 && argv[1].type == CS_T_STR) cs_map_set(opts, "body", argv[1]);
+    int ret = nf_http_request_async(vm, ud, 1, &opts, out);
+    cs_value_release(opts);
+    return ret;
+}
+
+// Native function: http_pool_config({max_per_host?, idle_timeout?}) -> nil
+// idle_timeout is in ms; max_per_host 0 stops pooling and closes idle connections.
+static int nf_http_pool_config(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc < 1 || argv[0].type != CS_T_MAP) {
+        cs_error(vm, "http_pool_config() requires options map");
+        return 1;
+    }
+    struct cs_http_pool* p = http_pool(vm);
+    if (!p) {
+        cs_error(vm, "out of memory");
+        return 1;
+    }
+    cs_value max_val = cs_map_get(argv[0], "max_per_host");
+    cs_value idle_val = cs_map_get(argv[0], "idle_timeout");
+    if (max_val.type == CS_T_INT) {
+        int64_t n = max_val.as.i;
+        p->max_per_host = n < 0 ? 0 : (n > 1024 ? 1024 : (int)n);
+    }
+    if (idle_val.type == CS_T_INT) {
+        int64_t ms = idle_val.as.i;
+        p->idle_timeout_ns = (uint64_t)(ms < 0 ? 0 : ms) * 1000000ull;
+    }
+    cs_value_release(max_val);
+    cs_value_release(idle_val);
+    http_pool_prune(p, cs_monotonic_ns());
+    if (out) *out = cs_nil();
+    return 0;
+}
+
+// Native function: http_pool_stats() -> {hits, misses, stale, idle, tls_resumed}
+static int nf_http_pool_stats(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud; (void)argc; (void)argv;
+    if (!out) return 0;
+    struct cs_http_pool* p = vm->http_pool;
+    cs_value stats = cs_map(vm);
+    if (stats.type != CS_T_MAP) {
+        *out = cs_nil();
+        return 0;
+    }
+    cs_map_set(stats, "hits", cs_int(p ? (int64_t)p->hits : 0));
+    cs_map_set(stats, "misses", cs_int(p ? (int64_t)p->misses : 0));
+    cs_map_set(stats, "stale", cs_int(p ? (int64_t)p->stale : 0));
+    cs_map_set(stats, "idle", cs_int(p ? p->idle_count : 0));
+    cs_map_set(stats, "tls_resumed", cs_int(p ? (int64_t)p->tls_resumed : 0));
+    *out = stats;
+    return 0;
+}
+
+// ---------- server ----------
+// http_serve(port, handler, opts) accepts connections and reads requests as pending
+// operations on the event loop. Complete requests, including several pipelined in one
+// read, queue on the server. The native itself takes them in order, calls the handler
+// and writes the response, and waits on the loop while the queue is empty, so handlers
+// run as ordinary script code and never from inside the poller. A handler that returns
+// a pending promise parks its request until the promise settles; other connections
+// are served meanwhile, and later requests on the same connection wait behind it so
+// responses leave in request order. A connection stops reading while
+// HTTP_SERVE_PIPELINE of its requests wait, or while a response can't be sent.
+
+#define HTTP_SERVE_MAX_HEAD 16384
+#define HTTP_SERVE_MAX_BODY (1024 * 1024)
+#define HTTP_SERVE_IDLE_TIMEOUT_MS 10000
+#define HTTP_SERVE_PIPELINE 32
+
+typedef struct cs_http_server http_server;
+
+typedef struct http_sconn {
+    struct http_sconn* prev;
+    struct http_sconn* next;
+    http_server* srv;
+    cs_socket_t fd;
+    int refs;                  // its read or write operation and each queued request
+    int reading;               // a read operation is queued
+    int writing;               // a write operation is queued; never both
+    int closing;               // the client sends nothing more: answer what is queued
+    int last_sent;             // a response that closes the connection was written
+    int dead;                  // nothing more is read or written
+    int queued;                // requests not yet answered
+    int busy;                  // one of its requests is parked
+    struct http_sreq* held;    // requests queued behind the parked one
+    struct http_sreq* held_tail;
+    cs_http_parser parser;
+    char* out;                 // responses not yet sent
+    size_t out_len;
+    size_t out_cap;
+    size_t out_sent;
+} http_sconn;
+
+typedef struct http_sreq {
+    struct http_sreq* next;
+    http_sconn* conn;
+    cs_value req;
+    cs_value promise;          // parked: the handler's result, still pending
+    int status;                // an error to answer without calling the handler
+    int head;                  // HEAD: the response has no body
+    int keep_alive;
+    int http_minor;
+} http_sreq;
+
+struct cs_http_server {
+    int refs;                  // http_serve, the accept operation and each connection
+    cs_vm* vm;
+    cs_socket_t fd;
+    int port;
+    int stopping;
+    cs_value handler;
+    cs_value wake;             // promise http_serve waits on while the queue is empty
+    http_sconn* conns;
+    http_sreq* queue;
+    http_sreq* queue_tail;
+    http_sreq* parked;         // requests whose handler is still awaiting
+    int writers;               // connections with a write operation queued
+    size_t max_head;
+    size_t max_body;
+    uint64_t idle_timeout_ms;
+    int build_headers;         // opts.headers false: requests carry the raw head instead
+    int64_t max_requests;
+    int64_t requests;
+    int64_t connections;
+    int64_t rejected;
+    time_t date_at;
+    char date[40];
+    struct cs_http_server* outer;  // the http_serve this one runs inside
+};
+
+static void http_server_release(void* state) {
+    http_server* s = (http_server*)state;
+    if (--s->refs > 0) return;
+    cs_value_release(s->handler);
+    cs_value_release(s->wake);
+    free(s);
+}
+
+static void http_server_signal(cs_vm* vm, http_server* s) {
+    if (s->wake.type == CS_T_PROMISE && cs_promise_is_pending(s->wake)) cs_promise_resolve(vm, s->wake, cs_nil());
+}
+
+static void http_sconn_release(http_sconn* c) {
+    if (--c->refs > 0) return;
+    http_server* s = c->srv;
+    if (c->prev) c->prev->next = c->next;
+    else s->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    cs_socket_close(c->fd);
+    cs_http_parser_free(&c->parser);
+    free(c->out);
+    free(c);
+    http_server_release(s);
+}
+
+// An operation ended. Its handler clears reading/writing first, so a flag still set
+// means it timed out or the VM dropped it.
+static void http_sconn_op_free(void* state) {
+    http_sconn* c = (http_sconn*)state;
+    if (c->reading || c->writing) {
+        if (c->writing) c->srv->writers--;
+        c->reading = c->writing = 0;
+        c->dead = 1;
+        http_server_signal(c->srv->vm, c->srv);
+    }
+    http_sconn_release(c);
+}
+
+static void http_sconn_parser_start(http_sconn* c) {
+    cs_http_parser_init(&c->parser, c->srv->vm);
+    c->parser.is_request = 1;
+    c->parser.max_head = c->srv->max_head;
+}
+
+static int http_sconn_read(cs_vm* vm, cs_pending_io* io);
+static int http_sconn_write(cs_vm* vm, cs_pending_io* io);
+static int out_append(http_sconn* c, const char* s, size_t n);
+
+// Queues the connection's read (CS_POLL_READ) or write operation
+static void http_sconn_start(cs_vm* vm, http_sconn* c, int events) {
+    int reading = events == CS_POLL_READ;
+    c->refs++;
+    if (reading) c->reading = 1;
+    else {
+        c->writing = 1;
+        c->srv->writers++;
+    }
+    cs_value promise = cs_promise_new(vm);
+    cs_add_pending_op(vm, c->fd, events, promise, c, reading ? http_sconn_read : http_sconn_write,
+                      http_sconn_op_free, c->srv->idle_timeout_ms);
+    cs_value_release(promise);
+}
+
+// From http_serve, not an operation's handler: ends the connection's operation now
+static void http_sconn_kill(cs_vm* vm, http_sconn* c) {
+    c->dead = 1;
+    if (!c->reading && !c->writing) return;
+    if (c->writing) c->srv->writers--;
+    c->reading = c->writing = 0;
+    cs_remove_pending_io(vm, c->fd);
+}
+
+// Everything written: close, or read the next requests. 1 if the connection is done.
+static int http_sconn_drained(http_sconn* c) {
+    c->out_len = c->out_sent = 0;
+    return c->last_sent || (c->closing && c->queued == 0);
+}
+
+static int http_sconn_resumable(const http_sconn* c) {
+    return !c->dead && !c->reading && !c->writing && !c->closing && !c->last_sent &&
+           !c->srv->stopping && c->queued < HTTP_SERVE_PIPELINE;
+}
+
+static void http_sconn_flush(cs_vm* vm, http_sconn* c) {
+    while (!c->dead && c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, HTTP_SEND_FLAGS);
+        if (n < 0 && socket_would_block()) {
+            // The client isn't reading: stop taking its requests until it catches up
+            if (c->reading) {
+                c->reading = 0;
+                cs_remove_pending_io(vm, c->fd);
+            }
+            if (!c->writing) http_sconn_start(vm, c, CS_POLL_WRITE);
+            return;
+        }
+        if (n <= 0) {
+            http_sconn_kill(vm, c);
+            return;
+        }
+        c->out_sent += (size_t)n;
+    }
+    if (c->dead) return;
+    if (http_sconn_drained(c)) http_sconn_kill(vm, c);
+    else if (http_sconn_resumable(c)) http_sconn_start(vm, c, CS_POLL_READ);
+}
+
+static int http_sconn_write(cs_vm* vm, cs_pending_io* io) {
+    http_sconn* c = (http_sconn*)io->state;
+    while (!c->dead && c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, HTTP_SEND_FLAGS);
+        if (n < 0 && socket_would_block()) return 0;
+        if (n <= 0) {
+            c->dead = 1;
+            break;
+        }
+        c->out_sent += (size_t)n;
+        cs_pending_io_touch(vm, io);
+    }
+    c->writing = 0;
+    c->srv->writers--;
+    if (!c->dead && http_sconn_drained(c)) c->dead = 1;
+    if (http_sconn_resumable(c)) http_sconn_start(vm, c, CS_POLL_READ);
+    http_server_signal(vm, c->srv);
+    cs_promise_resolve(vm, io->promise, cs_nil());
+    return 1;
+}
+
+static void map_set_str_n(cs_vm* vm, cs_value map, const char* key, const char* s, size_t n) {
+    char* copy = dup_n(s, n);
+    if (!copy) return;
+    cs_value v = cs_str_take(vm, copy, (uint64_t)n);
+    cs_map_set(map, key, v);
+    cs_value_release(v);
+}
+
+// Steps through the header lines of a request head (after the request line)
+static int head_next_header(const char** cur, const char* end, const char** name, size_t* name_len,
+                            const char** val, size_t* val_len) {
+    while (*cur < end) {
+        const char* line = *cur;
+        const char* eol = (const char*)memchr(line, '\r', (size_t)(end - line));
+        if (!eol) eol = end;
+        *cur = eol + 2 <= end ? eol + 2 : end;
+        const char* colon = (const char*)memchr(line, ':', (size_t)(eol - line));
+        if (!colon) continue;
+        const char* ne = colon;
+        while (ne > line && (ne[-1] == ' ' || ne[-1] == '\t')) ne--;
+        const char* v = colon + 1;
+        const char* ve = eol;
+        while (v < ve && (*v == ' ' || *v == '\t')) v++;
+        while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t')) ve--;
+        *name = line;
+        *name_len = (size_t)(ne - line);
+        *val = v;
+        *val_len = (size_t)(ve - v);
+        return 1;
+    }
+    return 0;
+}
+
+// Request map {method, target, path, query, version, headers or head, body}; takes the
+// parser's body
+static cs_value http_request_map(cs_vm* vm, cs_http_parser* p, int build_headers) {
+    cs_value req = cs_map(vm);
+    if (!req.as.p) return req;
+    const char* target = p->head + p->target_off;
+    const char* q = (const char*)memchr(target, '?', p->target_len);
+    size_t path_len = q ? (size_t)(q - target) : p->target_len;
+    const char* line_end = strstr(p->head, "\r\n");
+    size_t head_off = line_end ? (size_t)(line_end - p->head) + 2 : p->head_len;
+    size_t head_len = p->head_len - head_off;
+    if (head_len >= 2) head_len -= 2;  // the blank line
+
+    map_set_str_n(vm, req, "method", p->head, p->method_len);
+    map_set_str_n(vm, req, "target", target, p->target_len);
+    map_set_str_n(vm, req, "path", target, path_len);
+    map_set_str_n(vm, req, "query", q ? q + 1 : "", q ? p->target_len - path_len - 1 : 0);
+    map_set_str_n(vm, req, "version", p->http_minor >= 1 ? "HTTP/1.1" : "HTTP/1.0", 8);
+    if (build_headers) {
+        cs_value headers = cs_http_parser_headers(p, 1);
+        cs_map_set(req, "headers", headers);
+        cs_value_release(headers);
+    } else {
+        map_set_str_n(vm, req, "head", p->head + head_off, head_len);
+    }
+    if (p->body) p->body[p->body_len] = 0;
+    cs_value body = cs_str_take(vm, p->body ? p->body : dup_cstr(""), (uint64_t)p->body_len);
+    p->body = NULL;
+    p->body_len = 0;
+    cs_map_set(req, "body", body);
+    cs_value_release(body);
+    return req;
+}
+
+// Queues the request the parser holds, or an error response when status is set
+static void http_server_push(cs_vm* vm, http_sconn* c, int status) {
+    http_server* s = c->srv;
+    http_sreq* r = (http_sreq*)calloc(1, sizeof(http_sreq));
+    if (!r) {
+        c->closing = 1;
+        return;
+    }
+    r->conn = c;
+    r->status = status;
+    r->http_minor = 1;
+    if (!status) {
+        cs_http_parser* p = &c->parser;
+        r->req = http_request_map(vm, p, s->build_headers);
+        r->head = p->method_len == 4 && memcmp(p->head, "HEAD", 4) == 0;
+        r->keep_alive = cs_http_parser_keep_alive(p);
+        r->http_minor = p->http_minor;
+    }
+    c->refs++;
+    c->queued++;
+    if (s->queue_tail) s->queue_tail->next = r;
+    else s->queue = r;
+    s->queue_tail = r;
+    http_server_signal(vm, s);
+}
+
+static void http_sreq_free(http_sreq* r) {
+    cs_value_release(r->req);
+    cs_value_release(r->promise);
+    http_sconn_release(r->conn);
+    free(r);
+}
+
+// Parses what arrived; each complete request is queued for the handler
+static void http_sconn_feed(cs_vm* vm, http_sconn* c, const char* data, size_t len) {
+    http_server* s = c->srv;
+    while (!c->closing) {
+        cs_http_parser* p = &c->parser;
+        int done = cs_http_parser_feed(p, data, len);
+        int status = 0;
+        if (done < 0) status = p->head_too_large ? 431 : 400;
+        else if (p->body_len > s->max_body || (p->has_content_length && p->content_length > s->max_body)) status = 413;
+        if (status) {
+            http_server_push(vm, c, status);
+            c->closing = 1;
+            return;
+        }
+        if (!done) {
+            if (p->expect_continue && p->state == HTTP_PARSE_BODY && c->queued == 0 && c->out_len == 0) {
+                // What doesn't fit now leads the output, which is empty, so it still
+                // goes out before the response
+                static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                ssize_t n = send(c->fd, cont, sizeof(cont) - 1, HTTP_SEND_FLAGS);
+                if (n < 0 && socket_would_block()) n = 0;
+                if (n < 0 || ((size_t)n < sizeof(cont) - 1 && !out_append(c, cont + n, sizeof(cont) - 1 - (size_t)n))) {
+                    c->closing = 1;
+                    c->dead = 1;
+                    return;
+                }
+            }
+            p->expect_continue = 0;
+            return;
+        }
+        size_t used = len - p->excess;
+        http_server_push(vm, c, 0);
+        if (!cs_http_parser_keep_alive(p)) c->closing = 1;
+        cs_http_parser_free(p);
+        http_sconn_parser_start(c);
+        data += used;
+        len -= used;
+        if (len == 0) return;
+    }
+}
+
+static int http_sconn_read(cs_vm* vm, cs_pending_io* io) {
+    http_sconn* c = (http_sconn*)io->state;
+    char buf[16384];
+    while (!c->dead && !c->closing && !c->srv->stopping && c->queued < HTTP_SERVE_PIPELINE) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n < 0 && socket_would_block()) return 0;
+        if (n <= 0) {
+            // The client is done sending: answer what it sent, unless it is gone
+            c->closing = 1;
+            if (n < 0) c->dead = 1;
+            break;
+        }
+        cs_pending_io_touch(vm, io);
+        http_sconn_feed(vm, c, buf, (size_t)n);
+    }
+    c->reading = 0;
+    if (c->closing && c->queued == 0) c->dead = 1;
+    cs_promise_resolve(vm, io->promise, cs_nil());
+    return 1;
+}
+
+static int http_server_accept(cs_vm* vm, cs_pending_io* io) {
+    http_server* s = (http_server*)io->state;
+    while (!s->stopping) {
+        cs_socket_t fd = accept(s->fd, NULL, NULL);
+        if (fd == CS_INVALID_SOCKET) break;  // none left, or out of descriptors until one closes
+        http_sconn* c = (http_sconn*)calloc(1, sizeof(http_sconn));
+        if (!c) {
+            cs_socket_close(fd);
+            continue;
+        }
+        int one = 1;
+        cs_socket_set_nonblocking(fd);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+        c->fd = fd;
+        c->srv = s;
+        s->refs++;
+        http_sconn_parser_start(c);
+        c->next = s->conns;
+        if (s->conns) s->conns->prev = c;
+        s->conns = c;
+        s->connections++;
+        http_sconn_start(vm, c, CS_POLL_READ);
+    }
+    return 0;  // removed by http_serve when it stops
+}
+
+static const char* http_reason(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 413: return "Content Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "";
+    }
+}
+
+static const char* http_server_date(http_server* s) {
+    time_t now = time(NULL);
+    if (now != s->date_at || !s->date[0]) {
+        struct tm tm;
+#ifdef _WIN32
+        gmtime_s(&tm, &now);
+#else
+        gmtime_r(&now, &tm);
+#endif
+        strftime(s->date, sizeof(s->date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        s->date_at = now;
+    }
+    return s->date;
+}
+
+static int out_append(http_sconn* c, const char* s, size_t n) {
+    if (!ensure_buf(&c->out, &c->out_cap, c->out_len + n + 1)) return 0;
+    memcpy(c->out + c->out_len, s, n);
+    c->out_len += n;
+    return 1;
+}
+
+static int out_append_cstr(http_sconn* c, const char* s) {
+    return out_append(c, s, strlen(s));
+}
+
+static int has_crlf(const char* s) {
+    return strchr(s, '\r') != NULL || strchr(s, '\n') != NULL;
+}
+
+// Appends the response to the connection's output; 1 after raising a script error.
+// ret is what the handler returned: a body string, {status, headers, body} or nil.
+static int http_server_render(cs_vm* vm, http_sconn* c, const http_sreq* r, cs_value ret) {
+    http_server* s = c->srv;
+    int status = r->status ? r->status : 200;
+    const char* body = "";
+    size_t body_len = 0;
+    cs_value headers = cs_nil();
+    cs_value body_val = cs_nil();
+    const char* fail = NULL;
+
+    if (r->status) {
+        body = http_reason(r->status);
+        body_len = strlen(body);
+    } else if (ret.type == CS_T_STR) {
+        body_val = cs_value_copy(ret);
+    } else if (ret.type == CS_T_MAP) {
+        cs_value status_val = cs_map_get(ret, "status");
+        headers = cs_map_get(ret, "headers");
+        body_val = cs_map_get(ret, "body");
+        if (status_val.type == CS_T_INT) status = (int)status_val.as.i;
+        else if (status_val.type != CS_T_NIL) fail = "http_serve() response status must be an integer";
+        cs_value_release(status_val);
+        if (status < 200 || status > 599) fail = "http_serve() response status must be 200-599";
+        if (body_val.type != CS_T_STR && body_val.type != CS_T_NIL) fail = "http_serve() response body must be a string";
+        if (headers.type != CS_T_MAP && headers.type != CS_T_NIL) fail = "http_serve() response headers must be a map";
+    } else if (ret.type == CS_T_NIL) {
+        status = 204;
+    } else {
+        fail = "http_serve() handler must return a string, a response map or nil";
+    }
+    if (body_val.type == CS_T_STR) {
+        body = cs_to_cstr(body_val);
+        body_len = ((cs_string*)body_val.as.p)->len;
+    }
+
+    int close_conn = !r->keep_alive || s->stopping;
+    int no_body = status == 204 || status == 304;
+    int content_type = 0;
+    char line[128];
+    size_t mark = c->out_len;
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\nDate: %s\r\n", status, http_reason(status), http_server_date(s));
+    int ok = out_append_cstr(c, line);
+    if (!fail && headers.type == CS_T_MAP) {
+        cs_value keys = cs_map_keys(vm, headers);
+        cs_list_obj* l = keys.type == CS_T_LIST ? (cs_list_obj*)keys.as.p : NULL;
+        for (size_t i = 0; l && i < l->len && !fail; i++) {
+            cs_value k = l->items[i];
+            if (k.type != CS_T_STR) continue;
+            const char* name = cs_to_cstr(k);
+            cs_value v = cs_map_get(headers, name);
+            cs_value vs = v.type == CS_T_STR ? cs_value_copy(v) : cs_nil();
+            if (v.type == CS_T_INT) {
+                char num[32];
+                snprintf(num, sizeof(num), "%lld", (long long)v.as.i);
+                vs = cs_str(vm, num);
+            }
+            if (vs.type != CS_T_STR) fail = "http_serve() header values must be strings or integers";
+            else if (has_crlf(name) || has_crlf(cs_to_cstr(vs))) fail = "http_serve() header names and values cannot contain CR or LF";
+            else if (strcasecmp(name, "connection") == 0) {
+                if (header_has_token(cs_to_cstr(vs), ((cs_string*)vs.as.p)->len, "close")) close_conn = 1;
+            } else if (strcasecmp(name, "content-length") != 0 && strcasecmp(name, "transfer-encoding") != 0) {
+                if (strcasecmp(name, "content-type") == 0) content_type = 1;
+                ok = ok && out_append_cstr(c, name) && out_append(c, ": ", 2) &&
+                     out_append_cstr(c, cs_to_cstr(vs)) && out_append(c, "\r\n", 2);
+            }
+            cs_value_release(vs);
+            cs_value_release(v);
+        }
+        cs_value_release(keys);
+    }
+    if (!fail) {
+        if (!content_type && body_len > 0 && !no_body) ok = ok && out_append_cstr(c, "Content-Type: text/plain; charset=utf-8\r\n");
+        if (!no_body) {
+            snprintf(line, sizeof(line), "Content-Length: %zu\r\n", body_len);
+            ok = ok && out_append_cstr(c, line);
+        }
+        if (close_conn) ok = ok && out_append_cstr(c, "Connection: close\r\n");
+        else if (r->http_minor == 0) ok = ok && out_append_cstr(c, "Connection: keep-alive\r\n");
+        ok = ok && out_append(c, "\r\n", 2);
+        if (!no_body && !r->head) ok = ok && out_append(c, body, body_len);
+        if (!ok) fail = "out of memory";
+    }
+    cs_value_release(headers);
+    cs_value_release(body_val);
+    if (fail) {
+        c->out_len = mark;
+        cs_error(vm, fail);
+        return 1;
+    }
+    if (close_conn) c->last_sent = 1;
+    return 0;
+}
+
+// Appends the response for a settled handler promise; 1 after raising its rejection
+static int http_server_render_settled(cs_vm* vm, http_sconn* c, const http_sreq* r, cs_value promise) {
+    int ok = 1;
+    cs_value ret = cs_wait_promise(vm, promise, &ok);  // settled: returns at once
+    int rc = !ok ? 1 : c->dead || c->last_sent ? 0 : http_server_render(vm, c, r, ret);
+    cs_value_release(ret);
+    return rc;
+}
+
+// Runs the handler for r, or answers an error, then appends the response. Sets *parked
+// instead when the handler's promise is still pending; r->promise then holds it.
+static int http_server_answer(cs_vm* vm, http_server* s, http_sreq* r, int* parked) {
+    http_sconn* c = r->conn;
+    if (c->dead || c->last_sent) return 0;  // nobody to answer
+    cs_value ret = cs_nil();
+    if (r->status) {
+        s->rejected++;
+    } else {
+        s->requests++;
+        if (cs_call_value(vm, s->handler, 1, &r->req, &ret) != 0) return 1;
+        if (s->max_requests > 0 && s->requests >= s->max_requests) s->stopping = 1;
+        if (ret.type == CS_T_PROMISE) {
+            if (cs_promise_is_pending(ret)) {
+                r->promise = ret;
+                *parked = 1;
+                return 0;
+            }
+            int rc = http_server_render_settled(vm, c, r, ret);
+            cs_value_release(ret);
+            return rc;
+        }
+    }
+    int rc = c->dead ? 0 : http_server_render(vm, c, r, ret);
+    cs_value_release(ret);
+    return rc;
+}
+
+// Sends what a connection has ready unless its next queued request can join it:
+// pipelined responses for one connection go out together
+static void http_server_flush(cs_vm* vm, http_server* s, http_sconn* c) {
+    if (!s->queue || s->queue->conn != c) http_sconn_flush(vm, c);
+}
+
+// Answers the parked requests whose promise settled. The requests held behind one
+// go back to the front of the queue, still in order.
+static int http_server_settle(cs_vm* vm, http_server* s) {
+    http_sreq** link = &s->parked;
+    while (*link) {
+        http_sreq* r = *link;
+        if (cs_promise_is_pending(r->promise)) {
+            link = &r->next;
+            continue;
+        }
+        *link = r->next;
+        http_sconn* c = r->conn;
+        c->busy = 0;
+        c->queued--;
+        if (c->held) {
+            c->held_tail->next = s->queue;
+            if (!s->queue) s->queue_tail = c->held_tail;
+            s->queue = c->held;
+            c->held = c->held_tail = NULL;
+        }
+        int rc = http_server_render_settled(vm, c, r, r->promise);
+        if (rc == 0) http_server_flush(vm, s, c);
+        http_sreq_free(r);
+        if (rc != 0) return 1;
+    }
+    return 0;
+}
+
+// Waits for a new request, a parked handler to settle, a write to finish or a stop
+static int http_server_wait(cs_vm* vm, http_server* s) {
+    s->wake = cs_promise_new(vm);
+    for (http_sreq* r = s->parked; r; r = r->next) cs_promise_notify(vm, r->promise, s->wake);
+    int ok = 1;
+    cs_value settled = cs_wait_promise(vm, s->wake, &ok);
+    cs_value_release(settled);
+    cs_value_release(s->wake);
+    s->wake = cs_nil();
+    return ok ? 0 : 1;
+}
+
+static int http_server_run(cs_vm* vm, http_server* s) {
+    while (!s->stopping) {
+        if (http_server_settle(vm, s) != 0) return 1;
+        http_sreq* r = s->queue;
+        if (!r || s->stopping) {
+            if (!s->stopping && http_server_wait(vm, s) != 0) return 1;
+            continue;
+        }
+        s->queue = r->next;
+        if (!s->queue) s->queue_tail = NULL;
+        r->next = NULL;
+        http_sconn* c = r->conn;
+        if (c->busy) {
+            if (c->held_tail) c->held_tail->next = r;
+            else c->held = r;
+            c->held_tail = r;
+            continue;
+        }
+        int parked = 0;
+        int rc = http_server_answer(vm, s, r, &parked);
+        if (parked) {
+            c->busy = 1;
+            r->next = s->parked;
+            s->parked = r;
+            continue;
+        }
+        c->queued--;
+        if (rc == 0) http_server_flush(vm, s, c);
+        http_sreq_free(r);
+        if (rc != 0) return 1;
+    }
+    // Let parked handlers finish and responses still being written go out before the
+    // connections close
+    for (;;) {
+        if (http_server_settle(vm, s) != 0) return 1;
+        if (!s->parked && s->writers == 0) return 0;
+        if (http_server_wait(vm, s) != 0) return 1;
+    }
+}
+
+static void http_server_close(cs_vm* vm, http_server* s) {
+    if (s->fd != CS_INVALID_SOCKET) {
+        cs_remove_pending_io(vm, s->fd);
+        cs_socket_close(s->fd);
+        s->fd = CS_INVALID_SOCKET;
+    }
+    while (s->queue) {
+        http_sreq* r = s->queue;
+        s->queue = r->next;
+        r->conn->queued--;
+        http_sreq_free(r);
+    }
+    s->queue_tail = NULL;
+    while (s->parked) {
+        http_sreq* r = s->parked;
+        s->parked = r->next;
+        r->conn->busy = 0;
+        r->conn->queued--;
+        http_sreq_free(r);
+    }
+    http_sconn* c = s->conns;
+    while (c) {
+        c->refs++;
+        while (c->held) {
+            http_sreq* r = c->held;
+            c->held = r->next;
+            c->queued--;
+            http_sreq_free(r);
+        }
+        c->held_tail = NULL;
+        http_sconn_kill(vm, c);
+        http_sconn* next = c->next;
+        http_sconn_release(c);
+        c = next;
+    }
+}
+
+static int opt_int(cs_value opts, const char* key, int64_t dflt) {
+    cs_value v = cs_map_get(opts, key);
+    int64_t n = v.type == CS_T_INT ? v.as.i : dflt;
+    cs_value_release(v);
+    return (int)(n < 0 ? 0 : (n > 0x7fffffff ? 0x7fffffff : n));
+}
+
+// Native function: http_serve(port, handler, opts?) -> {port, requests, connections, rejected}
+// Serves until http_serve_stop() or opts.max_requests; port 0 picks a free port, passed
+// to opts.on_listen. Other opts: host, max_head, max_body, idle_timeout (ms), headers.
+static int nf_http_serve(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc < 2 || argv[0].type != CS_T_INT || (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE)) {
+        cs_error(vm, "http_serve() requires port and handler function");
+        return 1;
+    }
+    if (argv[0].as.i < 0 || argv[0].as.i > 65535) {
+        cs_error(vm, "http_serve() port must be 0-65535");
+        return 1;
+    }
+    cs_value opts = argc >= 3 ? argv[2] : cs_nil();
+    if (opts.type != CS_T_MAP && opts.type != CS_T_NIL) {
+        cs_error(vm, "http_serve() options must be a map");
+        return 1;
+    }
+    cs_value host_val = cs_map_get(opts, "host");
+    cs_value headers_val = cs_map_get(opts, "headers");
+    cs_value on_listen = cs_map_get(opts, "on_listen");
+    const char* host = host_val.type == CS_T_STR ? cs_to_cstr(host_val) : "127.0.0.1";
+    const char* fail = NULL;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)argv[0].as.i);
+    if (strcmp(host, "0.0.0.0") == 0 || host[0] == 0) addr.sin_addr.s_addr = INADDR_ANY;
+    else if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) fail = "http_serve() invalid host";
+
+    http_server* s = fail ? NULL : (http_server*)calloc(1, sizeof(http_server));
+    if (!fail && !s) fail = "out of memory";
+    if (s) {
+        s->refs = 1;
+        s->vm = vm;
+        s->handler = cs_value_copy(argv[1]);
+        s->wake = cs_nil();
+        s->max_head = (size_t)opt_int(opts, "max_head", HTTP_SERVE_MAX_HEAD);
+        s->max_body = (size_t)opt_int(opts, "max_body", HTTP_SERVE_MAX_BODY);
+        s->idle_timeout_ms = (uint64_t)opt_int(opts, "idle_timeout", HTTP_SERVE_IDLE_TIMEOUT_MS);
+        s->max_requests = opt_int(opts, "max_requests", 0);
+        s->build_headers = !(headers_val.type == CS_T_BOOL && !headers_val.as.b);
+        cs_event_init();
+        s->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (s->fd == CS_INVALID_SOCKET) fail = "http_serve() failed to create socket";
+    }
+    if (!fail) {
+        int one = 1;
+        setsockopt(s->fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+        cs_socket_set_nonblocking(s->fd);
+        socklen_t len = sizeof(addr);
+        if (bind(s->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) fail = "http_serve() bind failed";
+        else if (listen(s->fd, 511) != 0) fail = "http_serve() listen failed";
+        else if (getsockname(s->fd, (struct sockaddr*)&addr, &len) == 0) s->port = ntohs(addr.sin_port);
+    }
+    if (!fail) {
+        cs_value promise = cs_promise_new(vm);
+        s->refs++;
+        if (cs_add_pending_op(vm, s->fd, CS_POLL_READ, promise, s, http_server_accept, http_server_release,
+                              CS_IO_NO_DEADLINE) != 0) {
+            fail = "out of memory";
+        }
+        cs_value_release(promise);
+    }
+    cs_value_release(host_val);
+    cs_value_release(headers_val);
+    if (fail) {
+        cs_value_release(on_listen);
+        if (s) {
+            if (s->fd != CS_INVALID_SOCKET) cs_socket_close(s->fd);
+            s->fd = CS_INVALID_SOCKET;
+            http_server_release(s);
+        }
+        cs_error(vm, fail);
+        return 1;
+    }
+
+    s->outer = vm->http_server;
+    vm->http_server = s;
+    int rc = 0;
+    if (on_listen.type == CS_T_FUNC || on_listen.type == CS_T_NATIVE) {
+        cs_value port = cs_int(s->port);
+        cs_value ret = cs_nil();
+        rc = cs_call_value(vm, on_listen, 1, &port, &ret);
+        cs_value_release(ret);
+    }
+    cs_value_release(on_listen);
+    if (rc == 0) rc = http_server_run(vm, s);
+    vm->http_server = s->outer;
+    http_server_close(vm, s);
+
+    if (rc == 0 && out) {
+        cs_value stats = cs_map(vm);
+        cs_map_set(stats, "port", cs_int(s->port));
+        cs_map_set(stats, "requests", cs_int(s->requests));
+        cs_map_set(stats, "connections", cs_int(s->connections));
+        cs_map_set(stats, "rejected", cs_int(s->rejected));
+        *out = stats;
+    }
+    http_server_release(s);
+    return rc ? 1 : 0;
+}
+
+// Native function: http_serve_stop() -> bool
+// Stops the innermost running http_serve once the request in hand is answered.
+static int nf_http_serve_stop(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud; (void)argc; (void)argv;
+    http_server* s = vm->http_server;
+    if (s) {
+        s->stopping = 1;
+        http_server_signal(vm, s);
+    }
+    if (out) *out = cs_bool(s != NULL);
+    return 0;
+}
+
+// Native function: http_header(msg, name) -> string or nil
+// Case-insensitive lookup in a request or response: its headers map, or the raw head
+// of a request served with opts.headers false or a response fetched with opts.raw_head.
+static int nf_http_header(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc < 2 || argv[0].type != CS_T_MAP || argv[1].type != CS_T_STR) {
+        cs_error(vm, "http_header() requires a request or response map and a header name");
+        return 1;
+    }
+    if (!out) return 0;
+    *out = cs_nil();
+    const char* want = cs_to_cstr(argv[1]);
+    size_t want_len = ((cs_string*)argv[1].as.p)->len;
+    cs_value headers = cs_map_get(argv[0], "headers");
+    if (headers.type == CS_T_MAP) {
+        cs_value v = cs_map_get(headers, want);
+        if (v.type == CS_T_NIL) {
+            cs_value keys = cs_map_keys(vm, headers);
+            cs_list_obj* l = keys.type == CS_T_LIST ? (cs_list_obj*)keys.as.p : NULL;
+            for (size_t i = 0; l && i < l->len; i++) {
+                if (l->items[i].type == CS_T_STR && strcasecmp(cs_to_cstr(l->items[i]), want) == 0) {
+                    v = cs_map_get(headers, cs_to_cstr(l->items[i]));
+                    break;
+                }
+            }
+            cs_value_release(keys);
+        }
+        *out = v;
+    } else {
+        cs_value head = cs_map_get(argv[0], "head");
+        if (head.type == CS_T_STR) {
+            const char* cur = cs_to_cstr(head);
+            const char* end = cur + ((cs_string*)head.as.p)->len;
+            const char* name;
+            const char* val;
+            size_t name_len, val_len;
+            while (head_next_header(&cur, end, &name, &name_len, &val, &val_len)) {
+                if (name_len == want_len && strncasecmp(name, want, want_len) == 0) {
+                    char* copy = dup_n(val, val_len);
+                    if (copy) *out = cs_str_take(vm, copy, (uint64_t)val_len);
+                    break;
+                }
+            }
+        }
+        cs_value_release(head);
+    }
+    cs_value_release(headers);
+    return 0;
+}
+
+// Native function: http_parse(data, opts?) -> map, or nil while data is incomplete
+// Parses one response, or a request with opts.request, from the start of data. opts:
+// headers (false: the raw head instead of a map), max_head. used is the bytes taken.
+static int nf_http_parse(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc < 1 || argv[0].type != CS_T_STR || (argc >= 2 && argv[1].type != CS_T_MAP && argv[1].type != CS_T_NIL)) {
+        cs_error(vm, "http_parse() requires a string and an optional options map");
+        return 1;
+    }
+    cs_value opts = argc >= 2 ? argv[1] : cs_nil();
+    cs_value request_val = opts.type == CS_T_MAP ? cs_map_get(opts, "request") : cs_nil();
+    cs_value headers_val = opts.type == CS_T_MAP ? cs_map_get(opts, "headers") : cs_nil();
+    int is_request = request_val.type == CS_T_BOOL && request_val.as.b;
+    int build_headers = !(headers_val.type == CS_T_BOOL && !headers_val.as.b);
+    cs_value_release(request_val);
+    cs_value_release(headers_val);
+
+    cs_http_parser p;
+    cs_http_parser_init(&p, vm);
+    p.is_request = is_request;
+    p.max_head = (size_t)opt_int(opts, "max_head", 0);
+    size_t len = ((cs_string*)argv[0].as.p)->len;
+    int rc = cs_http_parser_feed(&p, cs_to_cstr(argv[0]), len);
+    if (rc < 0) {
+        int too_large = p.head_too_large;
+        cs_http_parser_free(&p);
+        cs_error(vm, too_large ? "http_parse(): head exceeds max_head" : "http_parse(): malformed message");
+        return 1;
+    }
+    // A response body with no length runs to the end of data
+    if (rc == 0 && !is_request) rc = cs_http_parser_finish(&p);
+    if (out) *out = cs_nil();
+    if (rc == 1 && out) {
+        *out = is_request ? http_request_map(vm, &p, build_headers) : http_make_response(vm, &p, !build_headers);
+        cs_map_set(*out, "used", cs_int((int64_t)(len - p.excess)));
+    }
+    cs_http_parser_free(&p);
+    return 0;
+}
+
 // Native functions
 static int nf_url_parse(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
@@ -636,4 +2779,13 @@ void cs_register_http_stdlib(cs_vm* vm) {
     cs_register_native(vm, "http_post", nf_http_post, NULL);
     cs_register_native(vm, "http_delete", nf_http_delete, NULL);
     cs_register_native(vm, "http_request", nf_http_request, NULL);
+    cs_register_native(vm, "http_get_async", nf_http_get_async, NULL);
+    cs_register_native(vm, "http_post_async", nf_http_post_async, NULL);
+    cs_register_native(vm, "http_request_async", nf_http_request_async, NULL);
+    cs_register_native(vm, "http_pool_config", nf_http_pool_config, NULL);
+    cs_register_native(vm, "http_pool_stats", nf_http_pool_stats, NULL);
+    cs_register_native(vm, "http_serve", nf_http_serve, NULL);
+    cs_register_native(vm, "http_serve_stop", nf_http_serve_stop, NULL);
+    cs_register_native(vm, "http_header", nf_http_header, NULL);
+    cs_register_native(vm, "http_parse", nf_http_parse, NULL);
 }
@@ -3,7 +3,7 @@
 
 #include "cupidscript.h"
 
-// HTTP response parser state
+// HTTP message parser state (responses, or requests with is_request)
 typedef enum {
     HTTP_PARSE_STATUS_LINE,
     HTTP_PARSE_HEADERS,
@@ -12,20 +12,66 @@ typedef enum {
     HTTP_PARSE_ERROR
 } cs_http_parse_state;
 
+typedef enum {
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_DATA_END,      // CRLF after the data
+    HTTP_CHUNK_TRAILER        // trailer lines up to a blank one
+} cs_http_chunk_phase;
+
+// Takes body bytes, already decoded, as they arrive; returns 0 to fail the parse
+typedef int (*cs_http_body_fn)(void* ud, const char* data, size_t len);
+
+// One header of a parsed head: offsets into head, the value without surrounding whitespace
+typedef struct {
+    size_t name_off;
+    size_t name_len;
+    size_t value_off;
+    size_t value_len;
+} cs_http_header_ref;
+
 typedef struct {
     cs_http_parse_state state;
     cs_vm* vm;
     int status_code;
+    int http_minor;           // 1 for HTTP/1.1
     char status_text[64];
-    cs_value headers;
     char* body;
     size_t body_len;
     size_t body_cap;
     size_t content_length;
+    int has_content_length;
+    int has_transfer_encoding;
     int chunked;
     size_t chunk_remaining;
-    int in_chunk;
-    char* line_buf;
+    cs_http_chunk_phase chunk_phase;
+    int until_close;          // no length given: the body ends when the server closes
+    int no_body;              // set before feeding for responses to HEAD
+    int conn_close;           // Connection: close
+    int conn_keep_alive;      // Connection: keep-alive (HTTP/1.0)
+    size_t excess;            // bytes of the last feed past the end of the response
+    int decode;               // set before feeding: inflate gzip/deflate Content-Encoding
+    int encoded;              // the body is gzip/deflate encoded
+    void* inflater;           // z_stream while decoding
+    cs_http_body_fn on_body;  // set before feeding to stream the body instead of buffering it
+    void* on_body_ud;
+    size_t body_total;        // body bytes delivered, after decoding
+    int is_request;           // set before feeding: parse a request (http_serve)
+    char* head;               // start line and header lines, each ending in CRLF
+    size_t head_len;
+    size_t head_cap;
+    size_t line_off;          // start of the line being read within head
+    int pending_cr;           // the last feed ended on the CR of a line end
+    cs_http_header_ref* refs; // headers in the order received; strings are built on demand
+    size_t ref_count;
+    size_t ref_cap;
+    size_t max_head;          // longest head accepted, 0 for no limit
+    int head_too_large;       // the parse failed on max_head
+    size_t method_len;        // the method starts the head
+    size_t target_off;        // request target within head
+    size_t target_len;
+    int expect_continue;      // Expect: 100-continue
+    char* line_buf;           // chunk size and trailer lines
     size_t line_len;
     size_t line_cap;
 } cs_http_parser;
@@ -33,8 +79,17 @@ typedef struct {
 // Parser functions
 void cs_http_parser_init(cs_http_parser* p, cs_vm* vm);
 void cs_http_parser_free(cs_http_parser* p);
+// 1 once the message is complete, 0 while more input is needed, -1 if malformed.
+// Bytes past its end are left unconsumed (excess): a pipelined request may follow.
 int cs_http_parser_feed(cs_http_parser* p, const char* data, size_t len);
+// At end of input: completes a body delimited by the close; 1 if the response is whole
+int cs_http_parser_finish(cs_http_parser* p);
 int cs_http_parser_is_done(cs_http_parser* p);
+// Whether the connection can carry another request after this message
+int cs_http_parser_keep_alive(cs_http_parser* p);
+// Header map of the parsed head. Names are kept as sent (a repeat replaces the earlier
+// value), or with lower set, lower-cased with repeated values joined by ", ".
+cs_value cs_http_parser_headers(cs_http_parser* p, int lower);
 
 // URL parsing
 cs_value cs_url_parse(cs_vm* vm, const char* url);
@@ -43,4 +98,7 @@ cs_value cs_url_build(cs_vm* vm, cs_value parts);
 // Register HTTP stdlib functions
 void cs_register_http_stdlib(cs_vm* vm);
 
+// Close the VM's idle keep-alive connections (cs_vm_free)
+void cs_http_pool_free(cs_vm* vm);
+
 #endif
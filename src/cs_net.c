@@ -44,35 +44,212 @@ int cs_resolve_host(const char* host, int port, struct sockaddr_in* addr) {
     return 0;
 }
 
-cs_value cs_make_socket_map(cs_vm* vm, cs_socket_t fd, const char* type, const char* host, int port) {
-    cs_value sock = cs_map(vm);
-    if (!sock.as.p) return cs_nil();
+// ---------- socket table ----------
+// Script values carry a handle rather than the descriptor: a closed socket's handle
+// never matches a later socket, even when the descriptor number is reused.
+
+struct cs_socket_table {
+    cs_socket** slots;
+    uint32_t* free_slots;     // stack of empty slot indexes
+    uint32_t free_count;
+    uint32_t cap;
+    uint32_t seq;
+};
+
+static void socket_shut(cs_socket* s) {
+#ifndef CS_NO_TLS
+    if (s->ssl) {
+        cs_tls_close((SSL*)s->ssl);
+        s->ssl = NULL;
+    }
+#endif
+    if (s->fd != CS_INVALID_SOCKET) {
+        cs_socket_close(s->fd);
+        s->fd = CS_INVALID_SOCKET;
+    }
+}
+
+void cs_socket_incref(cs_socket* s) {
+    s->ref++;
+}
+
+void cs_socket_decref(cs_socket* s) {
+    if (--s->ref > 0) return;
+    socket_shut(s);
+    free(s->host);
+    free(s);
+}
 
-    cs_map_set(sock, "_fd", cs_int((int64_t)fd));
+static int socket_table_add(cs_vm* vm, cs_socket* s) {
+    struct cs_socket_table* t = vm->sockets;
+    if (!t) {
+        t = (struct cs_socket_table*)calloc(1, sizeof(*t));
+        if (!t) return -1;
+        vm->sockets = t;
+    }
+    if (t->free_count == 0) {
+        uint32_t cap = t->cap ? t->cap * 2 : 16;
+        cs_socket** slots = (cs_socket**)realloc(t->slots, cap * sizeof(*slots));
+        if (!slots) return -1;
+        t->slots = slots;
+        uint32_t* free_slots = (uint32_t*)realloc(t->free_slots, cap * sizeof(*free_slots));
+        if (!free_slots) return -1;
+        t->free_slots = free_slots;
+        for (uint32_t i = cap; i > t->cap; i--) {
+            t->slots[i - 1] = NULL;
+            t->free_slots[t->free_count++] = i - 1;
+        }
+        t->cap = cap;
+    }
+    uint32_t slot = t->free_slots[--t->free_count];
+    t->seq = (t->seq + 1) & 0x7fffffff;
+    s->handle = ((int64_t)t->seq << 32) | slot;
+    t->slots[slot] = s;
+    return 0;
+}
+
+cs_value cs_make_socket_map(cs_vm* vm, cs_socket_t fd, const char* type, const char* host, int port, cs_socket** out) {
+    cs_socket* s = (cs_socket*)calloc(1, sizeof(cs_socket));
+    if (!s) {
+        cs_socket_close(fd);
+        return cs_nil();
+    }
+    s->ref = 1;
+    s->fd = fd;
+    s->host = host ? strdup(host) : NULL;
+    s->port = port;
+    if (socket_table_add(vm, s) != 0) {
+        cs_socket_decref(s);
+        return cs_nil();
+    }
+
+    cs_value sock = cs_map(vm);
+    if (!sock.as.p) {
+        cs_socket_discard(vm, s);
+        return cs_nil();
+    }
+    cs_map_set(sock, "_sock", cs_int(s->handle));
     cs_map_set(sock, "_type", cs_str(vm, type));
     if (host) cs_map_set(sock, "host", cs_str(vm, host));
     if (port > 0) cs_map_set(sock, "port", cs_int(port));
+    if (out) *out = s;
     return sock;
 }
 
-cs_socket_t cs_socket_map_fd(cs_value sock) {
-    if (sock.type != CS_T_MAP) return CS_INVALID_SOCKET;
-    cs_value fd_val = cs_map_get(sock, "_fd");
-    if (fd_val.type != CS_T_INT) {
-        cs_value_release(fd_val);
-        return CS_INVALID_SOCKET;
+cs_socket* cs_socket_from_value(cs_vm* vm, cs_value sock) {
+    struct cs_socket_table* t = vm->sockets;
+    if (!t || sock.type != CS_T_MAP) return NULL;
+    cs_value handle_val = cs_map_get(sock, "_sock");
+    int64_t handle = handle_val.type == CS_T_INT ? handle_val.as.i : -1;
+    cs_value_release(handle_val);
+    if (handle < 0) return NULL;
+    uint32_t slot = (uint32_t)(handle & 0xffffffff);
+    if (slot >= t->cap || !t->slots[slot] || t->slots[slot]->handle != handle) return NULL;
+    return t->slots[slot];
+}
+
+void cs_socket_discard(cs_vm* vm, cs_socket* s) {
+    socket_shut(s);
+    struct cs_socket_table* t = vm->sockets;
+    uint32_t slot = (uint32_t)(s->handle & 0xffffffff);
+    if (!t || slot >= t->cap || t->slots[slot] != s) return;
+    t->slots[slot] = NULL;
+    t->free_slots[t->free_count++] = slot;
+    cs_socket_decref(s);
+}
+
+void cs_net_free_sockets(cs_vm* vm) {
+    struct cs_socket_table* t = vm->sockets;
+    if (!t) return;
+    for (uint32_t i = 0; i < t->cap; i++) {
+        if (!t->slots[i]) continue;
+        socket_shut(t->slots[i]);
+        cs_socket_decref(t->slots[i]);
+    }
+    free(t->slots);
+    free(t->free_slots);
+    free(t);
+    vm->sockets = NULL;
+}
+
+ssize_t cs_socket_send(cs_socket* s, const char* data, size_t len, int* wait) {
+    ssize_t sent;
+    *wait = 0;
+#ifndef CS_NO_TLS
+    if (s->ssl) {
+        SSL* ssl = (SSL*)s->ssl;
+        sent = SSL_write(ssl, data, (int)len);
+        if (sent <= 0) {
+            int err = SSL_get_error(ssl, (int)sent);
+            if (err == SSL_ERROR_WANT_READ) *wait = CS_POLL_READ;
+            else if (err == SSL_ERROR_WANT_WRITE) *wait = CS_POLL_WRITE;
+            return -1;
+        }
+        s->sends++;
+        s->bytes_sent += (uint64_t)sent;
+        return sent;
+    }
+#endif
+    sent = send(s->fd, data, len, 0);
+    if (sent >= 0) {
+        s->sends++;
+        s->bytes_sent += (uint64_t)sent;
+        return sent;
     }
-    cs_socket_t fd = (cs_socket_t)fd_val.as.i;
-    cs_value_release(fd_val);
-    return fd;
+#ifdef _WIN32
+    if (WSAGetLastError() == WSAEWOULDBLOCK) *wait = CS_POLL_WRITE;
+#else
+    if (errno == EAGAIN || errno == EWOULDBLOCK) *wait = CS_POLL_WRITE;
+#endif
+    return -1;
 }
 
-static cs_value make_op_context(cs_vm* vm, const char* op, cs_value sock) {
-    cs_value ctx = cs_map(vm);
-    if (!ctx.as.p) return cs_nil();
-    cs_map_set(ctx, "_op", cs_str(vm, op));
-    cs_map_set(ctx, "sock", sock);
-    return ctx;
+ssize_t cs_socket_recv(cs_socket* s, char* buf, size_t max, int* wait) {
+    ssize_t received;
+    *wait = 0;
+#ifndef CS_NO_TLS
+    if (s->ssl) {
+        SSL* ssl = (SSL*)s->ssl;
+        received = SSL_read(ssl, buf, (int)max);
+        if (received <= 0) {
+            int err = SSL_get_error(ssl, (int)received);
+            if (err == SSL_ERROR_WANT_READ) *wait = CS_POLL_READ;
+            else if (err == SSL_ERROR_WANT_WRITE) *wait = CS_POLL_WRITE;
+            return -1;
+        }
+        s->recvs++;
+        s->bytes_received += (uint64_t)received;
+        return received;
+    }
+#endif
+    received = recv(s->fd, buf, max, 0);
+    if (received >= 0) {
+        s->recvs++;
+        s->bytes_received += (uint64_t)received;
+        return received;
+    }
+#ifdef _WIN32
+    if (WSAGetLastError() == WSAEWOULDBLOCK) *wait = CS_POLL_READ;
+#else
+    if (errno == EAGAIN || errno == EWOULDBLOCK) *wait = CS_POLL_READ;
+#endif
+    return -1;
+}
+
+// Looks up argv[0] for a socket_* native; NULL with the error set
+static cs_socket* socket_arg(cs_vm* vm, const char* fname, int argc, const cs_value* argv) {
+    char buf[128];
+    if (argc < 1 || argv[0].type != CS_T_MAP) {
+        snprintf(buf, sizeof(buf), "%s() first argument must be a socket", fname);
+        cs_error(vm, buf);
+        return NULL;
+    }
+    cs_socket* s = cs_socket_from_value(vm, argv[0]);
+    if (!s) {
+        snprintf(buf, sizeof(buf), "%s() invalid socket", fname);
+        cs_error(vm, buf);
+    }
+    return s;
 }
 
 // Native function: tcp_connect(host, port) -> promise<socket>
@@ -128,7 +305,7 @@ static int nf_tcp_connect(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
 
     int ret = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
     if (ret == 0) {
-        if (out) *out = cs_make_socket_map(vm, fd, "tcp", host, port);
+        if (out) *out = cs_make_socket_map(vm, fd, "tcp", host, port, NULL);
         return 0;
     }
 
@@ -138,11 +315,14 @@ static int nf_tcp_connect(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
 #else
     if (errno == EINPROGRESS) {
 #endif
+        cs_socket* s = NULL;
+        cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port, &s);
+        if (!s) {
+            cs_error(vm, "tcp_connect() out of memory");
+            return 1;
+        }
         cs_value promise = cs_promise_new(vm);
-        cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port);
-        cs_value ctx = make_op_context(vm, "connect", sock);
-        cs_add_pending_io(vm, fd, CS_POLL_WRITE, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, s, CS_SOCK_CONNECT, CS_POLL_WRITE, promise, sock, 0, NULL);
         cs_value_release(sock);
         if (out) *out = promise;
         return 0;
@@ -173,83 +353,39 @@ static int nf_socket_send(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
         cs_error(vm, "socket_send() requires 2 arguments (sock, data)");
         return 1;
     }
-    if (argv[0].type != CS_T_MAP) {
-        cs_error(vm, "socket_send() first argument must be a socket");
-        return 1;
-    }
+    cs_socket* s = socket_arg(vm, "socket_send", argc, argv);
+    if (!s) return 1;
     if (argv[1].type != CS_T_STR) {
         cs_error(vm, "socket_send() data must be a string");
         return 1;
     }
 
-    cs_socket_t fd = cs_socket_map_fd(argv[0]);
-    if (fd == CS_INVALID_SOCKET) {
-        cs_error(vm, "socket_send() invalid socket");
-        return 1;
-    }
-
-    const char* data = cs_to_cstr(argv[1]);
-    size_t len = strlen(data);
-
-    ssize_t sent = -1;
-#ifndef CS_NO_TLS
-    cs_value tls_val = cs_map_get(argv[0], "_tls");
-    if (tls_val.type == CS_T_INT && tls_val.as.i != 0) {
-        SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
-        sent = SSL_write(ssl, data, (int)len);
-        if (sent <= 0) {
-            int err = SSL_get_error(ssl, (int)sent);
-            cs_value_release(tls_val);
-            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
-                cs_value promise = cs_promise_new(vm);
-                cs_value ctx = make_op_context(vm, "send", argv[0]);
-                cs_map_set(ctx, "data", argv[1]);
-                int events = (err == SSL_ERROR_WANT_READ) ? CS_POLL_READ : CS_POLL_WRITE;
-                cs_add_pending_io(vm, fd, events, promise, ctx, 0);
-                cs_value_release(ctx);
-                if (out) *out = promise;
-                return 0;
-            }
-            cs_error(vm, "socket_send() TLS write failed");
-            return 1;
-        }
-        cs_value_release(tls_val);
-    } else {
-        cs_value_release(tls_val);
-        sent = send(fd, data, len, 0);
-    }
-#else
-    sent = send(fd, data, len, 0);
-#endif
-
+    const cs_string* data = (const cs_string*)argv[1].as.p;  // strings may hold binary data
+    int wait = 0;
+    ssize_t sent = cs_socket_send(s, data->data, data->len, &wait);
     if (sent >= 0) {
         if (out) *out = cs_int(sent);
         return 0;
     }
-
-#ifdef _WIN32
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK) {
-#else
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-#endif
+    if (wait) {
         cs_value promise = cs_promise_new(vm);
-        cs_value ctx = make_op_context(vm, "send", argv[0]);
-        cs_map_set(ctx, "data", argv[1]);
-        cs_add_pending_io(vm, fd, CS_POLL_WRITE, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, s, CS_SOCK_SEND, wait, promise, argv[1], 0, NULL);
         if (out) *out = promise;
         return 0;
     }
+    if (s->ssl) {
+        cs_error(vm, "socket_send() TLS write failed");
+        return 1;
+    }
 
-        {
+    {
     #ifdef _WIN32
         int err2 = WSAGetLastError();
     #else
         int err2 = errno;
     #endif
         net_errorf(vm, "socket_send() failed", cs_socket_error_str(err2));
-        }
+    }
     return 1;
 }
 
@@ -260,21 +396,13 @@ static int nf_socket_recv(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
         cs_error(vm, "socket_recv() requires 2 arguments (sock, max_bytes)");
         return 1;
     }
-    if (argv[0].type != CS_T_MAP) {
-        cs_error(vm, "socket_recv() first argument must be a socket");
-        return 1;
-    }
+    cs_socket* s = socket_arg(vm, "socket_recv", argc, argv);
+    if (!s) return 1;
     if (argv[1].type != CS_T_INT) {
         cs_error(vm, "socket_recv() max_bytes must be an integer");
         return 1;
     }
 
-    cs_socket_t fd = cs_socket_map_fd(argv[0]);
-    if (fd == CS_INVALID_SOCKET) {
-        cs_error(vm, "socket_recv() invalid socket");
-        return 1;
-    }
-
     int max_bytes = (int)argv[1].as.i;
     if (max_bytes <= 0 || max_bytes > 1024 * 1024) {
         cs_error(vm, "socket_recv() max_bytes must be between 1 and 1048576");
@@ -287,38 +415,8 @@ static int nf_socket_recv(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
         return 1;
     }
 
-    ssize_t received = -1;
-#ifndef CS_NO_TLS
-    cs_value tls_val = cs_map_get(argv[0], "_tls");
-    if (tls_val.type == CS_T_INT && tls_val.as.i != 0) {
-        SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
-        received = SSL_read(ssl, buf, max_bytes);
-        if (received <= 0) {
-            int err = SSL_get_error(ssl, (int)received);
-            cs_value_release(tls_val);
-            free(buf);
-            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
-                cs_value promise = cs_promise_new(vm);
-                cs_value ctx = make_op_context(vm, "recv", argv[0]);
-                cs_map_set(ctx, "max", argv[1]);
-                int events = (err == SSL_ERROR_WANT_READ) ? CS_POLL_READ : CS_POLL_WRITE;
-                cs_add_pending_io(vm, fd, events, promise, ctx, 0);
-                cs_value_release(ctx);
-                if (out) *out = promise;
-                return 0;
-            }
-            cs_error(vm, "socket_recv() TLS read failed");
-            return 1;
-        }
-        cs_value_release(tls_val);
-    } else {
-        cs_value_release(tls_val);
-        received = recv(fd, buf, (size_t)max_bytes, 0);
-    }
-#else
-    received = recv(fd, buf, (size_t)max_bytes, 0);
-#endif
-
+    int wait = 0;
+    ssize_t received = cs_socket_recv(s, buf, (size_t)max_bytes, &wait);
     if (received > 0) {
         buf[received] = '\0';
         if (out) *out = cs_str_take(vm, buf, (uint64_t)received);
@@ -331,30 +429,25 @@ static int nf_socket_recv(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
         if (out) *out = cs_nil();
         return 0;
     }
-
-#ifdef _WIN32
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK) {
-#else
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-#endif
+    if (wait) {
         cs_value promise = cs_promise_new(vm);
-        cs_value ctx = make_op_context(vm, "recv", argv[0]);
-        cs_map_set(ctx, "max", argv[1]);
-        cs_add_pending_io(vm, fd, CS_POLL_READ, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, s, CS_SOCK_RECV, wait, promise, cs_nil(), (size_t)max_bytes, NULL);
         if (out) *out = promise;
         return 0;
     }
+    if (s->ssl) {
+        cs_error(vm, "socket_recv() TLS read failed");
+        return 1;
+    }
 
-        {
+    {
     #ifdef _WIN32
         int err2 = WSAGetLastError();
     #else
         int err2 = errno;
     #endif
         net_errorf(vm, "socket_recv() failed", cs_socket_error_str(err2));
-        }
+    }
     return 1;
 }
 
@@ -370,25 +463,33 @@ static int nf_socket_close_native(cs_vm* vm, void* ud, int argc, const cs_value*
         return 1;
     }
 
-    cs_socket_t fd = cs_socket_map_fd(argv[0]);
-    if (fd != CS_INVALID_SOCKET) {
-        cs_remove_pending_io(vm, fd);
-#ifndef CS_NO_TLS
-        cs_value tls_val = cs_map_get(argv[0], "_tls");
-        if (tls_val.type == CS_T_INT && tls_val.as.i != 0) {
-            SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
-            cs_tls_close(ssl);
-        }
-        cs_value_release(tls_val);
-#endif
-        cs_socket_close(fd);
-        cs_map_set(argv[0], "_fd", cs_int(-1));
+    // Closing twice is harmless: the handle no longer names a socket
+    cs_socket* s = cs_socket_from_value(vm, argv[0]);
+    if (s) {
+        cs_remove_pending_io(vm, s->fd);
+        cs_socket_discard(vm, s);
     }
 
     if (out) *out = cs_nil();
     return 0;
 }
 
+// Native function: socket_stats(sock) -> {bytes_sent, bytes_received, sends, recvs, secure}
+static int nf_socket_stats(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    cs_socket* s = socket_arg(vm, "socket_stats", argc, argv);
+    if (!s) return 1;
+    if (!out) return 0;
+    *out = cs_map(vm);
+    if (!out->as.p) return 0;
+    cs_map_set(*out, "bytes_sent", cs_int((int64_t)s->bytes_sent));
+    cs_map_set(*out, "bytes_received", cs_int((int64_t)s->bytes_received));
+    cs_map_set(*out, "sends", cs_int((int64_t)s->sends));
+    cs_map_set(*out, "recvs", cs_int((int64_t)s->recvs));
+    cs_map_set(*out, "secure", cs_bool(s->ssl != NULL));
+    return 0;
+}
+
 // Native function: tcp_listen(host, port) -> socket
 static int nf_tcp_listen(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
@@ -448,7 +549,7 @@ static int nf_tcp_listen(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
         return 1;
     }
 
-    cs_value sock = cs_make_socket_map(vm, fd, "tcp_server", host, port);
+    cs_value sock = cs_make_socket_map(vm, fd, "tcp_server", host, port, NULL);
     if (out) *out = sock;
     return 0;
 }
@@ -465,27 +566,20 @@ static int nf_socket_accept(cs_vm* vm, void* ud, int argc, const cs_value* argv,
         return 1;
     }
 
-    cs_socket_t fd = cs_socket_map_fd(argv[0]);
-    if (fd == CS_INVALID_SOCKET) {
+    cs_socket* server = cs_socket_from_value(vm, argv[0]);
+    if (!server) {
         cs_error(vm, "socket_accept() invalid socket");
         return 1;
     }
 
     struct sockaddr_in addr;
     socklen_t addrlen = sizeof(addr);
-    cs_socket_t client = accept(fd, (struct sockaddr*)&addr, &addrlen);
+    cs_socket_t client = accept(server->fd, (struct sockaddr*)&addr, &addrlen);
     if (client != CS_INVALID_SOCKET) {
         cs_socket_set_nonblocking(client);
         char ipbuf[64];
         const char* ip = inet_ntop(AF_INET, &addr.sin_addr, ipbuf, sizeof(ipbuf));
-        cs_value sock = cs_map(vm);
-        if (sock.as.p) {
-            cs_map_set(sock, "_fd", cs_int((int64_t)client));
-            cs_map_set(sock, "_type", cs_str(vm, "tcp"));
-            if (ip) cs_map_set(sock, "host", cs_str(vm, ip));
-            cs_map_set(sock, "port", cs_int((int)ntohs(addr.sin_port)));
-        }
-        if (out) *out = sock;
+        if (out) *out = cs_make_socket_map(vm, client, "tcp", ip, (int)ntohs(addr.sin_port), NULL);
         return 0;
     }
 
@@ -496,9 +590,7 @@ static int nf_socket_accept(cs_vm* vm, void* ud, int argc, const cs_value* argv,
     if (errno == EAGAIN || errno == EWOULDBLOCK) {
 #endif
         cs_value promise = cs_promise_new(vm);
-        cs_value ctx = make_op_context(vm, "accept", argv[0]);
-        cs_add_pending_io(vm, fd, CS_POLL_READ, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, server, CS_SOCK_ACCEPT, CS_POLL_READ, promise, cs_nil(), 0, NULL);
         if (out) *out = promise;
         return 0;
     }
@@ -521,12 +613,43 @@ static int nf_net_set_default_timeout(cs_vm* vm, void* ud, int argc, const cs_va
     return 0;
 }
 
+// Native function: net_poll_backend() -> "io_uring" | "epoll" | "poll" | "select"
+static int nf_net_poll_backend(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud; (void)argc; (void)argv;
+    if (out) *out = cs_str(vm, cs_io_backend_name(vm));
+    return 0;
+}
+
+// Native function: net_set_poll_backend(name) -> backend now in use
+// Asking for "io_uring" where the kernel lacks it keeps the readiness backend.
+static int nf_net_set_poll_backend(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc < 1 || argv[0].type != CS_T_STR) {
+        cs_error(vm, "net_set_poll_backend() requires a backend name");
+        return 1;
+    }
+    int rc = cs_io_set_backend(vm, cs_to_cstr(argv[0]));
+    if (rc == -1) {
+        cs_error(vm, "net_set_poll_backend() cannot switch with operations pending");
+        return 1;
+    }
+    if (rc == -2) {
+        cs_error(vm, "net_set_poll_backend() unknown backend");
+        return 1;
+    }
+    if (out) *out = cs_str(vm, cs_io_backend_name(vm));
+    return 0;
+}
+
 void cs_register_net_stdlib(cs_vm* vm) {
     cs_register_native(vm, "tcp_connect", nf_tcp_connect, NULL);
     cs_register_native(vm, "socket_send", nf_socket_send, NULL);
     cs_register_native(vm, "socket_recv", nf_socket_recv, NULL);
     cs_register_native(vm, "socket_close", nf_socket_close_native, NULL);
+    cs_register_native(vm, "socket_stats", nf_socket_stats, NULL);
     cs_register_native(vm, "tcp_listen", nf_tcp_listen, NULL);
     cs_register_native(vm, "socket_accept", nf_socket_accept, NULL);
     cs_register_native(vm, "net_set_default_timeout", nf_net_set_default_timeout, NULL);
+    cs_register_native(vm, "net_poll_backend", nf_net_poll_backend, NULL);
+    cs_register_native(vm, "net_set_poll_backend", nf_net_set_poll_backend, NULL);
 }
@@ -4,14 +4,49 @@
 #include "cupidscript.h"
 #include "cs_event_loop.h"
 
+struct ssl_st;
+
+// A socket's native state. Script values are maps {_sock, _type, host, port}: _sock is
+// a handle into the VM's socket table, which holds one reference; every pending
+// operation on the socket holds another.
+typedef struct cs_socket {
+    int ref;
+    int64_t handle;           // _sock: table slot in the low 32 bits, sequence above
+    cs_socket_t fd;           // CS_INVALID_SOCKET once closed
+    struct ssl_st* ssl;       // set once a TLS handshake finished
+    char* host;               // connect target, or the peer address of accepted sockets
+    int port;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t sends;
+    uint64_t recvs;
+} cs_socket;
+
 // DNS resolution
 int cs_resolve_host(const char* host, int port, struct sockaddr_in* addr);
 
-// Create socket map value
-cs_value cs_make_socket_map(cs_vm* vm, cs_socket_t fd, const char* type, const char* host, int port);
+// Take fd into a new socket in vm's table and return its script value (nil on OOM,
+// with fd closed). *out, if given, receives the socket without a new reference.
+cs_value cs_make_socket_map(cs_vm* vm, cs_socket_t fd, const char* type, const char* host, int port, cs_socket** out);
+
+// The open socket behind a script value, or NULL
+cs_socket* cs_socket_from_value(cs_vm* vm, cs_value sock);
+
+// One nonblocking send (recv) on s, through its SSL once it has one. Returns the byte
+// count (recv: 0 at end of stream), or -1 with *wait set to the events to wait for
+// before trying again, or to 0 on failure (errno says why for plain sockets).
+ssize_t cs_socket_send(cs_socket* s, const char* data, size_t len, int* wait);
+ssize_t cs_socket_recv(cs_socket* s, char* buf, size_t max, int* wait);
+
+void cs_socket_incref(cs_socket* s);
+void cs_socket_decref(cs_socket* s);   // the last reference closes what is still open
+
+// Close s and drop it from vm's table; its handle is invalid from then on. Pending
+// operations are left alone (socket_close removes them first).
+void cs_socket_discard(cs_vm* vm, cs_socket* s);
 
-// Extract fd from socket map
-cs_socket_t cs_socket_map_fd(cs_value sock);
+// Close every socket still in vm's table (cs_vm_free, after pending operations)
+void cs_net_free_sockets(cs_vm* vm);
 
 // Register network stdlib functions
 void cs_register_net_stdlib(cs_vm* vm);
@@ -1,4 +1,5 @@
 #include "cs_parser.h"
+#include "cs_value.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -2021,7 +2022,9 @@ static ast* parse_match_pattern(parser* P) {
         return n;
     }
     if (P->tok.type == TK_STR) {
-        ast* n = make_quoted_str_lit_from_tok(P, P->tok.start, P->tok.len);
+        // token already includes its quotes
+        ast* n = node(P, N_LIT_STR);
+        n->as.lit_str.s = cs_strndup2(P->tok.start, P->tok.len);
         next(P);
         return n;
     }
@@ -2320,6 +2323,7 @@ static ast* build_assignment(parser* P, ast* lv, token_type op, ast* rhs) {
             bin->as.binop.right = rhs;
             n->as.assign_stmt.value = bin;
         }
+        ast_free(lv);
         return n;
     }
     if (lv && lv->type == N_INDEX) {
@@ -2328,6 +2332,9 @@ static ast* build_assignment(parser* P, ast* lv, token_type op, ast* rhs) {
         n->as.setindex_stmt.index = lv->as.index.index;
         n->as.setindex_stmt.value = rhs;
         n->as.setindex_stmt.op = op;
+        lv->as.index.target = NULL;
+        lv->as.index.index = NULL;
+        ast_free(lv);
         return n;
     }
     if (lv && lv->type == N_GETFIELD) {
@@ -2338,6 +2345,8 @@ static ast* build_assignment(parser* P, ast* lv, token_type op, ast* rhs) {
         n->as.setindex_stmt.index = idx;
         n->as.setindex_stmt.value = rhs;
         n->as.setindex_stmt.op = op;
+        lv->as.getfield.target = NULL;
+        ast_free(lv);
         return n;
     }
     if (!P->error) P->error = fmt_err(P, &P->tok, "invalid assignment target");
@@ -2499,7 +2508,7 @@ static ast* parse_stmt(parser* P) {
                     lexer saveL = P->L;
                     token saveT = P->tok;
 
-                    (void)parse_lvalue(P);
+                    ast_free(parse_lvalue(P));  // lookahead only
                     token_type assign_op = P->tok.type;
                     int is_assign = (assign_op == TK_ASSIGN || assign_op == TK_PLUSEQ || assign_op == TK_MINUSEQ ||
                                      assign_op == TK_STAREQ || assign_op == TK_SLASHEQ);
@@ -2543,7 +2552,7 @@ static ast* parse_stmt(parser* P) {
                     lexer saveL = P->L;
                     token saveT = P->tok;
 
-                    (void)parse_lvalue(P);
+                    ast_free(parse_lvalue(P));  // lookahead only
                     token_type assign_op = P->tok.type;
                     int is_assign = (assign_op == TK_ASSIGN || assign_op == TK_PLUSEQ || assign_op == TK_MINUSEQ ||
                                      assign_op == TK_STAREQ || assign_op == TK_SLASHEQ);
@@ -2713,7 +2722,7 @@ static ast* parse_stmt(parser* P) {
         lexer saveL = P->L;
         token saveT = P->tok;
 
-        (void)parse_lvalue(P);
+        ast_free(parse_lvalue(P));  // lookahead only
         token_type assign_op = P->tok.type;
         int is_assign = (assign_op == TK_ASSIGN || assign_op == TK_PLUSEQ || assign_op == TK_MINUSEQ ||
                          assign_op == TK_STAREQ || assign_op == TK_SLASHEQ);
@@ -2792,6 +2801,7 @@ void ast_free(ast* node) {
             free(node->as.switch_stmt.case_patterns);
             free(node->as.switch_stmt.case_blocks);
             free(node->as.switch_stmt.case_kinds);
+            free(node->as.switch_stmt.dispatch);
             break;
         case N_MATCH:
             ast_free(node->as.match_expr.expr);
@@ -2804,6 +2814,7 @@ void ast_free(ast* node) {
             free(node->as.match_expr.case_guards);
             free(node->as.match_expr.case_values);
             ast_free(node->as.match_expr.default_expr);
+            free(node->as.match_expr.dispatch);
             break;
         case N_DEFER:
             ast_free(node->as.defer_stmt.stmt);
@@ -2905,6 +2916,7 @@ void ast_free(ast* node) {
             free(node->as.fndef.defaults);
             free(node->as.fndef.rest_param);
             ast_free(node->as.fndef.body);
+            free(node->as.fndef.captures);
             break;
         case N_BINOP:
             ast_free(node->as.binop.left);
@@ -2935,18 +2947,18 @@ void ast_free(ast* node) {
                 ast_free(node->as.call.args[i]);
             }
             free(node->as.call.args);
+            free(node->as.call.ic);
             break;
         case N_INDEX:
             ast_free(node->as.index.target);
             ast_free(node->as.index.index);
             break;
         case N_GETFIELD:
-            ast_free(node->as.getfield.target);
-            free(node->as.getfield.field);
-            break;
         case N_OPTGETFIELD:
             ast_free(node->as.getfield.target);
             free(node->as.getfield.field);
+            if (node->as.getfield.key) cs_str_decref(node->as.getfield.key);
+            free(node->as.getfield.ic);
             break;
         case N_FUNCLIT:
             for (size_t i = 0; i < node->as.funclit.param_count; i++) {
@@ -2957,6 +2969,7 @@ void ast_free(ast* node) {
             free(node->as.funclit.defaults);
             free(node->as.funclit.rest_param);
             ast_free(node->as.funclit.body);
+            free(node->as.funclit.captures);
             break;
         case N_LISTLIT:
             for (size_t i = 0; i < node->as.listlit.count; i++) {
@@ -2964,6 +2977,16 @@ void ast_free(ast* node) {
             }
             free(node->as.listlit.items);
             break;
+        case N_SETLIT:
+            for (size_t i = 0; i < node->as.setlit.count; i++) {
+                ast_free(node->as.setlit.items[i]);
+            }
+            free(node->as.setlit.items);
+            break;
+        case N_WALRUS:
+            free(node->as.walrus.name);
+            ast_free(node->as.walrus.value);
+            break;
         case N_MAPLIT:
             for (size_t i = 0; i < node->as.maplit.count; i++) {
                 ast_free(node->as.maplit.keys[i]);
@@ -3047,6 +3070,7 @@ void ast_free(ast* node) {
             break;
         case N_LIT_STR:
             free(node->as.lit_str.s);
+            if (node->as.lit_str.cached) cs_str_decref(node->as.lit_str.cached);
             break;
         case N_STR_INTERP:
             for (size_t i = 0; i < node->as.str_interp.count; i++) {
@@ -3071,3 +3095,320 @@ void ast_free(ast* node) {
     
     free(node);
 }
+
+// ---------- cloning ----------
+// Deep copy of a parsed program. The shared code cache keeps one pristine tree per file
+// and hands every VM its own copy, so the caches a VM fills in on nodes (literal strings,
+// inline caches, dispatch tables, captures) are never shared between VMs or threads.
+// Every allocation is logged so a copy that runs out of memory can be released whole.
+
+typedef struct {
+    const char* source_name;
+    void** allocs;
+    size_t count;
+    size_t cap;
+    int ok;
+} clone_ctx;
+
+static void* clone_alloc(clone_ctx* C, size_t size) {
+    if (!C->ok) return NULL;
+    if (C->count == C->cap) {
+        size_t nc = C->cap ? C->cap * 2 : 256;
+        void** na = (void**)realloc(C->allocs, nc * sizeof(void*));
+        if (!na) { C->ok = 0; return NULL; }
+        C->allocs = na;
+        C->cap = nc;
+    }
+    void* p = calloc(1, size ? size : 1);
+    if (!p) { C->ok = 0; return NULL; }
+    C->allocs[C->count++] = p;
+    return p;
+}
+
+static char* clone_str(clone_ctx* C, const char* s) {
+    if (!s) return NULL;
+    size_t n = strlen(s);
+    char* p = (char*)clone_alloc(C, n + 1);
+    if (p) memcpy(p, s, n + 1);
+    return p;
+}
+
+static char** clone_strs(clone_ctx* C, char** v, size_t n) {
+    if (!v) return NULL;
+    char** out = (char**)clone_alloc(C, n * sizeof(char*));
+    if (!out) return NULL;
+    for (size_t i = 0; i < n; i++) out[i] = clone_str(C, v[i]);
+    return out;
+}
+
+static ast* clone_node(clone_ctx* C, const ast* n);
+
+static ast** clone_nodes(clone_ctx* C, ast** v, size_t n) {
+    if (!v) return NULL;
+    ast** out = (ast**)clone_alloc(C, n * sizeof(ast*));
+    if (!out) return NULL;
+    for (size_t i = 0; i < n; i++) out[i] = clone_node(C, v[i]);
+    return out;
+}
+
+static ast* clone_node(clone_ctx* C, const ast* n) {
+    if (!n) return NULL;
+    ast* c = (ast*)clone_alloc(C, sizeof(ast));
+    if (!c) return NULL;
+    *c = *n;
+    if (C->source_name) c->source_name = C->source_name;
+
+    switch (n->type) {
+        case N_BLOCK:
+            c->as.block.items = clone_nodes(C, n->as.block.items, n->as.block.count);
+            break;
+        case N_LET:
+            c->as.let_stmt.name = clone_str(C, n->as.let_stmt.name);
+            c->as.let_stmt.init = clone_node(C, n->as.let_stmt.init);
+            c->as.let_stmt.pattern = clone_node(C, n->as.let_stmt.pattern);
+            break;
+        case N_ASSIGN:
+            c->as.assign_stmt.name = clone_str(C, n->as.assign_stmt.name);
+            c->as.assign_stmt.value = clone_node(C, n->as.assign_stmt.value);
+            break;
+        case N_SETINDEX:
+            c->as.setindex_stmt.target = clone_node(C, n->as.setindex_stmt.target);
+            c->as.setindex_stmt.index = clone_node(C, n->as.setindex_stmt.index);
+            c->as.setindex_stmt.value = clone_node(C, n->as.setindex_stmt.value);
+            break;
+        case N_WALRUS:
+            c->as.walrus.name = clone_str(C, n->as.walrus.name);
+            c->as.walrus.value = clone_node(C, n->as.walrus.value);
+            break;
+        case N_SWITCH: {
+            size_t cnt = n->as.switch_stmt.case_count;
+            c->as.switch_stmt.expr = clone_node(C, n->as.switch_stmt.expr);
+            c->as.switch_stmt.case_exprs = clone_nodes(C, n->as.switch_stmt.case_exprs, cnt);
+            c->as.switch_stmt.case_patterns = clone_nodes(C, n->as.switch_stmt.case_patterns, cnt);
+            c->as.switch_stmt.case_blocks = clone_nodes(C, n->as.switch_stmt.case_blocks, cnt);
+            c->as.switch_stmt.case_kinds = NULL;
+            if (n->as.switch_stmt.case_kinds) {
+                c->as.switch_stmt.case_kinds = (unsigned char*)clone_alloc(C, cnt);
+                if (c->as.switch_stmt.case_kinds && cnt) memcpy(c->as.switch_stmt.case_kinds, n->as.switch_stmt.case_kinds, cnt);
+            }
+            c->as.switch_stmt.dispatch = NULL;
+            break;
+        }
+        case N_MATCH: {
+            size_t cnt = n->as.match_expr.case_count;
+            c->as.match_expr.expr = clone_node(C, n->as.match_expr.expr);
+            c->as.match_expr.case_patterns = clone_nodes(C, n->as.match_expr.case_patterns, cnt);
+            c->as.match_expr.case_guards = clone_nodes(C, n->as.match_expr.case_guards, cnt);
+            c->as.match_expr.case_values = clone_nodes(C, n->as.match_expr.case_values, cnt);
+            c->as.match_expr.default_expr = clone_node(C, n->as.match_expr.default_expr);
+            c->as.match_expr.dispatch = NULL;
+            break;
+        }
+        case N_DEFER:
+            c->as.defer_stmt.stmt = clone_node(C, n->as.defer_stmt.stmt);
+            break;
+        case N_FORIN:
+            c->as.forin_stmt.name = clone_str(C, n->as.forin_stmt.name);
+            c->as.forin_stmt.name2 = clone_str(C, n->as.forin_stmt.name2);
+            c->as.forin_stmt.iterable = clone_node(C, n->as.forin_stmt.iterable);
+            c->as.forin_stmt.body = clone_node(C, n->as.forin_stmt.body);
+            break;
+        case N_FOR_C_STYLE:
+            c->as.for_c_style_stmt.init = clone_node(C, n->as.for_c_style_stmt.init);
+            c->as.for_c_style_stmt.cond = clone_node(C, n->as.for_c_style_stmt.cond);
+            c->as.for_c_style_stmt.incr = clone_node(C, n->as.for_c_style_stmt.incr);
+            c->as.for_c_style_stmt.body = clone_node(C, n->as.for_c_style_stmt.body);
+            break;
+        case N_THROW:
+            c->as.throw_stmt.value = clone_node(C, n->as.throw_stmt.value);
+            break;
+        case N_TRY:
+            c->as.try_stmt.try_b = clone_node(C, n->as.try_stmt.try_b);
+            c->as.try_stmt.catch_name = clone_str(C, n->as.try_stmt.catch_name);
+            c->as.try_stmt.catch_b = clone_node(C, n->as.try_stmt.catch_b);
+            c->as.try_stmt.finally_b = clone_node(C, n->as.try_stmt.finally_b);
+            break;
+        case N_EXPORT:
+            c->as.export_stmt.name = clone_str(C, n->as.export_stmt.name);
+            c->as.export_stmt.value = clone_node(C, n->as.export_stmt.value);
+            break;
+        case N_CLASS:
+            c->as.class_stmt.name = clone_str(C, n->as.class_stmt.name);
+            c->as.class_stmt.parent = clone_str(C, n->as.class_stmt.parent);
+            c->as.class_stmt.methods = clone_nodes(C, n->as.class_stmt.methods, n->as.class_stmt.method_count);
+            break;
+        case N_STRUCT:
+            c->as.struct_stmt.name = clone_str(C, n->as.struct_stmt.name);
+            c->as.struct_stmt.field_names = clone_strs(C, n->as.struct_stmt.field_names, n->as.struct_stmt.field_count);
+            c->as.struct_stmt.field_defaults = clone_nodes(C, n->as.struct_stmt.field_defaults, n->as.struct_stmt.field_count);
+            break;
+        case N_ENUM:
+            c->as.enum_stmt.name = clone_str(C, n->as.enum_stmt.name);
+            c->as.enum_stmt.names = clone_strs(C, n->as.enum_stmt.names, n->as.enum_stmt.count);
+            c->as.enum_stmt.values = clone_nodes(C, n->as.enum_stmt.values, n->as.enum_stmt.count);
+            break;
+        case N_EXPORT_LIST:
+            c->as.export_list.local_names = clone_strs(C, n->as.export_list.local_names, n->as.export_list.count);
+            c->as.export_list.export_names = clone_strs(C, n->as.export_list.export_names, n->as.export_list.count);
+            break;
+        case N_IMPORT:
+            c->as.import_stmt.path = clone_node(C, n->as.import_stmt.path);
+            c->as.import_stmt.default_name = clone_str(C, n->as.import_stmt.default_name);
+            c->as.import_stmt.import_names = clone_strs(C, n->as.import_stmt.import_names, n->as.import_stmt.count);
+            c->as.import_stmt.local_names = clone_strs(C, n->as.import_stmt.local_names, n->as.import_stmt.count);
+            break;
+        case N_IF:
+            c->as.if_stmt.cond = clone_node(C, n->as.if_stmt.cond);
+            c->as.if_stmt.then_b = clone_node(C, n->as.if_stmt.then_b);
+            c->as.if_stmt.else_b = clone_node(C, n->as.if_stmt.else_b);
+            break;
+        case N_WHILE:
+            c->as.while_stmt.cond = clone_node(C, n->as.while_stmt.cond);
+            c->as.while_stmt.body = clone_node(C, n->as.while_stmt.body);
+            break;
+        case N_RETURN:
+            c->as.ret_stmt.value = clone_node(C, n->as.ret_stmt.value);
+            break;
+        case N_YIELD:
+            c->as.yield_stmt.value = clone_node(C, n->as.yield_stmt.value);
+            break;
+        case N_EXPR_STMT:
+            c->as.expr_stmt.expr = clone_node(C, n->as.expr_stmt.expr);
+            break;
+        case N_FNDEF:
+            c->as.fndef.name = clone_str(C, n->as.fndef.name);
+            c->as.fndef.params = clone_strs(C, n->as.fndef.params, n->as.fndef.param_count);
+            c->as.fndef.defaults = clone_nodes(C, n->as.fndef.defaults, n->as.fndef.param_count);
+            c->as.fndef.rest_param = clone_str(C, n->as.fndef.rest_param);
+            c->as.fndef.body = clone_node(C, n->as.fndef.body);
+            c->as.fndef.captures = NULL;
+            break;
+        case N_FUNCLIT:
+            c->as.funclit.params = clone_strs(C, n->as.funclit.params, n->as.funclit.param_count);
+            c->as.funclit.defaults = clone_nodes(C, n->as.funclit.defaults, n->as.funclit.param_count);
+            c->as.funclit.rest_param = clone_str(C, n->as.funclit.rest_param);
+            c->as.funclit.body = clone_node(C, n->as.funclit.body);
+            c->as.funclit.captures = NULL;
+            break;
+        case N_BINOP:
+            c->as.binop.left = clone_node(C, n->as.binop.left);
+            c->as.binop.right = clone_node(C, n->as.binop.right);
+            break;
+        case N_UNOP:
+            c->as.unop.expr = clone_node(C, n->as.unop.expr);
+            break;
+        case N_AWAIT:
+            c->as.await_expr.expr = clone_node(C, n->as.await_expr.expr);
+            break;
+        case N_RANGE:
+            c->as.range.left = clone_node(C, n->as.range.left);
+            c->as.range.right = clone_node(C, n->as.range.right);
+            break;
+        case N_TERNARY:
+            c->as.ternary.cond = clone_node(C, n->as.ternary.cond);
+            c->as.ternary.then_e = clone_node(C, n->as.ternary.then_e);
+            c->as.ternary.else_e = clone_node(C, n->as.ternary.else_e);
+            break;
+        case N_PIPE:
+            c->as.pipe.left = clone_node(C, n->as.pipe.left);
+            c->as.pipe.right = clone_node(C, n->as.pipe.right);
+            break;
+        case N_CALL:
+            c->as.call.callee = clone_node(C, n->as.call.callee);
+            c->as.call.args = clone_nodes(C, n->as.call.args, n->as.call.argc);
+            c->as.call.ic = NULL;
+            break;
+        case N_INDEX:
+            c->as.index.target = clone_node(C, n->as.index.target);
+            c->as.index.index = clone_node(C, n->as.index.index);
+            break;
+        case N_GETFIELD:
+        case N_OPTGETFIELD:
+            c->as.getfield.target = clone_node(C, n->as.getfield.target);
+            c->as.getfield.field = clone_str(C, n->as.getfield.field);
+            c->as.getfield.key = NULL;
+            c->as.getfield.ic = NULL;
+            break;
+        case N_LISTLIT:
+            c->as.listlit.items = clone_nodes(C, n->as.listlit.items, n->as.listlit.count);
+            break;
+        case N_MAPLIT:
+            c->as.maplit.keys = clone_nodes(C, n->as.maplit.keys, n->as.maplit.count);
+            c->as.maplit.vals = clone_nodes(C, n->as.maplit.vals, n->as.maplit.count);
+            break;
+        case N_SETLIT:
+            c->as.setlit.items = clone_nodes(C, n->as.setlit.items, n->as.setlit.count);
+            break;
+        case N_TUPLELIT:
+            c->as.tuplelit.field_names = clone_strs(C, n->as.tuplelit.field_names, n->as.tuplelit.count);
+            c->as.tuplelit.field_values = clone_nodes(C, n->as.tuplelit.field_values, n->as.tuplelit.count);
+            break;
+        case N_LISTCOMP:
+            c->as.listcomp.expr = clone_node(C, n->as.listcomp.expr);
+            c->as.listcomp.vars = clone_strs(C, n->as.listcomp.vars, n->as.listcomp.iter_count);
+            c->as.listcomp.vars2 = clone_strs(C, n->as.listcomp.vars2, n->as.listcomp.iter_count);
+            c->as.listcomp.iterables = clone_nodes(C, n->as.listcomp.iterables, n->as.listcomp.iter_count);
+            c->as.listcomp.filter = clone_node(C, n->as.listcomp.filter);
+            break;
+        case N_MAPCOMP:
+            c->as.mapcomp.key_expr = clone_node(C, n->as.mapcomp.key_expr);
+            c->as.mapcomp.val_expr = clone_node(C, n->as.mapcomp.val_expr);
+            c->as.mapcomp.key_vars = clone_strs(C, n->as.mapcomp.key_vars, n->as.mapcomp.iter_count);
+            c->as.mapcomp.val_vars = clone_strs(C, n->as.mapcomp.val_vars, n->as.mapcomp.iter_count);
+            c->as.mapcomp.iterables = clone_nodes(C, n->as.mapcomp.iterables, n->as.mapcomp.iter_count);
+            c->as.mapcomp.filter = clone_node(C, n->as.mapcomp.filter);
+            break;
+        case N_SETCOMP:
+            c->as.setcomp.expr = clone_node(C, n->as.setcomp.expr);
+            c->as.setcomp.vars = clone_strs(C, n->as.setcomp.vars, n->as.setcomp.iter_count);
+            c->as.setcomp.vars2 = clone_strs(C, n->as.setcomp.vars2, n->as.setcomp.iter_count);
+            c->as.setcomp.iterables = clone_nodes(C, n->as.setcomp.iterables, n->as.setcomp.iter_count);
+            c->as.setcomp.filter = clone_node(C, n->as.setcomp.filter);
+            break;
+        case N_PATTERN_LIST:
+            c->as.list_pattern.names = clone_strs(C, n->as.list_pattern.names, n->as.list_pattern.count);
+            c->as.list_pattern.rest_name = clone_str(C, n->as.list_pattern.rest_name);
+            break;
+        case N_PATTERN_MAP:
+            c->as.map_pattern.keys = clone_strs(C, n->as.map_pattern.keys, n->as.map_pattern.count);
+            c->as.map_pattern.names = clone_strs(C, n->as.map_pattern.names, n->as.map_pattern.count);
+            c->as.map_pattern.rest_name = clone_str(C, n->as.map_pattern.rest_name);
+            break;
+        case N_PATTERN_TYPE:
+            c->as.type_pattern.type_name = clone_str(C, n->as.type_pattern.type_name);
+            c->as.type_pattern.inner = clone_node(C, n->as.type_pattern.inner);
+            break;
+        case N_SPREAD:
+            c->as.spread.expr = clone_node(C, n->as.spread.expr);
+            break;
+        case N_IDENT:
+            c->as.ident.name = clone_str(C, n->as.ident.name);
+            break;
+        case N_LIT_STR:
+            c->as.lit_str.s = clone_str(C, n->as.lit_str.s);
+            c->as.lit_str.cached = NULL;
+            break;
+        case N_STR_INTERP:
+            c->as.str_interp.parts = clone_nodes(C, n->as.str_interp.parts, n->as.str_interp.count);
+            break;
+        default:
+            // Literals, wildcards, break/continue: no owned pointers
+            break;
+    }
+    return c;
+}
+
+ast* ast_clone(const ast* root, const char* source_name) {
+    if (!root) return NULL;
+    clone_ctx C;
+    memset(&C, 0, sizeof(C));
+    C.source_name = source_name;
+    C.ok = 1;
+    ast* out = clone_node(&C, root);
+    if (!C.ok) {
+        for (size_t i = 0; i < C.count; i++) free(C.allocs[i]);
+        out = NULL;
+    }
+    free(C.allocs);
+    return out;
+}
@@ -43,7 +43,7 @@ struct ast {
         struct { char* name; } ident;
         struct { long long v; } lit_int;
         struct { double v; } lit_float;
-        struct { char* s; } lit_str;
+        struct { char* s; struct cs_string* cached; } lit_str;  // cached: unescaped value, filled by the VM
         struct { int v; } lit_bool;
         struct { ast** parts; size_t count; } str_interp;
 
@@ -60,6 +60,7 @@ struct ast {
             ast** case_blocks;
             unsigned char* case_kinds;
             size_t case_count;
+            struct cs_dispatch* dispatch;  // filled by the VM
         } switch_stmt;
         struct {
             ast* expr;
@@ -68,6 +69,7 @@ struct ast {
             ast** case_values;
             size_t case_count;
             ast* default_expr;
+            struct cs_dispatch* dispatch;  // filled by the VM
         } match_expr;
         struct { ast* stmt; } defer_stmt;
         struct {
@@ -119,6 +121,7 @@ struct ast {
             ast* body;
             int is_async;
             int is_generator;
+            struct cs_captures* captures;  // free-variable summary, filled by the VM
         } fndef;
         struct {
             char** params;
@@ -128,6 +131,7 @@ struct ast {
             ast* body;
             int is_async;
             int is_generator;
+            struct cs_captures* captures;  // free-variable summary, filled by the VM
         } funclit;
         struct { int op; ast* left; ast* right; } binop;
         struct { int op; ast* expr; } unop;
@@ -135,9 +139,9 @@ struct ast {
         struct { ast* left; ast* right; int inclusive; } range;
         struct { ast* cond; ast* then_e; ast* else_e; } ternary;
         struct { ast* left; ast* right; } pipe;
-        struct { ast* callee; ast** args; size_t argc; } call;
+        struct { ast* callee; ast** args; size_t argc; struct cs_inline_cache* ic; } call;  // ic: constructor lookups, filled by the VM
         struct { ast* target; ast* index; } index;
-        struct { ast* target; char* field; } getfield;
+        struct { ast* target; char* field; struct cs_string* key; struct cs_inline_cache* ic; } getfield;  // key/ic: filled by the VM
         struct { ast** items; size_t count; } listlit;
         struct { ast** keys; ast** vals; size_t count; } maplit;
         struct { ast** items; size_t count; } setlit;
@@ -190,5 +194,7 @@ void parser_init(parser* P, const char* src, const char* source_name);
 ast* parse_program(parser* P);
 void parse_free_error(parser* P);
 void ast_free(ast* node);
+// Deep copy with VM caches cleared; source_name (if non-NULL) replaces every node's. NULL on OOM.
+ast* ast_clone(const ast* node, const char* source_name);
 
 #endif
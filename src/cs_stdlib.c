@@ -2,6 +2,7 @@
 #include "cs_net.h"
 #include "cs_tls.h"
 #include "cs_http.h"
+#include "cs_worker.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +28,7 @@
 #include <sys/inotify.h>
 #include <poll.h>
 #include <zlib.h>
+#include <pthread.h>
 #endif
 
 #if defined(_WIN32)
@@ -408,6 +410,7 @@ static const char* value_repr(cs_value v, char* buf, size_t buf_sz) {
         case CS_T_FUNC:   return "<function>";
         case CS_T_NATIVE: return "<native>";
         case CS_T_PROMISE: return "<promise>";
+        case CS_T_ITER:   return "<iterator>";
         default:          return "<obj>";
     }
 }
@@ -575,9 +578,161 @@ static int nf_list(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value
     return 0;
 }
 
+// ---------- Lazy iterator stages ----------
+// map/filter/take/drop/enumerate/zip return a fused, pull-based stage when the
+// input is an iterator or a range; lists keep the eager behavior.
+static int is_lazy_source(cs_value v) {
+    return v.type == CS_T_ITER || v.type == CS_T_RANGE;
+}
+
+static int iter_stage_map(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    cs_value v = cs_nil();
+    int rc = cs_iter_next(vm, it->src, &v);
+    if (rc <= 0) return rc;
+    cs_value args[1] = { v };
+    int failed = cs_call_value(vm, it->arg, 1, args, out) != 0;
+    cs_value_release(v);
+    return failed ? -1 : 1;
+}
+
+static int iter_stage_filter(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    for (;;) {
+        cs_value v = cs_nil();
+        int rc = cs_iter_next(vm, it->src, &v);
+        if (rc <= 0) return rc;
+        cs_value args[1] = { v };
+        cs_value ret = cs_nil();
+        if (cs_call_value(vm, it->arg, 1, args, &ret) != 0) { cs_value_release(v); return -1; }
+        int truth = truthy_local(ret);
+        cs_value_release(ret);
+        if (truth) { *out = v; return 1; }
+        cs_value_release(v);
+    }
+}
+
+static int iter_stage_take(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    // Short-circuit: never pull past the limit.
+    if (it->pos >= it->limit) return 0;
+    it->pos++;
+    return cs_iter_next(vm, it->src, out);
+}
+
+static int iter_stage_drop(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    while (it->pos < it->limit) {
+        cs_value skipped = cs_nil();
+        int rc = cs_iter_next(vm, it->src, &skipped);
+        if (rc <= 0) return rc;
+        cs_value_release(skipped);
+        it->pos++;
+    }
+    return cs_iter_next(vm, it->src, out);
+}
+
+static int iter_make_pair(cs_vm* vm, cs_value a, cs_value b, cs_value* out) {
+    cs_value pair = cs_list(vm);
+    if (!pair.as.p || cs_list_push(pair, a) != 0 || cs_list_push(pair, b) != 0) {
+        cs_value_release(pair);
+        cs_error(vm, "out of memory");
+        return -1;
+    }
+    *out = pair;
+    return 1;
+}
+
+static int iter_stage_enumerate(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    cs_value v = cs_nil();
+    int rc = cs_iter_next(vm, it->src, &v);
+    if (rc <= 0) return rc;
+    rc = iter_make_pair(vm, cs_int(it->pos++), v, out);
+    cs_value_release(v);
+    return rc;
+}
+
+static int iter_stage_zip(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    cs_value a = cs_nil();
+    int rc = cs_iter_next(vm, it->src, &a);
+    if (rc <= 0) return rc;
+    cs_value b = cs_nil();
+    rc = cs_iter_next(vm, it->arg, &b);
+    if (rc <= 0) { cs_value_release(a); return rc; }
+    rc = iter_make_pair(vm, a, b, out);
+    cs_value_release(a);
+    cs_value_release(b);
+    return rc;
+}
+
+// Wraps `src` (iterator or range) in a lazy stage; returns 0 and sets *out on success.
+static int iter_stage_new(cs_vm* vm, cs_iter_next_fn next, cs_value src, cs_value arg, int64_t limit, cs_value* out) {
+    cs_value upstream = cs_iter_from(vm, src);
+    if (upstream.type != CS_T_ITER) { cs_error(vm, "expected an iterable (list, range, map, set, string, or iterator)"); return 1; }
+    cs_value stage = cs_iter_new(vm, next, upstream, arg);
+    cs_value_release(upstream);
+    if (stage.type != CS_T_ITER) { cs_error(vm, "out of memory"); return 1; }
+    ((cs_iter_obj*)stage.as.p)->limit = limit;
+    *out = stage;
+    return 0;
+}
+
+static int nf_iter(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+    if (argc != 1) { cs_error(vm, "iter() expects 1 argument"); return 1; }
+    cs_value it = cs_iter_from(vm, argv[0]);
+    if (it.type != CS_T_ITER) {
+        cs_error(vm, "iter() expects a list, range, map, set, string, or iterator");
+        return 1;
+    }
+    *out = it;
+    return 0;
+}
+
+static int nf_collect(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+    if (argc != 1) { cs_error(vm, "collect() expects 1 argument"); return 1; }
+    cs_value it = cs_iter_from(vm, argv[0]);
+    if (it.type != CS_T_ITER) {
+        cs_error(vm, "collect() expects a list, range, map, set, string, or iterator");
+        return 1;
+    }
+    cs_value listv = cs_list(vm);
+    if (!listv.as.p) { cs_value_release(it); cs_error(vm, "out of memory"); return 1; }
+    for (;;) {
+        cs_value v = cs_nil();
+        int rc = cs_iter_next(vm, it, &v);
+        if (rc == 0) break;
+        if (rc < 0 || cs_list_push(listv, v) != 0) {
+            if (rc > 0) { cs_value_release(v); cs_error(vm, "out of memory"); }
+            cs_value_release(listv);
+            cs_value_release(it);
+            return 1;
+        }
+        cs_value_release(v);
+    }
+    cs_value_release(it);
+    *out = listv;
+    return 0;
+}
+
+static int nf_next(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+    if (argc < 1 || argc > 2) { cs_error(vm, "next() expects 1 or 2 arguments (iterator, default?)"); return 1; }
+    if (argv[0].type != CS_T_ITER) { cs_error(vm, "next() expects an iterator"); return 1; }
+    cs_value v = cs_nil();
+    int rc = cs_iter_next(vm, argv[0], &v);
+    if (rc < 0) return 1;
+    *out = rc > 0 ? v : (argc == 2 ? cs_value_copy(argv[1]) : cs_nil());
+    return 0;
+}
+
 static int nf_map(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc == 2 && is_lazy_source(argv[0])) {
+        if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "map(): mapper must be a function"); return 1; }
+        return iter_stage_new(vm, iter_stage_map, argv[0], argv[1], 0, out);
+    }
     if (argc == 2 && argv[0].type == CS_T_LIST) {
         if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "map(): mapper must be a function"); return 1; }
         cs_list_obj* l = (cs_list_obj*)argv[0].as.p;
@@ -708,6 +863,12 @@ static int nf_len(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value*
     if (argv[0].type == CS_T_SET) { *out = cs_int((int64_t)((cs_map_obj*)argv[0].as.p)->len); return 0; }
     if (argv[0].type == CS_T_STRBUF) { *out = cs_int((int64_t)((cs_strbuf_obj*)argv[0].as.p)->len); return 0; }
     if (argv[0].type == CS_T_BYTES) { *out = cs_int((int64_t)((cs_bytes_obj*)argv[0].as.p)->len); return 0; }
+    if (argv[0].type == CS_T_ITER) {
+        cs_list_obj* items = cs_iter_items(vm, argv[0]);
+        if (!items) return 1;
+        *out = cs_int((int64_t)items->len);
+        return 0;
+    }
     *out = cs_int(0);
     return 0;
 }
@@ -737,13 +898,14 @@ static int nf_pop(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value*
 static int nf_extend(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (out) *out = cs_nil();
-    if (argc != 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_LIST) {
-        cs_error(vm, "extend() requires two lists");
+    if (argc != 2 || argv[0].type != CS_T_LIST || (argv[1].type != CS_T_LIST && argv[1].type != CS_T_ITER)) {
+        cs_error(vm, "extend() requires a list and a list or iterator");
         return 1;
     }
 
     cs_list_obj* dst = (cs_list_obj*)argv[0].as.p;
-    cs_list_obj* src = (cs_list_obj*)argv[1].as.p;
+    cs_list_obj* src = argv[1].type == CS_T_ITER ? cs_iter_items(vm, argv[1]) : (cs_list_obj*)argv[1].as.p;
+    if (argv[1].type == CS_T_ITER && !src) return 1;
     if (!dst || !src) return 0;
     if (src->len == 0) return 0;
 
@@ -917,6 +1079,182 @@ static int sort_merge(cs_vm* vm, cs_list_obj* list, cs_value cmp) {
     return rc;
 }
 
+// ---------- Parallel sort ----------
+// Used by sort(xs, "parallel") for large lists of plain numbers or strings.
+// Chunks are merge-sorted on worker threads, then merged pairwise; every
+// merge prefers the left run on ties so the result matches sort_merge.
+#define CS_PSORT_MIN_LEN     32768
+#define CS_PSORT_MAX_THREADS 16
+#define CS_PSORT_INSERTION   16
+
+typedef enum { PSORT_NUM, PSORT_STR } psort_kind;
+
+static int psort_classify(const cs_list_obj* list, psort_kind* kind) {
+    int nums = 0, strs = 0;
+    for (size_t i = 0; i < list->len; i++) {
+        cs_type t = list->items[i].type;
+        if (t == CS_T_INT || t == CS_T_FLOAT) nums = 1;
+        else if (t == CS_T_STR) strs = 1;
+        else return 0;
+        if (nums && strs) return 0;
+    }
+    *kind = strs ? PSORT_STR : PSORT_NUM;
+    return 1;
+}
+
+static int psort_cmp(psort_kind kind, cs_value a, cs_value b) {
+    if (kind == PSORT_STR) {
+        int cmp = strcmp(((cs_string*)a.as.p)->data, ((cs_string*)b.as.p)->data);
+        return (cmp < 0) ? -1 : (cmp > 0 ? 1 : 0);
+    }
+    // Same numeric semantics as compare_default().
+    double av = (a.type == CS_T_INT) ? (double)a.as.i : a.as.f;
+    double bv = (b.type == CS_T_INT) ? (double)b.as.i : b.as.f;
+    return (av < bv) ? -1 : (av > bv ? 1 : 0);
+}
+
+static void psort_merge_runs(psort_kind kind, const cs_value* src, cs_value* dst, size_t lo, size_t mid, size_t hi) {
+    size_t i = lo, j = mid, k = lo;
+    while (i < mid && j < hi) {
+        if (psort_cmp(kind, src[i], src[j]) <= 0) dst[k++] = src[i++];
+        else dst[k++] = src[j++];
+    }
+    while (i < mid) dst[k++] = src[i++];
+    while (j < hi) dst[k++] = src[j++];
+}
+
+static void psort_chunk(psort_kind kind, cs_value* items, cs_value* tmp, size_t lo, size_t hi) {
+    if (hi - lo <= CS_PSORT_INSERTION) {
+        for (size_t i = lo + 1; i < hi; i++) {
+            cs_value key = items[i];
+            size_t j = i;
+            while (j > lo && psort_cmp(kind, items[j - 1], key) > 0) {
+                items[j] = items[j - 1];
+                j--;
+            }
+            items[j] = key;
+        }
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    psort_chunk(kind, items, tmp, lo, mid);
+    psort_chunk(kind, items, tmp, mid, hi);
+    if (psort_cmp(kind, items[mid - 1], items[mid]) <= 0) return;
+    psort_merge_runs(kind, items, tmp, lo, mid, hi);
+    memcpy(items + lo, tmp + lo, sizeof(cs_value) * (hi - lo));
+}
+
+typedef struct {
+    psort_kind kind;
+    cs_value* src;
+    cs_value* dst;
+    size_t lo, mid, hi;
+    int merge;
+} psort_job;
+
+static void* psort_worker(void* arg) {
+    psort_job* job = (psort_job*)arg;
+    if (job->merge) psort_merge_runs(job->kind, job->src, job->dst, job->lo, job->mid, job->hi);
+    else psort_chunk(job->kind, job->src, job->dst, job->lo, job->hi);
+    return NULL;
+}
+
+static void psort_run_jobs(psort_job* jobs, size_t count) {
+#if !defined(_WIN32)
+    pthread_t threads[CS_PSORT_MAX_THREADS];
+    int started[CS_PSORT_MAX_THREADS];
+    // Job 0 runs on the calling thread; if a thread can't be created its job runs inline too.
+    for (size_t i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, psort_worker, &jobs[i]) == 0;
+        if (!started[i]) psort_worker(&jobs[i]);
+    }
+    if (count > 0) psort_worker(&jobs[0]);
+    for (size_t i = 1; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+#else
+    for (size_t i = 0; i < count; i++) psort_worker(&jobs[i]);
+#endif
+}
+
+static size_t psort_thread_count(size_t len) {
+    long n = 1;
+#if !defined(_WIN32)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n < 1) n = 1;
+    if (n > CS_PSORT_MAX_THREADS) n = CS_PSORT_MAX_THREADS;
+    size_t by_len = len / (CS_PSORT_MIN_LEN / 4);
+    if (by_len < 1) by_len = 1;
+    return ((size_t)n < by_len) ? (size_t)n : by_len;
+}
+
+static int sort_parallel(cs_vm* vm, cs_list_obj* list, cs_value cmp) {
+    if (!list || list->len < 2) return 0;
+
+    // Script comparators can't run off the VM thread; those (and mixed lists,
+    // which need compare_default's error reporting) take the sequential path.
+    psort_kind kind;
+    if (cmp.type != CS_T_NIL || list->len < CS_PSORT_MIN_LEN || !psort_classify(list, &kind)) {
+        return sort_merge(vm, list, cmp);
+    }
+
+    size_t nthreads = psort_thread_count(list->len);
+    if (nthreads < 2) return sort_merge(vm, list, cmp);
+
+    size_t len = list->len;
+    cs_value* tmp = (cs_value*)malloc(sizeof(cs_value) * len);
+    if (!tmp) { cs_error(vm, "out of memory"); return 1; }
+
+    size_t bounds[CS_PSORT_MAX_THREADS + 1];
+    for (size_t i = 0; i <= nthreads; i++) bounds[i] = len * i / nthreads;
+
+    psort_job jobs[CS_PSORT_MAX_THREADS];
+    for (size_t i = 0; i < nthreads; i++) {
+        jobs[i].kind = kind;
+        jobs[i].src = list->items;
+        jobs[i].dst = tmp;
+        jobs[i].lo = bounds[i];
+        jobs[i].mid = bounds[i];
+        jobs[i].hi = bounds[i + 1];
+        jobs[i].merge = 0;
+    }
+    psort_run_jobs(jobs, nthreads);
+
+    // Merge adjacent runs pairwise, ping-ponging between the two buffers.
+    cs_value* src = list->items;
+    cs_value* dst = tmp;
+    size_t runs = nthreads;
+    while (runs > 1) {
+        size_t njobs = 0;
+        size_t next = 0;
+        for (size_t r = 0; r < runs; r += 2) {
+            psort_job* job = &jobs[njobs++];
+            job->kind = kind;
+            job->src = src;
+            job->dst = dst;
+            job->lo = bounds[r];
+            if (r + 1 < runs) {
+                job->mid = bounds[r + 1];
+                job->hi = bounds[r + 2];
+            } else {
+                job->mid = bounds[r + 1];
+                job->hi = bounds[r + 1];
+            }
+            job->merge = 1;
+            bounds[next++] = bounds[r];
+        }
+        bounds[next] = len;
+        psort_run_jobs(jobs, njobs);
+        runs = next;
+        cs_value* t = src; src = dst; dst = t;
+    }
+
+    if (src != list->items) memcpy(list->items, src, sizeof(cs_value) * len);
+    free(tmp);
+    return 0;
+}
+
 static int nf_sort(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
@@ -950,6 +1288,7 @@ static int nf_sort(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value
     if (strcmp(algo, "insertion") == 0) rc = sort_insertion(vm, list, cmp);
     else if (strcmp(algo, "quick") == 0 || strcmp(algo, "quicksort") == 0) rc = sort_quick(vm, list, cmp);
     else if (strcmp(algo, "merge") == 0 || strcmp(algo, "mergesort") == 0) rc = sort_merge(vm, list, cmp);
+    else if (strcmp(algo, "parallel") == 0) rc = sort_parallel(vm, list, cmp);
     else {
         cs_error(vm, "sort(): unknown algorithm");
         return 1;
@@ -1721,6 +2060,78 @@ static int nf_write_file_bytes(cs_vm* vm, void* ud, int argc, const cs_value* ar
     return 0;
 }
 
+// Settles a fresh promise with the result of a synchronous file native
+static int file_result_promise(cs_vm* vm, cs_native_fn fn, int argc, const cs_value* argv, cs_value* out) {
+    cs_value val = cs_nil();
+    if (fn(vm, NULL, argc, argv, &val) != 0) return 1;
+    cs_value p = cs_promise_new(vm);
+    cs_promise_resolve(vm, p, val);
+    cs_value_release(val);
+    *out = p;
+    return 0;
+}
+
+// read_file_async(path) -> promise<string|nil>. The read goes through io_uring when the
+// VM uses it (net_set_poll_backend); otherwise the file is read now.
+static int nf_read_file_async(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+#ifndef _WIN32
+    if (argc == 1 && argv[0].type == CS_T_STR && strcmp(cs_io_backend_name(vm), "io_uring") == 0) {
+        char* resolved = resolve_path_alloc(vm, ((cs_string*)argv[0].as.p)->data);
+        if (!resolved) { cs_error(vm, "out of memory"); return 1; }
+        int fd = open(resolved, O_RDONLY | O_CLOEXEC);
+        free(resolved);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            cs_value p = cs_promise_new(vm);
+            if (cs_io_file_read(vm, fd, (size_t)st.st_size, p)) {
+                *out = p;
+                return 0;
+            }
+            cs_value_release(p);
+        }
+        if (fd >= 0) close(fd);
+    }
+#endif
+    return file_result_promise(vm, nf_read_file, argc, argv, out);
+}
+
+// write_file_async(path, data) -> promise<bool>, like read_file_async
+static int nf_write_file_async(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+#ifndef _WIN32
+    if (argc == 2 && argv[0].type == CS_T_STR && (argv[1].type == CS_T_STR || argv[1].type == CS_T_BYTES) &&
+        strcmp(cs_io_backend_name(vm), "io_uring") == 0) {
+        const char* data;
+        size_t len;
+        if (argv[1].type == CS_T_STR) {
+            data = ((cs_string*)argv[1].as.p)->data;
+            len = ((cs_string*)argv[1].as.p)->len;
+        } else {
+            cs_bytes_obj* b = (cs_bytes_obj*)argv[1].as.p;
+            data = (const char*)b->data;
+            len = b->len;
+        }
+        char* resolved = resolve_path_alloc(vm, ((cs_string*)argv[0].as.p)->data);
+        if (!resolved) { cs_error(vm, "out of memory"); return 1; }
+        int fd = len > 0 ? open(resolved, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) : -1;
+        free(resolved);
+        if (fd >= 0) {
+            cs_value p = cs_promise_new(vm);
+            if (cs_io_file_write(vm, fd, data, len, p)) {
+                *out = p;
+                return 0;
+            }
+            cs_value_release(p);
+            close(fd);
+        }
+    }
+#endif
+    return file_result_promise(vm, nf_write_file, argc, argv, out);
+}
+
 static int nf_exists(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
@@ -2157,48 +2568,41 @@ static int nf_glob(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value
 
 // ---------- File Watching with inotify ----------
 
-#define MAX_WATCHES 256
 #define INOTIFY_EVENT_SIZE (sizeof(struct inotify_event))
 #define INOTIFY_BUF_LEN (1024 * (INOTIFY_EVENT_SIZE + 16))
 
-typedef struct {
-    int handle_id;
-    int inotify_fd;
-    int watch_fd;
-    char* path;
-    cs_value callback;
-    int is_directory;
-    int recursive;
-} file_watch;
-
-static file_watch* watches[MAX_WATCHES];
-static int next_watch_handle = 1;
-static int inotify_global_fd = -1;
-
-static void init_inotify() {
-    if (inotify_global_fd < 0) {
-        inotify_global_fd = inotify_init1(IN_NONBLOCK);
+// Each VM has its own inotify descriptor and watch table, so VMs on different threads
+// never read each other's events or call each other's callbacks.
+static int init_inotify(cs_vm* vm) {
+    if (!vm->watches) {
+        vm->watches = (cs_file_watch**)calloc(CS_MAX_WATCHES, sizeof(cs_file_watch*));
+        if (!vm->watches) return 0;
+    }
+    if (vm->inotify_fd < 0) {
+        vm->inotify_fd = inotify_init1(IN_NONBLOCK);
     }
+    return vm->inotify_fd >= 0;
 }
 
-static int find_watch_by_handle(int handle) {
-    for (int i = 0; i < MAX_WATCHES; i++) {
-        if (watches[i] && watches[i]->handle_id == handle) return i;
+static int find_watch_by_handle(cs_vm* vm, int handle) {
+    if (!vm->watches) return -1;
+    for (int i = 0; i < CS_MAX_WATCHES; i++) {
+        if (vm->watches[i] && vm->watches[i]->handle_id == handle) return i;
     }
     return -1;
 }
 
-static void cleanup_watch(int idx) {
-    if (idx < 0 || idx >= MAX_WATCHES || !watches[idx]) return;
+static void cleanup_watch(cs_vm* vm, int idx) {
+    if (!vm->watches || idx < 0 || idx >= CS_MAX_WATCHES || !vm->watches[idx]) return;
     
-    file_watch* w = watches[idx];
-    if (w->watch_fd >= 0 && inotify_global_fd >= 0) {
-        inotify_rm_watch(inotify_global_fd, w->watch_fd);
+    cs_file_watch* w = vm->watches[idx];
+    if (w->watch_fd >= 0 && vm->inotify_fd >= 0) {
+        inotify_rm_watch(vm->inotify_fd, w->watch_fd);
     }
     free(w->path);
     cs_value_release(w->callback);
     free(w);
-    watches[idx] = NULL;
+    vm->watches[idx] = NULL;
 }
 
 static const char* inotify_event_type(uint32_t mask) {
@@ -2210,10 +2614,10 @@ static const char* inotify_event_type(uint32_t mask) {
 }
 
 static void process_inotify_events(cs_vm* vm) {
-    if (inotify_global_fd < 0) return;
+    if (vm->inotify_fd < 0 || !vm->watches) return;
     
     char buffer[INOTIFY_BUF_LEN];
-    ssize_t len = read(inotify_global_fd, buffer, INOTIFY_BUF_LEN);
+    ssize_t len = read(vm->inotify_fd, buffer, INOTIFY_BUF_LEN);
     if (len < 0) return;
     
     int i = 0;
@@ -2221,9 +2625,9 @@ static void process_inotify_events(cs_vm* vm) {
         struct inotify_event* event = (struct inotify_event*)&buffer[i];
         
         // Find the watch that corresponds to this event
-        for (int w = 0; w < MAX_WATCHES; w++) {
-            if (watches[w] && watches[w]->watch_fd == event->wd) {
-                file_watch* watch = watches[w];
+        for (int w = 0; w < CS_MAX_WATCHES; w++) {
+            if (vm->watches[w] && vm->watches[w]->watch_fd == event->wd) {
+                cs_file_watch* watch = vm->watches[w];
                 
                 // Build full path
                 char* event_path = watch->path;
@@ -2262,8 +2666,7 @@ static int nf_watch_file(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
         return 0;
     }
     
-    init_inotify();
-    if (inotify_global_fd < 0) {
+    if (!init_inotify(vm)) {
         cs_error(vm, "failed to initialize inotify");
         return 1;
     }
@@ -2277,8 +2680,8 @@ static int nf_watch_file(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
     
     // Find free slot
     int slot = -1;
-    for (int i = 0; i < MAX_WATCHES; i++) {
-        if (!watches[i]) {
+    for (int i = 0; i < CS_MAX_WATCHES; i++) {
+        if (!vm->watches[i]) {
             slot = i;
             break;
         }
@@ -2290,7 +2693,7 @@ static int nf_watch_file(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
         return 1;
     }
     
-    int wd = inotify_add_watch(inotify_global_fd, resolved, 
+    int wd = inotify_add_watch(vm->inotify_fd, resolved, 
                                IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE);
     if (wd < 0) {
         free(resolved);
@@ -2298,23 +2701,22 @@ static int nf_watch_file(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
         return 1;
     }
     
-    file_watch* w = (file_watch*)malloc(sizeof(file_watch));
+    cs_file_watch* w = (cs_file_watch*)malloc(sizeof(cs_file_watch));
     if (!w) {
-        inotify_rm_watch(inotify_global_fd, wd);
+        inotify_rm_watch(vm->inotify_fd, wd);
         free(resolved);
         cs_error(vm, "out of memory");
         return 1;
     }
     
-    w->handle_id = next_watch_handle++;
-    w->inotify_fd = inotify_global_fd;
+    w->handle_id = vm->next_watch_handle++;
     w->watch_fd = wd;
     w->path = resolved;
     w->callback = cs_value_copy(argv[1]);
     w->is_directory = 0;
     w->recursive = 0;
     
-    watches[slot] = w;
+    vm->watches[slot] = w;
     *out = cs_int(w->handle_id);
     return 0;
 }
@@ -2332,8 +2734,7 @@ static int nf_watch_dir(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_
         recursive = argv[2].as.b;
     }
     
-    init_inotify();
-    if (inotify_global_fd < 0) {
+    if (!init_inotify(vm)) {
         cs_error(vm, "failed to initialize inotify");
         return 1;
     }
@@ -2347,8 +2748,8 @@ static int nf_watch_dir(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_
     
     // Find free slot
     int slot = -1;
-    for (int i = 0; i < MAX_WATCHES; i++) {
-        if (!watches[i]) {
+    for (int i = 0; i < CS_MAX_WATCHES; i++) {
+        if (!vm->watches[i]) {
             slot = i;
             break;
         }
@@ -2363,36 +2764,34 @@ static int nf_watch_dir(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_
     uint32_t mask = IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE;
     if (recursive) mask |= IN_CREATE; // Watch for new subdirectories
     
-    int wd = inotify_add_watch(inotify_global_fd, resolved, mask);
+    int wd = inotify_add_watch(vm->inotify_fd, resolved, mask);
     if (wd < 0) {
         free(resolved);
         cs_error(vm, "failed to add watch");
         return 1;
     }
     
-    file_watch* w = (file_watch*)malloc(sizeof(file_watch));
+    cs_file_watch* w = (cs_file_watch*)malloc(sizeof(cs_file_watch));
     if (!w) {
-        inotify_rm_watch(inotify_global_fd, wd);
+        inotify_rm_watch(vm->inotify_fd, wd);
         free(resolved);
         cs_error(vm, "out of memory");
         return 1;
     }
     
-    w->handle_id = next_watch_handle++;
-    w->inotify_fd = inotify_global_fd;
+    w->handle_id = vm->next_watch_handle++;
     w->watch_fd = wd;
     w->path = resolved;
     w->callback = cs_value_copy(argv[1]);
     w->is_directory = 1;
     w->recursive = recursive;
     
-    watches[slot] = w;
+    vm->watches[slot] = w;
     *out = cs_int(w->handle_id);
     return 0;
 }
 
 static int nf_unwatch(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
-    (void)vm;
     (void)ud;
     if (!out) return 0;
     if (argc != 1 || argv[0].type != CS_T_INT) {
@@ -2401,13 +2800,13 @@ static int nf_unwatch(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_va
     }
     
     int handle = (int)argv[0].as.i;
-    int idx = find_watch_by_handle(handle);
+    int idx = find_watch_by_handle(vm, handle);
     if (idx < 0) {
         *out = cs_bool(0);
         return 0;
     }
     
-    cleanup_watch(idx);
+    cleanup_watch(vm, idx);
     *out = cs_bool(1);
     return 0;
 }
@@ -2426,11 +2825,14 @@ static int nf_process_file_watches(cs_vm* vm, void* ud, int argc, const cs_value
 // ---------- Temp Files ----------
 
 #define MAX_TEMP_FILES 512
+// Process-wide: temp files are removed at exit whichever VM created them.
 static char* temp_files[MAX_TEMP_FILES];
 static int temp_file_count = 0;
 static int temp_cleanup_registered = 0;
+static pthread_mutex_t temp_files_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void cleanup_temp_files() {
+    pthread_mutex_lock(&temp_files_lock);
     for (int i = 0; i < temp_file_count; i++) {
         if (temp_files[i]) {
             remove(temp_files[i]);
@@ -2439,9 +2841,11 @@ static void cleanup_temp_files() {
             temp_files[i] = NULL;
         }
     }
+    pthread_mutex_unlock(&temp_files_lock);
 }
 
 static void register_temp_cleanup(const char* path) {
+    pthread_mutex_lock(&temp_files_lock);
     if (!temp_cleanup_registered) {
         atexit(cleanup_temp_files);
         temp_cleanup_registered = 1;
@@ -2450,6 +2854,7 @@ static void register_temp_cleanup(const char* path) {
     if (temp_file_count < MAX_TEMP_FILES) {
         temp_files[temp_file_count++] = cs_strdup2_local(path);
     }
+    pthread_mutex_unlock(&temp_files_lock);
 }
 
 static char* create_temp_path(const char* prefix, const char* suffix, int is_dir) {
@@ -7856,34 +8261,46 @@ static int nf_now_ms(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_val
 #endif
 }
 
-static uint64_t stdlib_now_ms(void) {
-#if !defined(_WIN32)
-    struct timeval tv;
-    if (gettimeofday(&tv, NULL) != 0) return 0;
-    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)(tv.tv_usec / 1000);
-#else
-    return (uint64_t)(clock() * 1000 / (uint64_t)CLOCKS_PER_SEC);
-#endif
+// now_ns() -> int: monotonic clock in nanoseconds, for measuring intervals
+static int nf_now_ns(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)vm; (void)ud; (void)argc; (void)argv;
+    if (!out) return 0;
+    *out = cs_int((int64_t)cs_monotonic_ns());
+    return 0;
 }
 
+// sleep(ms) -> promise; ms may be a float for sub-millisecond delays
 static int nf_sleep(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
-    if (argc != 1 || argv[0].type != CS_T_INT) { *out = cs_nil(); return 0; }
-    int64_t ms = argv[0].as.i;
+    if (argc != 1 || (argv[0].type != CS_T_INT && argv[0].type != CS_T_FLOAT)) { *out = cs_nil(); return 0; }
+    double ms = argv[0].type == CS_T_INT ? (double)argv[0].as.i : argv[0].as.f;
     cs_value p = cs_promise_new(vm);
     if (p.type != CS_T_PROMISE) { cs_error(vm, "out of memory"); return 1; }
-    if (ms <= 0) {
+    if (!(ms > 0)) {
         cs_promise_resolve(vm, p, cs_nil());
         *out = p;
         return 0;
     }
-    uint64_t due = stdlib_now_ms() + (uint64_t)ms;
-    cs_schedule_timer(vm, p, due);
+    if (ms > 9.0e12) ms = 9.0e12;  // keep the deadline inside uint64 nanoseconds
+    if (!cs_schedule_timer_ns(vm, p, (uint64_t)(ms * 1000000.0))) {
+        cs_value_release(p);
+        cs_error(vm, "out of memory");
+        return 1;
+    }
     *out = p;
     return 0;
 }
 
+// cancel_timer(p) -> bool: disarm a pending sleep/delay promise and reject it with
+// "cancelled". False if p is not an armed timer (already fired or cancelled).
+static int nf_cancel_timer(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (!out) return 0;
+    *out = cs_bool(argc == 1 && cs_cancel_timer(vm, argv[0]));
+    return 0;
+}
+
 static int nf_promise(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud; (void)argc; (void)argv;
     if (!out) return 0;
@@ -8115,6 +8532,9 @@ static int nf_items(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_valu
 static int nf_enumerate(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc == 1 && is_lazy_source(argv[0])) {
+        return iter_stage_new(vm, iter_stage_enumerate, argv[0], cs_nil(), 0, out);
+    }
     if (argc != 1 || argv[0].type != CS_T_LIST) { *out = cs_list(vm); return 0; }
     cs_list_obj* l = (cs_list_obj*)argv[0].as.p;
     cs_value outer = cs_list(vm);
@@ -8143,6 +8563,13 @@ static int nf_enumerate(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_
 static int nf_zip(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc == 2 && (is_lazy_source(argv[0]) || is_lazy_source(argv[1]))) {
+        cs_value other = cs_iter_from(vm, argv[1]);
+        if (other.type != CS_T_ITER) { cs_error(vm, "zip(): arguments must be iterable"); return 1; }
+        int rc = iter_stage_new(vm, iter_stage_zip, argv[0], other, 0, out);
+        cs_value_release(other);
+        return rc;
+    }
     if (argc != 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_LIST) { *out = cs_list(vm); return 0; }
     cs_list_obj* a = (cs_list_obj*)argv[0].as.p;
     cs_list_obj* b = (cs_list_obj*)argv[1].as.p;
@@ -8227,6 +8654,10 @@ static int nf_all(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value*
 static int nf_filter(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc == 2 && is_lazy_source(argv[0])) {
+        if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "filter(): predicate must be a function"); return 1; }
+        return iter_stage_new(vm, iter_stage_filter, argv[0], argv[1], 0, out);
+    }
     if (argc != 2 || argv[0].type != CS_T_LIST) { *out = cs_list(vm); return 0; }
     if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "filter(): predicate must be a function"); return 1; }
     cs_list_obj* l = (cs_list_obj*)argv[0].as.p;
@@ -8250,6 +8681,31 @@ static int nf_filter(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_val
 static int nf_reduce(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc >= 2 && is_lazy_source(argv[0])) {
+        if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "reduce(): reducer must be a function"); return 1; }
+        cs_value it = cs_iter_from(vm, argv[0]);
+        if (it.type != CS_T_ITER) { cs_error(vm, "out of memory"); return 1; }
+        cs_value acc = cs_nil();
+        int rc = 1;
+        if (argc >= 3) acc = cs_value_copy(argv[2]);
+        else rc = cs_iter_next(vm, it, &acc);
+        while (rc > 0) {
+            cs_value v = cs_nil();
+            rc = cs_iter_next(vm, it, &v);
+            if (rc <= 0) break;
+            cs_value args[2] = { acc, v };
+            cs_value ret = cs_nil();
+            int failed = cs_call_value(vm, argv[1], 2, args, &ret) != 0;
+            cs_value_release(v);
+            if (failed) { rc = -1; break; }
+            cs_value_release(acc);
+            acc = ret;
+        }
+        cs_value_release(it);
+        if (rc < 0) { cs_value_release(acc); return 1; }
+        *out = acc;
+        return 0;
+    }
     if (argc < 2 || argv[0].type != CS_T_LIST) { *out = cs_nil(); return 0; }
     if (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_NATIVE) { cs_error(vm, "reduce(): reducer must be a function"); return 1; }
     cs_list_obj* l = (cs_list_obj*)argv[0].as.p;
@@ -8542,6 +8998,31 @@ static int nf_get_instruction_count(cs_vm* vm, void* ud, int argc, const cs_valu
     return 0;
 }
 
+static int nf_prof_stats(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud; (void)argc; (void)argv;
+    if (!out) return 0;
+
+    cs_value stats_map = cs_map(vm);
+    if (stats_map.type != CS_T_MAP) {
+        *out = cs_nil();
+        return 0;
+    }
+
+    cs_map_set(stats_map, "string_ops", cs_int((int64_t)vm->prof_string_ops));
+    cs_map_set(stats_map, "string_ms", cs_int((int64_t)vm->prof_string_ms));
+    cs_map_set(stats_map, "pipe_ops", cs_int((int64_t)vm->prof_pipe_ops));
+    cs_map_set(stats_map, "pipe_ms", cs_int((int64_t)vm->prof_pipe_ms));
+    cs_map_set(stats_map, "match_ops", cs_int((int64_t)vm->prof_match_ops));
+    cs_map_set(stats_map, "match_ms", cs_int((int64_t)vm->prof_match_ms));
+    cs_map_set(stats_map, "optchain_ops", cs_int((int64_t)vm->prof_optchain_ops));
+    cs_map_set(stats_map, "optchain_ms", cs_int((int64_t)vm->prof_optchain_ms));
+    cs_map_set(stats_map, "ic_hits", cs_int((int64_t)vm->prof_ic_hits));
+    cs_map_set(stats_map, "ic_misses", cs_int((int64_t)vm->prof_ic_misses));
+
+    *out = stats_map;
+    return 0;
+}
+
 static int nf_range(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
@@ -8808,12 +9289,29 @@ static int nf_exp(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value*
     return 0;
 }
 
+#if !defined(_WIN32)
+static pthread_once_t random_seed_once = PTHREAD_ONCE_INIT;
+
+static void random_seed_init(void) {
+    srand((unsigned int)time(NULL));
+}
+#endif
+
+// Seeds rand() once per process, even when several VMs start on different threads.
+static void seed_random(void) {
+#if !defined(_WIN32)
+    pthread_once(&random_seed_once, random_seed_init);
+#else
+    static int seeded = 0;
+    if (!seeded) { srand((unsigned int)time(NULL)); seeded = 1; }
+#endif
+}
+
 static int nf_random(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)vm; (void)ud; (void)argv;
     if (!out) return 0;
     if (argc != 0) { *out = cs_nil(); return 0; }
-    static int seeded = 0;
-    if (!seeded) { srand((unsigned int)time(NULL)); seeded = 1; }
+    seed_random();
     double r = (double)rand() / ((double)RAND_MAX + 1.0);
     *out = cs_float(r);
     return 0;
@@ -8912,8 +9410,7 @@ static int nf_random_int(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
         return 0; 
     }
     
-    static int seeded = 0;
-    if (!seeded) { srand((unsigned int)time(NULL)); seeded = 1; }
+    seed_random();
     
     int64_t min_val = (int64_t)to_number(argv[0]);
     int64_t max_val = (int64_t)to_number(argv[1]);
@@ -8944,8 +9441,7 @@ static int nf_random_choice(cs_vm* vm, void* ud, int argc, const cs_value* argv,
         return 0;
     }
     
-    static int seeded = 0;
-    if (!seeded) { srand((unsigned int)time(NULL)); seeded = 1; }
+    seed_random();
     
     size_t idx = (size_t)(rand() % list->len);
     *out = cs_value_copy(list->items[idx]);
@@ -8966,8 +9462,7 @@ static int nf_shuffle(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_va
         return 0;
     }
     
-    static int seeded = 0;
-    if (!seeded) { srand((unsigned int)time(NULL)); seeded = 1; }
+    seed_random();
     
     // Fisher-Yates shuffle
     for (size_t i = list->len - 1; i > 0; i--) {
@@ -9201,14 +9696,167 @@ static int nf_split_lines(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
     return 0;
 }
 
-static int list_contains_value_local(cs_list_obj* l, cs_value v) {
-    if (!l) return 0;
-    for (size_t i = 0; i < l->len; i++) {
-        if (cs_value_equals(&l->items[i], &v)) return 1;
+// ---------- Temporary value index for list set operations ----------
+// Every value hashes by content, consistently with cs_value_equals: lists and
+// tuples combine their items in order, maps combine key/value pairs order-free.
+// Nesting deeper than VALUE_INDEX_HASH_DEPTH hashes to a constant, so a deep or
+// cyclic container costs a bounded walk and equality settles the rest.
+// Values are borrowed: the index must not outlive the lists it was fed from.
+#define VALUE_INDEX_HASH_DEPTH 8
+
+typedef struct {
+    cs_value* slots;
+    uint32_t* hashes;
+    unsigned char* used;
+    size_t cap;
+    size_t len;
+} value_index;
+
+static uint32_t value_index_hash(cs_value v, int depth) {
+    if (depth >= VALUE_INDEX_HASH_DEPTH) return 0x27d4eb2fu;
+    switch (v.type) {
+        case CS_T_LIST: {
+            cs_list_obj* l = (cs_list_obj*)v.as.p;
+            uint32_t h = 0x165667b1u ^ (uint32_t)(l ? l->len : 0);
+            for (size_t i = 0; l && i < l->len; i++) {
+                h = (h ^ value_index_hash(l->items[i], depth + 1)) * 0x01000193u;
+            }
+            return h;
+        }
+        case CS_T_TUPLE: {
+            cs_tuple_obj* t = (cs_tuple_obj*)v.as.p;
+            uint32_t h = 0xd3a2646cu ^ (uint32_t)(t ? t->len : 0);
+            for (size_t i = 0; t && i < t->len; i++) {
+                h = (h ^ value_index_hash(t->fields[i].value, depth + 1)) * 0x01000193u;
+            }
+            return h;
+        }
+        case CS_T_MAP: {
+            cs_map_obj* m = (cs_map_obj*)v.as.p;
+            uint32_t h = 0xfd7046c5u;
+            for (size_t i = 0; m && i < m->cap; i++) {
+                if (!m->entries[i].in_use) continue;
+                uint32_t kh = value_index_hash(m->entries[i].key, depth + 1);
+                uint32_t vh = value_index_hash(m->entries[i].val, depth + 1);
+                h += (kh * 0x9e3779b1u) ^ vh;  // commutative: entry order is irrelevant
+            }
+            return h;
+        }
+        default:
+            return cs_value_hash(v);
+    }
+}
+
+static int value_index_init(value_index* ix, size_t expected) {
+    memset(ix, 0, sizeof(*ix));
+    size_t cap = 16;
+    while (cap < expected * 2 + 1) cap *= 2;
+    ix->slots = (cs_value*)malloc(sizeof(cs_value) * cap);
+    ix->hashes = (uint32_t*)malloc(sizeof(uint32_t) * cap);
+    ix->used = (unsigned char*)calloc(cap, 1);
+    if (!ix->slots || !ix->hashes || !ix->used) {
+        free(ix->slots);
+        free(ix->hashes);
+        free(ix->used);
+        return 0;
+    }
+    ix->cap = cap;
+    return 1;
+}
+
+static void value_index_free(value_index* ix) {
+    free(ix->slots);
+    free(ix->hashes);
+    free(ix->used);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static int value_index_has(const value_index* ix, cs_value v) {
+    uint32_t h = value_index_hash(v, 0);
+    size_t mask = ix->cap - 1;
+    for (size_t i = (size_t)h & mask; ix->used[i]; i = (i + 1) & mask) {
+        if (ix->hashes[i] == h && cs_value_equals(&ix->slots[i], &v)) return 1;
     }
     return 0;
 }
 
+static int value_index_grow(value_index* ix) {
+    value_index bigger;
+    if (!value_index_init(&bigger, ix->cap)) return 0;
+    size_t mask = bigger.cap - 1;
+    for (size_t i = 0; i < ix->cap; i++) {
+        if (!ix->used[i]) continue;
+        size_t j = (size_t)ix->hashes[i] & mask;
+        while (bigger.used[j]) j = (j + 1) & mask;
+        bigger.used[j] = 1;
+        bigger.slots[j] = ix->slots[i];
+        bigger.hashes[j] = ix->hashes[i];
+    }
+    free(ix->slots);
+    free(ix->hashes);
+    free(ix->used);
+    ix->slots = bigger.slots;
+    ix->hashes = bigger.hashes;
+    ix->used = bigger.used;
+    ix->cap = bigger.cap;
+    return 1;
+}
+
+// Returns 1 if added, 0 if already present, -1 on out of memory.
+static int value_index_add(value_index* ix, cs_value v) {
+    if ((ix->len + 1) * 10 >= ix->cap * 7 && !value_index_grow(ix)) return -1;
+    uint32_t h = value_index_hash(v, 0);
+    size_t mask = ix->cap - 1;
+    size_t i = (size_t)h & mask;
+    for (; ix->used[i]; i = (i + 1) & mask) {
+        if (ix->hashes[i] == h && cs_value_equals(&ix->slots[i], &v)) return 0;
+    }
+    ix->used[i] = 1;
+    ix->slots[i] = v;
+    ix->hashes[i] = h;
+    ix->len++;
+    return 1;
+}
+
+static int value_index_add_list(value_index* ix, const cs_list_obj* l) {
+    for (size_t i = 0; l && i < l->len; i++) {
+        if (value_index_add(ix, l->items[i]) < 0) return 0;
+    }
+    return 1;
+}
+
+// Membership against the right-hand operand of a list set operation: sets use
+// their own hash table, lists are indexed once up front.
+typedef struct {
+    cs_value set;
+    value_index ix;
+} member_lookup;
+
+static int member_lookup_init(member_lookup* ml, cs_value other) {
+    memset(ml, 0, sizeof(*ml));
+    ml->set = cs_nil();
+    if (other.type == CS_T_SET) { ml->set = other; return 1; }
+    cs_list_obj* l = (cs_list_obj*)other.as.p;
+    if (!value_index_init(&ml->ix, l ? l->len : 0)) return 0;
+    if (!value_index_add_list(&ml->ix, l)) { value_index_free(&ml->ix); return 0; }
+    return 1;
+}
+
+static int member_lookup_has(const member_lookup* ml, cs_value v) {
+    if (ml->set.type == CS_T_SET) return cs_map_has_value(ml->set, v) != 0;
+    return value_index_has(&ml->ix, v);
+}
+
+static void member_lookup_free(member_lookup* ml) {
+    if (ml->set.type != CS_T_SET) value_index_free(&ml->ix);
+}
+
+static int list_push_copy_local(cs_list_obj* l, cs_value v) {
+    if (!list_ensure(l, l->len + 1)) return 0;
+    l->items[l->len++] = cs_value_copy(v);
+    return 1;
+}
+
 static int nf_list_unique(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
@@ -9217,13 +9865,19 @@ static int nf_list_unique(cs_vm* vm, void* ud, int argc, const cs_value* argv, c
     cs_value listv = cs_list(vm);
     if (!listv.as.p) { cs_error(vm, "out of memory"); return 1; }
     cs_list_obj* outl = (cs_list_obj*)listv.as.p;
+    value_index seen;
+    if (!value_index_init(&seen, src->len)) { cs_value_release(listv); cs_error(vm, "out of memory"); return 1; }
     for (size_t i = 0; i < src->len; i++) {
         cs_value item = src->items[i];
-        if (!list_contains_value_local(outl, item)) {
-            if (!list_ensure(outl, outl->len + 1)) { cs_value_release(listv); cs_error(vm, "out of memory"); return 1; }
-            outl->items[outl->len++] = cs_value_copy(item);
+        int added = value_index_add(&seen, item);
+        if (added < 0 || (added > 0 && !list_push_copy_local(outl, item))) {
+            value_index_free(&seen);
+            cs_value_release(listv);
+            cs_error(vm, "out of memory");
+            return 1;
         }
     }
+    value_index_free(&seen);
     *out = listv;
     return 0;
 }
@@ -9776,33 +10430,46 @@ static int nf_event_loop_running(cs_vm* vm, void* ud, int argc, const cs_value*
 static int nf_list_intersection(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
-    if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_LIST) { 
+    if (argc < 2 || argv[0].type != CS_T_LIST || (argv[1].type != CS_T_LIST && argv[1].type != CS_T_SET)) {
         *out = cs_list(vm);
         return 0;
     }
     
     cs_list_obj* list1 = (cs_list_obj*)argv[0].as.p;
-    cs_list_obj* list2 = (cs_list_obj*)argv[1].as.p;
     cs_value result = cs_list(vm);
     if (!result.as.p) { cs_error(vm, "out of memory"); return 1; }
     cs_list_obj* outl = (cs_list_obj*)result.as.p;
+
+    member_lookup other;
+    value_index seen;
+    if (!member_lookup_init(&other, argv[1])) {
+        cs_value_release(result);
+        cs_error(vm, "out of memory");
+        return 1;
+    }
+    if (!value_index_init(&seen, list1->len)) {
+        member_lookup_free(&other);
+        cs_value_release(result);
+        cs_error(vm, "out of memory");
+        return 1;
+    }
     
     for (size_t i = 0; i < list1->len; i++) {
         cs_value item = list1->items[i];
-        // Check if item exists in list2 and not already in result
-        int found_in_list2 = list_contains_value_local(list2, item);
-        int found_in_result = list_contains_value_local(outl, item);
-        
-        if (found_in_list2 && !found_in_result) {
-            if (!list_ensure(outl, outl->len + 1)) { 
-                cs_value_release(result); 
-                cs_error(vm, "out of memory"); 
-                return 1; 
-            }
-            outl->items[outl->len++] = cs_value_copy(item);
+        // Keep the first occurrence of each item that is also in the other operand
+        if (!member_lookup_has(&other, item)) continue;
+        int added = value_index_add(&seen, item);
+        if (added < 0 || (added > 0 && !list_push_copy_local(outl, item))) {
+            value_index_free(&seen);
+            member_lookup_free(&other);
+            cs_value_release(result);
+            cs_error(vm, "out of memory");
+            return 1;
         }
     }
     
+    value_index_free(&seen);
+    member_lookup_free(&other);
     *out = result;
     return 0;
 }
@@ -9810,30 +10477,36 @@ static int nf_list_intersection(cs_vm* vm, void* ud, int argc, const cs_value* a
 static int nf_list_difference(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
-    if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_LIST) { 
+    if (argc < 2 || argv[0].type != CS_T_LIST || (argv[1].type != CS_T_LIST && argv[1].type != CS_T_SET)) {
         *out = cs_list(vm);
         return 0;
     }
     
     cs_list_obj* list1 = (cs_list_obj*)argv[0].as.p;
-    cs_list_obj* list2 = (cs_list_obj*)argv[1].as.p;
     cs_value result = cs_list(vm);
     if (!result.as.p) { cs_error(vm, "out of memory"); return 1; }
     cs_list_obj* outl = (cs_list_obj*)result.as.p;
+
+    member_lookup other;
+    if (!member_lookup_init(&other, argv[1])) {
+        cs_value_release(result);
+        cs_error(vm, "out of memory");
+        return 1;
+    }
     
     for (size_t i = 0; i < list1->len; i++) {
         cs_value item = list1->items[i];
-        // Add to result if not in list2
-        if (!list_contains_value_local(list2, item)) {
-            if (!list_ensure(outl, outl->len + 1)) { 
-                cs_value_release(result); 
-                cs_error(vm, "out of memory"); 
-                return 1; 
-            }
-            outl->items[outl->len++] = cs_value_copy(item);
+        // Add to result if not in the other operand
+        if (member_lookup_has(&other, item)) continue;
+        if (!list_push_copy_local(outl, item)) {
+            member_lookup_free(&other);
+            cs_value_release(result);
+            cs_error(vm, "out of memory");
+            return 1;
         }
     }
     
+    member_lookup_free(&other);
     *out = result;
     return 0;
 }
@@ -9841,43 +10514,46 @@ static int nf_list_difference(cs_vm* vm, void* ud, int argc, const cs_value* arg
 static int nf_list_union(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
-    if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_LIST) { 
+    if (argc < 2 || argv[0].type != CS_T_LIST || (argv[1].type != CS_T_LIST && argv[1].type != CS_T_SET)) {
         *out = cs_list(vm);
         return 0;
     }
     
     cs_list_obj* list1 = (cs_list_obj*)argv[0].as.p;
-    cs_list_obj* list2 = (cs_list_obj*)argv[1].as.p;
+    cs_map_obj* set2 = (argv[1].type == CS_T_SET) ? (cs_map_obj*)argv[1].as.p : NULL;
+    cs_list_obj* list2 = set2 ? NULL : (cs_list_obj*)argv[1].as.p;
+    size_t len2 = set2 ? set2->len : list2->len;
     cs_value result = cs_list(vm);
     if (!result.as.p) { cs_error(vm, "out of memory"); return 1; }
     cs_list_obj* outl = (cs_list_obj*)result.as.p;
-    
-    // Add all items from list1
-    for (size_t i = 0; i < list1->len; i++) {
-        cs_value item = list1->items[i];
-        if (!list_contains_value_local(outl, item)) {
-            if (!list_ensure(outl, outl->len + 1)) { 
-                cs_value_release(result); 
-                cs_error(vm, "out of memory"); 
-                return 1; 
-            }
-            outl->items[outl->len++] = cs_value_copy(item);
-        }
+
+    value_index seen;
+    if (!value_index_init(&seen, list1->len + len2)) {
+        cs_value_release(result);
+        cs_error(vm, "out of memory");
+        return 1;
     }
     
-    // Add items from list2 that aren't already in result
-    for (size_t i = 0; i < list2->len; i++) {
-        cs_value item = list2->items[i];
-        if (!list_contains_value_local(outl, item)) {
-            if (!list_ensure(outl, outl->len + 1)) { 
-                cs_value_release(result); 
-                cs_error(vm, "out of memory"); 
-                return 1; 
-            }
-            outl->items[outl->len++] = cs_value_copy(item);
-        }
+    // Add all items from list1, then items from the other operand that aren't already in result
+    int ok = 1;
+    for (size_t i = 0; ok && i < list1->len; i++) {
+        int added = value_index_add(&seen, list1->items[i]);
+        if (added < 0 || (added > 0 && !list_push_copy_local(outl, list1->items[i]))) ok = 0;
+    }
+    size_t cap2 = set2 ? set2->cap : list2->len;
+    for (size_t i = 0; ok && i < cap2; i++) {
+        if (set2 && !set2->entries[i].in_use) continue;
+        cs_value item = set2 ? set2->entries[i].key : list2->items[i];
+        int added = value_index_add(&seen, item);
+        if (added < 0 || (added > 0 && !list_push_copy_local(outl, item))) ok = 0;
     }
     
+    value_index_free(&seen);
+    if (!ok) {
+        cs_value_release(result);
+        cs_error(vm, "out of memory");
+        return 1;
+    }
     *out = result;
     return 0;
 }
@@ -9885,18 +10561,28 @@ static int nf_list_union(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs
 static int nf_list_partition(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
-    if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_FUNC) {
+    if (argc < 2 || argv[0].type != CS_T_LIST ||
+        (argv[1].type != CS_T_FUNC && argv[1].type != CS_T_LIST && argv[1].type != CS_T_SET)) {
         *out = cs_nil();
         return 0;
     }
     
     cs_list_obj* src = (cs_list_obj*)argv[0].as.p;
     cs_value predicate = argv[1];
+
+    // A list or set instead of a predicate partitions by membership.
+    int by_member = (predicate.type != CS_T_FUNC);
+    member_lookup members;
+    if (by_member && !member_lookup_init(&members, predicate)) {
+        cs_error(vm, "out of memory");
+        return 1;
+    }
     
     // Create two lists: [truthy, falsy]
     cs_value truthy_list = cs_list(vm);
     cs_value falsy_list = cs_list(vm);
     if (!truthy_list.as.p || !falsy_list.as.p) {
+        if (by_member) member_lookup_free(&members);
         cs_value_release(truthy_list);
         cs_value_release(falsy_list);
         cs_error(vm, "out of memory");
@@ -9908,22 +10594,28 @@ static int nf_list_partition(cs_vm* vm, void* ud, int argc, const cs_value* argv
     
     for (size_t i = 0; i < src->len; i++) {
         cs_value item = src->items[i];
-        cs_value call_args[1] = { item };
-        cs_value result;
-        
-        int rc = cs_call_value(vm, predicate, 1, call_args, &result);
-        if (rc != 0) {
-            cs_value_release(truthy_list);
-            cs_value_release(falsy_list);
-            return 1;
-        }
-        
-        int is_truthy = (result.type != CS_T_NIL && 
+        int is_truthy;
+        if (by_member) {
+            is_truthy = member_lookup_has(&members, item);
+        } else {
+            cs_value call_args[1] = { item };
+            cs_value result;
+            
+            int rc = cs_call_value(vm, predicate, 1, call_args, &result);
+            if (rc != 0) {
+                cs_value_release(truthy_list);
+                cs_value_release(falsy_list);
+                return 1;
+            }
+            
+            is_truthy = (result.type != CS_T_NIL && 
                         (result.type != CS_T_BOOL || result.as.b));
-        cs_value_release(result);
+            cs_value_release(result);
+        }
         
         cs_list_obj* target = is_truthy ? truthy : falsy;
         if (!list_ensure(target, target->len + 1)) {
+            if (by_member) member_lookup_free(&members);
             cs_value_release(truthy_list);
             cs_value_release(falsy_list);
             cs_error(vm, "out of memory");
@@ -9931,6 +10623,7 @@ static int nf_list_partition(cs_vm* vm, void* ud, int argc, const cs_value* argv
         }
         target->items[target->len++] = cs_value_copy(item);
     }
+    if (by_member) member_lookup_free(&members);
     
     // Return [truthy, falsy] as a list
     cs_value result_list = cs_list(vm);
@@ -9960,6 +10653,9 @@ static int nf_list_partition(cs_vm* vm, void* ud, int argc, const cs_value* argv
 static int nf_take(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc >= 2 && is_lazy_source(argv[0]) && argv[1].type == CS_T_INT) {
+        return iter_stage_new(vm, iter_stage_take, argv[0], cs_nil(), argv[1].as.i, out);
+    }
     if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_INT) {
         *out = cs_list(vm);
         return 0;
@@ -9997,6 +10693,9 @@ static int nf_take(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value
 static int nf_drop(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
     (void)ud;
     if (!out) return 0;
+    if (argc >= 2 && is_lazy_source(argv[0]) && argv[1].type == CS_T_INT) {
+        return iter_stage_new(vm, iter_stage_drop, argv[0], cs_nil(), argv[1].as.i, out);
+    }
     if (argc < 2 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_INT) {
         *out = cs_list(vm);
         return 0;
@@ -10143,6 +10842,9 @@ void cs_register_stdlib(cs_vm* vm) {
     cs_register_native(vm, "filter",    nf_filter,    NULL);
     cs_register_native(vm, "map",       nf_map,       NULL);
     cs_register_native(vm, "reduce",    nf_reduce,    NULL);
+    cs_register_native(vm, "iter",      nf_iter,      NULL);
+    cs_register_native(vm, "collect",   nf_collect,   NULL);
+    cs_register_native(vm, "next",      nf_next,      NULL);
     cs_register_native(vm, "insert", nf_insert, NULL);
     cs_register_native(vm, "remove", nf_remove, NULL);
     cs_register_native(vm, "slice",  nf_slice,  NULL);
@@ -10231,6 +10933,8 @@ void cs_register_stdlib(cs_vm* vm) {
     cs_register_native(vm, "read_file_bytes",  nf_read_file_bytes,  NULL);
     cs_register_native(vm, "write_file", nf_write_file, NULL);
     cs_register_native(vm, "write_file_bytes", nf_write_file_bytes, NULL);
+    cs_register_native(vm, "read_file_async",  nf_read_file_async,  NULL);
+    cs_register_native(vm, "write_file_async", nf_write_file_async, NULL);
     cs_register_native(vm, "exists",     nf_exists,     NULL);
     cs_register_native(vm, "is_dir",     nf_is_dir,     NULL);
     cs_register_native(vm, "is_file",    nf_is_file,    NULL);
@@ -10259,6 +10963,7 @@ void cs_register_stdlib(cs_vm* vm) {
 #endif
     
     cs_register_native(vm, "now_ms",      nf_now_ms,      NULL);
+    cs_register_native(vm, "now_ns",      nf_now_ns,      NULL);
     cs_register_native(vm, "unix_ms",     nf_unix_ms,     NULL);
     cs_register_native(vm, "unix_s",      nf_unix_s,      NULL);
     cs_register_native(vm, "datetime_now",            nf_datetime_now,            NULL);
@@ -10267,6 +10972,7 @@ void cs_register_stdlib(cs_vm* vm) {
     cs_register_native(vm, "datetime_from_unix_ms_utc", nf_datetime_from_unix_ms_utc, NULL);
     cs_register_native(vm, "sleep",       nf_sleep,       NULL);
     cs_register_native(vm, "delay",       nf_sleep,       NULL);
+    cs_register_native(vm, "cancel_timer", nf_cancel_timer, NULL);
     cs_register_native(vm, "promise",     nf_promise,     NULL);
     cs_register_native(vm, "resolve",     nf_resolve,     NULL);
     cs_register_native(vm, "reject",      nf_reject,      NULL);
@@ -10349,6 +11055,7 @@ void cs_register_stdlib(cs_vm* vm) {
     cs_register_native(vm, "get_timeout",            nf_get_timeout,            NULL);
     cs_register_native(vm, "get_instruction_limit",  nf_get_instruction_limit,  NULL);
     cs_register_native(vm, "get_instruction_count",  nf_get_instruction_count,  NULL);
+    cs_register_native(vm, "prof_stats",  nf_prof_stats,  NULL);
     
     // Error code constants (ERR.*)
     cs_value err_map = cs_map(vm);
@@ -10386,4 +11093,5 @@ void cs_register_stdlib(cs_vm* vm) {
     cs_register_net_stdlib(vm);
     cs_register_tls_stdlib(vm);
     cs_register_http_stdlib(vm);
+    cs_register_worker_stdlib(vm);
 }
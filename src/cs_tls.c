@@ -4,13 +4,126 @@
 
 #include "cs_vm.h"
 #include "cs_net.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
 
+// One client context for the process. SSL_CTX is safe to share between threads once
+// configured; the lock only serializes creating and destroying it.
 static SSL_CTX *g_ssl_ctx = NULL;
 static int g_tls_initialized = 0;
+#if defined(_WIN32)
+static SRWLOCK g_tls_lock = SRWLOCK_INIT;
+#define TLS_LOCK() AcquireSRWLockExclusive(&g_tls_lock)
+#define TLS_UNLOCK() ReleaseSRWLockExclusive(&g_tls_lock)
+#else
+static pthread_mutex_t g_tls_lock = PTHREAD_MUTEX_INITIALIZER;
+#define TLS_LOCK() pthread_mutex_lock(&g_tls_lock)
+#define TLS_UNLOCK() pthread_mutex_unlock(&g_tls_lock)
+#endif
 
-int cs_tls_init(void) {
+// ---------- session cache ----------
+// Client sessions are kept for resumption, keyed by "host:port", so a later connection
+// to the same peer skips the full handshake. OpenSSL hands each new session to
+// tls_new_session: for TLS 1.3 that is every ticket, which arrives after the handshake
+// with the first read. A TLS 1.3 ticket is taken out when it is offered, since tickets
+// are meant for one use (RFC 8446 appendix C.4). A TLS 1.2 session stays until it is
+// replaced. The cache is shared by every VM and guarded by g_tls_lock.
+
+#define TLS_SESSION_CACHE_MAX 64
+
+typedef struct tls_session {
+    struct tls_session* next;  // most recently stored first
+    char* key;
+    SSL_SESSION* sess;
+} tls_session;
+
+static tls_session* g_sessions = NULL;
+static int g_session_count = 0;
+static int g_session_cache = 1;   // tls_config({session_cache})
+static int g_key_index = -1;      // SSL ex_data slot holding the session key
+
+static void tls_session_free(tls_session* e) {
+    SSL_SESSION_free(e->sess);
+    free(e->key);
+    free(e);
+}
+
+// Drops the entries for key, or all of them when key is NULL
+static void tls_sessions_drop_locked(const char* key) {
+    tls_session** pp = &g_sessions;
+    while (*pp) {
+        tls_session* e = *pp;
+        if (key && strcmp(e->key, key) != 0) {
+            pp = &e->next;
+            continue;
+        }
+        *pp = e->next;
+        tls_session_free(e);
+        g_session_count--;
+    }
+}
+
+static void tls_key_free(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp) {
+    (void)parent; (void)ad; (void)idx; (void)argl; (void)argp;
+    free(ptr);
+}
+
+// Returns 1 to keep the reference to sess
+static int tls_new_session(SSL* ssl, SSL_SESSION* sess) {
+    const char* key = (const char*)SSL_get_ex_data(ssl, g_key_index);
+    if (!key || !SSL_SESSION_is_resumable(sess)) return 0;
+    tls_session* e = (tls_session*)calloc(1, sizeof(tls_session));
+    char* key_copy = e ? strdup(key) : NULL;
+    if (!key_copy) {
+        free(e);
+        return 0;
+    }
+    e->key = key_copy;
+    e->sess = sess;
+    TLS_LOCK();
+    if (!g_session_cache) {
+        TLS_UNLOCK();
+        free(key_copy);
+        free(e);
+        return 0;
+    }
+    if (SSL_SESSION_get_protocol_version(sess) < TLS1_3_VERSION) tls_sessions_drop_locked(key);
+    e->next = g_sessions;
+    g_sessions = e;
+    g_session_count++;
+    if (g_session_count > TLS_SESSION_CACHE_MAX) {
+        tls_session** pp = &g_sessions;
+        while ((*pp)->next) pp = &(*pp)->next;
+        tls_session_free(*pp);
+        *pp = NULL;
+        g_session_count--;
+    }
+    TLS_UNLOCK();
+    return 1;
+}
+
+// Offers the latest cached session for key to ssl
+static void tls_resume(SSL* ssl, const char* key) {
+    TLS_LOCK();
+    tls_session** pp = &g_sessions;
+    while (g_session_cache && *pp && strcmp((*pp)->key, key) != 0) pp = &(*pp)->next;
+    tls_session* e = g_session_cache ? *pp : NULL;
+    if (e) {
+        SSL_set_session(ssl, e->sess);
+        if (SSL_SESSION_get_protocol_version(e->sess) >= TLS1_3_VERSION) {
+            *pp = e->next;
+            tls_session_free(e);
+            g_session_count--;
+        }
+    }
+    TLS_UNLOCK();
+}
+
+static int tls_init_locked(void) {
     if (g_tls_initialized) return 0;
     SSL_library_init();
     SSL_load_error_strings();
@@ -23,33 +136,60 @@ int cs_tls_init(void) {
     SSL_CTX_set_verify(g_ssl_ctx, SSL_VERIFY_PEER, NULL);
     SSL_CTX_set_min_proto_version(g_ssl_ctx, TLS1_2_VERSION);
 
+    // Sessions live in g_sessions rather than the context's own store, which is keyed
+    // by session ID and can't be looked up by peer
+    if (g_key_index < 0) g_key_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, tls_key_free);
+    SSL_CTX_set_session_cache_mode(g_ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(g_ssl_ctx, tls_new_session);
+
     g_tls_initialized = 1;
     return 0;
 }
 
+int cs_tls_init(void) {
+    TLS_LOCK();
+    int rc = tls_init_locked();
+    TLS_UNLOCK();
+    return rc;
+}
+
 void cs_tls_cleanup(void) {
-    if (!g_tls_initialized) return;
-    if (g_ssl_ctx) {
-        SSL_CTX_free(g_ssl_ctx);
-        g_ssl_ctx = NULL;
+    TLS_LOCK();
+    if (g_tls_initialized) {
+        // Live SSL objects hold their own reference to the context.
+        tls_sessions_drop_locked(NULL);
+        if (g_ssl_ctx) {
+            SSL_CTX_free(g_ssl_ctx);
+            g_ssl_ctx = NULL;
+        }
+        g_tls_initialized = 0;
     }
-    g_tls_initialized = 0;
+    TLS_UNLOCK();
 }
 
 SSL_CTX* cs_tls_get_ctx(void) {
-    if (!g_tls_initialized) {
-        if (cs_tls_init() != 0) return NULL;
-    }
-    return g_ssl_ctx;
+    TLS_LOCK();
+    SSL_CTX* ctx = tls_init_locked() == 0 ? g_ssl_ctx : NULL;
+    TLS_UNLOCK();
+    return ctx;
 }
 
-SSL* cs_tls_new_ssl(cs_socket_t fd, const char *hostname) {
+SSL* cs_tls_new_ssl(cs_socket_t fd, const char *hostname, int port) {
     SSL_CTX *ctx = cs_tls_get_ctx();
     if (!ctx) return NULL;
     SSL *ssl = SSL_new(ctx);
     if (!ssl) return NULL;
     SSL_set_fd(ssl, (int)fd);
-    if (hostname && *hostname) SSL_set_tlsext_host_name(ssl, hostname);
+    if (hostname && *hostname) {
+        SSL_set_tlsext_host_name(ssl, hostname);
+        size_t n = strlen(hostname) + 16;
+        char *key = (char*)malloc(n);
+        if (key) {
+            snprintf(key, n, "%s:%d", hostname, port);
+            if (SSL_set_ex_data(ssl, g_key_index, key)) tls_resume(ssl, key);
+            else free(key);
+        }
+    }
     return ssl;
 }
 
@@ -77,10 +217,17 @@ void cs_tls_close(SSL *ssl) {
 
 int cs_tls_verify_cert(SSL *ssl) {
     X509 *cert = SSL_get_peer_certificate(ssl);
-    if (!cert) return -1;
-    X509_free(cert);
-    long result = SSL_get_verify_result(ssl);
-    return (result == X509_V_OK) ? 0 : -1;
+    long result = cert ? SSL_get_verify_result(ssl) : X509_V_ERR_UNSPECIFIED;
+    if (cert) X509_free(cert);
+    if (result == X509_V_OK) return 0;
+    // Nothing from a peer that failed verification is offered again
+    const char *key = (const char*)SSL_get_ex_data(ssl, g_key_index);
+    if (key) {
+        TLS_LOCK();
+        tls_sessions_drop_locked(key);
+        TLS_UNLOCK();
+    }
+    return -1;
 }
 
 // Native function: tls_connect(host, port) -> promise<socket>
@@ -122,83 +269,74 @@ static int nf_tls_connect(cs_vm *vm, void *ud, int argc, const cs_value *argv, c
     }
 
     int ret = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
-    if (ret == 0) {
-        SSL *ssl = cs_tls_new_ssl(fd, host);
-        if (!ssl) {
-            cs_socket_close(fd);
-            cs_error(vm, "tls_connect() failed to create SSL object");
-            return 1;
-        }
-        int hs = cs_tls_do_handshake(ssl);
-        if (hs == 1) {
-            if (cs_tls_verify_cert(ssl) != 0) {
-                cs_tls_close(ssl);
-                cs_socket_close(fd);
-                cs_error(vm, "tls_connect() certificate verification failed");
-                return 1;
-            }
-            cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port);
-            cs_map_set(sock, "_tls", cs_int((int64_t)(uintptr_t)ssl));
-            cs_map_set(sock, "_secure", cs_bool(1));
-            if (out) *out = sock;
-            return 0;
-        }
-        if (hs == 0) {
-            cs_value promise = cs_promise_new(vm);
-            cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port);
-            cs_value ctx = cs_map(vm);
-            cs_map_set(ctx, "_op", cs_str(vm, "tls_connect"));
-            cs_map_set(ctx, "sock", sock);
-            cs_map_set(ctx, "host", argv[0]);
-            cs_map_set(ctx, "_ssl", cs_int((int64_t)(uintptr_t)ssl));
-            cs_add_pending_io(vm, fd, CS_POLL_WRITE, promise, ctx, 0);
-            cs_value_release(ctx);
-            cs_value_release(sock);
-            if (out) *out = promise;
-            return 0;
-        }
-        cs_tls_close(ssl);
+#ifdef _WIN32
+    int in_progress = ret != 0 && (WSAGetLastError() == WSAEWOULDBLOCK || WSAGetLastError() == WSAEINPROGRESS);
+#else
+    int in_progress = ret != 0 && errno == EINPROGRESS;
+#endif
+    if (ret != 0 && !in_progress) {
         cs_socket_close(fd);
-        cs_error(vm, "tls_connect() handshake failed");
+        cs_error(vm, "tls_connect() connection failed");
         return 1;
     }
 
-#ifdef _WIN32
-    int err = WSAGetLastError();
-    if (err == WSAEWOULDBLOCK || err == WSAEINPROGRESS) {
-#else
-    if (errno == EINPROGRESS) {
-#endif
+    cs_socket *s = NULL;
+    cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port, &s);
+    if (!s) {
+        cs_error(vm, "tls_connect() out of memory");
+        return 1;
+    }
+
+    // Still connecting: the handshake starts once the socket is writable
+    if (in_progress) {
         cs_value promise = cs_promise_new(vm);
-        cs_value sock = cs_make_socket_map(vm, fd, "tcp", host, port);
-        cs_value ctx = cs_map(vm);
-        cs_map_set(ctx, "_op", cs_str(vm, "tls_connect"));
-        cs_map_set(ctx, "sock", sock);
-        cs_map_set(ctx, "host", argv[0]);
-        cs_add_pending_io(vm, fd, CS_POLL_WRITE, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, s, CS_SOCK_TLS_CONNECT, CS_POLL_WRITE, promise, sock, 0, NULL);
         cs_value_release(sock);
         if (out) *out = promise;
         return 0;
     }
 
-    cs_socket_close(fd);
-    cs_error(vm, "tls_connect() connection failed");
+    SSL *ssl = cs_tls_new_ssl(fd, host, port);
+    if (!ssl) {
+        cs_socket_discard(vm, s);
+        cs_value_release(sock);
+        cs_error(vm, "tls_connect() failed to create SSL object");
+        return 1;
+    }
+    int hs = cs_tls_do_handshake(ssl);
+    if (hs == 1) {
+        if (cs_tls_verify_cert(ssl) != 0) {
+            cs_tls_close(ssl);
+            cs_socket_discard(vm, s);
+            cs_value_release(sock);
+            cs_error(vm, "tls_connect() certificate verification failed");
+            return 1;
+        }
+        s->ssl = ssl;
+        if (out) *out = sock;
+        else cs_value_release(sock);
+        return 0;
+    }
+    if (hs == 0) {
+        cs_value promise = cs_promise_new(vm);
+        cs_add_socket_op(vm, s, CS_SOCK_TLS_CONNECT, CS_POLL_WRITE, promise, sock, 0, ssl);
+        cs_value_release(sock);
+        if (out) *out = promise;
+        return 0;
+    }
+    cs_tls_close(ssl);
+    cs_socket_discard(vm, s);
+    cs_value_release(sock);
+    cs_error(vm, "tls_connect() handshake failed");
     return 1;
 }
 
 // Native function: socket_is_secure(sock) -> bool
 static int nf_socket_is_secure(cs_vm *vm, void *ud, int argc, const cs_value *argv, cs_value *out) {
-    (void)vm; (void)ud;
+    (void)ud;
     if (!out) return 0;
-    if (argc < 1 || argv[0].type != CS_T_MAP) {
-        *out = cs_bool(0);
-        return 0;
-    }
-    cs_value secure = cs_map_get(argv[0], "_secure");
-    int is_secure = (secure.type == CS_T_BOOL && secure.as.b);
-    cs_value_release(secure);
-    *out = cs_bool(is_secure);
+    cs_socket *s = argc >= 1 ? cs_socket_from_value(vm, argv[0]) : NULL;
+    *out = cs_bool(s && s->ssl);
     return 0;
 }
 
@@ -210,29 +348,22 @@ static int nf_tls_upgrade(cs_vm *vm, void *ud, int argc, const cs_value *argv, c
         return 1;
     }
 
-    cs_socket_t fd = cs_socket_map_fd(argv[0]);
-    if (fd == CS_INVALID_SOCKET) {
+    cs_socket *s = cs_socket_from_value(vm, argv[0]);
+    if (!s) {
         cs_error(vm, "tls_upgrade() invalid socket");
         return 1;
     }
-
-    cs_value secure = cs_map_get(argv[0], "_secure");
-    if (secure.type == CS_T_BOOL && secure.as.b) {
-        cs_value_release(secure);
+    if (s->ssl) {
         if (out) *out = cs_nil();
         return 0;
     }
-    cs_value_release(secure);
 
     if (cs_tls_init() != 0) {
         cs_error(vm, "tls_upgrade() failed to initialize TLS");
         return 1;
     }
 
-    cs_value host_val = cs_map_get(argv[0], "host");
-    const char* host = (host_val.type == CS_T_STR) ? cs_to_cstr(host_val) : NULL;
-    SSL *ssl = cs_tls_new_ssl(fd, host);
-    cs_value_release(host_val);
+    SSL *ssl = cs_tls_new_ssl(s->fd, s->host, s->port);
     if (!ssl) {
         cs_error(vm, "tls_upgrade() failed to create SSL object");
         return 1;
@@ -245,19 +376,13 @@ static int nf_tls_upgrade(cs_vm *vm, void *ud, int argc, const cs_value *argv, c
             cs_error(vm, "tls_upgrade() certificate verification failed");
             return 1;
         }
-        cs_map_set(argv[0], "_tls", cs_int((int64_t)(uintptr_t)ssl));
-        cs_map_set(argv[0], "_secure", cs_bool(1));
+        s->ssl = ssl;
         if (out) *out = cs_nil();
         return 0;
     }
     if (hs == 0) {
         cs_value promise = cs_promise_new(vm);
-        cs_value ctx = cs_map(vm);
-        cs_map_set(ctx, "_op", cs_str(vm, "tls_upgrade"));
-        cs_map_set(ctx, "sock", argv[0]);
-        cs_map_set(ctx, "_ssl", cs_int((int64_t)(uintptr_t)ssl));
-        cs_add_pending_io(vm, fd, CS_POLL_WRITE, promise, ctx, 0);
-        cs_value_release(ctx);
+        cs_add_socket_op(vm, s, CS_SOCK_TLS_UPGRADE, CS_POLL_WRITE, promise, cs_nil(), 0, ssl);
         if (out) *out = promise;
         return 0;
     }
@@ -275,20 +400,20 @@ static int nf_tls_info(cs_vm *vm, void *ud, int argc, const cs_value *argv, cs_v
         *out = cs_map(vm);
         return 0;
     }
-    cs_value tls_val = cs_map_get(argv[0], "_tls");
-    if (tls_val.type != CS_T_INT || tls_val.as.i == 0) {
-        cs_value_release(tls_val);
+    cs_socket *s = cs_socket_from_value(vm, argv[0]);
+    if (!s || !s->ssl) {
         *out = cs_map(vm);
         return 0;
     }
 
-    SSL* ssl = (SSL*)(uintptr_t)tls_val.as.i;
+    SSL* ssl = (SSL*)s->ssl;
     cs_value info = cs_map(vm);
     if (info.as.p) {
         const char* ver = SSL_get_version(ssl);
         const char* cipher = SSL_get_cipher(ssl);
         if (ver) cs_map_set(info, "version", cs_str(vm, ver));
         if (cipher) cs_map_set(info, "cipher", cs_str(vm, cipher));
+        cs_map_set(info, "resumed", cs_bool(SSL_session_reused(ssl)));
 
         X509* cert = SSL_get_peer_certificate(ssl);
         if (cert) {
@@ -299,16 +424,65 @@ static int nf_tls_info(cs_vm *vm, void *ud, int argc, const cs_value *argv, cs_v
         }
     }
 
-    cs_value_release(tls_val);
     *out = info;
     return 0;
 }
 
+// Native function: tls_config(opts) -> {sessions}
+// Settings for the process-wide client context: ca_file adds trusted certificates
+// (relative to the script's directory); session_cache false stops resumption and
+// empties the cache. Returns the number of cached sessions.
+static int nf_tls_config(cs_vm *vm, void *ud, int argc, const cs_value *argv, cs_value *out) {
+    (void)ud;
+    if (argc >= 1 && argv[0].type != CS_T_MAP && argv[0].type != CS_T_NIL) {
+        cs_error(vm, "tls_config() requires an options map");
+        return 1;
+    }
+    SSL_CTX *ctx = cs_tls_get_ctx();
+    if (!ctx) {
+        cs_error(vm, "tls_config() failed to initialize TLS");
+        return 1;
+    }
+    cs_value opts = argc >= 1 ? argv[0] : cs_nil();
+    cs_value ca_val = cs_map_get(opts, "ca_file");
+    cs_value cache_val = cs_map_get(opts, "session_cache");
+    if (ca_val.type == CS_T_STR) {
+        const char *path = cs_to_cstr(ca_val);
+        char full[4096];
+        int absolute = path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+        if (!absolute && vm->dir_count > 0) {
+            snprintf(full, sizeof(full), "%s/%s", vm->dir_stack[vm->dir_count - 1], path);
+            path = full;
+        }
+        if (SSL_CTX_load_verify_locations(ctx, path, NULL) != 1) {
+            cs_value_release(ca_val);
+            cs_value_release(cache_val);
+            cs_error(vm, "tls_config() failed to load ca_file");
+            return 1;
+        }
+    }
+    TLS_LOCK();
+    if (cache_val.type == CS_T_BOOL) {
+        g_session_cache = cache_val.as.b;
+        if (!g_session_cache) tls_sessions_drop_locked(NULL);
+    }
+    int count = g_session_count;
+    TLS_UNLOCK();
+    cs_value_release(ca_val);
+    cs_value_release(cache_val);
+    if (out) {
+        *out = cs_map(vm);
+        cs_map_set(*out, "sessions", cs_int(count));
+    }
+    return 0;
+}
+
 void cs_register_tls_stdlib(cs_vm *vm) {
     cs_register_native(vm, "tls_connect", nf_tls_connect, NULL);
     cs_register_native(vm, "socket_is_secure", nf_socket_is_secure, NULL);
     cs_register_native(vm, "tls_upgrade", nf_tls_upgrade, NULL);
     cs_register_native(vm, "tls_info", nf_tls_info, NULL);
+    cs_register_native(vm, "tls_config", nf_tls_config, NULL);
 }
 
 #endif // CS_NO_TLS
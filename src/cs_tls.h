@@ -25,7 +25,8 @@ void cs_tls_cleanup(void);
 SSL_CTX* cs_tls_get_ctx(void);
 
 // TLS socket operations
-SSL* cs_tls_new_ssl(cs_socket_t fd, const char *hostname);
+// The SSL offers a cached session for hostname:port, if there is one
+SSL* cs_tls_new_ssl(cs_socket_t fd, const char *hostname, int port);
 int cs_tls_do_handshake(SSL *ssl);
 int cs_tls_read(SSL *ssl, char *buf, int len);
 int cs_tls_write(SSL *ssl, const char *buf, int len);
@@ -1,18 +1,6 @@
 #include "cs_value.h"
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-
-static uint64_t prof_now_ms(void) {
-    return (uint64_t)(clock() * 1000 / (uint64_t)CLOCKS_PER_SEC);
-}
-
-static uint64_t prof_str_new_count = 0;
-static uint64_t prof_str_new_ms = 0;
-static uint64_t prof_str_new_take_count = 0;
-static uint64_t prof_str_new_take_ms = 0;
-static uint64_t prof_str_incref_count = 0;
-static uint64_t prof_str_decref_count = 0;
 
 static uint32_t hash_bytes(const unsigned char* data, size_t len) {
     uint32_t hash = 2166136261u;
@@ -41,31 +29,21 @@ static char* cs_strdup_len(const char* s, size_t n) {
 }
 
 cs_string* cs_str_new(const char* s) {
-    uint64_t start_ms = prof_now_ms();
     cs_string* st = (cs_string*)calloc(1, sizeof(cs_string));
-    if (!st) {
-        prof_str_new_count++;
-        prof_str_new_ms += (prof_now_ms() - start_ms);
-        return NULL;
-    }
+    if (!st) return NULL;
     st->ref = 1;
     const char* src = s ? s : "";
     size_t len = src[0] ? strlen(src) : 0;
     st->data = cs_strdup_len(src, len);
     st->len = st->data ? len : 0;
     st->cap = st->len;
-    prof_str_new_count++;
-    prof_str_new_ms += (prof_now_ms() - start_ms);
     return st;
 }
 
 cs_string* cs_str_new_take(char* owned, size_t len) {
-    uint64_t start_ms = prof_now_ms();
     cs_string* st = (cs_string*)calloc(1, sizeof(cs_string));
     if (!st) {
         free(owned);
-        prof_str_new_take_count++;
-        prof_str_new_take_ms += (prof_now_ms() - start_ms);
         return NULL;
     }
     st->ref = 1;
@@ -73,25 +51,19 @@ cs_string* cs_str_new_take(char* owned, size_t len) {
         st->data = cs_strdup_len("", 0);
         st->len = 0;
         st->cap = st->len;
-        prof_str_new_take_count++;
-        prof_str_new_take_ms += (prof_now_ms() - start_ms);
         return st;
     }
     st->data = owned;
     st->len = (len == (size_t)-1) ? strlen(owned) : len;
     st->cap = st->len;
-    prof_str_new_take_count++;
-    prof_str_new_take_ms += (prof_now_ms() - start_ms);
     return st;
 }
 
 void cs_str_incref(cs_string* s) {
-    prof_str_incref_count++;
     if (s) s->ref++;
 }
 
 void cs_str_decref(cs_string* s) {
-    prof_str_decref_count++;
     if (!s) return;
     s->ref--;
     if (s->ref <= 0) {
@@ -117,6 +89,7 @@ const char* cs_type_name_impl(cs_type t) {
         case CS_T_NATIVE: return "native";
         case CS_T_PROMISE: return "promise";
         case CS_T_TUPLE:  return "tuple";
+        case CS_T_ITER:   return "iterator";
         default:          return "unknown";
     }
 }
@@ -7,6 +7,7 @@
 
 typedef struct cs_string {
     int ref;
+    cs_vm* interned;  // VM whose intern table holds this as the canonical key (see shapes in cs_vm.c)
     size_t len;
     size_t cap; // capacity in bytes excluding trailing NUL
     char* data;
@@ -20,12 +21,15 @@ typedef struct cs_native {
     void* userdata;
 } cs_native;
 
+struct cs_track_node;
+
 typedef struct cs_list_obj {
     int ref;
     cs_vm* owner;
     size_t len;
     size_t cap;
     cs_value* items;
+    struct cs_track_node* track;  // node in owner's tracked list (O(1) removal)
 } cs_list_obj;
 
 typedef struct cs_map_entry {
@@ -35,12 +39,18 @@ typedef struct cs_map_entry {
     unsigned char in_use;
 } cs_map_entry;
 
+typedef struct cs_shape cs_shape;
+
 typedef struct cs_map_obj {
     int ref;
     cs_vm* owner;
     size_t len;
     size_t cap;
     cs_map_entry* entries;
+    cs_shape* shape;   // instance layout; when set, entries[0..len) are dense in slot order (no hashing)
+    int inline_entries; // entries share the object's allocation (never passed to free/realloc)
+    int ic_watched;     // an inline cache depends on this map; mutating it bumps owner->ic_epoch
+    struct cs_track_node* track;  // node in owner's tracked list (O(1) removal)
 } cs_map_obj;
 
 typedef struct cs_strbuf_obj {
@@ -55,6 +65,8 @@ typedef struct cs_bytes_obj {
     size_t len;
     size_t cap;
     unsigned char* data;
+    cs_bytes_release_fn release;  // set for host buffers from cs_bytes_wrap; NULL = malloc'd
+    void* release_ud;
 } cs_bytes_obj;
 
 typedef struct cs_range_obj {
@@ -69,6 +81,8 @@ typedef struct cs_promise_obj {
     int ref;
     int state; // 0=pending, 1=fulfilled, 2=rejected
     cs_value value;
+    struct cs_timer* timer; // armed scheduler timer that settles this promise, if any
+    struct cs_promise_obj* notify; // resolved with nil when this one settles
 } cs_promise_obj;
 
 typedef struct cs_tuple_field {
@@ -82,6 +96,25 @@ typedef struct cs_tuple_obj {
     cs_tuple_field* fields;
 } cs_tuple_obj;
 
+typedef struct cs_iter_obj cs_iter_obj;
+
+// Pull-based lazy iterator step. Returns 1 and stores a new reference in *out,
+// 0 when exhausted, or -1 with the VM error set.
+typedef int (*cs_iter_next_fn)(cs_vm* vm, cs_iter_obj* it, cs_value* out);
+
+struct cs_iter_obj {
+    int ref;
+    cs_iter_next_fn next;
+    cs_value src;      // source collection or upstream iterator
+    cs_value arg;      // stage callable, or second source for zip
+    int64_t pos;       // cursor / counter
+    int64_t limit;     // take/drop count
+    int done;
+    void* state;       // cursor-private state (e.g. a suspended generator)
+    void (*state_free)(void* state);
+    cs_value items;    // values drained by cs_iter_items when used like a list (nil until then)
+};
+
 // refcounted heap objects
 cs_string* cs_str_new(const char* s);
 cs_string* cs_str_new_take(char* owned, size_t len);
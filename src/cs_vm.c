@@ -1,18 +1,30 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // MAP_ANONYMOUS/MAP_NORESERVE and pthread_getattr_np for stack bounds
+#endif
 #include "cs_vm.h"
 #include "cs_event_loop.h"
+#include "cs_worker.h"
+#include "cs_http.h"
+#include "cs_net.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #if !defined(_WIN32)
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <pthread.h>
+#include <unistd.h>
 #else
 #include <windows.h>
 #endif
 
 #if defined(__linux__)
-#include <pthread.h>
 #include <unistd.h>
 #endif
 
@@ -28,6 +40,7 @@ static char* cs_strdup2(const char* s) {
 // Forward declarations for scheduler helpers
 static int bind_params_with_defaults(cs_vm* vm, cs_env* callenv, struct cs_func* fn, int argc, const cs_value* argv, int* ok);
 static void vm_set_pending_throw(cs_vm* vm, cs_value thrown);
+static void vm_intern_builtin_keys(cs_vm* vm);
 // scheduler helper (declared earlier to avoid implicit decl when used)
 static int scheduler_run_one_task(cs_vm* vm, ast* e, int* ok);
 
@@ -48,13 +61,24 @@ static void vm_append_stacktrace(cs_vm* vm, char** io_msg) {
 
     size_t w = base_len;
     w += (size_t)snprintf(out + w, base_len + extra + 1 - w, "\nStack trace:");
+    size_t repeats = 0;  // identical frames folded into the line above (deep recursion)
     for (size_t i = 0; i < vm->frame_count; i++) {
         const cs_frame* f = &vm->frames[vm->frame_count - 1 - i];
         const char* fn = f->func ? f->func : "<call>";
         const char* src = f->source ? f->source : "<input>";
+        if (i > 0) {
+            const cs_frame* prev = f + 1;
+            if (prev->func == f->func && prev->source == f->source && prev->line == f->line && prev->col == f->col) {
+                repeats++;
+                continue;
+            }
+        }
+        if (repeats) w += (size_t)snprintf(out + w, base_len + extra + 1 - w, "\n  ... repeated %zu more times", repeats);
+        repeats = 0;
         if (f->line > 0) w += (size_t)snprintf(out + w, base_len + extra + 1 - w, "\n  at %s (%s:%d:%d)", fn, src, f->line, f->col);
         else w += (size_t)snprintf(out + w, base_len + extra + 1 - w, "\n  at %s (%s)", fn, src);
     }
+    if (repeats) w += (size_t)snprintf(out + w, base_len + extra + 1 - w, "\n  ... repeated %zu more times", repeats);
     out[w] = 0;
 }
 
@@ -75,6 +99,22 @@ static void vm_frames_pop(cs_vm* vm) {
     vm->frame_count--;
 }
 
+// Moves the frames above base into *frames (grown as needed) and truncates the VM stack
+// to base. Used by coroutines that suspend with frames still pushed.
+static int vm_frames_stash(cs_vm* vm, size_t base, cs_frame** frames, size_t* count, size_t* cap) {
+    size_t n = vm->frame_count > base ? vm->frame_count - base : 0;
+    if (n > *cap) {
+        cs_frame* nf = (cs_frame*)realloc(*frames, n * sizeof(cs_frame));
+        if (!nf) return 0;
+        *frames = nf;
+        *cap = n;
+    }
+    if (n) memcpy(*frames, vm->frames + base, n * sizeof(cs_frame));
+    *count = n;
+    vm->frame_count = base;
+    return 1;
+}
+
 static const char* vm_intern_source(cs_vm* vm, const char* src) {
     if (!vm) return src ? src : "";
     if (!src) src = "";
@@ -280,10 +320,14 @@ static cs_env* env_new(cs_env* parent);
 
 static int env_find(cs_env* e, const char* key);
 
+static cs_value* env_val(cs_env* e, int idx) {
+    return (e->cells && e->cells[idx]) ? &e->cells[idx]->v : &e->vals[idx];
+}
+
 static int env_get_nocopy(cs_env* e, const char* key, cs_value* out) {
     for (cs_env* cur = e; cur; cur = cur->parent) {
         int idx = env_find(cur, key);
-        if (idx >= 0) { *out = cur->vals[idx]; return 1; }
+        if (idx >= 0) { *out = *env_val(cur, idx); return 1; }
     }
     return 0;
 }
@@ -330,6 +374,7 @@ cs_vm* cs_vm_new(void) {
         free(vm);
         return NULL;
     }
+    vm->globals->persistent = 1;
     vm->last_error = NULL;
     vm->pending_throw = 0;
     vm->pending_thrown = cs_nil();
@@ -368,17 +413,38 @@ cs_vm* cs_vm_new(void) {
     vm->exec_start_ms = 0;
     vm->exec_timeout_ms = 0;
     vm->interrupt_requested = 0;
-    vm->yield_list = NULL;
-    vm->yield_active = 0;
-    vm->yield_used = 0;
+    vm->slice = NULL;
+    vm->inotify_fd = -1;
+    vm->next_watch_handle = 1;
+    vm->watches = NULL;
+    vm->gen_current = NULL;
+    vm->gen_stack_count = 0;
+    vm->tearing_down = 0;
+    vm->shape_root = NULL;
+    vm->intern_slots = NULL;
+    vm->intern_hashes = NULL;
+    vm->intern_count = 0;
+    vm->intern_cap = 0;
+    vm_intern_builtin_keys(vm);
 
     vm->task_head = NULL;
     vm->task_tail = NULL;
     vm->timers = NULL;
+    vm->timer_count = 0;
+    vm->timer_cap = 0;
+    vm->timer_seq = 0;
     vm->pending_io = NULL;
     vm->pending_io_count = 0;
     vm->net_default_timeout_ms = 30000;
 
+#if defined(_WIN32)
+    InitializeSRWLock(&vm->inbox_lock);
+    InitializeConditionVariable(&vm->inbox_cond);
+#else
+    pthread_mutex_init(&vm->inbox_lock, NULL);
+    pthread_cond_init(&vm->inbox_cond, NULL);
+#endif
+
 #if defined(__linux__)
     // Initialize background loop primitives (start stopped)
     pthread_mutex_init(&vm->loop_mutex, NULL);
@@ -470,6 +536,7 @@ static const char* interp_repr(cs_value v, char* buf, size_t buf_sz) {
             snprintf(buf, buf_sz, "<promise %s>", state);
             return buf;
         }
+        case CS_T_ITER:   return "<iterator>";
         default:          return "<obj>";
     }
 }
@@ -537,31 +604,26 @@ cs_value cs_str_take(cs_vm* vm, char* owned, uint64_t len) {
     return v;
 }
 
-static int vm_track_add(cs_vm* vm, cs_track_type type, void* ptr) {
-    if (!vm || !ptr) return 0;
+static cs_track_node* vm_track_add(cs_vm* vm, cs_track_type type, void* ptr) {
+    if (!vm || !ptr) return NULL;
     cs_track_node* n = (cs_track_node*)calloc(1, sizeof(cs_track_node));
-    if (!n) return 0;
+    if (!n) return NULL;
     n->type = type;
     n->ptr = ptr;
     n->next = vm->tracked;
+    if (vm->tracked) vm->tracked->prev = n;
     vm->tracked = n;
     vm->tracked_count++;
-    return 1;
+    return n;
 }
 
-static void vm_track_remove(cs_vm* vm, cs_track_type type, void* ptr) {
-    if (!vm || !ptr) return;
-    cs_track_node** pp = &vm->tracked;
-    while (*pp) {
-        cs_track_node* cur = *pp;
-        if (cur->type == type && cur->ptr == ptr) {
-            *pp = cur->next;
-            free(cur);
-            if (vm->tracked_count) vm->tracked_count--;
-            return;
-        }
-        pp = &cur->next;
-    }
+static void vm_track_remove(cs_vm* vm, cs_track_node* n) {
+    if (!vm || !n) return;
+    if (n->prev) n->prev->next = n->next;
+    else vm->tracked = n->next;
+    if (n->next) n->next->prev = n->prev;
+    free(n);
+    if (vm->tracked_count) vm->tracked_count--;
 }
 
 static cs_list_obj* list_new(cs_vm* vm) {
@@ -573,7 +635,8 @@ static cs_list_obj* list_new(cs_vm* vm) {
     l->items = (cs_value*)calloc(l->cap, sizeof(cs_value));
     if (!l->items) { free(l); return NULL; }
     l->len = 0;
-    if (!vm_track_add(vm, CS_TRACK_LIST, l)) { free(l->items); free(l); return NULL; }
+    l->track = vm_track_add(vm, CS_TRACK_LIST, l);
+    if (!l->track) { free(l->items); free(l); return NULL; }
     
     // Track allocation and maybe trigger GC
     if (vm) {
@@ -591,20 +654,41 @@ static void list_decref(cs_list_obj* l) {
     if (--l->ref > 0) return;
     for (size_t i = 0; i < l->len; i++) cs_value_release(l->items[i]);
     free(l->items);
-    vm_track_remove(l->owner, CS_TRACK_LIST, l);
+    vm_track_remove(l->owner, l->track);
     free(l);
 }
 
-static cs_map_obj* map_new(cs_vm* vm) {
-    cs_map_obj* m = (cs_map_obj*)calloc(1, sizeof(cs_map_obj));
-    if (!m) return NULL;
+// Invalidates inline caches that resolved through this map (see "inline caches").
+static void map_ic_touch(cs_map_obj* m) {
+    if (m->ic_watched && m->owner) m->owner->ic_epoch++;
+}
+
+static void map_entries_free(cs_map_obj* m) {
+    if (!m->inline_entries) free(m->entries);
+    m->entries = NULL;
+    m->inline_entries = 0;
+}
+
+// inline_entries: allocate the entry array together with the object (fixed-size instances).
+static cs_map_obj* map_new_ex(cs_vm* vm, size_t cap, int inline_entries) {
+    cs_map_obj* m;
+    if (inline_entries) {
+        m = (cs_map_obj*)calloc(1, sizeof(cs_map_obj) + cap * sizeof(cs_map_entry));
+        if (!m) return NULL;
+        m->entries = (cs_map_entry*)(m + 1);
+        m->inline_entries = 1;
+    } else {
+        m = (cs_map_obj*)calloc(1, sizeof(cs_map_obj));
+        if (!m) return NULL;
+        m->entries = (cs_map_entry*)calloc(cap, sizeof(cs_map_entry));
+        if (!m->entries) { free(m); return NULL; }
+    }
     m->ref = 1;
     m->owner = vm;
-    m->cap = 8;
-    m->entries = (cs_map_entry*)calloc(m->cap, sizeof(cs_map_entry));
-    if (!m->entries) { free(m); return NULL; }
+    m->cap = cap;
     m->len = 0;
-    if (!vm_track_add(vm, CS_TRACK_MAP, m)) { free(m->entries); free(m); return NULL; }
+    m->track = vm_track_add(vm, CS_TRACK_MAP, m);
+    if (!m->track) { map_entries_free(m); free(m); return NULL; }
     
     // Track allocation and maybe trigger GC
     if (vm) {
@@ -615,6 +699,10 @@ static cs_map_obj* map_new(cs_vm* vm) {
     return m;
 }
 
+static cs_map_obj* map_new(cs_vm* vm) {
+    return map_new_ex(vm, 8, 0);
+}
+
 static cs_strbuf_obj* strbuf_new(void) {
     cs_strbuf_obj* b = (cs_strbuf_obj*)calloc(1, sizeof(cs_strbuf_obj));
     if (!b) return NULL;
@@ -643,7 +731,8 @@ static void bytes_incref(cs_bytes_obj* b) { if (b) b->ref++; }
 static void bytes_decref(cs_bytes_obj* b) {
     if (!b) return;
     if (--b->ref > 0) return;
-    free(b->data);
+    if (b->release) b->release(b->release_ud, b->data, b->cap);
+    else free(b->data);
     free(b);
 }
 
@@ -662,13 +751,14 @@ static void map_incref(cs_map_obj* m) { if (m) m->ref++; }
 static void map_decref(cs_map_obj* m) {
     if (!m) return;
     if (--m->ref > 0) return;
+    map_ic_touch(m);
     for (size_t i = 0; i < m->cap; i++) {
         if (!m->entries[i].in_use) continue;
         cs_value_release(m->entries[i].key);
         cs_value_release(m->entries[i].val);
     }
-    free(m->entries);
-    vm_track_remove(m->owner, CS_TRACK_MAP, m);
+    map_entries_free(m);
+    vm_track_remove(m->owner, m->track);
     free(m);
 }
 
@@ -704,10 +794,146 @@ static void promise_decref(cs_promise_obj* p) {
     p->ref--;
     if (p->ref <= 0) {
         cs_value_release(p->value);
+        promise_decref(p->notify);
         free(p);
     }
 }
 
+// ---------- lazy iterators ----------
+static void iter_incref(cs_iter_obj* it) {
+    if (it) it->ref++;
+}
+
+static void iter_decref(cs_iter_obj* it) {
+    if (!it) return;
+    if (--it->ref > 0) return;
+    if (it->state_free) it->state_free(it->state);
+    cs_value_release(it->src);
+    cs_value_release(it->arg);
+    cs_value_release(it->items);
+    free(it);
+}
+
+cs_value cs_iter_new(cs_vm* vm, cs_iter_next_fn next, cs_value src, cs_value arg) {
+    (void)vm;
+    cs_iter_obj* it = (cs_iter_obj*)calloc(1, sizeof(cs_iter_obj));
+    if (!it) return cs_nil();
+    it->ref = 1;
+    it->next = next;
+    it->src = cs_value_copy(src);
+    it->arg = cs_value_copy(arg);
+    cs_value v; v.type = CS_T_ITER; v.as.p = it;
+    return v;
+}
+
+static int iter_next_list(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    (void)vm;
+    cs_list_obj* l = (cs_list_obj*)it->src.as.p;
+    // Re-check len each step so mutation during iteration can't read past the end.
+    if (!l || (size_t)it->pos >= l->len) return 0;
+    *out = cs_value_copy(l->items[it->pos++]);
+    return 1;
+}
+
+static int iter_next_range(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    (void)vm;
+    cs_range_obj* r = (cs_range_obj*)it->src.as.p;
+    if (!r) return 0;
+    int64_t step = (r->step == 0) ? ((r->start <= r->end) ? 1 : -1) : r->step;
+    int64_t cur = r->start + it->pos * step;
+    if (step > 0 ? (r->inclusive ? cur > r->end : cur >= r->end)
+                 : (r->inclusive ? cur < r->end : cur <= r->end)) return 0;
+    it->pos++;
+    *out = cs_int(cur);
+    return 1;
+}
+
+static int iter_next_map_keys(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    (void)vm;
+    cs_map_obj* m = (cs_map_obj*)it->src.as.p;
+    while (m && (size_t)it->pos < m->cap) {
+        cs_map_entry* e = &m->entries[it->pos++];
+        if (!e->in_use) continue;
+        *out = cs_value_copy(e->key);
+        return 1;
+    }
+    return 0;
+}
+
+static int iter_next_str(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    cs_string* s = (cs_string*)it->src.as.p;
+    if (!s || (size_t)it->pos >= s->len) return 0;
+    char ch[2] = { s->data[it->pos++], '\0' };
+    *out = cs_str(vm, ch);
+    if (!out->as.p) { cs_error(vm, "out of memory"); return -1; }
+    return 1;
+}
+
+cs_value cs_iter_from(cs_vm* vm, cs_value v) {
+    switch (v.type) {
+        case CS_T_ITER:  return cs_value_copy(v);
+        case CS_T_LIST:  return cs_iter_new(vm, iter_next_list, v, cs_nil());
+        case CS_T_RANGE: return cs_iter_new(vm, iter_next_range, v, cs_nil());
+        case CS_T_MAP:
+        case CS_T_SET:   return cs_iter_new(vm, iter_next_map_keys, v, cs_nil());
+        case CS_T_STR:   return cs_iter_new(vm, iter_next_str, v, cs_nil());
+        default:         return cs_nil();
+    }
+}
+
+int cs_iter_next(cs_vm* vm, cs_value itv, cs_value* out) {
+    if (itv.type != CS_T_ITER || !itv.as.p) return 0;
+    cs_iter_obj* it = (cs_iter_obj*)itv.as.p;
+    if (it->done) return 0;
+    *out = cs_nil();
+    // Keep the iterator alive across the step; a stage callback may drop the last outside reference.
+    iter_incref(it);
+    int rc = it->next(vm, it, out);
+    if (rc <= 0) {
+        it->done = 1;
+        // Drop the source early so exhausted pipelines don't pin large inputs.
+        cs_value_release(it->src);
+        it->src = cs_nil();
+    }
+    iter_decref(it);
+    return rc;
+}
+
+static int iter_next_items(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    (void)vm;
+    cs_list_obj* l = (cs_list_obj*)it->items.as.p;
+    if (!l || (size_t)it->pos >= l->len) return 0;
+    *out = cs_value_copy(l->items[it->pos++]);
+    return 1;
+}
+
+// Generator calls used to return a list, so an iterator used like one (len, indexing,
+// list spread, extend) drains its remaining values into a list cached on the iterator.
+// Later calls see the same list, and later steps walk the cached values once.
+cs_list_obj* cs_iter_items(cs_vm* vm, cs_value itv) {
+    if (itv.type != CS_T_ITER || !itv.as.p) return NULL;
+    cs_iter_obj* it = (cs_iter_obj*)itv.as.p;
+    if (it->items.type == CS_T_LIST) return as_list(it->items);
+    cs_value lv = cs_list(vm);
+    if (!lv.as.p) { cs_error(vm, "out of memory"); return NULL; }
+    for (;;) {
+        cs_value v = cs_nil();
+        int rc = cs_iter_next(vm, itv, &v);
+        if (rc == 0) break;
+        if (rc < 0 || cs_list_push(lv, v) != 0) {
+            if (rc > 0) { cs_value_release(v); cs_error(vm, "out of memory"); }
+            cs_value_release(lv);
+            return NULL;
+        }
+        cs_value_release(v);
+    }
+    it->items = lv;
+    it->next = iter_next_items;
+    it->pos = 0;
+    it->done = 0;
+    return as_list(lv);
+}
+
 cs_value cs_list(cs_vm* vm) {
     cs_list_obj* l = list_new(vm);
     cs_value v; v.type = CS_T_LIST; v.as.p = l;
@@ -755,6 +981,23 @@ cs_value cs_bytes_take(cs_vm* vm, uint8_t* owned, size_t len) {
     return v;
 }
 
+cs_value cs_bytes_wrap(cs_vm* vm, uint8_t* data, size_t len, cs_bytes_release_fn release, void* userdata) {
+    if (!data) return cs_bytes(vm, NULL, 0);
+    cs_bytes_obj* b = (cs_bytes_obj*)calloc(1, sizeof(cs_bytes_obj));
+    if (!b) {
+        if (release) release(userdata, data, len);
+        cs_value v; v.type = CS_T_NIL; v.as.p = NULL; return v;
+    }
+    b->ref = 1;
+    b->data = data;
+    b->len = len;
+    b->cap = len;
+    b->release = release;
+    b->release_ud = userdata;
+    cs_value v; v.type = CS_T_BYTES; v.as.p = b;
+    return v;
+}
+
 cs_value cs_value_copy(cs_value v) {
     if (v.type == CS_T_STR) cs_str_incref(as_str(v));
     else if (v.type == CS_T_LIST) list_incref(as_list(v));
@@ -764,6 +1007,7 @@ cs_value cs_value_copy(cs_value v) {
     else if (v.type == CS_T_BYTES) bytes_incref(as_bytes(v));
     else if (v.type == CS_T_RANGE) range_incref(as_range(v));
     else if (v.type == CS_T_PROMISE) promise_incref(as_promise(v));
+    else if (v.type == CS_T_ITER) iter_incref((cs_iter_obj*)v.as.p);
     else if (v.type == CS_T_NATIVE) as_native(v)->ref++;
     else if (v.type == CS_T_FUNC) as_func(v)->ref++;
     return v;
@@ -778,6 +1022,7 @@ void cs_value_release(cs_value v) {
     else if (v.type == CS_T_BYTES) bytes_decref(as_bytes(v));
     else if (v.type == CS_T_RANGE) range_decref(as_range(v));
     else if (v.type == CS_T_PROMISE) promise_decref(as_promise(v));
+    else if (v.type == CS_T_ITER) iter_decref((cs_iter_obj*)v.as.p);
     else if (v.type == CS_T_NATIVE) {
         cs_native* nf = as_native(v);
         if (nf && --nf->ref <= 0) free(nf);
@@ -795,6 +1040,12 @@ static void env_incref(cs_env* e) {
     if (e) e->ref++;
 }
 
+static void cell_decref(cs_cell* c) {
+    if (!c || --c->ref > 0) return;
+    cs_value_release(c->v);
+    free(c);
+}
+
 static void env_decref(cs_env* e) {
     if (!e) return;
     if (--e->ref > 0) return;
@@ -802,10 +1053,12 @@ static void env_decref(cs_env* e) {
     for (size_t i = 0; i < e->count; i++) {
         free(e->keys[i]);
         cs_value_release(e->vals[i]);
+        if (e->cells) cell_decref(e->cells[i]);
     }
     free(e->keys);
     free(e->vals);
     free(e->is_const);
+    free(e->cells);
     free(e);
     env_decref(parent);
 }
@@ -823,6 +1076,13 @@ static cs_env* env_new(cs_env* parent) {
     return e;
 }
 
+// Scope for one call of fn; closures created inside it consult what the body declares.
+static cs_env* call_env_new(const struct cs_func* fn) {
+    cs_env* e = env_new(fn->closure);
+    if (e) e->decls = fn->captures;
+    return e;
+}
+
 static int env_find(cs_env* e, const char* key) {
     for (size_t i = 0; i < e->count; i++) {
         if (strcmp(e->keys[i], key) == 0) return (int)i;
@@ -830,46 +1090,51 @@ static int env_find(cs_env* e, const char* key) {
     return -1;
 }
 
-static void env_set_here_ex(cs_env* e, const char* key, cs_value v, int is_const) {
-    int idx = env_find(e, key);
-    if (idx >= 0) {
-        cs_value_release(e->vals[idx]);
-        e->vals[idx] = cs_value_copy(v);
-        if (is_const) e->is_const[idx] = 1;
-        return;
-    }
-    if (e->count == e->cap) {
-        e->cap *= 2;
-        e->keys = (char**)realloc(e->keys, e->cap * sizeof(char*));
-        e->vals = (cs_value*)realloc(e->vals, e->cap * sizeof(cs_value));
-        e->is_const = (unsigned char*)realloc(e->is_const, e->cap * sizeof(unsigned char));
-    }
-    e->keys[e->count] = cs_strdup2(key);
-    e->vals[e->count] = cs_value_copy(v);
-    e->is_const[e->count] = (unsigned char)(is_const ? 1 : 0);
-    e->count++;
+static int env_grow(cs_env* e) {
+    if (e->count < e->cap) return 1;
+    size_t cap = e->cap * 2;
+    char** keys = (char**)realloc(e->keys, cap * sizeof(char*));
+    if (keys) e->keys = keys;
+    cs_value* vals = (cs_value*)realloc(e->vals, cap * sizeof(cs_value));
+    if (vals) e->vals = vals;
+    unsigned char* is_const = (unsigned char*)realloc(e->is_const, cap * sizeof(unsigned char));
+    if (is_const) e->is_const = is_const;
+    if (!keys || !vals || !is_const) return 0;
+    if (e->cells) {
+        cs_cell** cells = (cs_cell**)realloc(e->cells, cap * sizeof(cs_cell*));
+        if (!cells) return 0;
+        memset(cells + e->cap, 0, (cap - e->cap) * sizeof(cs_cell*));
+        e->cells = cells;
+    }
+    e->cap = cap;
+    return 1;
+}
+
+// Store v (already owned) in slot idx, writing through a shared cell if there is one.
+static void env_store(cs_env* e, int idx, cs_value v) {
+    cs_value* slot = env_val(e, idx);
+    cs_value_release(*slot);
+    *slot = v;
 }
 
 static void env_set_here_take(cs_env* e, const char* key, cs_value v, int is_const) {
     int idx = env_find(e, key);
     if (idx >= 0) {
-        cs_value_release(e->vals[idx]);
-        e->vals[idx] = v;
+        env_store(e, idx, v);
         if (is_const) e->is_const[idx] = 1;
         return;
     }
-    if (e->count == e->cap) {
-        e->cap *= 2;
-        e->keys = (char**)realloc(e->keys, e->cap * sizeof(char*));
-        e->vals = (cs_value*)realloc(e->vals, e->cap * sizeof(cs_value));
-        e->is_const = (unsigned char*)realloc(e->is_const, e->cap * sizeof(unsigned char));
-    }
+    if (!env_grow(e)) { cs_value_release(v); return; }
     e->keys[e->count] = cs_strdup2(key);
     e->vals[e->count] = v;
     e->is_const[e->count] = (unsigned char)(is_const ? 1 : 0);
     e->count++;
 }
 
+static void env_set_here_ex(cs_env* e, const char* key, cs_value v, int is_const) {
+    env_set_here_take(e, key, cs_value_copy(v), is_const);
+}
+
 static void env_set_here(cs_env* e, const char* key, cs_value v) {
     env_set_here_ex(e, key, v, 0);
 }
@@ -890,8 +1155,7 @@ static int env_assign_existing(cs_env* e, const char* key, cs_value v) {
             if (cur->is_const[idx]) {
                 return -1; // const binding
             }
-            cs_value_release(cur->vals[idx]);
-            cur->vals[idx] = cs_value_copy(v);
+            env_store(cur, idx, cs_value_copy(v));
             return 1;
         }
     }
@@ -901,7 +1165,7 @@ static int env_assign_existing(cs_env* e, const char* key, cs_value v) {
 static int env_get(cs_env* e, const char* key, cs_value* out) {
     for (cs_env* cur = e; cur; cur = cur->parent) {
         int idx = env_find(cur, key);
-        if (idx >= 0) { *out = cs_value_copy(cur->vals[idx]); return 1; }
+        if (idx >= 0) { *out = cs_value_copy(*env_val(cur, idx)); return 1; }
     }
     return 0;
 }
@@ -909,11 +1173,437 @@ static int env_get(cs_env* e, const char* key, cs_value* out) {
 static cs_value* env_get_slot(cs_env* e, const char* key) {
     for (cs_env* cur = e; cur; cur = cur->parent) {
         int idx = env_find(cur, key);
-        if (idx >= 0) return &cur->vals[idx];
+        if (idx >= 0) return env_val(cur, idx);
     }
     return NULL;
 }
 
+// Turn binding idx of e into a shared cell (once); the cell stays owned by e.
+static cs_cell* env_capture_cell(cs_env* e, int idx) {
+    if (!e->cells) {
+        e->cells = (cs_cell**)calloc(e->cap, sizeof(cs_cell*));
+        if (!e->cells) return NULL;
+    }
+    cs_cell* c = e->cells[idx];
+    if (!c) {
+        c = (cs_cell*)calloc(1, sizeof(cs_cell));
+        if (!c) return NULL;
+        c->ref = 1;
+        c->v = e->vals[idx];
+        e->vals[idx] = cs_nil();
+        e->cells[idx] = c;
+    }
+    return c;
+}
+
+// Drop every binding but keep the allocated arrays (host call envs are reused).
+static void env_clear(cs_env* e) {
+    for (size_t i = 0; i < e->count; i++) {
+        free(e->keys[i]);
+        cs_value_release(e->vals[i]);
+        e->vals[i] = cs_nil();
+        e->is_const[i] = 0;
+        if (e->cells && e->cells[i]) {
+            cell_decref(e->cells[i]);
+            e->cells[i] = NULL;
+        }
+    }
+    e->count = 0;
+}
+
+// Bind key in e to an existing cell; used to build flat closure environments.
+static int env_bind_cell(cs_env* e, const char* key, cs_cell* c, int is_const) {
+    if (!env_grow(e)) return 0;
+    if (!e->cells) {
+        e->cells = (cs_cell**)calloc(e->cap, sizeof(cs_cell*));
+        if (!e->cells) return 0;
+    }
+    e->keys[e->count] = cs_strdup2(key);
+    e->vals[e->count] = cs_nil();
+    e->is_const[e->count] = (unsigned char)(is_const ? 1 : 0);
+    e->cells[e->count] = c;
+    c->ref++;
+    e->count++;
+    return 1;
+}
+
+// ---------- closure capture ----------
+// Functions created inside another function do not keep the whole defining env chain
+// alive. The first time a function literal or `fn` statement runs, its body is scanned
+// for the names it can read or assign; each creation then copies just those bindings
+// into a small flat env whose parent is the nearest persistent (global/module) scope.
+// Captured bindings become shared cells, so writes on either side stay visible to the
+// other. Names that resolve in the persistent scope are still looked up dynamically.
+// If a name cannot be resolved yet (e.g. a local helper defined further down), could
+// still be shadowed by a declaration that has not run yet in one of the defining scopes,
+// or the body contains something the scan does not understand, the function keeps the
+// full chain exactly as before.
+enum {
+    CAPTURE_REF = 1,     // read or assigned; must resolve when the function is created
+    CAPTURE_SOFT = 2,    // optional lookup (type patterns, dotted globals, walrus)
+    CAPTURE_LOCAL = 4    // declared somewhere inside the function
+};
+
+typedef struct cs_capture_name {
+    const char* name;    // borrowed from the AST
+    unsigned char flags;
+    unsigned char decls; // times the body declares the name (2 = two or more)
+} cs_capture_name;
+
+struct cs_captures {
+    int flat;            // 0 when the body uses something the scan cannot follow
+    size_t count;
+    cs_capture_name names[];
+};
+
+typedef struct {
+    cs_capture_name* items;
+    size_t count;
+    size_t cap;
+    int ok;
+} capture_builder;
+
+static void capture_add(capture_builder* b, const char* name, unsigned char flags) {
+    if (!name || !b->ok) return;
+    for (size_t i = 0; i < b->count; i++) {
+        if (strcmp(b->items[i].name, name) != 0) continue;
+        b->items[i].flags |= flags;
+        if ((flags & CAPTURE_LOCAL) && b->items[i].decls < 2) b->items[i].decls++;
+        return;
+    }
+    if (b->count == b->cap) {
+        size_t nc = b->cap ? b->cap * 2 : 16;
+        cs_capture_name* ni = (cs_capture_name*)realloc(b->items, nc * sizeof(cs_capture_name));
+        if (!ni) { b->ok = 0; return; }
+        b->items = ni;
+        b->cap = nc;
+    }
+    b->items[b->count].name = name;
+    b->items[b->count].flags = flags;
+    b->items[b->count].decls = (flags & CAPTURE_LOCAL) ? 1 : 0;
+    b->count++;
+}
+
+static void capture_walk(capture_builder* b, ast* n);
+
+static void capture_walk_all(capture_builder* b, ast** nodes, size_t count) {
+    if (!nodes) return;
+    for (size_t i = 0; i < count; i++) capture_walk(b, nodes[i]);
+}
+
+static void capture_walk_pattern(capture_builder* b, ast* p) {
+    if (!p) return;
+    switch (p->type) {
+        case N_IDENT:
+            capture_add(b, p->as.ident.name, CAPTURE_LOCAL);
+            break;
+        case N_PATTERN_WILDCARD:
+            break;
+        case N_PATTERN_TYPE:
+            capture_add(b, p->as.type_pattern.type_name, CAPTURE_SOFT);
+            capture_walk_pattern(b, p->as.type_pattern.inner);
+            break;
+        case N_PATTERN_LIST:
+            for (size_t i = 0; i < p->as.list_pattern.count; i++) capture_add(b, p->as.list_pattern.names[i], CAPTURE_LOCAL);
+            capture_add(b, p->as.list_pattern.rest_name, CAPTURE_LOCAL);
+            break;
+        case N_PATTERN_MAP:
+            for (size_t i = 0; i < p->as.map_pattern.count; i++) capture_add(b, p->as.map_pattern.names[i], CAPTURE_LOCAL);
+            capture_add(b, p->as.map_pattern.rest_name, CAPTURE_LOCAL);
+            break;
+        default:
+            capture_walk(b, p);
+            break;
+    }
+}
+
+static void capture_walk_func(capture_builder* b, char** params, ast** defaults, size_t param_count, const char* rest, ast* body) {
+    for (size_t i = 0; i < param_count; i++) {
+        capture_add(b, params[i], CAPTURE_LOCAL);
+        if (defaults) capture_walk(b, defaults[i]);
+    }
+    capture_add(b, rest, CAPTURE_LOCAL);
+    capture_walk(b, body);
+}
+
+static void capture_walk_comp(capture_builder* b, char** vars, char** vars2, ast** iterables, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (vars) capture_add(b, vars[i], CAPTURE_LOCAL);
+        if (vars2) capture_add(b, vars2[i], CAPTURE_LOCAL);
+        if (iterables) capture_walk(b, iterables[i]);
+    }
+}
+
+static void capture_walk(capture_builder* b, ast* n) {
+    if (!n || !b->ok) return;
+    switch (n->type) {
+        case N_LIT_INT: case N_LIT_FLOAT: case N_LIT_STR: case N_LIT_BOOL: case N_LIT_NIL:
+        case N_PLACEHOLDER: case N_BREAK: case N_CONTINUE: case N_PATTERN_WILDCARD:
+            break;
+        case N_IDENT:
+            capture_add(b, n->as.ident.name, CAPTURE_REF);
+            // `super.m()` binds self from the caller's scope
+            if (strcmp(n->as.ident.name, "super") == 0) capture_add(b, "self", CAPTURE_REF);
+            break;
+        case N_STR_INTERP: capture_walk_all(b, n->as.str_interp.parts, n->as.str_interp.count); break;
+        case N_BLOCK: capture_walk_all(b, n->as.block.items, n->as.block.count); break;
+        case N_LISTLIT: capture_walk_all(b, n->as.listlit.items, n->as.listlit.count); break;
+        case N_SETLIT: capture_walk_all(b, n->as.setlit.items, n->as.setlit.count); break;
+        case N_TUPLELIT: capture_walk_all(b, n->as.tuplelit.field_values, n->as.tuplelit.count); break;
+        case N_MAPLIT:
+            capture_walk_all(b, n->as.maplit.keys, n->as.maplit.count);
+            capture_walk_all(b, n->as.maplit.vals, n->as.maplit.count);
+            break;
+        case N_LISTCOMP:
+            capture_walk_comp(b, n->as.listcomp.vars, n->as.listcomp.vars2, n->as.listcomp.iterables, n->as.listcomp.iter_count);
+            capture_walk(b, n->as.listcomp.expr);
+            capture_walk(b, n->as.listcomp.filter);
+            break;
+        case N_SETCOMP:
+            capture_walk_comp(b, n->as.setcomp.vars, n->as.setcomp.vars2, n->as.setcomp.iterables, n->as.setcomp.iter_count);
+            capture_walk(b, n->as.setcomp.expr);
+            capture_walk(b, n->as.setcomp.filter);
+            break;
+        case N_MAPCOMP:
+            capture_walk_comp(b, n->as.mapcomp.key_vars, n->as.mapcomp.val_vars, n->as.mapcomp.iterables, n->as.mapcomp.iter_count);
+            capture_walk(b, n->as.mapcomp.key_expr);
+            capture_walk(b, n->as.mapcomp.val_expr);
+            capture_walk(b, n->as.mapcomp.filter);
+            break;
+        case N_BINOP: capture_walk(b, n->as.binop.left); capture_walk(b, n->as.binop.right); break;
+        case N_UNOP: capture_walk(b, n->as.unop.expr); break;
+        case N_AWAIT: capture_walk(b, n->as.await_expr.expr); break;
+        case N_SPREAD: capture_walk(b, n->as.spread.expr); break;
+        case N_RANGE: capture_walk(b, n->as.range.left); capture_walk(b, n->as.range.right); break;
+        case N_PIPE: capture_walk(b, n->as.pipe.left); capture_walk(b, n->as.pipe.right); break;
+        case N_TERNARY:
+            capture_walk(b, n->as.ternary.cond);
+            capture_walk(b, n->as.ternary.then_e);
+            capture_walk(b, n->as.ternary.else_e);
+            break;
+        case N_INDEX: capture_walk(b, n->as.index.target); capture_walk(b, n->as.index.index); break;
+        case N_GETFIELD:
+        case N_OPTGETFIELD:
+            // `fm.status` may name a dotted global rather than a field of `fm`
+            if (n->as.getfield.target && n->as.getfield.target->type == N_IDENT) {
+                capture_add(b, n->as.getfield.target->as.ident.name, CAPTURE_SOFT);
+                if (strcmp(n->as.getfield.target->as.ident.name, "super") == 0) capture_add(b, "self", CAPTURE_REF);
+            } else {
+                capture_walk(b, n->as.getfield.target);
+            }
+            break;
+        case N_CALL:
+            capture_walk(b, n->as.call.callee);
+            capture_walk_all(b, n->as.call.args, n->as.call.argc);
+            break;
+        case N_WALRUS:
+            capture_add(b, n->as.walrus.name, CAPTURE_SOFT | CAPTURE_LOCAL);
+            capture_walk(b, n->as.walrus.value);
+            break;
+        case N_EXPR_STMT: capture_walk(b, n->as.expr_stmt.expr); break;
+        case N_LET:
+            capture_walk(b, n->as.let_stmt.init);
+            capture_add(b, n->as.let_stmt.name, CAPTURE_LOCAL);
+            capture_walk_pattern(b, n->as.let_stmt.pattern);
+            break;
+        case N_ASSIGN:
+            capture_add(b, n->as.assign_stmt.name, CAPTURE_REF);
+            capture_walk(b, n->as.assign_stmt.value);
+            break;
+        case N_SETINDEX:
+            capture_walk(b, n->as.setindex_stmt.target);
+            capture_walk(b, n->as.setindex_stmt.index);
+            capture_walk(b, n->as.setindex_stmt.value);
+            break;
+        case N_IF:
+            capture_walk(b, n->as.if_stmt.cond);
+            capture_walk(b, n->as.if_stmt.then_b);
+            capture_walk(b, n->as.if_stmt.else_b);
+            break;
+        case N_WHILE: capture_walk(b, n->as.while_stmt.cond); capture_walk(b, n->as.while_stmt.body); break;
+        case N_FORIN:
+            capture_add(b, n->as.forin_stmt.name, CAPTURE_LOCAL);
+            capture_add(b, n->as.forin_stmt.name2, CAPTURE_LOCAL);
+            capture_walk(b, n->as.forin_stmt.iterable);
+            capture_walk(b, n->as.forin_stmt.body);
+            break;
+        case N_FOR_C_STYLE:
+            capture_walk(b, n->as.for_c_style_stmt.init);
+            capture_walk(b, n->as.for_c_style_stmt.cond);
+            capture_walk(b, n->as.for_c_style_stmt.incr);
+            capture_walk(b, n->as.for_c_style_stmt.body);
+            break;
+        case N_RETURN: capture_walk(b, n->as.ret_stmt.value); break;
+        case N_YIELD: capture_walk(b, n->as.yield_stmt.value); break;
+        case N_THROW: capture_walk(b, n->as.throw_stmt.value); break;
+        case N_DEFER: capture_walk(b, n->as.defer_stmt.stmt); break;
+        case N_TRY:
+            capture_walk(b, n->as.try_stmt.try_b);
+            capture_add(b, n->as.try_stmt.catch_name, CAPTURE_LOCAL);
+            capture_walk(b, n->as.try_stmt.catch_b);
+            capture_walk(b, n->as.try_stmt.finally_b);
+            break;
+        case N_FNDEF:
+            capture_add(b, n->as.fndef.name, CAPTURE_LOCAL);
+            capture_walk_func(b, n->as.fndef.params, n->as.fndef.defaults, n->as.fndef.param_count,
+                              n->as.fndef.rest_param, n->as.fndef.body);
+            break;
+        case N_FUNCLIT:
+            capture_walk_func(b, n->as.funclit.params, n->as.funclit.defaults, n->as.funclit.param_count,
+                              n->as.funclit.rest_param, n->as.funclit.body);
+            break;
+        case N_CLASS:
+            capture_add(b, n->as.class_stmt.name, CAPTURE_LOCAL);
+            capture_add(b, n->as.class_stmt.parent, CAPTURE_REF);
+            for (size_t i = 0; i < n->as.class_stmt.method_count; i++) {
+                ast* m = n->as.class_stmt.methods[i];
+                if (!m || m->type != N_FNDEF) { capture_walk(b, m); continue; }
+                // methods are stored on the class, not bound by name
+                capture_walk_func(b, m->as.fndef.params, m->as.fndef.defaults, m->as.fndef.param_count,
+                                  m->as.fndef.rest_param, m->as.fndef.body);
+            }
+            break;
+        case N_STRUCT:
+            capture_add(b, n->as.struct_stmt.name, CAPTURE_LOCAL);
+            capture_walk_all(b, n->as.struct_stmt.field_defaults, n->as.struct_stmt.field_count);
+            break;
+        case N_ENUM:
+            capture_add(b, n->as.enum_stmt.name, CAPTURE_LOCAL);
+            capture_walk_all(b, n->as.enum_stmt.values, n->as.enum_stmt.count);
+            break;
+        case N_MATCH:
+            capture_walk(b, n->as.match_expr.expr);
+            for (size_t i = 0; i < n->as.match_expr.case_count; i++) {
+                capture_walk_pattern(b, n->as.match_expr.case_patterns[i]);
+                if (n->as.match_expr.case_guards) capture_walk(b, n->as.match_expr.case_guards[i]);
+                capture_walk(b, n->as.match_expr.case_values[i]);
+            }
+            capture_walk(b, n->as.match_expr.default_expr);
+            break;
+        case N_SWITCH:
+            capture_walk(b, n->as.switch_stmt.expr);
+            for (size_t i = 0; i < n->as.switch_stmt.case_count; i++) {
+                if (n->as.switch_stmt.case_exprs) capture_walk(b, n->as.switch_stmt.case_exprs[i]);
+                if (n->as.switch_stmt.case_patterns) capture_walk_pattern(b, n->as.switch_stmt.case_patterns[i]);
+                if (n->as.switch_stmt.case_blocks) capture_walk(b, n->as.switch_stmt.case_blocks[i]);
+            }
+            break;
+        case N_IMPORT:
+            capture_walk(b, n->as.import_stmt.path);
+            capture_add(b, n->as.import_stmt.default_name, CAPTURE_LOCAL);
+            for (size_t i = 0; i < n->as.import_stmt.count; i++) {
+                if (n->as.import_stmt.local_names) capture_add(b, n->as.import_stmt.local_names[i], CAPTURE_LOCAL);
+            }
+            break;
+        case N_EXPORT:
+            capture_add(b, "exports", CAPTURE_SOFT);
+            capture_add(b, n->as.export_stmt.name, CAPTURE_LOCAL);
+            capture_walk(b, n->as.export_stmt.value);
+            break;
+        case N_EXPORT_LIST:
+            capture_add(b, "exports", CAPTURE_SOFT);
+            for (size_t i = 0; i < n->as.export_list.count; i++) capture_add(b, n->as.export_list.local_names[i], CAPTURE_REF);
+            break;
+        default:
+            b->ok = 0;
+            break;
+    }
+}
+
+static struct cs_captures* captures_build(char** params, ast** defaults, size_t param_count, const char* rest, ast* body) {
+    capture_builder b = { NULL, 0, 0, 1 };
+    capture_walk_func(&b, params, defaults, param_count, rest, body);
+    size_t count = b.ok ? b.count : 0;
+    struct cs_captures* c = (struct cs_captures*)calloc(1, sizeof(struct cs_captures) + count * sizeof(cs_capture_name));
+    if (c) {
+        c->flat = b.ok;
+        c->count = count;
+        if (count) memcpy(c->names, b.items, count * sizeof(cs_capture_name));
+    }
+    free(b.items);
+    return c;
+}
+
+// Flat closure scopes only hold the cells copied into them; nothing is declared there later.
+static const struct cs_captures flat_scope_decls = { 1, 0 };
+
+// How often the function owning a call scope declares name, or -1 if its body was not scanned.
+static int capture_decl_count(const struct cs_captures* decls, const char* name) {
+    if (!decls->flat) return -1;
+    for (size_t i = 0; i < decls->count; i++) {
+        if (strcmp(decls->names[i].name, name) == 0) return decls->names[i].decls;
+    }
+    return 0;
+}
+
+// Whether a declaration that has not run yet could bind name in a scope between env and
+// the one it resolves in now, which the full chain would see but a copied cell would not.
+// Each block scope belongs to the nearest call scope above it; redeclaring a name in the
+// scope that already holds it reuses the binding.
+static int capture_may_be_shadowed(cs_env* env, cs_env* top, const char* name) {
+    cs_env* found = NULL;
+    for (cs_env* cur = env; cur != top; cur = cur->parent) {
+        if (env_find(cur, name) >= 0) { found = cur; break; }
+    }
+    if (found == env) return 0;
+    int seg_open = 0, seg_found = 0;
+    for (cs_env* cur = env; cur != top; cur = cur->parent) {
+        seg_open = 1;
+        if (cur == found) seg_found = 1;
+        if (!cur->decls) continue;
+        // cur's function owns every scope walked since the previous call scope
+        int n = capture_decl_count(cur->decls, name);
+        if (n < 0 || n > seg_found) return 1;
+        if (seg_found) return 0;
+        seg_open = 0;
+    }
+    // scopes left over belong to top-level code, whose declarations were not scanned
+    return seg_open;
+}
+
+// Build the flat env for a function created in env, or return NULL to keep env itself.
+static cs_env* closure_env_for(const struct cs_captures* caps, cs_env* env) {
+    if (!caps || !caps->flat || !env || env->persistent) return NULL;
+    cs_env* top = env;
+    while (top && !top->persistent) top = top->parent;
+    if (!top) return NULL;
+
+    // Resolve everything before touching the defining scopes.
+    for (size_t i = 0; i < caps->count; i++) {
+        const cs_capture_name* cn = &caps->names[i];
+        if (!(cn->flags & (CAPTURE_REF | CAPTURE_SOFT)) || (cn->flags & CAPTURE_LOCAL)) continue;
+        if (capture_may_be_shadowed(env, top, cn->name)) return NULL;
+        if (!(cn->flags & CAPTURE_REF) || (cn->flags & CAPTURE_SOFT)) continue;
+        cs_value dummy;
+        if (!env_get_nocopy(env, cn->name, &dummy)) return NULL;
+    }
+
+    cs_env* flat = env_new(top);
+    if (!flat) return NULL;
+    flat->decls = &flat_scope_decls;
+    for (size_t i = 0; i < caps->count; i++) {
+        const cs_capture_name* cn = &caps->names[i];
+        if (!(cn->flags & (CAPTURE_REF | CAPTURE_SOFT))) continue;
+        for (cs_env* cur = env; cur != top; cur = cur->parent) {
+            int idx = env_find(cur, cn->name);
+            if (idx < 0) continue;
+            cs_cell* cell = env_capture_cell(cur, idx);
+            if (!cell || !env_bind_cell(flat, cn->name, cell, cur->is_const[idx])) {
+                env_decref(flat);
+                return NULL;
+            }
+            break;
+        }
+    }
+    if (flat->count == 0) {
+        // nothing local is referenced: close over the persistent scope directly
+        env_decref(flat);
+        env_incref(top);
+        return top;
+    }
+    return flat;
+}
+
 static int is_truthy(cs_value v) {
     switch (v.type) {
         case CS_T_NIL: return 0;
@@ -976,8 +1666,19 @@ static int bytes_ensure(cs_bytes_obj* b, size_t need) {
     if (need <= b->cap) return 1;
     size_t nc = b->cap ? b->cap : 8;
     while (nc < need) nc *= 2;
-    unsigned char* nd = (unsigned char*)realloc(b->data, nc);
-    if (!nd) return 0;
+    unsigned char* nd;
+    if (b->release) {
+        // host buffer: move to our own storage before growing
+        nd = (unsigned char*)malloc(nc);
+        if (!nd) return 0;
+        memcpy(nd, b->data, b->cap);
+        b->release(b->release_ud, b->data, b->cap);
+        b->release = NULL;
+        b->release_ud = NULL;
+    } else {
+        nd = (unsigned char*)realloc(b->data, nc);
+        if (!nd) return 0;
+    }
     if (nc > b->cap) memset(nd + b->cap, 0, nc - b->cap);
     b->data = nd;
     b->cap = nc;
@@ -997,6 +1698,266 @@ static int bytes_set(cs_bytes_obj* b, int64_t idx, unsigned char v) {
     return 1;
 }
 
+static cs_string* key_is_class(cs_vm* vm);
+static cs_string* key_is_struct(cs_vm* vm);
+static cs_string* key_class(cs_vm* vm);
+static cs_string* key_struct(cs_vm* vm);
+static cs_string* key_parent(cs_vm* vm);
+static cs_string* key_fields(cs_vm* vm);
+static cs_string* key_defaults(cs_vm* vm);
+static cs_string* key_new_method(cs_vm* vm);
+
+// ---------- interned keys ----------
+// Shape keys and cached field names share one cs_string per distinct key so slot
+// lookups usually succeed on pointer equality without hashing.
+static uint32_t str_hash(const cs_string* s) {
+    cs_value v; v.type = CS_T_STR; v.as.p = (void*)s;
+    return cs_value_hash(v);
+}
+
+static int vm_intern_grow(cs_vm* vm) {
+    size_t nc = vm->intern_cap ? vm->intern_cap * 2 : 64;
+    cs_string** ns = (cs_string**)calloc(nc, sizeof(cs_string*));
+    uint32_t* nh = (uint32_t*)calloc(nc, sizeof(uint32_t));
+    if (!ns || !nh) { free(ns); free(nh); return 0; }
+    for (size_t i = 0; i < vm->intern_cap; i++) {
+        if (!vm->intern_slots[i]) continue;
+        size_t j = vm->intern_hashes[i] & (nc - 1);
+        while (ns[j]) j = (j + 1) & (nc - 1);
+        ns[j] = vm->intern_slots[i];
+        nh[j] = vm->intern_hashes[i];
+    }
+    free(vm->intern_slots);
+    free(vm->intern_hashes);
+    vm->intern_slots = ns;
+    vm->intern_hashes = nh;
+    vm->intern_cap = nc;
+    return 1;
+}
+
+// Returns the VM's canonical string equal to s (borrowed), adding s itself if new.
+static cs_string* vm_intern_str(cs_vm* vm, cs_string* s) {
+    if (!vm || !s) return NULL;
+    if ((vm->intern_count + 1) * 10 > vm->intern_cap * 7 && !vm_intern_grow(vm)) return NULL;
+    uint32_t h = str_hash(s);
+    size_t j = h & (vm->intern_cap - 1);
+    while (vm->intern_slots[j]) {
+        cs_string* cur = vm->intern_slots[j];
+        if (cur == s) return cur;
+        if (vm->intern_hashes[j] == h && cur->len == s->len && memcmp(cur->data, s->data, s->len) == 0) return cur;
+        j = (j + 1) & (vm->intern_cap - 1);
+    }
+    cs_str_incref(s);
+    s->interned = vm;
+    vm->intern_slots[j] = s;
+    vm->intern_hashes[j] = h;
+    vm->intern_count++;
+    return s;
+}
+
+// Existing canonical string for key, or NULL; never allocates.
+static cs_string* vm_intern_lookup(cs_vm* vm, const char* key, size_t len) {
+    if (!vm || !vm->intern_cap) return NULL;
+    cs_string tmp;
+    tmp.ref = 1;
+    tmp.interned = NULL;
+    tmp.data = (char*)key;
+    tmp.len = len;
+    tmp.cap = len;
+    uint32_t h = str_hash(&tmp);
+    size_t j = h & (vm->intern_cap - 1);
+    while (vm->intern_slots[j]) {
+        cs_string* cur = vm->intern_slots[j];
+        if (vm->intern_hashes[j] == h && cur->len == len && memcmp(cur->data, key, len) == 0) return cur;
+        j = (j + 1) & (vm->intern_cap - 1);
+    }
+    return NULL;
+}
+
+static cs_string* vm_intern_cstr(cs_vm* vm, const char* key) {
+    cs_string* found = vm_intern_lookup(vm, key ? key : "", key ? strlen(key) : 0);
+    if (found) return found;
+    cs_string* s = cs_str_new(key ? key : "");
+    if (!s) return NULL;
+    cs_string* out = vm_intern_str(vm, s);
+    cs_str_decref(s);
+    return out;
+}
+
+static void vm_intern_free(cs_vm* vm) {
+    for (size_t i = 0; i < vm->intern_cap; i++) {
+        cs_string* k = vm->intern_slots[i];
+        if (!k) continue;
+        if (k->interned == vm) k->interned = NULL;
+        cs_str_decref(k);
+    }
+    free(vm->intern_slots);
+    free(vm->intern_hashes);
+    vm->intern_slots = NULL;
+    vm->intern_hashes = NULL;
+    vm->intern_count = vm->intern_cap = 0;
+}
+
+// ---------- shapes ----------
+// Instances (class/struct) start at the VM's root shape and move along shared
+// transitions as string keys are added, so instances built the same way share one
+// shape. Their entries are stored densely in slot order; deleting a key, adding a
+// non-string key or outgrowing the shape limits switches the map to dictionary mode.
+struct cs_shape {
+    struct cs_shape* parent;
+    cs_vm* owner;              // VM whose intern table the keys come from
+    size_t count;              // number of slots
+    cs_string** keys;          // interned (borrowed from the VM intern table)
+    uint32_t* hashes;
+    struct cs_shape** children;
+    size_t child_count;
+    size_t child_cap;
+};
+
+static cs_shape* shape_new(cs_shape* parent, cs_string* key, uint32_t hash) {
+    cs_shape* sh = (cs_shape*)calloc(1, sizeof(cs_shape));
+    if (!sh) return NULL;
+    sh->parent = parent;
+    sh->owner = parent ? parent->owner : NULL;
+    sh->count = parent ? parent->count + 1 : 0;
+    if (sh->count) {
+        sh->keys = (cs_string**)malloc(sh->count * sizeof(cs_string*));
+        sh->hashes = (uint32_t*)malloc(sh->count * sizeof(uint32_t));
+        if (!sh->keys || !sh->hashes) { free(sh->keys); free(sh->hashes); free(sh); return NULL; }
+        if (parent->count) {
+            memcpy(sh->keys, parent->keys, parent->count * sizeof(cs_string*));
+            memcpy(sh->hashes, parent->hashes, parent->count * sizeof(uint32_t));
+        }
+        sh->keys[sh->count - 1] = key;
+        sh->hashes[sh->count - 1] = hash;
+    }
+    return sh;
+}
+
+static void shape_free_tree(cs_shape* sh) {
+    if (!sh) return;
+    for (size_t i = 0; i < sh->child_count; i++) shape_free_tree(sh->children[i]);
+    free(sh->children);
+    free(sh->keys);
+    free(sh->hashes);
+    free(sh);
+}
+
+// Called at VM creation. Each VM owns its metadata keys so no string is shared between
+// VMs running on different threads.
+static void vm_intern_builtin_keys(cs_vm* vm) {
+    static const char* const names[CS_KEY_COUNT] = {
+        "__is_class", "__is_struct", "__class", "__struct",
+        "__parent", "__fields", "__defaults", "new"
+    };
+    for (int i = 0; i < CS_KEY_COUNT; i++) vm->keys[i] = vm_intern_cstr(vm, names[i]);
+}
+
+static cs_shape* vm_shape_root(cs_vm* vm) {
+    if (!vm) return NULL;
+    if (!vm->shape_root) {
+        vm->shape_root = shape_new(NULL, NULL, 0);
+        if (vm->shape_root) vm->shape_root->owner = vm;
+    }
+    return vm->shape_root;
+}
+
+// Follows (or creates) the transition adding `key`. NULL when the shape limits are hit.
+static cs_shape* shape_transition(cs_vm* vm, cs_shape* sh, cs_string* key) {
+    if (!sh || sh->count >= CS_SHAPE_MAX_SLOTS) return NULL;
+    for (size_t i = 0; i < sh->child_count; i++) {
+        if (sh->children[i]->keys[sh->count] == key) return sh->children[i];
+    }
+    cs_string* ik = vm_intern_str(vm, key);
+    if (!ik) return NULL;
+    if (ik != key) {
+        for (size_t i = 0; i < sh->child_count; i++) {
+            if (sh->children[i]->keys[sh->count] == ik) return sh->children[i];
+        }
+    }
+    if (sh->child_count >= CS_SHAPE_MAX_TRANSITIONS) return NULL;
+    if (sh->child_count == sh->child_cap) {
+        size_t nc = sh->child_cap ? sh->child_cap * 2 : 2;
+        cs_shape** nch = (cs_shape**)realloc(sh->children, nc * sizeof(cs_shape*));
+        if (!nch) return NULL;
+        sh->children = nch;
+        sh->child_cap = nc;
+    }
+    cs_shape* child = shape_new(sh, ik, str_hash(ik));
+    if (!child) return NULL;
+    sh->children[sh->child_count++] = child;
+    return child;
+}
+
+static int shape_slot(const cs_shape* sh, cs_value key) {
+    if (!sh || key.type != CS_T_STR || !key.as.p) return -1;
+    cs_string* ks = (cs_string*)key.as.p;
+    for (size_t i = 0; i < sh->count; i++) {
+        if (sh->keys[i] == ks) return (int)i;
+    }
+    // Shape keys are canonical in the shape's VM, so a probe that is canonical there and
+    // missed by pointer is absent. Keys interned by another VM are compared by content.
+    if (ks->interned == sh->owner) return -1;
+    uint32_t h = str_hash(ks);
+    for (size_t i = 0; i < sh->count; i++) {
+        cs_string* cur = sh->keys[i];
+        if (sh->hashes[i] == h && cur->len == ks->len && memcmp(cur->data, ks->data, ks->len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Moves a shaped map's dense entries into a regular hash table.
+static int map_make_dict(cs_map_obj* m) {
+    if (!m || !m->shape) return 1;
+    size_t nc = 8;
+    while ((m->len + 1) > (nc * 7 / 10)) nc *= 2;
+    cs_map_entry* ne = (cs_map_entry*)calloc(nc, sizeof(cs_map_entry));
+    if (!ne) return 0;
+    for (size_t i = 0; i < m->len; i++) {
+        size_t idx = m->entries[i].hash % nc;
+        while (ne[idx].in_use) idx = (idx + 1) % nc;
+        ne[idx] = m->entries[i];
+    }
+    map_entries_free(m);
+    m->entries = ne;
+    m->cap = nc;
+    m->shape = NULL;
+    return 1;
+}
+
+// Appends a new string key to a shaped map. Returns 0 if the map must become a dictionary.
+static int map_shape_append(cs_map_obj* m, cs_value key, cs_value v) {
+    cs_shape* next = shape_transition(m->owner, m->shape, (cs_string*)key.as.p);
+    if (!next) return 0;
+    if (m->len == m->cap) {
+        size_t nc = m->cap ? m->cap * 2 : 4;
+        cs_map_entry* ne = (cs_map_entry*)calloc(nc, sizeof(cs_map_entry));
+        if (!ne) return 0;
+        if (m->len) memcpy(ne, m->entries, m->len * sizeof(cs_map_entry));
+        map_entries_free(m);
+        m->entries = ne;
+        m->cap = nc;
+    }
+    cs_map_entry* ent = &m->entries[m->len];
+    cs_value kv; kv.type = CS_T_STR; kv.as.p = next->keys[next->count - 1];
+    ent->key = cs_value_copy(kv);
+    ent->val = cs_value_copy(v);
+    ent->hash = next->hashes[next->count - 1];
+    ent->in_use = 1;
+    m->len++;
+    m->shape = next;
+    return 1;
+}
+
+// New shaped map (class/struct types and their instances) with room for `slots` entries.
+static cs_value shaped_map_new(cs_vm* vm, size_t slots) {
+    cs_shape* root = vm_shape_root(vm);
+    cs_map_obj* m = map_new_ex(vm, slots ? slots : 4, 1);
+    if (m && root) m->shape = root;
+    cs_value v; v.type = CS_T_MAP; v.as.p = m;
+    return v;
+}
+
 static uint32_t map_key_hash(cs_value key) {
     return cs_value_hash(key);
 }
@@ -1014,6 +1975,8 @@ static int map_rehash(cs_map_obj* m, size_t new_cap) {
 
     cs_map_entry* old_entries = m->entries;
     size_t old_cap = m->cap;
+    int old_inline = m->inline_entries;
+    m->inline_entries = 0;
 
     m->entries = ne;
     m->cap = new_cap;
@@ -1025,7 +1988,7 @@ static int map_rehash(cs_map_obj* m, size_t new_cap) {
             while (ne[idx].in_use) idx = (idx + 1) % new_cap;
             ne[idx] = old_entries[i];
         }
-        free(old_entries);
+        if (!old_inline) free(old_entries);
     }
 
     return 1;
@@ -1055,6 +2018,10 @@ static int map_ensure(cs_map_obj* m, size_t need) {
 }
 
 static cs_value map_get_value(cs_map_obj* m, cs_value key) {
+    if (m && m->shape) {
+        int slot = shape_slot(m->shape, key);
+        return slot < 0 ? cs_nil() : cs_value_copy(m->entries[slot].val);
+    }
     uint32_t h = map_key_hash(key);
     int idx = map_find(m, key, h);
     if (idx < 0) return cs_nil();
@@ -1063,6 +2030,19 @@ static cs_value map_get_value(cs_map_obj* m, cs_value key) {
 
 static int map_set_value(cs_map_obj* m, cs_value key, cs_value v) {
     if (!m) return 0;
+    map_ic_touch(m);
+
+    if (m->shape) {
+        int slot = shape_slot(m->shape, key);
+        if (slot >= 0) {
+            cs_value old = m->entries[slot].val;
+            m->entries[slot].val = cs_value_copy(v);
+            cs_value_release(old);
+            return 1;
+        }
+        if (key.type == CS_T_STR && map_shape_append(m, key, v)) return 1;
+        if (!map_make_dict(m)) return 0;
+    }
 
     // Maintain load factor < 0.7
     if ((m->len + 1) > (m->cap * 7 / 10)) {
@@ -1096,6 +2076,7 @@ static int map_set_value(cs_map_obj* m, cs_value key, cs_value v) {
 
 static int map_has_value(cs_map_obj* m, cs_value key) {
     if (!m) return 0;
+    if (m->shape) return shape_slot(m->shape, key) >= 0;
     uint32_t h = map_key_hash(key);
     return map_find(m, key, h) >= 0 ? 1 : 0;
 }
@@ -1104,6 +2085,7 @@ static int map_has_cstr(cs_map_obj* m, const char* key) {
     if (!m || !key) return 0;
     cs_string tmp;
     tmp.ref = 1;
+    tmp.interned = NULL;
     tmp.data = (char*)key;
     tmp.len = strlen(key);
     tmp.cap = tmp.len;
@@ -1113,6 +2095,11 @@ static int map_has_cstr(cs_map_obj* m, const char* key) {
 
 static int map_del_value(cs_map_obj* m, cs_value key) {
     if (!m) return 0;
+    map_ic_touch(m);
+    if (m->shape) {
+        if (shape_slot(m->shape, key) < 0) return 0;
+        if (!map_make_dict(m)) return 0;
+    }
     uint32_t h = map_key_hash(key);
     int idx = map_find(m, key, h);
     if (idx < 0) return 0;
@@ -1131,7 +2118,7 @@ static int map_del_value(cs_map_obj* m, cs_value key) {
     cs_value_release(m->entries[(size_t)idx].key);
     cs_value_release(m->entries[(size_t)idx].val);
 
-    free(m->entries);
+    map_entries_free(m);
     m->entries = ne;
     if (m->len) m->len--;
     return 1;
@@ -1141,6 +2128,7 @@ static cs_value map_get_cstr(cs_map_obj* m, const char* key) {
     if (!m || !key) return cs_nil();
     cs_string tmp;
     tmp.ref = 1;
+    tmp.interned = NULL;
     tmp.data = (char*)key;
     tmp.len = strlen(key);
     tmp.cap = tmp.len;
@@ -1150,6 +2138,12 @@ static cs_value map_get_cstr(cs_map_obj* m, const char* key) {
 
 static int map_set_cstr(cs_map_obj* m, const char* key, cs_value v) {
     if (!m || !key) return 0;
+    // reuse the canonical key when a script already uses this name as a field
+    cs_string* interned = vm_intern_lookup(m->owner, key, strlen(key));
+    if (interned) {
+        cs_value kv; kv.type = CS_T_STR; kv.as.p = interned;
+        return map_set_value(m, kv, v);
+    }
     cs_string* ks = cs_str_new(key);
     if (!ks) return 0;
     cs_value kv; kv.type = CS_T_STR; kv.as.p = ks;
@@ -1158,52 +2152,36 @@ static int map_set_cstr(cs_map_obj* m, const char* key, cs_value v) {
     return ok;
 }
 
-static cs_string* key_is_class(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__is_class");
-    return k;
+static cs_string* key_is_class(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_IS_CLASS] : NULL;
 }
 
-static cs_string* key_is_struct(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__is_struct");
-    return k;
+static cs_string* key_is_struct(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_IS_STRUCT] : NULL;
 }
 
-static cs_string* key_class(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__class");
-    return k;
+static cs_string* key_class(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_CLASS] : NULL;
 }
 
-static cs_string* key_parent(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__parent");
-    return k;
+static cs_string* key_parent(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_PARENT] : NULL;
 }
 
-static cs_string* key_fields(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__fields");
-    return k;
+static cs_string* key_fields(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_FIELDS] : NULL;
 }
 
-static cs_string* key_defaults(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__defaults");
-    return k;
+static cs_string* key_defaults(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_DEFAULTS] : NULL;
 }
 
-static cs_string* key_struct(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("__struct");
-    return k;
+static cs_string* key_struct(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_STRUCT] : NULL;
 }
 
-static cs_string* key_new_method(void) {
-    static cs_string* k = NULL;
-    if (!k) k = cs_str_new("new");
-    return k;
+static cs_string* key_new_method(cs_vm* vm) {
+    return vm ? vm->keys[CS_KEY_NEW] : NULL;
 }
 
 static cs_value map_get_strkey(cs_map_obj* m, cs_string* key) {
@@ -1224,9 +2202,20 @@ static int map_set_strkey(cs_map_obj* m, cs_string* key, cs_value v) {
     return map_set_value(m, kv, v);
 }
 
+// Interned key for a GETFIELD node's field name, cached on the node.
+static cs_string* getfield_key(cs_vm* vm, ast* e) {
+    if (!e->as.getfield.key) {
+        cs_string* k = vm_intern_cstr(vm, e->as.getfield.field);
+        if (!k) return NULL;
+        cs_str_incref(k);
+        e->as.getfield.key = k;
+    }
+    return e->as.getfield.key;
+}
+
 static int map_is_class(cs_value v) {
     if (v.type != CS_T_MAP) return 0;
-    cs_string* k = key_is_class();
+    cs_string* k = key_is_class(as_map(v)->owner);
     cs_value flag = k ? map_get_strkey(as_map(v), k) : map_get_cstr(as_map(v), "__is_class");
     int ok = (flag.type == CS_T_BOOL && flag.as.b);
     cs_value_release(flag);
@@ -1235,41 +2224,52 @@ static int map_is_class(cs_value v) {
 
 static int map_is_struct(cs_value v) {
     if (v.type != CS_T_MAP) return 0;
-    cs_string* k = key_is_struct();
+    cs_vm* vm = as_map(v)->owner;
+    cs_string* k = key_is_struct(vm);
     cs_value flag = k ? map_get_strkey(as_map(v), k) : map_get_cstr(as_map(v), "__is_struct");
     int ok = (flag.type == CS_T_BOOL && flag.as.b);
     cs_value_release(flag);
     if (ok) return 1;
-    cs_string* kf = key_fields();
+    cs_string* kf = key_fields(vm);
     if ((kf && map_has_strkey(as_map(v), kf)) || map_has_cstr(as_map(v), "__fields")) return 1;
-    cs_string* kd = key_defaults();
+    cs_string* kd = key_defaults(vm);
     if ((kd && map_has_strkey(as_map(v), kd)) || map_has_cstr(as_map(v), "__defaults")) return 1;
     return 0;
 }
 
 
-static int class_find_method(cs_value class_val, const char* name, cs_value* method_out, cs_value* owner_out) {
+// Single-probe lookup: 1 and a copy in *out if present.
+static int map_lookup_strkey(cs_map_obj* m, cs_string* key, cs_value* out) {
+    cs_value kv; kv.type = CS_T_STR; kv.as.p = key;
+    if (m->shape) {
+        int slot = shape_slot(m->shape, kv);
+        if (slot < 0) return 0;
+        *out = cs_value_copy(m->entries[slot].val);
+        return 1;
+    }
+    int idx = map_find(m, kv, map_key_hash(kv));
+    if (idx < 0) return 0;
+    *out = cs_value_copy(m->entries[(size_t)idx].val);
+    return 1;
+}
+
+static int class_find_method(cs_value class_val, cs_string* key, cs_value* method_out, cs_value* owner_out) {
     if (method_out) *method_out = cs_nil();
     if (owner_out) *owner_out = cs_nil();
+    if (!key) return 0;
     cs_value cur = cs_value_copy(class_val);
-    int name_is_new = (name && name[0] == 'n' && name[1] == 'e' && name[2] == 'w' && name[3] == 0);
-    cs_string* k_new = name_is_new ? key_new_method() : NULL;
-    cs_string* k_parent = key_parent();
+    cs_string* k_parent = key_parent(class_val.type == CS_T_MAP ? as_map(class_val)->owner : NULL);
     while (cur.type == CS_T_MAP) {
         cs_map_obj* m = as_map(cur);
-        if (name_is_new && k_new && map_has_strkey(m, k_new)) {
-            if (method_out) *method_out = map_get_strkey(m, k_new);
+        cs_value found;
+        if (map_lookup_strkey(m, key, &found)) {
+            if (method_out) *method_out = found;
+            else cs_value_release(found);
             if (owner_out) *owner_out = cs_value_copy(cur);
             cs_value_release(cur);
             return 1;
         }
-        if (map_has_cstr(m, name)) {
-            if (method_out) *method_out = map_get_cstr(m, name);
-            if (owner_out) *owner_out = cs_value_copy(cur);
-            cs_value_release(cur);
-            return 1;
-        }
-        cs_value parent = k_parent ? map_get_strkey(m, k_parent) : map_get_cstr(m, "__parent");
+        cs_value parent = map_get_strkey(m, k_parent);
         cs_value_release(cur);
         cur = parent;
         if (cur.type == CS_T_NIL) { cs_value_release(cur); break; }
@@ -1277,6 +2277,217 @@ static int class_find_method(cs_value class_val, const char* name, cs_value* met
     return 0;
 }
 
+// ---------- inline caches ----------
+// Method-call and GETFIELD nodes carry a small polymorphic cache. Entries keyed on an
+// instance shape need no invalidation: the shape fixes which keys sit in which slot.
+// Entries resolved through a class chain are stamped with vm->ic_epoch and every map
+// on the walked chain is marked ic_watched, so mutating or freeing any of them makes
+// the entry stale.
+#define CS_IC_WAYS 4
+
+enum {
+    IC_SLOT = 1,        // receiver shape -> own slot (-1: field absent)
+    IC_INSTANCE_METHOD, // receiver shape -> __class slot, class -> method
+    IC_CLASS_METHOD     // class -> method (class receivers, constructors)
+};
+
+typedef struct cs_ic_entry {
+    int kind;
+    int slot;
+    cs_shape* shape;
+    cs_map_obj* cls;
+    cs_map_obj* owner;  // class defining the method; NULL if not found
+    cs_value method;    // borrowed from owner, valid while epoch matches
+    uint64_t epoch;
+} cs_ic_entry;
+
+struct cs_inline_cache {
+    cs_vm* vm;
+    int count;
+    int next;           // victim once all ways are in use
+    cs_ic_entry entries[CS_IC_WAYS];
+};
+
+static struct cs_inline_cache* ic_get(cs_vm* vm, struct cs_inline_cache** site) {
+    struct cs_inline_cache* ic = *site;
+    if (!ic) {
+        ic = (struct cs_inline_cache*)calloc(1, sizeof(*ic));
+        if (!ic) return NULL;
+        ic->vm = vm;
+        *site = ic;
+    } else if (ic->vm != vm) {
+        memset(ic, 0, sizeof(*ic));
+        ic->vm = vm;
+    }
+    return ic;
+}
+
+static cs_ic_entry* ic_add(struct cs_inline_cache* ic) {
+    if (ic->count < CS_IC_WAYS) return &ic->entries[ic->count++];
+    cs_ic_entry* ent = &ic->entries[ic->next];
+    ic->next = (ic->next + 1) % CS_IC_WAYS;
+    return ent;
+}
+
+// Marks cls..owner (or the whole chain when owner is NULL). 0 if a map can't be watched.
+static int ic_watch_chain(cs_vm* vm, cs_map_obj* cls, cs_map_obj* owner) {
+    cs_string* k_parent = key_parent(vm);
+    cs_map_obj* m = cls;
+    for (int depth = 0; m && depth < 256; depth++) {
+        if (m->owner != vm) return 0;
+        m->ic_watched = 1;
+        if (m == owner) return 1;
+        cs_value parent = map_get_strkey(m, k_parent);
+        cs_map_obj* next = parent.type == CS_T_MAP ? as_map(parent) : NULL;
+        cs_value_release(parent);
+        m = next;
+    }
+    return owner == NULL && m == NULL;
+}
+
+static void ic_fill_method(cs_vm* vm, cs_ic_entry* ent, cs_map_obj* cls, int found, cs_value method, cs_value owner) {
+    cs_map_obj* om = (found && owner.type == CS_T_MAP) ? as_map(owner) : NULL;
+    if (!ic_watch_chain(vm, cls, om)) { ent->kind = 0; return; }
+    ent->cls = cls;
+    ent->owner = om;
+    ent->method = found ? method : cs_nil();
+    ent->epoch = vm->ic_epoch;
+}
+
+// Looks `key` up on a class chain through the site cache. Same contract as class_find_method.
+static int class_find_method_cached(cs_vm* vm, struct cs_inline_cache** site, cs_value class_val,
+                                    cs_string* key, cs_value* method_out, cs_value* owner_out) {
+    cs_map_obj* cls = as_map(class_val);
+    struct cs_inline_cache* ic = ic_get(vm, site);
+    if (ic) {
+        for (int i = 0; i < ic->count; i++) {
+            cs_ic_entry* ent = &ic->entries[i];
+            if (ent->kind != IC_CLASS_METHOD || ent->cls != cls || ent->epoch != vm->ic_epoch) continue;
+            vm->prof_ic_hits++;
+            if (!ent->owner) {
+                *method_out = cs_nil();
+                *owner_out = cs_nil();
+                return 0;
+            }
+            cs_value ov; ov.type = CS_T_MAP; ov.as.p = ent->owner;
+            *method_out = cs_value_copy(ent->method);
+            *owner_out = cs_value_copy(ov);
+            return 1;
+        }
+    }
+    vm->prof_ic_misses++;
+    int found = class_find_method(class_val, key, method_out, owner_out);
+    if (ic) {
+        cs_ic_entry* ent = ic_add(ic);
+        ent->kind = IC_CLASS_METHOD;
+        ent->shape = NULL;
+        ent->slot = -1;
+        ic_fill_method(vm, ent, cls, found, *method_out, *owner_out);
+    }
+    return found;
+}
+
+// Resolves the callee of `self.field(...)` for a map receiver. Instances are checked for
+// an own field first, then their class chain. Returns 0 if self is a class lacking the
+// method (an instance without it yields nil in *f_out).
+static int method_lookup(cs_vm* vm, ast* gf, cs_value self, cs_value* f_out, cs_value* owner_out,
+                         int* from_class, int* self_is_class) {
+    cs_map_obj* sm = as_map(self);
+    cs_string* key = getfield_key(vm, gf);
+    *f_out = cs_nil();
+    *owner_out = cs_nil();
+    *from_class = 0;
+    *self_is_class = 0;
+
+    struct cs_inline_cache* ic = ic_get(vm, &gf->as.getfield.ic);
+    if (ic && sm->shape) {
+        for (int i = 0; i < ic->count; i++) {
+            cs_ic_entry* ent = &ic->entries[i];
+            if (ent->shape != sm->shape) continue;
+            if (ent->kind == IC_SLOT && ent->slot >= 0) {
+                vm->prof_ic_hits++;
+                *f_out = cs_value_copy(sm->entries[ent->slot].val);
+                return 1;
+            }
+            if (ent->kind == IC_INSTANCE_METHOD && ent->epoch == vm->ic_epoch) {
+                cs_value cls = sm->entries[ent->slot].val;
+                if (cls.type != CS_T_MAP || as_map(cls) != ent->cls) continue;
+                vm->prof_ic_hits++;
+                if (ent->owner) {
+                    cs_value ov; ov.type = CS_T_MAP; ov.as.p = ent->owner;
+                    *f_out = cs_value_copy(ent->method);
+                    *owner_out = cs_value_copy(ov);
+                    *from_class = 1;
+                }
+                return 1;
+            }
+        }
+    }
+
+    if (map_is_class(self)) {
+        *self_is_class = 1;
+        if (!class_find_method_cached(vm, &gf->as.getfield.ic, self, key, f_out, owner_out)) return 0;
+        *from_class = 1;
+        return 1;
+    }
+
+    vm->prof_ic_misses++;
+    cs_value kv; kv.type = CS_T_STR; kv.as.p = key;
+    // A shape holding __is_class could later turn into a class receiver; don't cache it.
+    cs_value kc; kc.type = CS_T_STR; kc.as.p = key_is_class(vm);
+    int cacheable = ic && key && sm->shape && shape_slot(sm->shape, kc) < 0;
+    if (key && map_lookup_strkey(sm, key, f_out)) {
+        if (cacheable) {
+            cs_ic_entry* ent = ic_add(ic);
+            ent->kind = IC_SLOT;
+            ent->shape = sm->shape;
+            ent->slot = shape_slot(sm->shape, kv);
+        }
+        return 1;
+    }
+    cs_value cls = map_get_strkey(sm, key_class(vm));
+    if (map_is_class(cls)) {
+        int found = class_find_method(cls, key, f_out, owner_out);
+        *from_class = found;
+        cs_value kcl; kcl.type = CS_T_STR; kcl.as.p = key_class(vm);
+        if (cacheable) {
+            cs_ic_entry* ent = ic_add(ic);
+            ent->kind = IC_INSTANCE_METHOD;
+            ent->shape = sm->shape;
+            ent->slot = shape_slot(sm->shape, kcl);
+            ic_fill_method(vm, ent, as_map(cls), found, *f_out, *owner_out);
+        }
+    }
+    cs_value_release(cls);
+    return 1;
+}
+
+// Reads `target.field` for a map target, caching the slot per receiver shape.
+static cs_value getfield_map(cs_vm* vm, ast* e, cs_map_obj* m) {
+    cs_string* key = getfield_key(vm, e);
+    if (!key) return map_get_cstr(m, e->as.getfield.field);
+    if (!m->shape) return map_get_strkey(m, key);
+    struct cs_inline_cache* ic = ic_get(vm, &e->as.getfield.ic);
+    if (ic) {
+        for (int i = 0; i < ic->count; i++) {
+            cs_ic_entry* ent = &ic->entries[i];
+            if (ent->kind != IC_SLOT || ent->shape != m->shape) continue;
+            vm->prof_ic_hits++;
+            return ent->slot < 0 ? cs_nil() : cs_value_copy(m->entries[ent->slot].val);
+        }
+    }
+    vm->prof_ic_misses++;
+    cs_value kv; kv.type = CS_T_STR; kv.as.p = key;
+    int slot = shape_slot(m->shape, kv);
+    if (ic) {
+        cs_ic_entry* ent = ic_add(ic);
+        ent->kind = IC_SLOT;
+        ent->shape = m->shape;
+        ent->slot = slot;
+    }
+    return slot < 0 ? cs_nil() : cs_value_copy(m->entries[slot].val);
+}
+
 // ---------- string helpers ----------
 static int str_append_inplace(cs_string* s, const char* add, size_t add_len) {
     if (!s || !add) return 0;
@@ -1343,13 +2554,31 @@ static int strbuf_method_id(const char* field) {
 }
 
 // ---------- time helper ----------
+// Budgets, timeouts and profiling use the monotonic clock so a wall-clock step
+// can neither starve a slice nor let it overrun.
 static uint64_t get_time_ms(void) {
+    return cs_monotonic_ns() / 1000000ULL;
+}
+
+static uint64_t get_time_us(void) {
+    return cs_monotonic_ns() / 1000ULL;
+}
+
+// Wall clock, only for converting the absolute times scripts pass in.
+static uint64_t get_wall_time_ms(void) {
 #if !defined(_WIN32)
     struct timeval tv;
     if (gettimeofday(&tv, NULL) != 0) return 0;
     return (uint64_t)tv.tv_sec * 1000 + (uint64_t)(tv.tv_usec / 1000);
 #else
-    return (uint64_t)(clock() * 1000 / CLOCKS_PER_SEC);
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULARGE_INTEGER uli;
+    uli.LowPart = ft.dwLowDateTime;
+    uli.HighPart = ft.dwHighDateTime;
+    const uint64_t EPOCH_100NS = 116444736000000000ULL; // 1601->1970
+    if (uli.QuadPart < EPOCH_100NS) return 0;
+    return (uint64_t)((uli.QuadPart - EPOCH_100NS) / 10000ULL);
 #endif
 }
 
@@ -1369,8 +2598,186 @@ typedef struct {
 
 static exec_result exec_block(cs_vm* vm, cs_env* env, ast* b);
 
+// ---------- time slices ----------
+// A program queued with cs_vm_load_* runs on its own coroutine stack. Once a slice has
+// spent its budget the safety check switches back to the host, leaving the program's
+// C stack intact so cs_vm_resume continues at the same expression.
+typedef struct cs_slice {
+    cs_vm* vm;
+    ast* prog;
+    char* dir;                         // directory of a loaded file (NULL for strings)
+    int started;
+    int finished;
+    int running;
+    int hold;                          // >0 while pausing would leave a lock held
+    int rc;
+    uint64_t budget_us;
+    uint64_t deadline_us;              // 0 = run until finished
+    uint64_t paused_at_ms;
+    // Program state parked while the host has control
+    uint64_t instruction_count;
+    uint64_t exec_start_ms;
+    struct cs_gen_state* gen_current;
+    struct cs_gen_state* host_gen;
+    char* last_error;
+    int pending_throw;
+    cs_value pending_thrown;
+    cs_frame* frames;
+    size_t frame_count;
+    size_t frame_cap;
+    size_t frame_base;                 // host frame depth during the current slice
+    char** dirs;
+    size_t dir_count;
+    size_t dir_cap;
+    size_t dir_base;
+    uintptr_t stack_floor;             // depth-check bounds of the slice's stack
+    uintptr_t stack_top;
+#if defined(_WIN32)
+    LPVOID fiber;
+    LPVOID paused;                     // fiber that was running when the slice paused
+    LPVOID caller;
+#else
+    void* stack;
+    ucontext_t ctx;
+    ucontext_t caller;
+#endif
+} cs_slice;
+
+static void vm_slice_pause(cs_vm* vm);
+static void slice_free(cs_slice* s);
+
+static int vm_slice_can_pause(cs_vm* vm) {
+    cs_slice* s = vm->slice;
+    if (!s || !s->running || s->hold) return 0;
+#if defined(__linux__)
+    // The background event loop thread drains tasks too; only the slice's thread may switch.
+    if (vm->loop_running && pthread_equal(vm->loop_thread, pthread_self())) return 0;
+#endif
+    return 1;
+}
+
+// ---------- stack depth ----------
+// Evaluation recurses on the C stack, so runaway recursion is stopped with an error
+// while CS_STACK_RESERVE of the running stack is still free. A host thread's bounds
+// are measured once per thread; generators and slices install the bounds of their
+// own coroutine stack while they run.
+#if defined(_WIN32)
+static void vm_thread_stack_bounds(uintptr_t probe, uintptr_t* lo, uintptr_t* hi) {
+    ULONG_PTR l = 0, h = 0;
+    (void)probe;
+    GetCurrentThreadStackLimits(&l, &h);
+    *lo = (uintptr_t)l;
+    *hi = (uintptr_t)h;
+}
+#else
+static __thread uintptr_t tls_stack_lo, tls_stack_hi;
+
+static void vm_thread_stack_bounds(uintptr_t probe, uintptr_t* lo, uintptr_t* hi) {
+    if (!tls_stack_hi) {
+#if defined(__linux__)
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            void* addr = NULL;
+            size_t size = 0;
+            if (pthread_attr_getstack(&attr, &addr, &size) == 0 && addr) {
+                tls_stack_lo = (uintptr_t)addr;
+                tls_stack_hi = tls_stack_lo + size;
+            }
+            pthread_attr_destroy(&attr);
+        }
+#endif
+        if (!tls_stack_hi) {
+            // Layout unknown: assume RLIMIT_STACK (2 MB when unlimited) below the first probe
+            size_t size = 2 * 1024 * 1024;
+            struct rlimit rl;
+            if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) size = (size_t)rl.rlim_cur;
+            tls_stack_hi = probe;
+            tls_stack_lo = probe > size ? probe - size : 0;
+        }
+    }
+    *lo = tls_stack_lo;
+    *hi = tls_stack_hi;
+}
+#endif
+
+// Slow path of the depth check, taken when the stack pointer is outside the bounds
+// installed on the VM: the first evaluation on a host thread, or a different thread.
+static int vm_stack_exhausted(cs_vm* vm, uintptr_t sp) {
+    if (!vm->stack_coroutine) {
+        vm_thread_stack_bounds(sp, &vm->stack_floor, &vm->stack_top);
+        vm->stack_floor += CS_STACK_RESERVE;
+    }
+    return vm->stack_top && sp < vm->stack_floor;
+}
+
+typedef struct {
+    uintptr_t floor;
+    uintptr_t top;
+    int coroutine;
+} cs_stack_bounds;
+
+// Installs the bounds of a generator or slice stack before switching onto it.
+static void vm_stack_enter(cs_vm* vm, uintptr_t floor, uintptr_t top, cs_stack_bounds* saved) {
+    saved->floor = vm->stack_floor;
+    saved->top = vm->stack_top;
+    saved->coroutine = vm->stack_coroutine;
+    vm->stack_floor = floor;
+    vm->stack_top = top;
+    vm->stack_coroutine = 1;
+}
+
+static void vm_stack_leave(cs_vm* vm, const cs_stack_bounds* saved) {
+    vm->stack_floor = saved->floor;
+    vm->stack_top = saved->top;
+    vm->stack_coroutine = saved->coroutine;
+}
+
+#if !defined(_WIN32)
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+// Maps a coroutine stack of `size` usable bytes with a PROT_NONE guard page below
+// it, so an overflow faults instead of running into the heap.
+static void* coro_stack_alloc(size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* p = (char*)mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == (char*)MAP_FAILED) return NULL;
+    if (mprotect(p, page, PROT_NONE) != 0) {
+        munmap(p, size + page);
+        return NULL;
+    }
+    return p + page;
+}
+
+static void coro_stack_free(void* stack, size_t size) {
+    if (!stack) return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    munmap((char*)stack - page, size + page);
+}
+#endif
+
 static int vm_check_safety(cs_vm* vm, ast* e, int* ok) {
     if (!vm) return 1;
+
+    // Refuse to recurse further once the running stack is nearly used up
+    char probe;
+    uintptr_t sp = (uintptr_t)&probe;
+    if ((sp < vm->stack_floor || sp > vm->stack_top) && vm_stack_exhausted(vm, sp)) {
+        vm_set_err(vm, "maximum call depth exceeded",
+                   e ? e->source_name : "<unknown>",
+                   e ? e->line : 0,
+                   e ? e->col : 0);
+        *ok = 0;
+        return 0;
+    }
+
+    // Hand control back to the host once the current time slice is spent
+    if (vm->slice && (vm->instruction_count & 255) == 0 && vm->slice->deadline_us &&
+        vm_slice_can_pause(vm) && get_time_us() >= vm->slice->deadline_us) {
+        vm_slice_pause(vm);
+    }
     
     // Check interrupt flag (allows host to abort execution)
     if (vm->interrupt_requested) {
@@ -1428,10 +2835,21 @@ static int promise_is_pending(cs_promise_obj* p) {
     return p && p->state == 0;
 }
 
+static int promise_fulfill(cs_promise_obj* p, cs_value v);
+
+static void promise_settled(cs_promise_obj* p) {
+    cs_promise_obj* n = p->notify;
+    if (!n) return;
+    p->notify = NULL;
+    promise_fulfill(n, cs_nil());
+    promise_decref(n);
+}
+
 static int promise_fulfill(cs_promise_obj* p, cs_value v) {
     if (!p || p->state != 0) return 0;
     p->state = 1;
     p->value = cs_value_copy(v);
+    promise_settled(p);
     return 1;
 }
 
@@ -1439,6 +2857,7 @@ static int promise_reject(cs_promise_obj* p, cs_value v) {
     if (!p || p->state != 0) return 0;
     p->state = 2;
     p->value = cs_value_copy(v);
+    promise_settled(p);
     return 1;
 }
 
@@ -1447,6 +2866,8 @@ static cs_value make_promise_value(cs_promise_obj* p) {
     return v;
 }
 
+static void scheduler_wake(cs_vm* vm);
+
 static void scheduler_push_task(cs_vm* vm, cs_task* t) {
     if (!vm || !t) return;
     t->next = NULL;
@@ -1456,6 +2877,7 @@ static void scheduler_push_task(cs_vm* vm, cs_task* t) {
         vm->task_tail->next = t;
         vm->task_tail = t;
     }
+    scheduler_wake(vm);
 }
 
 static cs_task* scheduler_pop_task(cs_vm* vm) {
@@ -1467,37 +2889,114 @@ static cs_task* scheduler_pop_task(cs_vm* vm) {
     return t;
 }
 
-static void scheduler_add_timer(cs_vm* vm, cs_timer* timer) {
-    if (!vm || !timer) return;
-#if defined(__linux__)
-    pthread_mutex_lock(&vm->loop_mutex);
+// ---------- timer heap ----------
+uint64_t cs_monotonic_ns(void) {
+#if !defined(_WIN32)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
 #endif
-    if (!vm->timers || timer->due_ms < vm->timers->due_ms) {
-        timer->next = vm->timers;
-        vm->timers = timer;
+}
+
+static int timer_before(const cs_timer* a, const cs_timer* b) {
+    if (a->due_ns != b->due_ns) return a->due_ns < b->due_ns;
+    return a->seq < b->seq;  // equal deadlines fire in the order they were armed
+}
+
+static void timer_heap_place(cs_vm* vm, size_t i, cs_timer* t) {
+    vm->timers[i] = t;
+    t->index = i;
+}
+
+static void timer_heap_up(cs_vm* vm, size_t i) {
+    cs_timer* t = vm->timers[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!timer_before(t, vm->timers[parent])) break;
+        timer_heap_place(vm, i, vm->timers[parent]);
+        i = parent;
+    }
+    timer_heap_place(vm, i, t);
+}
+
+static void timer_heap_down(cs_vm* vm, size_t i) {
+    cs_timer* t = vm->timers[i];
+    size_t n = vm->timer_count;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && timer_before(vm->timers[child + 1], vm->timers[child])) child++;
+        if (!timer_before(vm->timers[child], t)) break;
+        timer_heap_place(vm, i, vm->timers[child]);
+        i = child;
+    }
+    timer_heap_place(vm, i, t);
+}
+
+// Unlink the timer at slot i and restore the heap order. Caller owns the timer.
+static cs_timer* timer_heap_remove(cs_vm* vm, size_t i) {
+    cs_timer* t = vm->timers[i];
+    cs_timer* last = vm->timers[--vm->timer_count];
+    if (i < vm->timer_count) {
+        timer_heap_place(vm, i, last);
+        if (i > 0 && timer_before(last, vm->timers[(i - 1) / 2])) timer_heap_up(vm, i);
+        else timer_heap_down(vm, i);
+    }
+    vm->timers[vm->timer_count] = NULL;
+    return t;
+}
+
+static int scheduler_add_timer(cs_vm* vm, cs_timer* timer) {
+    if (!vm || !timer) return 0;
 #if defined(__linux__)
-        pthread_cond_broadcast(&vm->loop_cond);
-        pthread_mutex_unlock(&vm->loop_mutex);
+    pthread_mutex_lock(&vm->loop_mutex);
 #endif
-        return;
+    int ok = 1;
+    if (vm->timer_count == vm->timer_cap) {
+        size_t nc = vm->timer_cap ? vm->timer_cap * 2 : 16;
+        cs_timer** nt = (cs_timer**)realloc(vm->timers, nc * sizeof(cs_timer*));
+        if (!nt) ok = 0;
+        else { vm->timers = nt; vm->timer_cap = nc; }
+    }
+    if (ok) {
+        timer->seq = vm->timer_seq++;
+        timer_heap_place(vm, vm->timer_count++, timer);
+        timer_heap_up(vm, timer->index);
+        timer->promise->timer = timer;
     }
-    cs_timer* cur = vm->timers;
-    while (cur->next && cur->next->due_ms <= timer->due_ms) cur = cur->next;
-    timer->next = cur->next;
-    cur->next = timer;
 #if defined(__linux__)
     pthread_cond_broadcast(&vm->loop_cond);
     pthread_mutex_unlock(&vm->loop_mutex);
 #endif
+    // A blocked loop may be waiting for a later deadline than this one
+    if (ok) scheduler_wake(vm);
+    return ok;
 }
 
 static int scheduler_run_due_timers(cs_vm* vm) {
     if (!vm) return 0;
-    uint64_t now = get_time_ms();
+    uint64_t now = cs_monotonic_ns();
     int ran = 0;
-    while (vm->timers && vm->timers->due_ms <= now) {
-        cs_timer* t = vm->timers;
-        vm->timers = t->next;
+    while (vm->timer_count > 0) {
+        cs_timer* t = NULL;
+#if defined(__linux__)
+        // Another thread may be arming a timer
+        pthread_mutex_lock(&vm->loop_mutex);
+#endif
+        if (vm->timer_count > 0 && vm->timers[0]->due_ns <= now) {
+            t = timer_heap_remove(vm, 0);
+            t->promise->timer = NULL;
+        }
+#if defined(__linux__)
+        pthread_mutex_unlock(&vm->loop_mutex);
+#endif
+        if (!t) break;
         if (promise_is_pending(t->promise)) {
             promise_fulfill(t->promise, cs_nil());
 #if defined(__linux__)
@@ -1511,6 +3010,17 @@ static int scheduler_run_due_timers(cs_vm* vm) {
     return ran;
 }
 
+// Milliseconds until the earliest timer, rounded up so a sub-millisecond deadline
+// is not polled early; `cap` when no timer is armed or it is further away.
+static int scheduler_timer_wait_ms(cs_vm* vm, int cap) {
+    if (!vm || vm->timer_count == 0) return cap;
+    uint64_t now = cs_monotonic_ns();
+    uint64_t due = vm->timers[0]->due_ns;
+    if (due <= now) return 0;
+    uint64_t ms = (due - now + 999999ULL) / 1000000ULL;
+    return ms < (uint64_t)cap ? (int)ms : cap;
+}
+
 int cs_scheduler_run_due_timers(cs_vm* vm) {
     return scheduler_run_due_timers(vm);
 }
@@ -1532,7 +3042,7 @@ static int scheduler_run_one_task(cs_vm* vm, ast* e, int* ok) {
     if (t->bound_env) {
         callenv = t->bound_env;
     } else {
-        callenv = env_new(t->fn->closure);
+        callenv = call_env_new(t->fn);
     }
     if (!callenv) {
         vm_set_err(vm, "out of memory", e ? e->source_name : "<async>", e ? e->line : 0, e ? e->col : 0);
@@ -1559,7 +3069,11 @@ static int scheduler_run_one_task(cs_vm* vm, ast* e, int* ok) {
     }
 
     vm_frames_push(vm, t->fn->name ? t->fn->name : "<async>", t->source ? t->source : "<async>", t->line, t->col);
+    // Tasks can be drained from inside a generator body (await); they must not yield into it.
+    struct cs_gen_state* outer_gen = vm->gen_current;
+    vm->gen_current = NULL;
     exec_result r = exec_block(vm, callenv, t->fn->body);
+    vm->gen_current = outer_gen;
     if (r.did_throw) {
         promise_reject(t->promise, r.thrown);
         r.thrown = cs_nil();
@@ -1603,43 +3117,226 @@ task_cleanup:
     return 1;
 }
 
+// ---------- cross-thread deliveries ----------
+// Without a wake fd (Windows, or the fd could not be opened) an I/O wait is cut to
+// this many milliseconds while replies are owed, so a delivery is not stuck behind
+// the poll timeout.
+#define CS_WAKE_POLL_MS 2
+
+// How a blocked scheduler is woken (vm->wake_armed)
+#define CS_WAKE_COND 1  // waiting on inbox_cond
+#define CS_WAKE_IO   2  // waiting in cs_poll_pending_io; write the wake fd
+
+static void inbox_lock(cs_vm* vm) {
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(&vm->inbox_lock);
+#else
+    pthread_mutex_lock(&vm->inbox_lock);
+#endif
+}
+
+static void inbox_unlock(cs_vm* vm) {
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(&vm->inbox_lock);
+#else
+    pthread_mutex_unlock(&vm->inbox_lock);
+#endif
+}
+
+static void inbox_broadcast(cs_vm* vm) {
+#if defined(_WIN32)
+    WakeAllConditionVariable(&vm->inbox_cond);
+#else
+    pthread_cond_broadcast(&vm->inbox_cond);
+#endif
+}
+
+// Called after publishing work the scheduler must notice: a task, a timer, a settled
+// promise, a delivery or a loop stop. May be called from any thread. A wakeup with
+// nobody blocked is remembered so the next scheduler_block returns at once; that
+// closes the window between the scheduler finding no work and it going to sleep.
+static void wake_locked(cs_vm* vm) {
+    if (vm->wake_armed == CS_WAKE_COND) inbox_broadcast(vm);
+    else if (vm->wake_armed == CS_WAKE_IO) cs_io_wake(vm);
+    else vm->wake_pending = 1;
+    vm->wake_armed = 0;
+}
+
+static void scheduler_wake(cs_vm* vm) {
+    if (!vm) return;
+    inbox_lock(vm);
+    wake_locked(vm);
+    inbox_unlock(vm);
+}
+
+// Block the scheduler thread until scheduler_wake, ready I/O or timeout_ms (-1 = no
+// limit). With I/O pending the wait is the poller's, so ready sockets are handled.
+static void scheduler_block(cs_vm* vm, int timeout_ms) {
+    inbox_lock(vm);
+    if (vm->wake_pending) {
+        vm->wake_pending = 0;
+        timeout_ms = 0;
+    }
+    if (vm->pending_io_count > 0) {
+        if (!cs_io_wakeable(vm) && vm->inbox_expected > 0 &&
+            (timeout_ms < 0 || timeout_ms > CS_WAKE_POLL_MS)) {
+            timeout_ms = CS_WAKE_POLL_MS;
+        }
+        vm->wake_armed = timeout_ms != 0 ? CS_WAKE_IO : 0;
+        inbox_unlock(vm);
+        cs_poll_pending_io(vm, timeout_ms);
+        inbox_lock(vm);
+    } else if (timeout_ms != 0) {
+        vm->wake_armed = CS_WAKE_COND;
+#if defined(_WIN32)
+        SleepConditionVariableSRW(&vm->inbox_cond, &vm->inbox_lock,
+                                  timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms, 0);
+#else
+        if (timeout_ms < 0) {
+            while (vm->wake_armed) pthread_cond_wait(&vm->inbox_cond, &vm->inbox_lock);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += (time_t)(timeout_ms / 1000);
+            ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) { ts.tv_sec += 1; ts.tv_nsec -= 1000000000L; }
+            while (vm->wake_armed) {
+                if (pthread_cond_timedwait(&vm->inbox_cond, &vm->inbox_lock, &ts) != 0) break;
+            }
+        }
+#endif
+    }
+    vm->wake_armed = 0;
+    vm->wake_pending = 0;
+    inbox_unlock(vm);
+}
+
+void cs_vm_deliver(cs_vm* vm, cs_delivery* d) {
+    if (!vm || !d) return;
+    d->next = NULL;
+    inbox_lock(vm);
+    if (vm->inbox_tail) vm->inbox_tail->next = d;
+    else vm->inbox_head = d;
+    vm->inbox_tail = d;
+    inbox_broadcast(vm);
+    wake_locked(vm);
+    inbox_unlock(vm);
+}
+
+static cs_delivery* inbox_pop(cs_vm* vm) {
+    inbox_lock(vm);
+    cs_delivery* d = vm->inbox_head;
+    if (d) {
+        vm->inbox_head = d->next;
+        if (!vm->inbox_head) vm->inbox_tail = NULL;
+        d->next = NULL;
+    }
+    inbox_unlock(vm);
+    return d;
+}
+
+// One at a time: a delivery may run script that awaits and drains the inbox itself.
+int cs_vm_run_deliveries(cs_vm* vm) {
+    if (!vm) return 0;
+    int n = 0;
+    cs_delivery* d;
+    while ((d = inbox_pop(vm)) != NULL) {
+        d->run(vm, d);
+        n++;
+    }
+    return n;
+}
+
+static int scheduler_run_one_delivery(cs_vm* vm, int* ok) {
+    // Only VMs with workers get deliveries from the scheduler; a worker VM takes its
+    // messages one at a time from its own loop.
+    if (!vm->workers && !vm->inbox_expected) return 0;
+    cs_delivery* d = inbox_pop(vm);
+    if (!d) return 0;
+    d->run(vm, d);
+    if (vm->delivery_failed) {
+        // The callback's error is in vm->last_error; it fails whatever was waiting
+        vm->delivery_failed = 0;
+        *ok = 0;
+    }
+    return 1;
+}
+
+int cs_vm_wait_deliveries(cs_vm* vm, uint64_t timeout_ms) {
+    if (!vm) return 0;
+    inbox_lock(vm);
+    if (!vm->inbox_head && timeout_ms > 0) {
+#if defined(_WIN32)
+        SleepConditionVariableSRW(&vm->inbox_cond, &vm->inbox_lock, (DWORD)timeout_ms, 0);
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += (time_t)(timeout_ms / 1000);
+        ts.tv_nsec += (long)((timeout_ms % 1000) * 1000000L);
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec += 1; ts.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&vm->inbox_cond, &vm->inbox_lock, &ts);
+#endif
+    }
+    int queued = vm->inbox_head != NULL;
+    inbox_unlock(vm);
+    return queued;
+}
+
 static int scheduler_wait_and_run(cs_vm* vm, ast* e, int* ok) {
     if (!vm) return 0;
     if (scheduler_run_due_timers(vm)) return 1;
     if (scheduler_run_one_task(vm, e, ok)) return 1;
+    if (scheduler_run_one_delivery(vm, ok)) return 1;
 
     if (vm->pending_io_count > 0) {
-        int timeout = 100;
-        if (vm->timers) {
-            uint64_t now = get_time_ms();
-            uint64_t due = vm->timers->due_ms;
-            if (due <= now) timeout = 0;
-            else {
-                uint64_t delta = due - now;
-                if (delta < (uint64_t)timeout) timeout = (int)delta;
-            }
+        if (vm_slice_can_pause(vm)) {
+            // A time slice never blocks: poll once and give the rest of it back to the host
+            cs_poll_pending_io(vm, 0);
+            vm_slice_pause(vm);
+            return 1;
         }
-        cs_poll_pending_io(vm, timeout);
+        scheduler_block(vm, scheduler_timer_wait_ms(vm, 100));
         return 1;
     }
 
-    if (vm->timers) {
-        uint64_t now = get_time_ms();
-        uint64_t due = vm->timers->due_ms;
+    if (vm->timer_count > 0) {
+        uint64_t now = cs_monotonic_ns();
+        uint64_t due = vm->timers[0]->due_ns;
+        if (due > now && vm_slice_can_pause(vm)) {
+            vm_slice_pause(vm);
+            return 1;
+        }
         if (due > now) {
             uint64_t delta = due - now;
+            if (delta >= 1000000ULL) {
+                // Whole milliseconds are spent blocked so a task, delivery or settled
+                // promise is picked up at once; the timer is re-checked afterwards
+                uint64_t ms = delta / 1000000ULL;
+                scheduler_block(vm, ms < 100 ? (int)ms : 100);
+                return 1;
+            }
+            // The sub-millisecond tail is slept exactly
 #if !defined(_WIN32)
             struct timespec ts;
-            ts.tv_sec = (time_t)(delta / 1000);
-            ts.tv_nsec = (long)((delta % 1000) * 1000000L);
+            ts.tv_sec = (time_t)(delta / 1000000000ULL);
+            ts.tv_nsec = (long)(delta % 1000000000ULL);
             (void)nanosleep(&ts, NULL);
 #else
-            Sleep((DWORD)delta);
+            Sleep((DWORD)((delta + 999999ULL) / 1000000ULL));
 #endif
         }
         return scheduler_run_due_timers(vm);
     }
 
+    if (vm->inbox_expected > 0) {
+        if (vm_slice_can_pause(vm)) {
+            vm_slice_pause(vm);
+            return 1;
+        }
+        scheduler_block(vm, 100);
+        return 1;
+    }
+
     return 0;
 }
 
@@ -1674,6 +3371,7 @@ static cs_value await_promise(cs_vm* vm, cs_promise_obj* p, ast* e, int* ok) {
         }
     } else if (vm && vm->loop_running) {
         // Waiting on a promise from outside the event loop thread: block on cond variable
+        if (vm->slice) vm->slice->hold++;
         pthread_mutex_lock(&vm->loop_mutex);
         while (promise_is_pending(p) && *ok) {
             if (vm->exec_timeout_ms > 0) {
@@ -1708,6 +3406,7 @@ static cs_value await_promise(cs_vm* vm, cs_promise_obj* p, ast* e, int* ok) {
                 if (vm->interrupt_requested) { *ok = 0; break; }
             }
         }
+        if (vm->slice) vm->slice->hold--;
         // capture state while still under lock
         if (!*ok) { pthread_mutex_unlock(&vm->loop_mutex); return cs_nil(); }
         if (p->state == 1) {
@@ -1868,10 +3567,12 @@ int cs_promise_resolve(cs_vm* vm, cs_value promise, cs_value value) {
     int ok = promise_fulfill(as_promise(promise), value);
     if (vm) pthread_cond_broadcast(&vm->loop_cond);
     if (vm) pthread_mutex_unlock(&vm->loop_mutex);
+    if (ok) scheduler_wake(vm);
     return ok;
 #else
-    (void)vm;
-    return promise_fulfill(as_promise(promise), value);
+    int ok = promise_fulfill(as_promise(promise), value);
+    if (ok) scheduler_wake(vm);
+    return ok;
 #endif
 }
 
@@ -1882,10 +3583,12 @@ int cs_promise_reject(cs_vm* vm, cs_value promise, cs_value value) {
     int ok = promise_reject(as_promise(promise), value);
     if (vm) pthread_cond_broadcast(&vm->loop_cond);
     if (vm) pthread_mutex_unlock(&vm->loop_mutex);
+    if (ok) scheduler_wake(vm);
     return ok;
 #else
-    (void)vm;
-    return promise_reject(as_promise(promise), value);
+    int ok = promise_reject(as_promise(promise), value);
+    if (ok) scheduler_wake(vm);
+    return ok;
 #endif
 }
 
@@ -1894,14 +3597,81 @@ int cs_promise_is_pending(cs_value promise) {
     return promise_is_pending(as_promise(promise));
 }
 
-void cs_schedule_timer(cs_vm* vm, cs_value promise, uint64_t due_ms) {
-    if (!vm || promise.type != CS_T_PROMISE) return;
+int cs_promise_notify(cs_vm* vm, cs_value promise, cs_value notify) {
+    if (promise.type != CS_T_PROMISE || notify.type != CS_T_PROMISE) return 0;
+    cs_promise_obj* p = as_promise(promise);
+#if defined(__linux__)
+    if (vm) pthread_mutex_lock(&vm->loop_mutex);
+#endif
+    int pending = promise_is_pending(p);
+    if (pending) {
+        promise_decref(p->notify);
+        p->notify = as_promise(notify);
+        promise_incref(p->notify);
+    }
+#if defined(__linux__)
+    if (vm) pthread_mutex_unlock(&vm->loop_mutex);
+#endif
+    if (!pending) cs_promise_resolve(vm, notify, cs_nil());
+    return 1;
+}
+
+int cs_schedule_timer_ns(cs_vm* vm, cs_value promise, uint64_t delay_ns) {
+    if (!vm || promise.type != CS_T_PROMISE) return 0;
+    cs_promise_obj* p = as_promise(promise);
+    if (p->timer) return 1;  // already armed
     cs_timer* timer = (cs_timer*)calloc(1, sizeof(cs_timer));
-    if (!timer) return;
-    timer->due_ms = due_ms;
-    timer->promise = as_promise(promise);
-    promise_incref(timer->promise);
-    scheduler_add_timer(vm, timer);
+    if (!timer) return 0;
+    timer->due_ns = cs_monotonic_ns() + delay_ns;
+    timer->promise = p;
+    promise_incref(p);
+    if (!scheduler_add_timer(vm, timer)) {
+        promise_decref(p);
+        free(timer);
+        return 0;
+    }
+    return 1;
+}
+
+void cs_schedule_timer(cs_vm* vm, cs_value promise, uint64_t due_ms) {
+    // due_ms is on the wall clock now_ms() reports; convert to a delay so the
+    // heap stays on the monotonic clock
+    uint64_t now = get_wall_time_ms();
+    uint64_t delay = due_ms > now ? due_ms - now : 0;
+    (void)cs_schedule_timer_ns(vm, promise, delay * 1000000ULL);
+}
+
+int cs_cancel_timer(cs_vm* vm, cs_value promise) {
+    if (!vm || promise.type != CS_T_PROMISE) return 0;
+    cs_promise_obj* p = as_promise(promise);
+#if defined(__linux__)
+    pthread_mutex_lock(&vm->loop_mutex);
+#endif
+    cs_timer* t = p->timer;
+    if (t && t->index < vm->timer_count && vm->timers[t->index] == t) {
+        timer_heap_remove(vm, t->index);
+        p->timer = NULL;
+    } else {
+        t = NULL;
+    }
+#if defined(__linux__)
+    pthread_mutex_unlock(&vm->loop_mutex);
+#endif
+    if (!t) return 0;
+    if (promise_is_pending(p)) {
+        cs_value reason = cs_str(vm, "cancelled");
+        promise_reject(p, reason);
+        cs_value_release(reason);
+    }
+    promise_decref(p);
+    free(t);
+#if defined(__linux__)
+    pthread_mutex_lock(&vm->loop_mutex);
+    pthread_cond_broadcast(&vm->loop_cond);
+    pthread_mutex_unlock(&vm->loop_mutex);
+#endif
+    scheduler_wake(vm);
+    return 1;
 }
 
 // ---------- event loop (background thread) ----------
@@ -1921,13 +3691,9 @@ static void* event_loop_thread_func(void* arg) {
             pthread_mutex_unlock(&vm->loop_mutex);
         }
 
-        // If no work, sleep briefly to avoid busy-waiting
-        if (!had_work) {
-            struct timespec ts;
-            ts.tv_sec = 0;
-            ts.tv_nsec = 1000000L; // 1ms
-            nanosleep(&ts, NULL);
-        }
+        // Nothing runnable, armed or owed: sleep until a task, timer, settled promise
+        // or cs_event_loop_stop wakes the loop
+        if (!had_work && vm->loop_running) scheduler_block(vm, -1);
 
         // Reset ok flag for next iteration
         if (!ok) ok = 1;
@@ -1980,6 +3746,7 @@ int cs_event_loop_stop(cs_vm* vm) {
     pthread_t thread = vm->loop_thread;
 
     pthread_mutex_unlock(&vm->loop_mutex);
+    scheduler_wake(vm);
 
     // Wait for thread to exit (do this outside the lock to avoid deadlock)
     if (thread != 0) {
@@ -2137,30 +3904,276 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s);
 static exec_result exec_block(cs_vm* vm, cs_env* env, ast* b);
 static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok);
 
-static int build_call_argv(cs_vm* vm, cs_env* env, ast** args, size_t arg_count, cs_value** out_argv, int* out_argc, int* ok, const char* src, int line, int col) {
-    if (out_argv) *out_argv = NULL;
-    if (out_argc) *out_argc = 0;
-    if (!args || arg_count == 0) return 1;
+// ---------- generators ----------
+// A generator call binds its arguments and returns a suspended iterator. Each next()
+// switches onto the generator's own stack and runs the body until the following
+// `yield` (or the end of the body), so values are produced one at a time.
+typedef struct cs_gen_state {
+    cs_vm* vm;
+    struct cs_func* fn;
+    cs_env* env;
+    cs_frame* frames;        // generator frames, stashed while suspended
+    size_t frame_count;
+    size_t frame_cap;
+    size_t frame_base;       // caller's frame depth during the current resume
+    cs_value yielded;
+    exec_result result;
+    int started;
+    int finished;
+    int running;
+    int closing;             // set when the iterator is dropped before the body finished
+    uintptr_t stack_floor;   // depth-check bounds of the generator's stack
+    uintptr_t stack_top;
+#if defined(_WIN32)
+    LPVOID fiber;
+    LPVOID caller;
+#else
+    void* stack;
+    ucontext_t ctx;
+    ucontext_t caller;
+#endif
+} cs_gen_state;
 
-    size_t cap = arg_count ? arg_count : 4;
-    size_t cnt = 0;
-    cs_value* argv = (cs_value*)calloc(cap, sizeof(cs_value));
-    if (!argv) { vm_set_err(vm, "out of memory", src, line, col); *ok = 0; return 0; }
+static void gen_body(cs_gen_state* g);
 
-    for (size_t i = 0; i < arg_count; i++) {
-        ast* a = args[i];
-        if (a && a->type == N_SPREAD) {
-            cs_value spread = eval_expr(vm, env, a->as.spread.expr, ok);
-            if (!*ok) {
-                for (size_t k = 0; k < cnt; k++) cs_value_release(argv[k]);
-                free(argv);
-                return 0;
-            }
-            if (spread.type == CS_T_NIL) { cs_value_release(spread); continue; }
-            if (spread.type != CS_T_LIST) {
-                cs_value_release(spread);
-                for (size_t k = 0; k < cnt; k++) cs_value_release(argv[k]);
-                free(argv);
+static int gen_stash_frames(cs_gen_state* g) {
+    return vm_frames_stash(g->vm, g->frame_base, &g->frames, &g->frame_count, &g->frame_cap);
+}
+
+#if defined(_WIN32)
+static VOID CALLBACK gen_fiber_entry(LPVOID p) {
+    cs_gen_state* g = (cs_gen_state*)p;
+    ULONG_PTR lo = 0, hi = 0;
+    GetCurrentThreadStackLimits(&lo, &hi);
+    g->stack_floor = (uintptr_t)lo + CS_STACK_RESERVE;
+    g->stack_top = (uintptr_t)hi;
+    gen_body(g);
+}
+
+static int gen_switch_in(cs_gen_state* g) {
+    if (!g->fiber) {
+        g->fiber = CreateFiberEx(0, CS_GEN_STACK_SIZE, 0, gen_fiber_entry, g);
+        if (!g->fiber) return 0;
+    }
+    if (!IsThreadAFiber() && !ConvertThreadToFiber(NULL)) return 0;
+    g->caller = GetCurrentFiber();
+    SwitchToFiber(g->fiber);
+    return 1;
+}
+
+static void gen_switch_out(cs_gen_state* g) {
+    SwitchToFiber(g->caller);
+}
+
+static void gen_free_stack(cs_gen_state* g) {
+    if (g->fiber) DeleteFiber(g->fiber);
+    g->fiber = NULL;
+}
+#else
+static void gen_context_entry(unsigned int hi, unsigned int lo) {
+    uint64_t p = ((uint64_t)hi << 32) | (uint64_t)lo;
+    gen_body((cs_gen_state*)(uintptr_t)p);
+}
+
+static int gen_switch_in(cs_gen_state* g) {
+    cs_vm* vm = g->vm;
+    if (!g->stack) {
+        g->stack = vm->gen_stack_count > 0 ? vm->gen_stacks[--vm->gen_stack_count] : coro_stack_alloc(CS_GEN_STACK_SIZE);
+        if (!g->stack) return 0;
+        g->stack_floor = (uintptr_t)g->stack + CS_STACK_RESERVE;
+        g->stack_top = (uintptr_t)g->stack + CS_GEN_STACK_SIZE;
+        if (getcontext(&g->ctx) != 0) return 0;
+        g->ctx.uc_stack.ss_sp = g->stack;
+        g->ctx.uc_stack.ss_size = CS_GEN_STACK_SIZE;
+        g->ctx.uc_link = NULL;
+        uint64_t p = (uint64_t)(uintptr_t)g;
+        makecontext(&g->ctx, (void (*)(void))gen_context_entry, 2, (unsigned int)(p >> 32), (unsigned int)p);
+    }
+    return swapcontext(&g->caller, &g->ctx) == 0;
+}
+
+static void gen_switch_out(cs_gen_state* g) {
+    swapcontext(&g->ctx, &g->caller);
+}
+
+static void gen_free_stack(cs_gen_state* g) {
+    if (!g->stack) return;
+    cs_vm* vm = g->vm;
+    if (vm->gen_stack_count < CS_GEN_STACK_POOL) vm->gen_stacks[vm->gen_stack_count++] = g->stack;
+    else coro_stack_free(g->stack, CS_GEN_STACK_SIZE);
+    g->stack = NULL;
+}
+#endif
+
+static void gen_body(cs_gen_state* g) {
+    // The stack did not exist yet when gen_resume installed its bounds
+    g->vm->stack_floor = g->stack_floor;
+    g->vm->stack_top = g->stack_top;
+    g->result = exec_block(g->vm, g->env, g->fn->body);
+    g->finished = 1;
+    gen_switch_out(g);
+}
+
+static void gen_drop_callee(cs_gen_state* g) {
+    if (g->env) env_decref(g->env);
+    g->env = NULL;
+    if (g->fn) {
+        cs_value fv; fv.type = CS_T_FUNC; fv.as.p = g->fn;
+        cs_value_release(fv);
+        g->fn = NULL;
+    }
+}
+
+// Runs the body up to its next yield. Returns 1 with *out set, 0 when finished, -1 on error
+// (a script-level throw is left pending on the VM).
+static int gen_resume(cs_gen_state* g, cs_value* out) {
+    cs_vm* vm = g->vm;
+    if (g->finished) return 0;
+    if (g->running) { cs_error(vm, "generator is already running"); return -1; }
+
+    g->frame_base = vm->frame_count;
+    for (size_t i = 0; i < g->frame_count; i++) {
+        cs_frame* f = &g->frames[i];
+        vm_frames_push(vm, f->func, f->source, f->line, f->col);
+    }
+    g->frame_count = 0;
+
+    struct cs_gen_state* prev = vm->gen_current;
+    vm->gen_current = g;
+    g->running = 1;
+    g->started = 1;
+    cs_stack_bounds host_stack;
+    vm_stack_enter(vm, g->stack_floor, g->stack_top, &host_stack);
+    int switched = gen_switch_in(g);
+    vm_stack_leave(vm, &host_stack);
+    g->running = 0;
+    vm->gen_current = prev;
+
+    if (!switched) {
+        vm->frame_count = g->frame_base;
+        cs_error(vm, "out of memory");
+        return -1;
+    }
+
+    if (!g->finished) {
+        if (!gen_stash_frames(g)) {
+            cs_value_release(g->yielded);
+            g->yielded = cs_nil();
+            cs_error(vm, "out of memory");
+            return -1;
+        }
+        *out = g->yielded;
+        g->yielded = cs_nil();
+        return 1;
+    }
+
+    gen_free_stack(g);
+    exec_result r = g->result;
+    g->result.ret = cs_nil();
+    g->result.thrown = cs_nil();
+    int rc = 0;
+    if (r.did_throw) {
+        // Leave the generator frames in place so an uncaught throw reports them.
+        vm_set_pending_throw(vm, r.thrown);
+        r.thrown = cs_nil();
+        rc = -1;
+    } else {
+        vm->frame_count = g->frame_base;
+        if (r.did_break) { cs_error(vm, "break used outside of a loop"); rc = -1; }
+        else if (r.did_continue) { cs_error(vm, "continue used outside of a loop"); rc = -1; }
+        else if (!r.ok) rc = -1;
+    }
+    cs_value_release(r.ret);
+    cs_value_release(r.thrown);
+    gen_drop_callee(g);
+    return rc;
+}
+
+static void gen_state_free(void* p) {
+    cs_gen_state* g = (cs_gen_state*)p;
+    cs_vm* vm = g->vm;
+    if (g->started && !g->finished && !vm->tearing_down) {
+        // Dropped mid-body: resume with `closing` set so the pending yield returns and
+        // enclosing finally blocks run. Errors raised while closing are discarded.
+        char* saved_err = vm->last_error;
+        int saved_throw = vm->pending_throw;
+        cs_value saved_thrown = vm->pending_thrown;
+        size_t base = vm->frame_count;
+        vm->last_error = NULL;
+        vm->pending_throw = 0;
+        vm->pending_thrown = cs_nil();
+
+        g->closing = 1;
+        cs_value v = cs_nil();
+        while (gen_resume(g, &v) > 0) { cs_value_release(v); v = cs_nil(); }
+
+        vm_clear_pending_throw(vm);
+        free(vm->last_error);
+        vm->last_error = saved_err;
+        vm->pending_throw = saved_throw;
+        vm->pending_thrown = saved_thrown;
+        vm->frame_count = base;
+    }
+    gen_free_stack(g);
+    gen_drop_callee(g);
+    cs_value_release(g->yielded);
+    free(g->frames);
+    free(g);
+}
+
+static int iter_next_gen(cs_vm* vm, cs_iter_obj* it, cs_value* out) {
+    (void)vm;
+    return gen_resume((cs_gen_state*)it->state, out);
+}
+
+// Wraps a bound generator call. Takes its own reference to callenv; returns nil on OOM.
+static cs_value gen_new(cs_vm* vm, struct cs_func* fn, cs_env* callenv, const char* name, const char* source, int line, int col) {
+    cs_gen_state* g = (cs_gen_state*)calloc(1, sizeof(cs_gen_state));
+    if (!g) return cs_nil();
+    g->frames = (cs_frame*)malloc(sizeof(cs_frame));
+    cs_value itv = g->frames ? cs_iter_new(vm, iter_next_gen, cs_nil(), cs_nil()) : cs_nil();
+    if (itv.type != CS_T_ITER) { free(g->frames); free(g); return cs_nil(); }
+
+    g->vm = vm;
+    cs_value fv; fv.type = CS_T_FUNC; fv.as.p = fn;
+    g->fn = as_func(cs_value_copy(fv));
+    env_incref(callenv);
+    g->env = callenv;
+    g->frames[0] = (cs_frame){ name ? name : (fn->name ? fn->name : "<generator>"), source, line, col };
+    g->frame_count = 1;
+    g->frame_cap = 1;
+    g->yielded = cs_nil();
+
+    cs_iter_obj* it = (cs_iter_obj*)itv.as.p;
+    it->state = g;
+    it->state_free = gen_state_free;
+    return itv;
+}
+
+static int build_call_argv(cs_vm* vm, cs_env* env, ast** args, size_t arg_count, cs_value** out_argv, int* out_argc, int* ok, const char* src, int line, int col) {
+    if (out_argv) *out_argv = NULL;
+    if (out_argc) *out_argc = 0;
+    if (!args || arg_count == 0) return 1;
+
+    size_t cap = arg_count ? arg_count : 4;
+    size_t cnt = 0;
+    cs_value* argv = (cs_value*)calloc(cap, sizeof(cs_value));
+    if (!argv) { vm_set_err(vm, "out of memory", src, line, col); *ok = 0; return 0; }
+
+    for (size_t i = 0; i < arg_count; i++) {
+        ast* a = args[i];
+        if (a && a->type == N_SPREAD) {
+            cs_value spread = eval_expr(vm, env, a->as.spread.expr, ok);
+            if (!*ok) {
+                for (size_t k = 0; k < cnt; k++) cs_value_release(argv[k]);
+                free(argv);
+                return 0;
+            }
+            if (spread.type == CS_T_NIL) { cs_value_release(spread); continue; }
+            if (spread.type != CS_T_LIST) {
+                cs_value_release(spread);
+                for (size_t k = 0; k < cnt; k++) cs_value_release(argv[k]);
+                free(argv);
                 vm_set_err(vm, "spread expects list", src, line, col);
                 *ok = 0;
                 return 0;
@@ -2211,35 +4224,59 @@ static int build_call_argv(cs_vm* vm, cs_env* env, ast** args, size_t arg_count,
     return 1;
 }
 
+// Unescaped value of a string literal node, cached on the node (borrowed). NULL on OOM.
+static cs_string* lit_str_cached(cs_vm* vm, ast* e) {
+    if (!e->as.lit_str.cached) {
+        size_t n = strlen(e->as.lit_str.s);
+        char* un = unescape_string_token(e->as.lit_str.s, n);
+        if (!un) return NULL;
+        cs_string* st = cs_str_new_take(un, (size_t)-1);
+        if (!st) return NULL;
+        // Short literals (field names in `obj.f = v`, map keys) share the interned key.
+        cs_string* ik = st->len <= 64 ? vm_intern_str(vm, st) : NULL;
+        if (ik) { cs_str_incref(ik); cs_str_decref(st); st = ik; }
+        e->as.lit_str.cached = st;
+    }
+    return e->as.lit_str.cached;
+}
+
+// Value type named by a builtin type pattern (`int(x)`, `string(s)`, ...), or -1.
+static int builtin_type_tag(const char* name) {
+    if (strcmp(name, "nil") == 0) return CS_T_NIL;
+    if (strcmp(name, "bool") == 0) return CS_T_BOOL;
+    if (strcmp(name, "int") == 0) return CS_T_INT;
+    if (strcmp(name, "float") == 0) return CS_T_FLOAT;
+    if (strcmp(name, "string") == 0) return CS_T_STR;
+    if (strcmp(name, "list") == 0) return CS_T_LIST;
+    if (strcmp(name, "map") == 0) return CS_T_MAP;
+    if (strcmp(name, "set") == 0) return CS_T_SET;
+    if (strcmp(name, "strbuf") == 0) return CS_T_STRBUF;
+    if (strcmp(name, "range") == 0) return CS_T_RANGE;
+    if (strcmp(name, "function") == 0) return CS_T_FUNC;
+    if (strcmp(name, "native") == 0) return CS_T_NATIVE;
+    if (strcmp(name, "promise") == 0) return CS_T_PROMISE;
+    if (strcmp(name, "iterator") == 0) return CS_T_ITER;
+    return -1;
+}
+
 static int match_type_name(cs_vm* vm, cs_env* env, const char* name, cs_value v) {
     (void)vm;
     if (!name) return 0;
-    if (strcmp(name, "nil") == 0) return v.type == CS_T_NIL;
-    if (strcmp(name, "bool") == 0) return v.type == CS_T_BOOL;
-    if (strcmp(name, "int") == 0) return v.type == CS_T_INT;
-    if (strcmp(name, "float") == 0) return v.type == CS_T_FLOAT;
-    if (strcmp(name, "string") == 0) return v.type == CS_T_STR;
-    if (strcmp(name, "list") == 0) return v.type == CS_T_LIST;
-    if (strcmp(name, "map") == 0) return v.type == CS_T_MAP;
-    if (strcmp(name, "set") == 0) return v.type == CS_T_SET;
-    if (strcmp(name, "strbuf") == 0) return v.type == CS_T_STRBUF;
-    if (strcmp(name, "range") == 0) return v.type == CS_T_RANGE;
-    if (strcmp(name, "function") == 0) return v.type == CS_T_FUNC;
-    if (strcmp(name, "native") == 0) return v.type == CS_T_NATIVE;
-    if (strcmp(name, "promise") == 0) return v.type == CS_T_PROMISE;
+    int tag = builtin_type_tag(name);
+    if (tag >= 0) return (int)v.type == tag;
 
     if (env) {
         cs_value tv = cs_nil();
         if (env_get(env, name, &tv)) {
             int matched = 0;
             if (tv.type == CS_T_MAP && map_is_class(tv) && v.type == CS_T_MAP) {
-                cs_string* k_class = key_class();
+                cs_string* k_class = key_class(vm);
                 cs_value cls = k_class ? map_get_strkey(as_map(v), k_class)
                                        : map_get_cstr(as_map(v), "__class");
                 matched = (cls.type == CS_T_MAP && vm_value_equals(cls, tv));
                 cs_value_release(cls);
             } else if (tv.type == CS_T_MAP && map_is_struct(tv) && v.type == CS_T_MAP) {
-                cs_string* k_struct = key_struct();
+                cs_string* k_struct = key_struct(vm);
                 cs_value st = k_struct ? map_get_strkey(as_map(v), k_struct)
                                        : map_get_cstr(as_map(v), "__struct");
                 matched = (st.type == CS_T_MAP && vm_value_equals(st, tv));
@@ -2346,19 +4383,370 @@ static int match_pattern(cs_vm* vm, cs_env* match_env, ast* pat, cs_value mv, in
             return vm_value_equals(mv, pv);
         }
         case N_LIT_STR: {
-            size_t n = strlen(pat->as.lit_str.s);
-            char* un = unescape_string_token(pat->as.lit_str.s, n);
-            if (!un) { vm_set_err(vm, "out of memory", pat->source_name, pat->line, pat->col); *ok = 0; return 0; }
-            cs_value pv = cs_str_take(vm, un, (uint64_t)-1);
-            int matched = vm_value_equals(mv, pv);
-            cs_value_release(pv);
-            return matched;
+            cs_string* st = lit_str_cached(vm, pat);
+            if (!st) { vm_set_err(vm, "out of memory", pat->source_name, pat->line, pat->col); *ok = 0; return 0; }
+            cs_value pv; pv.type = CS_T_STR; pv.as.p = st;
+            return vm_value_equals(mv, pv);
         }
         default:
             return 0;
     }
 }
 
+// ---------- match/switch dispatch ----------
+// Built on first execution of a match expression or switch statement and cached on
+// the node. Literal arms (and `case Enum.Member` in switch) go into a hash table keyed
+// on their value; every other arm carries a mask of the value types it can possibly
+// match. Dispatch merges the arms sharing the subject's key with the type-compatible
+// remaining arms in source order, so first-match order and guards are unchanged while
+// a 40-arm string match only runs the arms that can actually apply. List arms are also
+// filtered on the subject's length, and map arms on key presence tests that are shared
+// between arms naming the same key.
+#define CS_DISPATCH_MAX_REBUILDS 8
+#define CS_DISPATCH_MAP_KEYS 32
+
+enum { DISPATCH_READY = 1, DISPATCH_LINEAR };
+
+typedef struct cs_dispatch_slot {
+    cs_value key;       // borrowed from the AST literal or a watched enum map
+    uint32_t hash;
+    int first;          // first arm with this key, -1 when the slot is empty
+} cs_dispatch_slot;
+
+struct cs_dispatch {
+    int state;
+    int rebuilds;
+    size_t arm_count;
+    cs_dispatch_slot* slots;
+    size_t slot_cap;          // power of two; 0 when no arm is keyed
+    int* next_same;           // arm -> next arm with an equal key, or -1
+    int* others;              // arms that are not keyed, in order
+    uint32_t* other_masks;    // value types each of `others` can match
+    size_t other_count;
+    signed char* type_tags;   // builtin type of an N_PATTERN_TYPE arm, else -1
+    int* list_lens;           // items an N_PATTERN_LIST arm destructures, else -1
+    unsigned char* list_rest; // ...and whether it takes a rest binding
+    uint32_t* map_needs;      // map_keys an N_PATTERN_MAP arm requires
+    const char* map_keys[CS_DISPATCH_MAP_KEYS]; // borrowed from the AST
+    size_t map_key_count;
+    const char** guard_names; // switch: enum identifiers the keys were read through
+    cs_map_obj** guard_maps;
+    size_t guard_count;
+    uint64_t epoch;           // vm->ic_epoch the guarded keys were read at
+};
+
+static int dispatch_key_type(cs_type t) {
+    return t == CS_T_NIL || t == CS_T_BOOL || t == CS_T_INT || t == CS_T_FLOAT || t == CS_T_STR;
+}
+
+static size_t dispatch_align(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static int dispatch_lookup(const struct cs_dispatch* d, cs_value v) {
+    if (!d->slot_cap || !dispatch_key_type(v.type)) return -1;
+    size_t mask = d->slot_cap - 1;
+    size_t idx = cs_value_hash(v) & mask;
+    uint32_t h = cs_value_hash(v);
+    for (size_t probe = 0; probe < d->slot_cap; probe++) {
+        const cs_dispatch_slot* sl = &d->slots[idx];
+        if (sl->first < 0) return -1;
+        if (sl->hash == h && vm_value_equals(sl->key, v)) return sl->first;
+        idx = (idx + 1) & mask;
+    }
+    return -1;
+}
+
+static void dispatch_insert(struct cs_dispatch* d, cs_value key, int arm) {
+    size_t mask = d->slot_cap - 1;
+    uint32_t h = cs_value_hash(key);
+    size_t idx = h & mask;
+    for (;;) {
+        cs_dispatch_slot* sl = &d->slots[idx];
+        if (sl->first < 0) {
+            sl->key = key;
+            sl->hash = h;
+            sl->first = arm;
+            return;
+        }
+        if (sl->hash == h && vm_value_equals(sl->key, key)) {
+            int cur = sl->first;
+            while (d->next_same[cur] >= 0) cur = d->next_same[cur];
+            d->next_same[cur] = arm;
+            return;
+        }
+        idx = (idx + 1) & mask;
+    }
+}
+
+// Key of a switch `case <expr>` that can live in the table: literals, negated numeric
+// literals and `Ident.field` reads of a map. Sets *keyed = 0 for anything else.
+static cs_value dispatch_case_key(cs_vm* vm, cs_env* env, struct cs_dispatch* d, ast* x, int* keyed) {
+    *keyed = 0;
+    if (!x) return cs_nil();
+    switch (x->type) {
+        case N_LIT_INT: *keyed = 1; return cs_int((int64_t)x->as.lit_int.v);
+        case N_LIT_FLOAT: *keyed = 1; return cs_float(x->as.lit_float.v);
+        case N_LIT_BOOL: *keyed = 1; return cs_bool(x->as.lit_bool.v);
+        case N_LIT_NIL: *keyed = 1; return cs_nil();
+        case N_LIT_STR: {
+            cs_string* st = lit_str_cached(vm, x);
+            if (!st) return cs_nil();
+            cs_value v; v.type = CS_T_STR; v.as.p = st;
+            *keyed = 1;
+            return v;
+        }
+        case N_UNOP: {
+            ast* in = x->as.unop.expr;
+            if (x->as.unop.op != TK_MINUS || !in) return cs_nil();
+            if (in->type == N_LIT_INT) { *keyed = 1; return cs_int(-(int64_t)in->as.lit_int.v); }
+            if (in->type == N_LIT_FLOAT) { *keyed = 1; return cs_float(-in->as.lit_float.v); }
+            return cs_nil();
+        }
+        case N_GETFIELD: {
+            ast* t = x->as.getfield.target;
+            if (!t || t->type != N_IDENT) return cs_nil();
+            cs_value base;
+            if (!env_get_nocopy(env, t->as.ident.name, &base) || base.type != CS_T_MAP) return cs_nil();
+            cs_map_obj* m = as_map(base);
+            if (m->owner != vm) return cs_nil();
+            cs_string* key = getfield_key(vm, x);
+            if (!key) return cs_nil();
+            cs_value kv; kv.type = CS_T_STR; kv.as.p = key;
+            cs_value v = cs_nil();
+            if (m->shape) {
+                int slot = shape_slot(m->shape, kv);
+                if (slot >= 0) v = m->entries[slot].val;
+            } else {
+                int idx = map_find(m, kv, map_key_hash(kv));
+                if (idx >= 0) v = m->entries[idx].val;
+            }
+            if (!dispatch_key_type(v.type)) return cs_nil();
+            size_t g = 0;
+            while (g < d->guard_count && d->guard_maps[g] != m) g++;
+            if (g == d->guard_count) {
+                d->guard_names[g] = t->as.ident.name;
+                d->guard_maps[g] = m;
+                d->guard_count++;
+            }
+            m->ic_watched = 1;
+            *keyed = 1;
+            return v;
+        }
+        default:
+            return cs_nil();
+    }
+}
+
+// patterns: match arms / switch pattern cases; exprs + kinds: switch `case <expr>` and
+// `default` entries (kinds as stored by the parser, NULL for match).
+static struct cs_dispatch* dispatch_build(cs_vm* vm, cs_env* env, ast** patterns, ast** exprs,
+                                          const unsigned char* kinds, size_t count) {
+    size_t slot_cap = 0;
+    while (slot_cap < count * 2) slot_cap = slot_cap ? slot_cap * 2 : 4;
+    size_t off_slots = dispatch_align(sizeof(struct cs_dispatch));
+    size_t off_names = off_slots + dispatch_align(slot_cap * sizeof(cs_dispatch_slot));
+    size_t off_maps = off_names + dispatch_align(count * sizeof(char*));
+    size_t off_next = off_maps + dispatch_align(count * sizeof(cs_map_obj*));
+    size_t off_others = off_next + dispatch_align(count * sizeof(int));
+    size_t off_masks = off_others + dispatch_align(count * sizeof(int));
+    size_t off_tags = off_masks + dispatch_align(count * sizeof(uint32_t));
+    size_t off_lens = off_tags + dispatch_align(count);
+    size_t off_rest = off_lens + dispatch_align(count * sizeof(int));
+    size_t off_needs = off_rest + dispatch_align(count);
+    size_t total = off_needs + dispatch_align(count * sizeof(uint32_t));
+
+    char* base = (char*)calloc(1, total);
+    if (!base) return NULL;
+    struct cs_dispatch* d = (struct cs_dispatch*)base;
+    d->state = DISPATCH_READY;
+    d->arm_count = count;
+    d->slots = (cs_dispatch_slot*)(base + off_slots);
+    d->slot_cap = slot_cap;
+    d->guard_names = (const char**)(base + off_names);
+    d->guard_maps = (cs_map_obj**)(base + off_maps);
+    d->next_same = (int*)(base + off_next);
+    d->others = (int*)(base + off_others);
+    d->other_masks = (uint32_t*)(base + off_masks);
+    d->type_tags = (signed char*)(base + off_tags);
+    d->list_lens = (int*)(base + off_lens);
+    d->list_rest = (unsigned char*)(base + off_rest);
+    d->map_needs = (uint32_t*)(base + off_needs);
+    for (size_t i = 0; i < slot_cap; i++) d->slots[i].first = -1;
+
+    const uint32_t all_types = 0xffffffffu;
+    size_t keyed_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        d->next_same[i] = -1;
+        d->type_tags[i] = -1;
+        d->list_lens[i] = -1;
+        unsigned char kind = kinds ? kinds[i] : 1;
+        if (kind == 2) continue;  // switch default is not dispatched on
+
+        int keyed = 0;
+        cs_value key = cs_nil();
+        uint32_t mask = 0;
+        if (kind == 0) {
+            key = dispatch_case_key(vm, env, d, exprs[i], &keyed);
+            if (!keyed) { d->state = DISPATCH_LINEAR; break; }
+        } else {
+            ast* pat = patterns[i];
+            if (!pat) { d->state = DISPATCH_LINEAR; break; }
+            switch (pat->type) {
+                case N_LIT_INT: case N_LIT_FLOAT: case N_LIT_BOOL: case N_LIT_NIL: case N_LIT_STR:
+                    key = dispatch_case_key(vm, env, d, pat, &keyed);
+                    if (!keyed) { d->state = DISPATCH_LINEAR; }
+                    break;
+                case N_PATTERN_WILDCARD:
+                case N_IDENT:
+                    mask = all_types;
+                    break;
+                case N_PATTERN_TYPE: {
+                    int tag = pat->as.type_pattern.type_name ? builtin_type_tag(pat->as.type_pattern.type_name) : -1;
+                    d->type_tags[i] = (signed char)tag;
+                    // User class/struct names only ever match map instances.
+                    mask = tag >= 0 ? (1u << tag) : (1u << CS_T_MAP);
+                    break;
+                }
+                case N_PATTERN_LIST:
+                    mask = 1u << CS_T_LIST;
+                    d->list_lens[i] = (int)pat->as.list_pattern.count;
+                    d->list_rest[i] = pat->as.list_pattern.rest_name != NULL;
+                    break;
+                case N_PATTERN_MAP:
+                    mask = 1u << CS_T_MAP;
+                    for (size_t j = 0; j < pat->as.map_pattern.count; j++) {
+                        const char* key = pat->as.map_pattern.keys[j];
+                        size_t k = 0;
+                        while (k < d->map_key_count && strcmp(d->map_keys[k], key) != 0) k++;
+                        if (k == d->map_key_count) {
+                            if (k == CS_DISPATCH_MAP_KEYS) continue;  // left to match_pattern
+                            d->map_keys[d->map_key_count++] = key;
+                        }
+                        d->map_needs[i] |= 1u << k;
+                    }
+                    break;
+                default: break;  // never matches
+            }
+            if (d->state == DISPATCH_LINEAR) break;
+        }
+        if (keyed) {
+            dispatch_insert(d, key, (int)i);
+            keyed_count++;
+        } else if (mask) {
+            d->others[d->other_count] = (int)i;
+            d->other_masks[d->other_count] = mask;
+            d->other_count++;
+        }
+    }
+    if (!keyed_count) d->slot_cap = 0;
+    d->epoch = vm->ic_epoch;
+    return d;
+}
+
+// Returns the node's dispatch table, building or refreshing it; NULL means scan linearly.
+static struct cs_dispatch* dispatch_get(cs_vm* vm, cs_env* env, struct cs_dispatch** site, ast** patterns,
+                                        ast** exprs, const unsigned char* kinds, size_t count) {
+    struct cs_dispatch* d = *site;
+    int rebuilds = 0;
+    if (d) {
+        if (d->state == DISPATCH_LINEAR) return NULL;
+        int valid = 1;
+        if (d->guard_count && d->epoch != vm->ic_epoch) valid = 0;
+        for (size_t g = 0; valid && g < d->guard_count; g++) {
+            cs_value v;
+            if (!env_get_nocopy(env, d->guard_names[g], &v) || v.type != CS_T_MAP || as_map(v) != d->guard_maps[g]) valid = 0;
+        }
+        if (valid) return d;
+        rebuilds = d->rebuilds + 1;
+        free(d);
+        *site = NULL;
+    }
+    d = dispatch_build(vm, env, patterns, exprs, kinds, count);
+    if (!d) return NULL;
+    d->rebuilds = rebuilds;
+    if (rebuilds >= CS_DISPATCH_MAX_REBUILDS) d->state = DISPATCH_LINEAR;
+    *site = d;
+    return d->state == DISPATCH_READY ? d : NULL;
+}
+
+typedef struct {
+    const struct cs_dispatch* d;
+    int keyed;          // next arm from the subject's key chain, or -1
+    size_t other;       // position in d->others
+    uint32_t bit;       // subject's type bit
+    int last_keyed;     // the arm just returned came from the key chain
+    cs_value subject;   // borrowed
+    uint32_t keys_known;   // map_keys already looked up in the subject
+    uint32_t keys_present; // ...and found
+} dispatch_iter;
+
+static void dispatch_begin(dispatch_iter* it, const struct cs_dispatch* d, cs_value v) {
+    it->d = d;
+    it->keyed = dispatch_lookup(d, v);
+    it->other = 0;
+    it->bit = 1u << v.type;
+    it->last_keyed = 0;
+    it->subject = v;
+    it->keys_known = 0;
+    it->keys_present = 0;
+}
+
+// A guard may have changed the subject, so key lookups made before it are stale.
+static void dispatch_guard_ran(dispatch_iter* it) {
+    it->keys_known = 0;
+    it->keys_present = 0;
+}
+
+// Sub-tests of a type-compatible arm that need no binding env: the length a list
+// pattern destructures and the keys a map pattern requires.
+static int dispatch_arm_viable(dispatch_iter* it, int arm) {
+    const struct cs_dispatch* d = it->d;
+    if (d->list_lens[arm] >= 0) {
+        cs_list_obj* l = as_list(it->subject);
+        size_t len = l ? l->len : 0;
+        size_t want = (size_t)d->list_lens[arm];
+        return d->list_rest[arm] ? len >= want : len == want;
+    }
+    uint32_t need = d->map_needs[arm];
+    if (need) {
+        uint32_t unknown = need & ~it->keys_known;
+        for (size_t k = 0; unknown; k++, unknown >>= 1) {
+            if (!(unknown & 1u)) continue;
+            if (map_has_cstr(as_map(it->subject), d->map_keys[k])) it->keys_present |= 1u << k;
+            it->keys_known |= 1u << k;
+        }
+        return (need & it->keys_present) == need;
+    }
+    return 1;
+}
+
+// Next candidate arm in source order, or -1.
+static int dispatch_next(dispatch_iter* it) {
+    const struct cs_dispatch* d = it->d;
+    while (it->other < d->other_count &&
+           (!(d->other_masks[it->other] & it->bit) || !dispatch_arm_viable(it, d->others[it->other]))) it->other++;
+    int other = it->other < d->other_count ? d->others[it->other] : -1;
+    if (it->keyed >= 0 && (other < 0 || it->keyed < other)) {
+        int arm = it->keyed;
+        it->keyed = d->next_same[arm];
+        it->last_keyed = 1;
+        return arm;
+    }
+    if (other < 0) return -1;
+    it->other++;
+    it->last_keyed = 0;
+    return other;
+}
+
+// Tests a non-keyed candidate arm; builtin type patterns already passed the type mask.
+static int dispatch_match_arm(cs_vm* vm, const struct cs_dispatch* d, cs_env* match_env, ast* pat, int arm, cs_value mv, int* ok) {
+    if (d->type_tags[arm] >= 0) {
+        return pat->as.type_pattern.inner ? match_pattern(vm, match_env, pat->as.type_pattern.inner, mv, ok) : 1;
+    }
+    return match_pattern(vm, match_env, pat, mv, ok);
+}
+
 // Helper to bind parameters with default value support
 static int bind_params_with_defaults(cs_vm* vm, cs_env* callenv, struct cs_func* fn, int argc, const cs_value* argv, int* ok) {
     // Calculate required params (those without defaults)
@@ -2731,6 +5119,34 @@ static cs_value eval_binop(cs_vm* vm, ast* e, cs_value a, cs_value b, int* ok) {
 
 // Helper function for executing nested iterations in list comprehensions
 // This recursively processes each level of iteration
+// Binds one item pulled from an iterator to a comprehension's loop variable(s).
+static int comprehension_bind_item(cs_vm* vm, cs_env* loop_env, const char* var, const char* var2,
+                                   int is_destructuring, cs_value item, int64_t index,
+                                   const char* source_name, int line, int col) {
+    if (!is_destructuring) {
+        env_set_here(loop_env, var, item);
+        if (var2) env_set_here(loop_env, var2, cs_int(index));
+        return 1;
+    }
+    cs_value first = cs_nil();
+    cs_value second = cs_nil();
+    if (item.type == CS_T_LIST) {
+        cs_list_obj* l = as_list(item);
+        if (l && l->len >= 1) first = l->items[0];
+        if (l && l->len >= 2) second = l->items[1];
+    } else if (item.type == CS_T_TUPLE) {
+        cs_tuple_obj* t = (cs_tuple_obj*)item.as.p;
+        if (t && t->len >= 1) first = t->fields[0].value;
+        if (t && t->len >= 2) second = t->fields[1].value;
+    } else {
+        vm_set_err(vm, "destructuring expects list or tuple", source_name, line, col);
+        return 0;
+    }
+    env_set_here(loop_env, var, first);
+    if (var2) env_set_here(loop_env, var2, second);
+    return 1;
+}
+
 static void execute_nested_list_iteration(
     cs_vm* vm,
     cs_env* loop_env,
@@ -2870,8 +5286,26 @@ static void execute_nested_list_iteration(
                 vars, vars2, iterables, iter_count, depth + 1, ok,
                 source_name, line, col);
         }
+    } else if (iterable.type == CS_T_ITER) {
+        for (int64_t i = 0; *ok; i++) {
+            cs_value item = cs_nil();
+            int got = cs_iter_next(vm, iterable, &item);
+            if (got < 0) {
+                if (!vm->last_error && !vm->pending_throw) vm_set_err(vm, "iterator failed", source_name, line, col);
+                *ok = 0;
+                break;
+            }
+            if (got == 0) break;
+            int bound = comprehension_bind_item(vm, loop_env, actual_var, var2, is_destructuring, item, i,
+                                                source_name, line, col);
+            cs_value_release(item);
+            if (!bound) { *ok = 0; break; }
+            execute_nested_list_iteration(vm, loop_env, expr, filter, result,
+                vars, vars2, iterables, iter_count, depth + 1, ok,
+                source_name, line, col);
+        }
     } else {
-        vm_set_err(vm, "comprehension requires iterable (list, range, map, or string)", source_name, line, col);
+        vm_set_err(vm, "comprehension requires iterable (list, range, map, string, or iterator)", source_name, line, col);
         *ok = 0;
     }
 
@@ -3008,8 +5442,26 @@ static void execute_nested_map_iteration(
                 key_vars, val_vars, iterables, iter_count, depth + 1, ok,
                 source_name, line, col);
         }
+    } else if (iterable.type == CS_T_ITER) {
+        for (int64_t i = 0; *ok; i++) {
+            cs_value item = cs_nil();
+            int got = cs_iter_next(vm, iterable, &item);
+            if (got < 0) {
+                if (!vm->last_error && !vm->pending_throw) vm_set_err(vm, "iterator failed", source_name, line, col);
+                *ok = 0;
+                break;
+            }
+            if (got == 0) break;
+            int bound = comprehension_bind_item(vm, loop_env, actual_var, var2, is_destructuring, item, i,
+                                                source_name, line, col);
+            cs_value_release(item);
+            if (!bound) { *ok = 0; break; }
+            execute_nested_map_iteration(vm, loop_env, key_expr, val_expr, filter, result,
+                key_vars, val_vars, iterables, iter_count, depth + 1, ok,
+                source_name, line, col);
+        }
     } else {
-        vm_set_err(vm, "map comprehension requires iterable (list, range, or map)", source_name, line, col);
+        vm_set_err(vm, "map comprehension requires iterable (list, range, map, or iterator)", source_name, line, col);
         *ok = 0;
     }
 
@@ -3177,8 +5629,26 @@ static void execute_nested_set_iteration(
                 vars, vars2, iterables, iter_count, depth + 1, ok,
                 source_name, line, col);
         }
+    } else if (iterable.type == CS_T_ITER) {
+        for (int64_t i = 0; *ok; i++) {
+            cs_value item = cs_nil();
+            int got = cs_iter_next(vm, iterable, &item);
+            if (got < 0) {
+                if (!vm->last_error && !vm->pending_throw) vm_set_err(vm, "iterator failed", source_name, line, col);
+                *ok = 0;
+                break;
+            }
+            if (got == 0) break;
+            int bound = comprehension_bind_item(vm, loop_env, actual_var, var2, is_destructuring, item, i,
+                                                source_name, line, col);
+            cs_value_release(item);
+            if (!bound) { *ok = 0; break; }
+            execute_nested_set_iteration(vm, loop_env, expr, filter, result,
+                vars, vars2, iterables, iter_count, depth + 1, ok,
+                source_name, line, col);
+        }
     } else {
-        vm_set_err(vm, "comprehension requires iterable (list, range, map, set, or string)", source_name, line, col);
+        vm_set_err(vm, "comprehension requires iterable (list, range, map, set, string, or iterator)", source_name, line, col);
         *ok = 0;
     }
 
@@ -3220,10 +5690,10 @@ static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok) {
         }
 
         case N_LIT_STR: {
-            size_t n = strlen(e->as.lit_str.s);
-            char* un = unescape_string_token(e->as.lit_str.s, n);
-            if (!un) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; return cs_nil(); }
-            return cs_str_take(vm, un, (uint64_t)-1);
+            cs_string* st = lit_str_cached(vm, e);
+            if (!st) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; return cs_nil(); }
+            cs_value v; v.type = CS_T_STR; v.as.p = st;
+            return cs_value_copy(v);
         }
 
         case N_STR_INTERP: {
@@ -3302,8 +5772,16 @@ static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok) {
             f->param_count = e->as.funclit.param_count;
             f->rest_param = e->as.funclit.rest_param;
             f->body = e->as.funclit.body;
-            f->closure = env;
-            env_incref(env);
+            if (!e->as.funclit.captures) {
+                e->as.funclit.captures = captures_build(e->as.funclit.params, e->as.funclit.defaults, e->as.funclit.param_count,
+                                                        e->as.funclit.rest_param, e->as.funclit.body);
+            }
+            f->captures = e->as.funclit.captures;
+            f->closure = closure_env_for(e->as.funclit.captures, env);
+            if (!f->closure) {
+                f->closure = env;
+                env_incref(env);
+            }
             f->is_async = e->as.funclit.is_async;
             f->is_generator = e->as.funclit.is_generator;
 
@@ -3495,32 +5973,16 @@ static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok) {
                     if (fn->is_async) {
                         out = schedule_async_call(vm, fn, argc, argv, NULL, e, ok);
                     } else {
-                    cs_env* callenv = env_new(fn->closure);
+                    cs_env* callenv = call_env_new(fn);
                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                     if (*ok) {
-                        if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
-                            env_decref(callenv);
-                        } else {
-                            cs_value listv = cs_list(vm);
-                            cs_list_obj* yl = as_list(listv);
-                            if (!yl) {
-                                vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
-                                *ok = 0;
+                        if (bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
+                            if (fn->is_generator) {
+                                out = gen_new(vm, fn, callenv, fn->name, e->source_name, e->line, e->col);
+                                if (out.type != CS_T_ITER) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                             } else {
-                                int prev_active = vm->yield_active;
-                                int prev_used = vm->yield_used;
-                                cs_list_obj* prev_list = vm->yield_list;
-                                vm->yield_active = 1;
-                                vm->yield_used = 0;
-                                vm->yield_list = yl;
-
                                 exec_result r = exec_block(vm, callenv, fn->body);
 
-                                int used = vm->yield_used;
-                                vm->yield_active = prev_active;
-                                vm->yield_used = prev_used;
-                                vm->yield_list = prev_list;
-
                                 if (r.did_throw) {
                                     vm_set_pending_throw(vm, r.thrown);
                                     r.thrown = cs_nil();
@@ -3533,26 +5995,23 @@ static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok) {
                                     *ok = 0;
                                 } else if (!r.ok) {
                                     *ok = 0;
-                                } else if (fn->is_generator || used) {
-                                    out = cs_value_copy(listv);
                                 } else if (r.did_return) {
                                     out = cs_value_copy(r.ret);
                                 }
                                 cs_value_release(r.ret);
                                 cs_value_release(r.thrown);
                             }
-                            cs_value_release(listv);
                         }
                     }
                     env_decref(callenv);
                     }
                 } else if (callee.type == CS_T_MAP && map_is_class(callee)) {
-                    cs_value instance = cs_map(vm);
+                    cs_value instance = shaped_map_new(vm, 4);
                     if (!instance.as.p) {
                         vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
                         *ok = 0;
                     } else {
-                        cs_string* k_class = key_class();
+                        cs_string* k_class = key_class(vm);
                         int set_ok = k_class ? map_set_strkey(as_map(instance), k_class, callee)
                                              : map_set_cstr(as_map(instance), "__class", callee);
                         if (!set_ok) {
@@ -3565,24 +6024,22 @@ static cs_value eval_expr(cs_vm* vm, cs_env* env, ast* e, int* ok) {
                     if (*ok) {
                         cs_value ctor = cs_nil();
                         cs_value owner_class = cs_nil();
-                        if (class_find_method(callee, "new", &ctor, &owner_class)) {
+                        if (class_find_method(callee, key_new_method(vm), &ctor, &owner_class)) {
                             if (ctor.type == CS_T_FUNC) {
                                 struct cs_func* fn = as_func(ctor);
-                                cs_env* callenv = env_new(fn->closure);
+                                cs_env* callenv = call_env_new(fn);
                                 if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                 if (*ok) {
                                     env_set_here(callenv, "self", instance);
                                     cs_value super_val = cs_nil();
                                     if (owner_class.type == CS_T_MAP) {
-                                        cs_string* k_parent = key_parent();
+                                        cs_string* k_parent = key_parent(vm);
                                         super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                              : map_get_cstr(as_map(owner_class), "__parent");
                                     }
                                     env_set_here(callenv, "super", super_val);
                                     cs_value_release(super_val);
-                                    if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
-                                        env_decref(callenv);
-                                    } else {
+                                    if (bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
                                         exec_result r = exec_block(vm, callenv, fn->body);
                                         if (r.did_throw) {
                                             vm_set_pending_throw(vm, r.thrown);
@@ -3614,8 +6071,8 @@ class_done:
                 } else if (callee.type == CS_T_MAP && map_is_struct(callee)) {
                     cs_value fields_v = cs_nil();
                     cs_value defaults_v = cs_nil();
-                    cs_string* k_fields = key_fields();
-                    cs_string* k_defaults = key_defaults();
+                    cs_string* k_fields = key_fields(vm);
+                    cs_string* k_defaults = key_defaults(vm);
                     fields_v = k_fields ? map_get_strkey(as_map(callee), k_fields)
                                         : map_get_cstr(as_map(callee), "__fields");
                     defaults_v = k_defaults ? map_get_strkey(as_map(callee), k_defaults)
@@ -3631,12 +6088,12 @@ class_done:
                             vm_set_err(vm, "too many arguments for struct", e->source_name, e->line, e->col);
                             *ok = 0;
                         } else {
-                            cs_value instance = cs_map(vm);
+                            cs_value instance = shaped_map_new(vm, field_count + 1);
                             if (!instance.as.p) {
                                 vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
                                 *ok = 0;
                             } else {
-                                cs_string* k_struct = key_struct();
+                                cs_string* k_struct = key_struct(vm);
                                 int set_ok = k_struct ? map_set_strkey(as_map(instance), k_struct, callee)
                                                       : map_set_cstr(as_map(instance), "__struct", callee);
                                 if (!set_ok) {
@@ -3692,11 +6149,24 @@ struct_done:
 
             uint64_t match_start = get_time_ms();
 
-            for (size_t i = 0; i < e->as.match_expr.case_count; i++) {
+            struct cs_dispatch* d = dispatch_get(vm, env, &e->as.match_expr.dispatch, e->as.match_expr.case_patterns,
+                                                 NULL, NULL, e->as.match_expr.case_count);
+            dispatch_iter it;
+            if (d) dispatch_begin(&it, d, mv);
+
+            for (size_t n = 0; d || n < e->as.match_expr.case_count; n++) {
+                size_t i = n;
+                if (d) {
+                    int arm = dispatch_next(&it);
+                    if (arm < 0) break;
+                    i = (size_t)arm;
+                }
                 cs_env* match_env = env_new(env);
                 if (!match_env) { cs_value_release(mv); vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; return cs_nil(); }
 
-                int matched = match_pattern(vm, match_env, e->as.match_expr.case_patterns[i], mv, ok);
+                ast* pat = e->as.match_expr.case_patterns[i];
+                int matched = !d ? match_pattern(vm, match_env, pat, mv, ok)
+                            : it.last_keyed ? 1 : dispatch_match_arm(vm, d, match_env, pat, (int)i, mv, ok);
                 if (!*ok) { env_decref(match_env); cs_value_release(mv); if (vm) { vm->prof_match_ops++; vm->prof_match_ms += get_time_ms() - match_start; } return cs_nil(); }
 
                 if (matched && e->as.match_expr.case_guards[i]) {
@@ -3704,6 +6174,7 @@ struct_done:
                     if (!*ok) { env_decref(match_env); cs_value_release(mv); if (vm) { vm->prof_match_ops++; vm->prof_match_ms += get_time_ms() - match_start; } return cs_nil(); }
                     matched = is_truthy(gv);
                     cs_value_release(gv);
+                    if (d) dispatch_guard_ran(&it);
                 }
 
                 if (matched) {
@@ -3815,14 +6286,24 @@ struct_done:
                         cs_value_release(spread);
                         continue;
                     }
-                    if (spread.type != CS_T_LIST) {
+                    cs_list_obj* sl = NULL;
+                    if (spread.type == CS_T_LIST) sl = as_list(spread);
+                    else if (spread.type == CS_T_ITER) {
+                        sl = cs_iter_items(vm, spread);
+                        if (!sl) {
+                            cs_value_release(spread);
+                            cs_value_release(lv);
+                            if (!vm->pending_throw && !vm->last_error) vm_set_err(vm, "iterator failed", e->source_name, e->line, e->col);
+                            *ok = 0;
+                            return cs_nil();
+                        }
+                    } else {
                         cs_value_release(spread);
                         cs_value_release(lv);
-                        vm_set_err(vm, "spread expects list", e->source_name, e->line, e->col);
+                        vm_set_err(vm, "spread expects list or iterator", e->source_name, e->line, e->col);
                         *ok = 0;
                         return cs_nil();
                     }
-                    cs_list_obj* sl = as_list(spread);
                     for (size_t j = 0; j < sl->len; j++) {
                         if (!list_push(l, sl->items[j])) {
                             cs_value_release(spread);
@@ -3997,6 +6478,13 @@ struct_done:
             cs_value out = cs_nil();
             if (target.type == CS_T_LIST && index.type == CS_T_INT) {
                 out = list_get(as_list(target), index.as.i);
+            } else if (target.type == CS_T_ITER && index.type == CS_T_INT) {
+                cs_list_obj* items = cs_iter_items(vm, target);
+                if (items) out = list_get(items, index.as.i);
+                else {
+                    if (!vm->pending_throw && !vm->last_error) vm_set_err(vm, "iterator failed", e->source_name, e->line, e->col);
+                    *ok = 0;
+                }
             } else if (target.type == CS_T_BYTES && index.type == CS_T_INT) {
                 cs_bytes_obj* b = as_bytes(target);
                 if (!b || index.as.i < 0 || (size_t)index.as.i >= b->len) {
@@ -4044,7 +6532,7 @@ struct_done:
 
             cs_value out = cs_nil();
             if (target.type == CS_T_MAP) {
-                out = map_get_cstr(as_map(target), e->as.getfield.field);
+                out = getfield_map(vm, e, as_map(target));
             } else if (target.type == CS_T_TUPLE) {
                 cs_tuple_obj* t = (cs_tuple_obj*)target.as.p;
                 if (t) {
@@ -4078,7 +6566,7 @@ struct_done:
 
             cs_value out = cs_nil();
             if (target.type == CS_T_MAP) {
-                out = map_get_cstr(as_map(target), e->as.getfield.field);
+                out = getfield_map(vm, e, as_map(target));
             } else {
                 vm_set_err(vm, "field access expects map", e->source_name, e->line, e->col);
                 *ok = 0;
@@ -4126,11 +6614,14 @@ struct_done:
                                         if (fn->is_async) {
                                             out = schedule_async_call(vm, fn, argc, argv, NULL, e, ok);
                                         } else {
-                                            cs_env* callenv = env_new(fn->closure);
+                                            cs_env* callenv = call_env_new(fn);
                                             if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                             if (*ok) {
                                                 if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
-                                                    env_decref(callenv);
+                                                    // callenv is released after the call below
+                                                } else if (fn->is_generator) {
+                                                    out = gen_new(vm, fn, callenv, name, e->source_name, e->line, e->col);
+                                                    if (out.type != CS_T_ITER) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                                 } else {
                                                     vm_frames_push(vm, name, e->source_name, e->line, e->col);
                                                     exec_result r = exec_block(vm, callenv, fn->body);
@@ -4447,26 +6938,10 @@ strbuf_done:
                         cs_value f = cs_nil();
                         cs_value owner_class = cs_nil();
                         int from_class = 0;
-                        if (map_is_class(self)) {
-                            if (!class_find_method(self, field, &f, &owner_class)) {
-                                vm_set_err(vm, "unknown class method", e->source_name, e->line, e->col);
-                                *ok = 0;
-                            } else {
-                                from_class = 1;
-                            }
-                        } else {
-                            cs_map_obj* sm = as_map(self);
-                            if (map_has_cstr(sm, field)) {
-                                f = map_get_cstr(sm, field);
-                            } else {
-                                cs_string* k_class = key_class();
-                                cs_value cls = k_class ? map_get_strkey(sm, k_class)
-                                                       : map_get_cstr(sm, "__class");
-                                if (map_is_class(cls) && class_find_method(cls, field, &f, &owner_class)) {
-                                    from_class = 1;
-                                }
-                                cs_value_release(cls);
-                            }
+                        int self_is_class = 0;
+                        if (!method_lookup(vm, gf, self, &f, &owner_class, &from_class, &self_is_class)) {
+                            vm_set_err(vm, "unknown class method", e->source_name, e->line, e->col);
+                            *ok = 0;
                         }
 
                         if (*ok) {
@@ -4481,11 +6956,11 @@ strbuf_done:
                             } else if (f.type == CS_T_FUNC) {
                                 struct cs_func* fn = as_func(f);
                                 if (fn->is_async) {
-                                    cs_env* callenv = env_new(fn->closure);
+                                    cs_env* callenv = call_env_new(fn);
                                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                     if (*ok && from_class) {
                                         cs_value self_val = cs_nil();
-                                        if (map_is_class(self)) {
+                                        if (self_is_class) {
                                             if (!env_get(env, "self", &self_val)) {
                                                 vm_set_err(vm, "super used outside of method", e->source_name, e->line, e->col);
                                                 *ok = 0;
@@ -4498,7 +6973,7 @@ strbuf_done:
                                             cs_value_release(self_val);
                                             cs_value super_val = cs_nil();
                                             if (owner_class.type == CS_T_MAP) {
-                                                cs_string* k_parent = key_parent();
+                                                cs_string* k_parent = key_parent(vm);
                                                 super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                                      : map_get_cstr(as_map(owner_class), "__parent");
                                             }
@@ -4511,13 +6986,13 @@ strbuf_done:
                                     }
                                     if (callenv) env_decref(callenv);
                                 } else {
-                                    cs_env* callenv = env_new(fn->closure);
+                                    cs_env* callenv = call_env_new(fn);
                                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
 
                                     if (*ok) {
                                         if (from_class) {
                                             cs_value self_val = cs_nil();
-                                            if (map_is_class(self)) {
+                                            if (self_is_class) {
                                                 if (!env_get(env, "self", &self_val)) {
                                                     vm_set_err(vm, "super used outside of method", e->source_name, e->line, e->col);
                                                     *ok = 0;
@@ -4530,7 +7005,7 @@ strbuf_done:
                                                 cs_value_release(self_val);
                                                 cs_value super_val = cs_nil();
                                                 if (owner_class.type == CS_T_MAP) {
-                                                    cs_string* k_parent = key_parent();
+                                                    cs_string* k_parent = key_parent(vm);
                                                     super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                                          : map_get_cstr(as_map(owner_class), "__parent");
                                                 }
@@ -4541,7 +7016,10 @@ strbuf_done:
 
                                         if (*ok) {
                                             if (!bind_params_with_defaults(vm, callenv, fn, argc0, argv0, ok)) {
-                                                env_decref(callenv);
+                                                // callenv is released after the call below
+                                            } else if (fn->is_generator) {
+                                                out = gen_new(vm, fn, callenv, field, e->source_name, e->line, e->col);
+                                                if (out.type != CS_T_ITER) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                             } else {
                                                 vm_frames_push(vm, field, e->source_name, e->line, e->col);
                                                 exec_result r = exec_block(vm, callenv, fn->body);
@@ -4833,26 +7311,10 @@ strbuf_done_opt:
                         cs_value f = cs_nil();
                         cs_value owner_class = cs_nil();
                         int from_class = 0;
-                        if (map_is_class(self)) {
-                            if (!class_find_method(self, field, &f, &owner_class)) {
-                                vm_set_err(vm, "unknown class method", e->source_name, e->line, e->col);
-                                *ok = 0;
-                            } else {
-                                from_class = 1;
-                            }
-                        } else {
-                            cs_map_obj* sm = as_map(self);
-                            if (map_has_cstr(sm, field)) {
-                                f = map_get_cstr(sm, field);
-                            } else {
-                                cs_string* k_class = key_class();
-                                cs_value cls = k_class ? map_get_strkey(sm, k_class)
-                                                       : map_get_cstr(sm, "__class");
-                                if (map_is_class(cls) && class_find_method(cls, field, &f, &owner_class)) {
-                                    from_class = 1;
-                                }
-                                cs_value_release(cls);
-                            }
+                        int self_is_class = 0;
+                        if (!method_lookup(vm, gf, self, &f, &owner_class, &from_class, &self_is_class)) {
+                            vm_set_err(vm, "unknown class method", e->source_name, e->line, e->col);
+                            *ok = 0;
                         }
 
                         if (*ok) {
@@ -4867,11 +7329,11 @@ strbuf_done_opt:
                             } else if (f.type == CS_T_FUNC) {
                                 struct cs_func* fn = as_func(f);
                                 if (fn->is_async) {
-                                    cs_env* callenv = env_new(fn->closure);
+                                    cs_env* callenv = call_env_new(fn);
                                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                     if (*ok && from_class) {
                                         cs_value self_val = cs_nil();
-                                        if (map_is_class(self)) {
+                                        if (self_is_class) {
                                             if (!env_get(env, "self", &self_val)) {
                                                 vm_set_err(vm, "super used outside of method", e->source_name, e->line, e->col);
                                                 *ok = 0;
@@ -4884,7 +7346,7 @@ strbuf_done_opt:
                                             cs_value_release(self_val);
                                             cs_value super_val = cs_nil();
                                             if (owner_class.type == CS_T_MAP) {
-                                                cs_string* k_parent = key_parent();
+                                                cs_string* k_parent = key_parent(vm);
                                                 super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                                      : map_get_cstr(as_map(owner_class), "__parent");
                                             }
@@ -4897,13 +7359,13 @@ strbuf_done_opt:
                                     }
                                     if (callenv) env_decref(callenv);
                                 } else {
-                                    cs_env* callenv = env_new(fn->closure);
+                                    cs_env* callenv = call_env_new(fn);
                                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
 
                                     if (*ok) {
                                         if (from_class) {
                                             cs_value self_val = cs_nil();
-                                            if (map_is_class(self)) {
+                                            if (self_is_class) {
                                                 if (!env_get(env, "self", &self_val)) {
                                                     vm_set_err(vm, "super used outside of method", e->source_name, e->line, e->col);
                                                     *ok = 0;
@@ -4916,7 +7378,7 @@ strbuf_done_opt:
                                                 cs_value_release(self_val);
                                                 cs_value super_val = cs_nil();
                                                 if (owner_class.type == CS_T_MAP) {
-                                                    cs_string* k_parent = key_parent();
+                                                    cs_string* k_parent = key_parent(vm);
                                                     super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                                          : map_get_cstr(as_map(owner_class), "__parent");
                                                 }
@@ -4927,7 +7389,10 @@ strbuf_done_opt:
 
                                         if (*ok) {
                                             if (!bind_params_with_defaults(vm, callenv, fn, argc0, argv0, ok)) {
-                                                env_decref(callenv);
+                                                // callenv is released after the call below
+                                            } else if (fn->is_generator) {
+                                                out = gen_new(vm, fn, callenv, field, e->source_name, e->line, e->col);
+                                                if (out.type != CS_T_ITER) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                             } else {
                                                 vm_frames_push(vm, field, e->source_name, e->line, e->col);
                                                 exec_result r = exec_block(vm, callenv, fn->body);
@@ -5000,35 +7465,18 @@ strbuf_done_opt:
                     if (fn->is_async) {
                         out = schedule_async_call(vm, fn, argc, argv, NULL, e, ok);
                     } else {
-                    cs_env* callenv = env_new(fn->closure);
+                    cs_env* callenv = call_env_new(fn);
                     if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
 
                     if (*ok) {
-                        if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
-                            env_decref(callenv);
-                        } else {
-                            vm_frames_push(vm, call_name ? call_name : (fn->name ? fn->name : "<fn>"), e->source_name, e->line, e->col);
-                            cs_value listv = cs_list(vm);
-                            cs_list_obj* yl = as_list(listv);
-                            int did_throw = 0;
-                            if (!yl) {
-                                vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
-                                *ok = 0;
+                        if (bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
+                            if (fn->is_generator) {
+                                out = gen_new(vm, fn, callenv, call_name, e->source_name, e->line, e->col);
+                                if (out.type != CS_T_ITER) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                             } else {
-                                int prev_active = vm->yield_active;
-                                int prev_used = vm->yield_used;
-                                cs_list_obj* prev_list = vm->yield_list;
-                                vm->yield_active = 1;
-                                vm->yield_used = 0;
-                                vm->yield_list = yl;
-
+                                vm_frames_push(vm, call_name ? call_name : (fn->name ? fn->name : "<fn>"), e->source_name, e->line, e->col);
                                 exec_result r = exec_block(vm, callenv, fn->body);
 
-                                int used = vm->yield_used;
-                                vm->yield_active = prev_active;
-                                vm->yield_used = prev_used;
-                                vm->yield_list = prev_list;
-
                                 if (r.did_throw) {
                                     vm_set_pending_throw(vm, r.thrown);
                                     r.thrown = cs_nil();
@@ -5041,28 +7489,24 @@ strbuf_done_opt:
                                     *ok = 0;
                                 } else if (!r.ok) {
                                     *ok = 0;
-                                } else if (fn->is_generator || used) {
-                                    out = cs_value_copy(listv);
                                 } else if (r.did_return) {
                                     out = cs_value_copy(r.ret);
                                 }
-                                did_throw = r.did_throw;
                                 cs_value_release(r.ret);
                                 cs_value_release(r.thrown);
+                                if (!r.did_throw) vm_frames_pop(vm);
                             }
-                            cs_value_release(listv);
-                            if (!did_throw) vm_frames_pop(vm);
                         }
                     }
                     env_decref(callenv);
                     }
                 } else if (callee.type == CS_T_MAP && map_is_class(callee)) {
-                    cs_value instance = cs_map(vm);
+                    cs_value instance = shaped_map_new(vm, 4);
                     if (!instance.as.p) {
                         vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
                         *ok = 0;
                     } else {
-                        cs_string* k_class = key_class();
+                        cs_string* k_class = key_class(vm);
                         int set_ok = k_class ? map_set_strkey(as_map(instance), k_class, callee)
                                              : map_set_cstr(as_map(instance), "__class", callee);
                         if (!set_ok) {
@@ -5073,24 +7517,22 @@ strbuf_done_opt:
                         }
                         cs_value ctor = cs_nil();
                         cs_value owner_class = cs_nil();
-                        if (class_find_method(callee, "new", &ctor, &owner_class)) {
+                        if (class_find_method_cached(vm, &e->as.call.ic, callee, key_new_method(vm), &ctor, &owner_class)) {
                             if (ctor.type == CS_T_FUNC) {
                                 struct cs_func* fn = as_func(ctor);
-                                cs_env* callenv = env_new(fn->closure);
+                                cs_env* callenv = call_env_new(fn);
                                 if (!callenv) { vm_set_err(vm, "out of memory", e->source_name, e->line, e->col); *ok = 0; }
                                 if (*ok) {
                                     env_set_here(callenv, "self", instance);
                                     cs_value super_val = cs_nil();
                                     if (owner_class.type == CS_T_MAP) {
-                                        cs_string* k_parent = key_parent();
+                                        cs_string* k_parent = key_parent(vm);
                                         super_val = k_parent ? map_get_strkey(as_map(owner_class), k_parent)
                                                              : map_get_cstr(as_map(owner_class), "__parent");
                                     }
                                     env_set_here(callenv, "super", super_val);
                                     cs_value_release(super_val);
-                                    if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
-                                        env_decref(callenv);
-                                    } else {
+                                    if (bind_params_with_defaults(vm, callenv, fn, argc, argv, ok)) {
                                         vm_frames_push(vm, call_name ? call_name : (fn->name ? fn->name : "<new>"), e->source_name, e->line, e->col);
                                         exec_result r = exec_block(vm, callenv, fn->body);
                                         if (r.did_throw) {
@@ -5124,8 +7566,8 @@ class_done_call:
                 } else if (callee.type == CS_T_MAP && map_is_struct(callee)) {
                     cs_value fields_v = cs_nil();
                     cs_value defaults_v = cs_nil();
-                    cs_string* k_fields = key_fields();
-                    cs_string* k_defaults = key_defaults();
+                    cs_string* k_fields = key_fields(vm);
+                    cs_string* k_defaults = key_defaults(vm);
                     fields_v = k_fields ? map_get_strkey(as_map(callee), k_fields)
                                         : map_get_cstr(as_map(callee), "__fields");
                     defaults_v = k_defaults ? map_get_strkey(as_map(callee), k_defaults)
@@ -5141,12 +7583,12 @@ class_done_call:
                             vm_set_err(vm, "too many arguments for struct", e->source_name, e->line, e->col);
                             *ok = 0;
                         } else {
-                            cs_value instance = cs_map(vm);
+                            cs_value instance = shaped_map_new(vm, field_count + 1);
                             if (!instance.as.p) {
                                 vm_set_err(vm, "out of memory", e->source_name, e->line, e->col);
                                 *ok = 0;
                             } else {
-                                cs_string* k_struct = key_struct();
+                                cs_string* k_struct = key_struct(vm);
                                 int set_ok = k_struct ? map_set_strkey(as_map(instance), k_struct, callee)
                                                       : map_set_cstr(as_map(instance), "__struct", callee);
                                 if (!set_ok) {
@@ -5730,7 +8172,30 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
             int default_index = -1;
             cs_env* match_env = NULL;
 
-            for (size_t i = 0; i < s->as.switch_stmt.case_count; i++) {
+            struct cs_dispatch* d = NULL;
+            if (s->as.switch_stmt.case_kinds) {
+                d = dispatch_get(vm, env, &s->as.switch_stmt.dispatch, s->as.switch_stmt.case_patterns,
+                                 s->as.switch_stmt.case_exprs, s->as.switch_stmt.case_kinds, s->as.switch_stmt.case_count);
+            }
+            dispatch_iter it;
+            if (d) {
+                dispatch_begin(&it, d, sw);
+                for (size_t i = 0; i < s->as.switch_stmt.case_count; i++) {
+                    if (s->as.switch_stmt.case_kinds[i] == 2) default_index = (int)i;
+                }
+            }
+
+            for (size_t n = 0; d || n < s->as.switch_stmt.case_count; n++) {
+                size_t i = n;
+                if (d) {
+                    int arm = dispatch_next(&it);
+                    if (arm < 0) break;
+                    i = (size_t)arm;
+                    if (it.last_keyed && s->as.switch_stmt.case_kinds[i] == 0) {
+                        match_index = (int)i;
+                        break;
+                    }
+                }
                 unsigned char kind = s->as.switch_stmt.case_kinds ? s->as.switch_stmt.case_kinds[i] : 0;
                 if (kind == 2) {
                     default_index = (int)i;
@@ -5740,7 +8205,9 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
                 if (kind == 1) {
                     cs_env* cand_env = env_new(env);
                     if (!cand_env) { cs_value_release(sw); vm_set_err(vm, "out of memory", s->source_name, s->line, s->col); r.ok = 0; return r; }
-                    int matched = match_pattern(vm, cand_env, s->as.switch_stmt.case_patterns[i], sw, &ok);
+                    ast* pat = s->as.switch_stmt.case_patterns[i];
+                    int matched = !d ? match_pattern(vm, cand_env, pat, sw, &ok)
+                                : it.last_keyed ? 1 : dispatch_match_arm(vm, d, cand_env, pat, (int)i, sw, &ok);
                     if (!ok) {
                         env_decref(cand_env);
                         cs_value_release(sw);
@@ -5804,10 +8271,22 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
             f->param_count = s->as.fndef.param_count;
             f->rest_param = s->as.fndef.rest_param;
             f->body = s->as.fndef.body;
-            f->closure = env;
             f->is_async = s->as.fndef.is_async;
             f->is_generator = s->as.fndef.is_generator;
-            env_incref(env);
+            if (!s->as.fndef.captures) {
+                s->as.fndef.captures = captures_build(s->as.fndef.params, s->as.fndef.defaults, s->as.fndef.param_count,
+                                                      s->as.fndef.rest_param, s->as.fndef.body);
+            }
+            f->captures = s->as.fndef.captures;
+            if (!env->persistent) {
+                // bind the name first so a recursive body can capture it
+                if (env_find(env, s->as.fndef.name) < 0) env_set_here(env, s->as.fndef.name, cs_nil());
+            }
+            f->closure = closure_env_for(s->as.fndef.captures, env);
+            if (!f->closure) {
+                f->closure = env;
+                env_incref(env);
+            }
 
             cs_value fv; fv.type = CS_T_FUNC; fv.as.p = f;
             env_set_here(env, s->as.fndef.name, fv);
@@ -5816,13 +8295,13 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
         }
 
         case N_CLASS: {
-            cs_value cv = cs_map(vm);
+            cs_value cv = shaped_map_new(vm, 4 + s->as.class_stmt.method_count);
             if (!cv.as.p) { vm_set_err(vm, "out of memory", s->source_name, s->line, s->col); r.ok = 0; return r; }
             cs_map_obj* cm = as_map(cv);
 
             cs_value is_cls = cs_bool(1);
             {
-                cs_string* k_is_class = key_is_class();
+                cs_string* k_is_class = key_is_class(vm);
                 int set_ok = k_is_class ? map_set_strkey(cm, k_is_class, is_cls)
                                         : map_set_cstr(cm, "__is_class", is_cls);
                 if (!set_ok) {
@@ -5853,13 +8332,13 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
                     return r;
                 }
                 {
-                    cs_string* k_parent = key_parent();
+                    cs_string* k_parent = key_parent(vm);
                     if (k_parent) map_set_strkey(cm, k_parent, parent);
                     else map_set_cstr(cm, "__parent", parent);
                 }
                 cs_value_release(parent);
             } else {
-                cs_string* k_parent = key_parent();
+                cs_string* k_parent = key_parent(vm);
                 if (k_parent) map_set_strkey(cm, k_parent, cs_nil());
                 else map_set_cstr(cm, "__parent", cs_nil());
             }
@@ -5879,12 +8358,18 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
                 f->param_count = m->as.fndef.param_count;
                 f->rest_param = m->as.fndef.rest_param;
                 f->body = m->as.fndef.body;
+                if (!m->as.fndef.captures) {
+                    m->as.fndef.captures = captures_build(m->as.fndef.params, m->as.fndef.defaults, m->as.fndef.param_count,
+                                                          m->as.fndef.rest_param, m->as.fndef.body);
+                }
+                f->captures = m->as.fndef.captures;
                 f->closure = env;
                 f->is_async = m->as.fndef.is_async;
                 f->is_generator = m->as.fndef.is_generator;
                 env_incref(env);
                 cs_value fv; fv.type = CS_T_FUNC; fv.as.p = f;
                 map_set_cstr(cm, f->name ? f->name : "<method>", fv);
+                cs_value_release(fv);
             }
 
             env_set_here(env, s->as.class_stmt.name, cv);
@@ -5893,12 +8378,12 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
         }
 
         case N_STRUCT: {
-            cs_value sv = cs_map(vm);
+            cs_value sv = shaped_map_new(vm, 4);
             if (!sv.as.p) { vm_set_err(vm, "out of memory", s->source_name, s->line, s->col); r.ok = 0; return r; }
             cs_map_obj* sm = as_map(sv);
 
             {
-                cs_string* k_is_struct = key_is_struct();
+                cs_string* k_is_struct = key_is_struct(vm);
                 int set_ok = k_is_struct ? map_set_strkey(sm, k_is_struct, cs_bool(1))
                                          : map_set_cstr(sm, "__is_struct", cs_bool(1));
                 if (!set_ok) {
@@ -5928,8 +8413,11 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
             cs_list_obj* dl = as_list(defaults);
             for (size_t i = 0; i < s->as.struct_stmt.field_count; i++) {
                 const char* fname = s->as.struct_stmt.field_names[i];
-                cs_value fnv = cs_str(vm, fname ? fname : "");
-                if (!list_push(fl, fnv)) {
+                // Interned so instance construction follows shape transitions by pointer.
+                cs_string* ik = vm_intern_cstr(vm, fname ? fname : "");
+                cs_value fnv = cs_nil();
+                if (ik) { cs_str_incref(ik); fnv.type = CS_T_STR; fnv.as.p = ik; }
+                if (!ik || !list_push(fl, fnv)) {
                     cs_value_release(fnv);
                     cs_value_release(fields);
                     cs_value_release(defaults);
@@ -5966,8 +8454,8 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
             }
 
             {
-                cs_string* k_fields = key_fields();
-                cs_string* k_defaults = key_defaults();
+                cs_string* k_fields = key_fields(vm);
+                cs_string* k_defaults = key_defaults(vm);
                 if (k_fields) map_set_strkey(sm, k_fields, fields);
                 else map_set_cstr(sm, "__fields", fields);
                 if (k_defaults) map_set_strkey(sm, k_defaults, defaults);
@@ -6084,7 +8572,8 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
         }
 
         case N_YIELD: {
-            if (!vm->yield_active || !vm->yield_list) {
+            cs_gen_state* g = vm->gen_current;
+            if (!g) {
                 vm_set_err(vm, "yield used outside of generator", s->source_name, s->line, s->col);
                 r.ok = 0;
                 return r;
@@ -6099,14 +8588,14 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
                     return r;
                 }
             }
-            if (!list_push(vm->yield_list, v)) {
-                cs_value_release(v);
-                vm_set_err(vm, "out of memory", s->source_name, s->line, s->col);
-                r.ok = 0;
-                return r;
+            if (!g->closing) {
+                g->yielded = v;
+                v = cs_nil();
+                gen_switch_out(g);
             }
-            vm->yield_used = 1;
             cs_value_release(v);
+            // A dropped generator unwinds like a return so finally blocks still run.
+            if (g->closing) r.did_return = 1;
             return r;
         }
 
@@ -6239,8 +8728,35 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
                         }
                     }
                 }
+            } else if (it.type == CS_T_ITER) {
+                size_t iteration_count = 0;
+                for (;;) {
+                    cs_value v = cs_nil();
+                    int got = cs_iter_next(vm, it, &v);
+                    if (got < 0) {
+                        if (exec_take_vm_throw(vm, &r)) break;
+                        if (!vm->last_error) vm_set_err(vm, "iterator failed", s->source_name, s->line, s->col);
+                        r.ok = 0;
+                        break;
+                    }
+                    if (got == 0) break;
+                    env_set_here_take(loopenv, s->as.forin_stmt.name, v, 0);
+
+                    // If name2 is present, bind it to the iteration count
+                    if (s->as.forin_stmt.name2) {
+                        cs_value count_val = cs_int((int64_t)iteration_count);
+                        env_set_here(loopenv, s->as.forin_stmt.name2, count_val);
+                    }
+
+                    iteration_count++;
+
+                    r = exec_stmt(vm, loopenv, s->as.forin_stmt.body);
+                    if (!r.ok || r.did_return || r.did_throw) break;
+                    if (r.did_break) { r.did_break = 0; break; }
+                    if (r.did_continue) { r.did_continue = 0; continue; }
+                }
             } else {
-                vm_set_err(vm, "for-in expects list, map, set, or range", s->source_name, s->line, s->col);
+                vm_set_err(vm, "for-in expects list, map, set, range, or iterator", s->source_name, s->line, s->col);
                 r.ok = 0;
             }
 
@@ -6539,6 +9055,15 @@ static exec_result exec_stmt(cs_vm* vm, cs_env* env, ast* s) {
 
 void cs_vm_free(cs_vm* vm) {
     if (!vm) return;
+    vm->tearing_down = 1;
+    if (vm->slice) {
+        // A paused program is abandoned; values held on its stack are not released
+        slice_free(vm->slice);
+        vm->slice = NULL;
+    }
+    // Workers post into this VM's inbox: stop them before draining it
+    cs_worker_shutdown_all(vm);
+    cs_vm_run_deliveries(vm);
     while (vm->task_head) {
         cs_task* t = vm->task_head;
         vm->task_head = t->next;
@@ -6548,19 +9073,34 @@ void cs_vm_free(cs_vm* vm) {
         free(t);
     }
     vm->task_tail = NULL;
-    while (vm->timers) {
-        cs_timer* t = vm->timers;
-        vm->timers = t->next;
+    for (size_t i = 0; i < vm->timer_count; i++) {
+        cs_timer* t = vm->timers[i];
+        t->promise->timer = NULL;
         promise_decref(t->promise);
         free(t);
     }
-    while (vm->pending_io) {
-        cs_pending_io* io = vm->pending_io;
-        vm->pending_io = io->next;
-        cs_value_release(io->promise);
-        cs_value_release(io->context);
-        free(io);
+    free(vm->timers);
+    vm->timers = NULL;
+    vm->timer_count = 0;
+    cs_free_pending_io(vm);
+    cs_http_pool_free(vm);
+    cs_net_free_sockets(vm);
+
+    if (vm->watches) {
+        for (int i = 0; i < CS_MAX_WATCHES; i++) {
+            cs_file_watch* w = vm->watches[i];
+            if (!w) continue;
+            free(w->path);
+            cs_value_release(w->callback);
+            free(w);
+        }
+        free(vm->watches);
+        vm->watches = NULL;
     }
+#if defined(__linux__)
+    if (vm->inotify_fd >= 0) close(vm->inotify_fd);
+    vm->inotify_fd = -1;
+#endif
 
 #if defined(__linux__)
     // Ensure background loop is stopped before we destroy VM resources
@@ -6568,7 +9108,17 @@ void cs_vm_free(cs_vm* vm) {
     pthread_cond_destroy(&vm->loop_cond);
     pthread_mutex_destroy(&vm->loop_mutex);
 #endif
+#if !defined(_WIN32)
+    pthread_cond_destroy(&vm->inbox_cond);
+    pthread_mutex_destroy(&vm->inbox_lock);
+#endif
 
+    // Functions defined at global or module scope hold the env they were defined in,
+    // which holds them back; clear those scopes so the cycles come apart.
+    for (size_t i = 0; i < vm->module_count; i++) {
+        if (vm->modules[i].env) env_clear(vm->modules[i].env);
+    }
+    env_clear(vm->globals);
     env_decref(vm->globals);
     free(vm->last_error);
     cs_value_release(vm->pending_thrown);
@@ -6577,6 +9127,7 @@ void cs_vm_free(cs_vm* vm) {
         ast_free(vm->asts[i]);
     }
     free(vm->asts);
+    cs_code_cache_free(vm->code_cache);
     for (size_t i = 0; i < vm->source_count; i++) free(vm->sources[i]);
     free(vm->sources);
     for (size_t i = 0; i < vm->dir_count; i++) free(vm->dir_stack[i]);
@@ -6584,16 +9135,25 @@ void cs_vm_free(cs_vm* vm) {
     for (size_t i = 0; i < vm->module_count; i++) {
         free(vm->modules[i].path);
         cs_value_release(vm->modules[i].exports);
+        env_decref(vm->modules[i].env);
     }
     free(vm->modules);
     while (vm->tracked) {
         cs_track_node* n = vm->tracked;
         vm->tracked = n->next;
+        // values the host still holds must not reach back into this VM
+        if (n->type == CS_TRACK_LIST) ((cs_list_obj*)n->ptr)->track = NULL;
+        else if (n->type == CS_TRACK_MAP) ((cs_map_obj*)n->ptr)->track = NULL;
         free(n);
     }
     if (vm->interp_cache) {
         strbuf_decref(vm->interp_cache);
     }
+#if !defined(_WIN32)
+    for (int i = 0; i < vm->gen_stack_count; i++) coro_stack_free(vm->gen_stacks[i], CS_GEN_STACK_SIZE);
+#endif
+    shape_free_tree(vm->shape_root);
+    vm_intern_free(vm);
     free(vm);
 }
 
@@ -6669,14 +9229,8 @@ static void vm_keep_ast(cs_vm* vm, ast* prog) {
     vm->asts[vm->ast_count++] = prog;
 }
 
-int cs_vm_run_string(cs_vm* vm, const char* code, const char* virtual_name) {
-    if (!vm || !code) return -1;
-
-    // Clear stale errors before running new code
-    free(vm->last_error);
-    vm->last_error = NULL;
-    vm_clear_pending_throw(vm);
-
+// Parses a whole program; on a parse error the message is left on the VM.
+static int vm_parse_source(cs_vm* vm, const char* code, const char* virtual_name, ast** out) {
     parser P;
     const char* srcname = vm_intern_source(vm, virtual_name ? virtual_name : "<input>");
     parser_init(&P, code, srcname);
@@ -6689,6 +9243,20 @@ int cs_vm_run_string(cs_vm* vm, const char* code, const char* virtual_name) {
         ast_free(prog);  // Free AST on parse error
         return -1;
     }
+    *out = prog;
+    return 0;
+}
+
+int cs_vm_run_string(cs_vm* vm, const char* code, const char* virtual_name) {
+    if (!vm || !code) return -1;
+
+    // Clear stale errors before running new code
+    free(vm->last_error);
+    vm->last_error = NULL;
+    vm_clear_pending_throw(vm);
+
+    ast* prog = NULL;
+    if (vm_parse_source(vm, code, virtual_name, &prog) != 0) return -1;
     int rc = run_ast_in_env(vm, prog, vm->globals);
 
     // Keep AST alive for closures/functions (freed in cs_vm_free).
@@ -6715,23 +9283,278 @@ static char* read_file_all(const char* path) {
     return buf;
 }
 
-int cs_vm_run_file(cs_vm* vm, const char* path) {
-    if (!vm || !path) return -1;
-    // Clear stale errors before loading/exec a file
-    free(vm->last_error);
-    vm->last_error = NULL;
-    vm_clear_pending_throw(vm);
+// ========== Shared Code Cache ==========
+// The cache keeps one parsed template per file. Templates are never run: the VM
+// caches that live on AST nodes would otherwise be shared between VMs, so every load
+// runs a private clone. Templates are reference counted so a VM can clone one outside
+// the cache lock while another thread replaces the entry with a newer parse.
+
+typedef struct cs_code_tmpl {
+    int refs;                       // guarded by the cache lock
+    char* name;                     // source_name of the template's nodes
+    ast* prog;
+} cs_code_tmpl;
+
+typedef struct cs_code_stamp {
+    int64_t mtime_s;
+    long mtime_ns;
+    int64_t size;
+} cs_code_stamp;
+
+typedef struct cs_code_entry {
+    struct cs_code_entry* next;
+    char* path;
+    cs_code_stamp stamp;
+    cs_code_tmpl* tmpl;
+} cs_code_entry;
+
+struct cs_code_cache {
+#if defined(_WIN32)
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    int refs;
+    cs_code_entry* entries;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static void code_cache_lock(cs_code_cache* c) {
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(&c->lock);
+#else
+    pthread_mutex_lock(&c->lock);
+#endif
+}
+
+static void code_cache_unlock(cs_code_cache* c) {
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(&c->lock);
+#else
+    pthread_mutex_unlock(&c->lock);
+#endif
+}
+
+static void code_tmpl_free(cs_code_tmpl* t) {
+    if (!t) return;
+    ast_free(t->prog);
+    free(t->name);
+    free(t);
+}
+
+// Drops a reference with the lock held; returns the template if the caller must free it.
+static cs_code_tmpl* code_tmpl_decref_locked(cs_code_tmpl* t) {
+    if (!t) return NULL;
+    return --t->refs == 0 ? t : NULL;
+}
+
+static int code_stamp_get(const char* path, cs_code_stamp* st) {
+    struct stat sb;
+    if (stat(path, &sb) != 0) return -1;
+    st->mtime_s = (int64_t)sb.st_mtime;
+#if defined(__linux__)
+    st->mtime_ns = (long)sb.st_mtim.tv_nsec;
+#else
+    st->mtime_ns = 0;
+#endif
+    st->size = (int64_t)sb.st_size;
+    return 0;
+}
+
+static int code_stamp_eq(const cs_code_stamp* a, const cs_code_stamp* b) {
+    return a->mtime_s == b->mtime_s && a->mtime_ns == b->mtime_ns && a->size == b->size;
+}
+
+cs_code_cache* cs_code_cache_new(void) {
+    cs_code_cache* c = (cs_code_cache*)calloc(1, sizeof(cs_code_cache));
+    if (!c) return NULL;
+#if defined(_WIN32)
+    InitializeSRWLock(&c->lock);
+#else
+    if (pthread_mutex_init(&c->lock, NULL) != 0) { free(c); return NULL; }
+#endif
+    c->refs = 1;
+    return c;
+}
+
+void cs_code_cache_free(cs_code_cache* c) {
+    if (!c) return;
+    code_cache_lock(c);
+    int last = --c->refs == 0;
+    code_cache_unlock(c);
+    if (!last) return;
+    while (c->entries) {
+        cs_code_entry* e = c->entries;
+        c->entries = e->next;
+        code_tmpl_free(code_tmpl_decref_locked(e->tmpl));
+        free(e->path);
+        free(e);
+    }
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&c->lock);
+#endif
+    free(c);
+}
+
+void cs_code_cache_stats(cs_code_cache* c, uint64_t* hits, uint64_t* misses) {
+    if (hits) *hits = 0;
+    if (misses) *misses = 0;
+    if (!c) return;
+    code_cache_lock(c);
+    if (hits) *hits = c->hits;
+    if (misses) *misses = c->misses;
+    code_cache_unlock(c);
+}
+
+void cs_vm_set_code_cache(cs_vm* vm, cs_code_cache* cache) {
+    if (!vm || vm->code_cache == cache) return;
+    if (cache) {
+        code_cache_lock(cache);
+        cache->refs++;
+        code_cache_unlock(cache);
+    }
+    cs_code_cache_free(vm->code_cache);
+    vm->code_cache = cache;
+}
+
+static cs_code_entry* code_cache_find_locked(cs_code_cache* c, const char* path) {
+    for (cs_code_entry* e = c->entries; e; e = e->next) {
+        if (strcmp(e->path, path) == 0) return e;
+    }
+    return NULL;
+}
+
+// Parses a file into a new template and publishes it under stamp (when have_stamp).
+// Returns the template with one reference held for the caller.
+static cs_code_tmpl* code_cache_fill(cs_vm* vm, cs_code_cache* c, const char* path,
+                                     const cs_code_stamp* stamp, int have_stamp) {
     char* code = read_file_all(path);
     if (!code) {
         free(vm->last_error);
         vm->last_error = cs_strdup2("could not read file");
+        return NULL;
+    }
+    cs_code_tmpl* t = (cs_code_tmpl*)calloc(1, sizeof(cs_code_tmpl));
+    char* name = cs_strdup2(path);
+    if (!t || !name) {
+        free(t);
+        free(name);
+        free(code);
+        free(vm->last_error);
+        vm->last_error = cs_strdup2("out of memory");
+        return NULL;
+    }
+
+    parser P;
+    parser_init(&P, code, name);
+    ast* prog = parse_program(&P);
+    free(code);
+    if (P.error) {
+        free(vm->last_error);
+        vm->last_error = cs_strdup2(P.error);
+        parse_free_error(&P);
+        ast_free(prog);
+        free(name);
+        free(t);
+        return NULL;
+    }
+    t->refs = 1;
+    t->name = name;
+    t->prog = prog;
+    if (!have_stamp) return t;
+
+    cs_code_entry* fresh = NULL;
+    cs_code_tmpl* stale = NULL;
+    code_cache_lock(c);
+    cs_code_entry* e = code_cache_find_locked(c, path);
+    if (e) {
+        stale = code_tmpl_decref_locked(e->tmpl);
+        e->tmpl = t;
+        e->stamp = *stamp;
+        t->refs++;
+    } else {
+        fresh = (cs_code_entry*)calloc(1, sizeof(cs_code_entry));
+        if (fresh) fresh->path = cs_strdup2(path);
+        if (fresh && fresh->path) {
+            fresh->stamp = *stamp;
+            fresh->tmpl = t;
+            fresh->next = c->entries;
+            c->entries = fresh;
+            t->refs++;
+            fresh = NULL;
+        }
+    }
+    code_cache_unlock(c);
+    // An entry that could not be allocated only means the next load parses again
+    if (fresh) free(fresh);
+    code_tmpl_free(stale);
+    return t;
+}
+
+// Reads and parses a whole file, through the VM's code cache when it has one. On
+// error the message is left on the VM.
+static int vm_parse_file(cs_vm* vm, const char* path, ast** out) {
+    cs_code_cache* c = vm->code_cache;
+    if (!c) {
+        char* code = read_file_all(path);
+        if (!code) {
+            free(vm->last_error);
+            vm->last_error = cs_strdup2("could not read file");
+            return -1;
+        }
+        int rc = vm_parse_source(vm, code, path, out);
+        free(code);
+        return rc;
+    }
+
+    cs_code_stamp stamp;
+    int have_stamp = code_stamp_get(path, &stamp) == 0;
+    cs_code_tmpl* t = NULL;
+    if (have_stamp) {
+        code_cache_lock(c);
+        cs_code_entry* e = code_cache_find_locked(c, path);
+        if (e && code_stamp_eq(&e->stamp, &stamp)) {
+            t = e->tmpl;
+            t->refs++;
+            c->hits++;
+        } else {
+            c->misses++;
+        }
+        code_cache_unlock(c);
+    }
+    if (!t) t = code_cache_fill(vm, c, path, &stamp, have_stamp);
+    if (!t) return -1;
+
+    ast* prog = ast_clone(t->prog, vm_intern_source(vm, path));
+    code_cache_lock(c);
+    cs_code_tmpl* dead = code_tmpl_decref_locked(t);
+    code_cache_unlock(c);
+    code_tmpl_free(dead);
+    if (!prog) {
+        free(vm->last_error);
+        vm->last_error = cs_strdup2("out of memory");
         return -1;
     }
+    *out = prog;
+    return 0;
+}
+
+int cs_vm_run_file(cs_vm* vm, const char* path) {
+    if (!vm || !path) return -1;
+    // Clear stale errors before loading/exec a file
+    free(vm->last_error);
+    vm->last_error = NULL;
+    vm_clear_pending_throw(vm);
+
+    ast* prog = NULL;
+    if (vm_parse_file(vm, path, &prog) != 0) return -1;
     char* dir = path_dirname_alloc(path);
     vm_dir_push_owned(vm, dir);
-    int rc = cs_vm_run_string(vm, code, path);
+    int rc = run_ast_in_env(vm, prog, vm->globals);
+    // Keep AST alive for closures/functions (freed in cs_vm_free).
+    vm_keep_ast(vm, prog);
     vm_dir_pop(vm);
-    free(code);
     
     // Trigger auto-GC after file execution
     vm_maybe_auto_gc(vm);
@@ -6739,6 +9562,254 @@ int cs_vm_run_file(cs_vm* vm, const char* path) {
     return rc;
 }
 
+// ========== Time Slices ==========
+
+static void slice_body(cs_slice* s);
+
+#if defined(_WIN32)
+static VOID CALLBACK slice_fiber_entry(LPVOID p) {
+    cs_slice* s = (cs_slice*)p;
+    ULONG_PTR lo = 0, hi = 0;
+    GetCurrentThreadStackLimits(&lo, &hi);
+    s->stack_floor = (uintptr_t)lo + CS_STACK_RESERVE;
+    s->stack_top = (uintptr_t)hi;
+    slice_body(s);
+}
+
+static int slice_switch_in(cs_slice* s) {
+    if (!s->fiber) {
+        s->fiber = CreateFiberEx(0, CS_SLICE_STACK_SIZE, 0, slice_fiber_entry, s);
+        if (!s->fiber) return 0;
+    }
+    if (!IsThreadAFiber() && !ConvertThreadToFiber(NULL)) return 0;
+    s->caller = GetCurrentFiber();
+    // A slice can pause inside a generator body, which runs on that generator's fiber.
+    SwitchToFiber(s->paused ? s->paused : s->fiber);
+    return 1;
+}
+
+static void slice_switch_out(cs_slice* s) {
+    s->paused = GetCurrentFiber();
+    SwitchToFiber(s->caller);
+}
+
+static void slice_free_stack(cs_slice* s) {
+    if (s->fiber) DeleteFiber(s->fiber);
+    s->fiber = NULL;
+}
+#else
+static void slice_free_stack(cs_slice* s);
+
+static void slice_context_entry(unsigned int hi, unsigned int lo) {
+    uint64_t p = ((uint64_t)hi << 32) | (uint64_t)lo;
+    slice_body((cs_slice*)(uintptr_t)p);
+}
+
+static int slice_switch_in(cs_slice* s) {
+    if (!s->stack) {
+        s->stack = coro_stack_alloc(CS_SLICE_STACK_SIZE);
+        if (!s->stack) return 0;
+        if (getcontext(&s->ctx) != 0) { slice_free_stack(s); return 0; }
+        s->stack_floor = (uintptr_t)s->stack + CS_STACK_RESERVE;
+        s->stack_top = (uintptr_t)s->stack + CS_SLICE_STACK_SIZE;
+        s->ctx.uc_stack.ss_sp = s->stack;
+        s->ctx.uc_stack.ss_size = CS_SLICE_STACK_SIZE;
+        s->ctx.uc_link = NULL;
+        uint64_t p = (uint64_t)(uintptr_t)s;
+        makecontext(&s->ctx, (void (*)(void))slice_context_entry, 2, (unsigned int)(p >> 32), (unsigned int)p);
+    }
+    return swapcontext(&s->caller, &s->ctx) == 0;
+}
+
+static void slice_switch_out(cs_slice* s) {
+    // Saves whichever stack is current, so pausing inside a generator body resumes there.
+    swapcontext(&s->ctx, &s->caller);
+}
+
+static void slice_free_stack(cs_slice* s) {
+    coro_stack_free(s->stack, CS_SLICE_STACK_SIZE);
+    s->stack = NULL;
+}
+#endif
+
+static void slice_body(cs_slice* s) {
+    cs_vm* vm = s->vm;
+    // The stack did not exist yet when cs_vm_run_slice installed its bounds
+    vm->stack_floor = s->stack_floor;
+    vm->stack_top = s->stack_top;
+    if (s->dir) vm_dir_push_owned(vm, cs_strdup2(s->dir));
+    s->rc = run_ast_in_env(vm, s->prog, vm->globals);
+    if (s->dir) vm_dir_pop(vm);
+    s->finished = 1;
+    slice_switch_out(s);
+}
+
+static void slice_free(cs_slice* s) {
+    if (!s) return;
+    slice_free_stack(s);
+    for (size_t i = 0; i < s->dir_count; i++) free(s->dirs[i]);
+    free(s->dirs);
+    free(s->frames);
+    free(s->dir);
+    free(s->last_error);
+    cs_value_release(s->pending_thrown);
+    free(s);
+}
+
+static int slice_stash_dirs(cs_slice* s) {
+    cs_vm* vm = s->vm;
+    size_t n = vm->dir_count > s->dir_base ? vm->dir_count - s->dir_base : 0;
+    if (n > s->dir_cap) {
+        char** nd = (char**)realloc(s->dirs, n * sizeof(char*));
+        if (!nd) return 0;
+        s->dirs = nd;
+        s->dir_cap = n;
+    }
+    if (n) memcpy(s->dirs, vm->dir_stack + s->dir_base, n * sizeof(char*));
+    s->dir_count = n;
+    vm->dir_count = s->dir_base;
+    return 1;
+}
+
+static void slice_restore_dirs(cs_slice* s) {
+    for (size_t i = 0; i < s->dir_count; i++) vm_dir_push_owned(s->vm, s->dirs[i]);
+    s->dir_count = 0;
+}
+
+// Parks the running program and switches back to cs_vm_run_slice. Returns on the
+// program's stack once the host resumes it. Frames, module directories, counters and
+// any in-flight throw are set aside so host calls made between slices start clean.
+static void vm_slice_pause(cs_vm* vm) {
+    cs_slice* s = vm->slice;
+    if (!slice_stash_dirs(s)) return;  // out of memory: keep running
+    if (!vm_frames_stash(vm, s->frame_base, &s->frames, &s->frame_count, &s->frame_cap)) {
+        slice_restore_dirs(s);
+        return;
+    }
+    s->instruction_count = vm->instruction_count;
+    s->exec_start_ms = vm->exec_start_ms;
+    s->gen_current = vm->gen_current;
+    vm->gen_current = s->host_gen;
+    s->last_error = vm->last_error;
+    vm->last_error = NULL;
+    s->pending_throw = vm->pending_throw;
+    s->pending_thrown = vm->pending_thrown;
+    vm->pending_throw = 0;
+    vm->pending_thrown = cs_nil();
+    s->paused_at_ms = get_time_ms();
+    // Pausing inside a generator body must come back to that generator's stack bounds
+    cs_stack_bounds running_stack;
+    vm_stack_enter(vm, vm->stack_floor, vm->stack_top, &running_stack);
+
+    slice_switch_out(s);
+
+    vm_stack_leave(vm, &running_stack);
+
+    for (size_t i = 0; i < s->frame_count; i++) {
+        cs_frame* f = &s->frames[i];
+        vm_frames_push(vm, f->func, f->source, f->line, f->col);
+    }
+    s->frame_count = 0;
+    slice_restore_dirs(s);
+    vm->instruction_count = s->instruction_count;
+    // Time spent paused does not count against the execution timeout
+    vm->exec_start_ms = s->exec_start_ms + (get_time_ms() - s->paused_at_ms);
+    vm->gen_current = s->gen_current;
+    free(vm->last_error);
+    vm->last_error = s->last_error;
+    s->last_error = NULL;
+    vm_clear_pending_throw(vm);
+    cs_value_release(vm->pending_thrown);
+    vm->pending_throw = s->pending_throw;
+    vm->pending_thrown = s->pending_thrown;
+    s->pending_throw = 0;
+    s->pending_thrown = cs_nil();
+}
+
+static int slice_load(cs_vm* vm, ast* prog, char* dir) {
+    cs_slice* s = (cs_slice*)calloc(1, sizeof(cs_slice));
+    if (!s) {
+        free(dir);
+        cs_error(vm, "out of memory");
+        return -1;
+    }
+    s->vm = vm;
+    s->prog = prog;
+    s->dir = dir;
+    s->pending_thrown = cs_nil();
+    vm->slice = s;
+    return 0;
+}
+
+int cs_vm_load_string(cs_vm* vm, const char* code, const char* virtual_name) {
+    if (!vm || !code) return -1;
+    if (vm->slice) { cs_error(vm, "a program is already loaded"); return -1; }
+    free(vm->last_error);
+    vm->last_error = NULL;
+
+    ast* prog = NULL;
+    if (vm_parse_source(vm, code, virtual_name, &prog) != 0) return -1;
+    vm_keep_ast(vm, prog);
+    return slice_load(vm, prog, NULL);
+}
+
+int cs_vm_load_file(cs_vm* vm, const char* path) {
+    if (!vm || !path) return -1;
+    if (vm->slice) { cs_error(vm, "a program is already loaded"); return -1; }
+    free(vm->last_error);
+    vm->last_error = NULL;
+
+    ast* prog = NULL;
+    if (vm_parse_file(vm, path, &prog) != 0) return -1;
+    vm_keep_ast(vm, prog);
+    return slice_load(vm, prog, path_dirname_alloc(path));
+}
+
+int cs_vm_run_slice(cs_vm* vm, uint64_t budget_us) {
+    if (!vm) return -1;
+    cs_slice* s = vm->slice;
+    if (!s) return 0;
+    if (s->running) { cs_error(vm, "time slice is already running"); return -1; }
+    if (!s->started) {
+        free(vm->last_error);
+        vm->last_error = NULL;
+        vm_clear_pending_throw(vm);
+    }
+
+    s->budget_us = budget_us;
+    s->deadline_us = budget_us ? get_time_us() + budget_us : 0;
+    s->frame_base = vm->frame_count;
+    s->dir_base = vm->dir_count;
+    s->host_gen = vm->gen_current;
+    vm->gen_current = NULL;
+    s->running = 1;
+    cs_stack_bounds host_stack;
+    vm_stack_enter(vm, s->stack_floor, s->stack_top, &host_stack);
+    int switched = slice_switch_in(s);
+    vm_stack_leave(vm, &host_stack);
+    s->running = 0;
+    if (!switched) {
+        vm->gen_current = s->host_gen;
+        cs_error(vm, "out of memory");
+        return -1;
+    }
+    s->started = 1;
+    if (!s->finished) return CS_YIELDED;
+
+    vm->gen_current = s->host_gen;
+    int rc = s->rc;
+    vm->slice = NULL;
+    slice_free(s);
+    vm_maybe_auto_gc(vm);
+    return rc;
+}
+
+int cs_vm_resume(cs_vm* vm) {
+    if (!vm) return -1;
+    if (!vm->slice) return 0;
+    return cs_vm_run_slice(vm, vm->slice->budget_us);
+}
+
 static size_t gc_find_index(void** keys, unsigned char* types, size_t* vals, size_t cap, cs_track_type t, void* p) {
     if (!p || !keys || !types || !vals || cap == 0) return (size_t)-1;
     uintptr_t h = ((uintptr_t)p >> 3) ^ (uintptr_t)t;
@@ -6899,10 +9970,11 @@ size_t cs_vm_collect_cycles(cs_vm* vm) {
                 l->items[j] = cs_nil();
             }
             free(l->items);
-            vm_track_remove(vm, CS_TRACK_LIST, l);
+            vm_track_remove(vm, l->track);
             free(l);
         } else if (items[i].type == CS_TRACK_MAP) {
             cs_map_obj* m = (cs_map_obj*)items[i].ptr;
+            if (m) map_ic_touch(m);
             for (size_t j = 0; m && j < m->cap; j++) {
                 if (!m->entries[j].in_use) continue;
                 cs_value_release(m->entries[j].key);
@@ -6920,8 +9992,8 @@ size_t cs_vm_collect_cycles(cs_vm* vm) {
                 m->entries[j].val = cs_nil();
                 m->entries[j].in_use = 0;
             }
-            free(m->entries);
-            vm_track_remove(vm, CS_TRACK_MAP, m);
+            map_entries_free(m);
+            vm_track_remove(vm, m->track);
             free(m);
         }
     }
@@ -6942,7 +10014,7 @@ static int module_find(cs_vm* vm, const char* path) {
     return -1;
 }
 
-static int module_add(cs_vm* vm, const char* path, cs_value exports) {
+static int module_add(cs_vm* vm, const char* path, cs_value exports, cs_env* env) {
     if (!vm || !path) return 0;
     if (vm->module_count == vm->module_cap) {
         size_t nc = vm->module_cap ? vm->module_cap * 2 : 16;
@@ -6952,23 +10024,15 @@ static int module_add(cs_vm* vm, const char* path, cs_value exports) {
         vm->module_cap = nc;
 
         if (vm->pending_io_count > 0) {
-            int timeout = 100;
-            if (vm->timers) {
-                uint64_t now = get_time_ms();
-                uint64_t due = vm->timers->due_ms;
-                if (due <= now) timeout = 0;
-                else {
-                    uint64_t delta = due - now;
-                    if (delta < (uint64_t)timeout) timeout = (int)delta;
-                }
-            }
-            cs_poll_pending_io(vm, timeout);
+            cs_poll_pending_io(vm, scheduler_timer_wait_ms(vm, 100));
             return 1;
         }
     }
     vm->modules[vm->module_count].path = cs_strdup2(path);
     if (!vm->modules[vm->module_count].path) return 0;
     vm->modules[vm->module_count].exports = cs_value_copy(exports);
+    vm->modules[vm->module_count].env = env;
+    env_incref(env);
     vm->module_count++;
     return 1;
 }
@@ -6993,31 +10057,16 @@ int cs_vm_require_module(cs_vm* vm, const char* path, cs_value* exports_out) {
         return 0;
     }
 
-    char* code = read_file_all(norm_path);
-    if (!code) { 
+    ast* prog = NULL;
+    if (vm_parse_file(vm, norm_path, &prog) != 0) {
+        vm_append_stacktrace(vm, &vm->last_error);
         free(norm_path);
-        cs_error(vm, "could not read file"); 
-        return -1; 
+        return -1;
     }
 
     char* dir = path_dirname_alloc(norm_path);
     vm_dir_push_owned(vm, dir);
 
-    const char* srcname = vm_intern_source(vm, norm_path);
-    parser P;
-    parser_init(&P, code, srcname);
-    ast* prog = parse_program(&P);
-    free(code);
-
-    if (P.error) {
-        cs_error(vm, P.error);
-        parse_free_error(&P);
-        ast_free(prog);  // Free AST on parse error
-        vm_dir_pop(vm);
-        free(norm_path);
-        return -1;
-    }
-
     cs_env* menv = env_new(vm->globals);
     if (!menv) {
         ast_free(prog);
@@ -7026,6 +10075,7 @@ int cs_vm_require_module(cs_vm* vm, const char* path, cs_value* exports_out) {
         cs_error(vm, "out of memory");
         return -1;
     }
+    menv->persistent = 1;
 
     cs_value exports = cs_map(vm);
     if (!exports.as.p) {
@@ -7068,7 +10118,7 @@ int cs_vm_require_module(cs_vm* vm, const char* path, cs_value* exports_out) {
     cs_value exv = cs_nil();
     (void)env_get(menv, "exports", &exv);
 
-    if (!module_add(vm, norm_path, exv)) {
+    if (!module_add(vm, norm_path, exv, menv)) {
         cs_value_release(exv);
         env_decref(menv);
         vm_dir_pop(vm);
@@ -7085,36 +10135,39 @@ int cs_vm_require_module(cs_vm* vm, const char* path, cs_value* exports_out) {
     return 0;
 }
 
-int cs_call(cs_vm* vm, const char* func_name, int argc, const cs_value* argv, cs_value* out) {
-    if (out) *out = cs_nil();
-    if (!vm || !func_name) return -1;
-
-    cs_value f;
-    if (!env_get(vm->globals, func_name, &f)) return -1;
-
+// Run a native or script function for the host. When spare is non-NULL it holds a
+// cleared call env for fn that may be reused, and receives this call's env back if
+// nothing (generator, async task) kept a reference to it.
+static int host_invoke(cs_vm* vm, cs_value f, const char* host_src, int argc, const cs_value* argv,
+                       cs_value* result, cs_env** spare) {
     int ok = 1;
-    cs_value result = cs_nil();
-
-    const char* host_src = vm_intern_source(vm, "(host)");
-    size_t base_depth = vm->frame_count;
-    vm_frames_push(vm, func_name, host_src, 0, 0);
-    vm_clear_pending_throw(vm);
+    *result = cs_nil();
 
     if (f.type == CS_T_NATIVE) {
         cs_native* nf = as_native(f);
-        if (nf->fn(vm, nf->userdata, argc, argv, &result) != 0) {
+        if (nf->fn(vm, nf->userdata, argc, argv, result) != 0) {
             if (!vm->last_error) cs_error(vm, "native call failed");
             ok = 0;
         }
     } else if (f.type == CS_T_FUNC) {
         struct cs_func* fn = as_func(f);
         if (fn->is_async) {
-            result = schedule_async_call(vm, fn, argc, (cs_value*)argv, NULL, NULL, &ok);
+            *result = schedule_async_call(vm, fn, argc, (cs_value*)argv, NULL, NULL, &ok);
         } else {
-            cs_env* callenv = env_new(fn->closure);
+            cs_env* callenv = NULL;
+            if (spare && *spare) {
+                callenv = *spare;
+                *spare = NULL;
+            } else {
+                callenv = call_env_new(fn);
+            }
             if (!callenv) ok = 0;
             else if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, &ok)) {
                 env_decref(callenv);
+            } else if (fn->is_generator) {
+                *result = gen_new(vm, fn, callenv, fn->name, host_src, 0, 0);
+                if (result->type != CS_T_ITER) { cs_error(vm, "out of memory"); ok = 0; }
+                env_decref(callenv);
             } else {
                 exec_result r = exec_block(vm, callenv, fn->body);
                 if (r.did_throw) {
@@ -7129,16 +10182,39 @@ int cs_call(cs_vm* vm, const char* func_name, int argc, const cs_value* argv, cs
                 } else if (!r.ok) {
                     ok = 0;
                 } else if (r.did_return) {
-                    result = cs_value_copy(r.ret);
+                    *result = cs_value_copy(r.ret);
                 }
                 cs_value_release(r.ret);
                 cs_value_release(r.thrown);
-                env_decref(callenv);
+                if (spare && !*spare && callenv->ref == 1) {
+                    env_clear(callenv);
+                    *spare = callenv;
+                } else {
+                    env_decref(callenv);
+                }
             }
         }
     } else {
         ok = 0;
     }
+    return ok;
+}
+
+int cs_call(cs_vm* vm, const char* func_name, int argc, const cs_value* argv, cs_value* out) {
+    if (out) *out = cs_nil();
+    if (!vm || !func_name) return -1;
+
+    cs_value f;
+    if (!env_get(vm->globals, func_name, &f)) return -1;
+
+    cs_value result = cs_nil();
+
+    const char* host_src = vm_intern_source(vm, "(host)");
+    size_t base_depth = vm->frame_count;
+    vm_frames_push(vm, func_name, host_src, 0, 0);
+    vm_clear_pending_throw(vm);
+
+    int ok = host_invoke(vm, f, host_src, argc, argv, &result, NULL);
 
     if (vm->frame_count > base_depth) vm->frame_count = base_depth;
 
@@ -7162,48 +10238,55 @@ int cs_call_value(cs_vm* vm, cs_value callee, int argc, const cs_value* argv, cs
     size_t base_depth = vm->frame_count;
     vm_frames_push(vm, "(callback)", host_src, 0, 0);
 
-    int ok = 1;
     cs_value result = cs_nil();
+    int ok = host_invoke(vm, callee, host_src, argc, argv, &result, NULL);
 
-    if (callee.type == CS_T_NATIVE) {
-        cs_native* nf = as_native(callee);
-        if (nf->fn(vm, nf->userdata, argc, argv, &result) != 0) {
-            if (!vm->last_error) cs_error(vm, "native call failed");
-            ok = 0;
-        }
-    } else if (callee.type == CS_T_FUNC) {
-        struct cs_func* fn = as_func(callee);
-        if (fn->is_async) {
-            result = schedule_async_call(vm, fn, argc, (cs_value*)argv, NULL, NULL, &ok);
-        } else {
-            cs_env* callenv = env_new(fn->closure);
-            if (!callenv) ok = 0;
-            else if (!bind_params_with_defaults(vm, callenv, fn, argc, argv, &ok)) {
-                env_decref(callenv);
-            } else {
-                exec_result r = exec_block(vm, callenv, fn->body);
-                if (r.did_throw) {
-                    vm_report_uncaught_throw(vm, r.thrown);
-                    ok = 0;
-                } else if (r.did_break) {
-                    cs_error(vm, "break used outside of a loop");
-                    ok = 0;
-                } else if (r.did_continue) {
-                    cs_error(vm, "continue used outside of a loop");
-                    ok = 0;
-                } else if (!r.ok) {
-                    ok = 0;
-                } else if (r.did_return) {
-                    result = cs_value_copy(r.ret);
-                }
-                cs_value_release(r.ret);
-                cs_value_release(r.thrown);
-                env_decref(callenv);
-            }
-        }
-    } else {
-        ok = 0;
+    if (vm->frame_count > base_depth) vm->frame_count = base_depth;
+
+    if (!ok) { cs_value_release(result); return -1; }
+    if (out) *out = result;
+    else cs_value_release(result);
+    return 0;
+}
+
+// ========== Prepared Calls ==========
+
+struct cs_callable {
+    cs_vm* vm;
+    cs_value fn;            // pinned: later reassignment of the global is not seen
+    char* name;
+    const char* host_src;
+    cs_env* spare;          // cleared call env reused by the next invocation
+};
+
+cs_callable* cs_prepare_call(cs_vm* vm, const char* func_name) {
+    if (!vm || !func_name) return NULL;
+    cs_value f;
+    if (!env_get(vm->globals, func_name, &f)) return NULL;
+    if (f.type != CS_T_FUNC && f.type != CS_T_NATIVE) {
+        cs_value_release(f);
+        return NULL;
     }
+    cs_callable* h = (cs_callable*)calloc(1, sizeof(cs_callable));
+    if (!h) { cs_value_release(f); return NULL; }
+    h->vm = vm;
+    h->fn = f;
+    h->name = cs_strdup2(func_name);
+    h->host_src = vm_intern_source(vm, "(host)");
+    if (!h->name) { cs_callable_free(h); return NULL; }
+    return h;
+}
+
+int cs_callable_invoke(cs_vm* vm, cs_callable* h, int argc, const cs_value* argv, cs_value* out) {
+    if (out) *out = cs_nil();
+    if (!vm || !h || h->vm != vm) return -1;
+
+    cs_value result = cs_nil();
+    size_t base_depth = vm->frame_count;
+    vm_frames_push(vm, h->name, h->host_src, 0, 0);
+    vm_clear_pending_throw(vm);
+
+    int ok = host_invoke(vm, h->fn, h->host_src, argc, argv, &result, &h->spare);
 
     if (vm->frame_count > base_depth) vm->frame_count = base_depth;
 
@@ -7213,6 +10296,14 @@ int cs_call_value(cs_vm* vm, cs_value callee, int argc, const cs_value* argv, cs
     return 0;
 }
 
+void cs_callable_free(cs_callable* h) {
+    if (!h) return;
+    env_decref(h->spare);
+    cs_value_release(h->fn);
+    free(h->name);
+    free(h);
+}
+
 // ========== Safety Control API ==========
 
 void cs_vm_set_instruction_limit(cs_vm* vm, uint64_t limit) {
@@ -7443,3 +10534,66 @@ cs_value cs_map_keys(cs_vm* vm, cs_value map_val) {
     
     return list_val;
 }
+
+// ========== Bulk Marshalling ==========
+
+static cs_value list_with_len(cs_vm* vm, size_t count) {
+    cs_value lv = cs_list(vm);
+    cs_list_obj* l = as_list(lv);
+    if (!l) return cs_nil();
+    if (!list_ensure(l, count)) { cs_value_release(lv); return cs_nil(); }
+    return lv;
+}
+
+cs_value cs_list_from_int64s(cs_vm* vm, const int64_t* items, size_t count) {
+    cs_value lv = list_with_len(vm, count);
+    cs_list_obj* l = as_list(lv);
+    if (!l) return cs_nil();
+    for (size_t i = 0; i < count; i++) l->items[i] = cs_int(items[i]);
+    l->len = count;
+    return lv;
+}
+
+cs_value cs_list_from_cstrs(cs_vm* vm, const char* const* items, size_t count) {
+    cs_value lv = list_with_len(vm, count);
+    cs_list_obj* l = as_list(lv);
+    if (!l) return cs_nil();
+    for (size_t i = 0; i < count; i++) {
+        cs_value v = cs_nil();
+        if (items[i]) {
+            cs_string* s = cs_str_new(items[i]);
+            if (!s) { cs_value_release(lv); return cs_nil(); }
+            v.type = CS_T_STR;
+            v.as.p = s;
+        }
+        l->items[l->len++] = v;
+    }
+    return lv;
+}
+
+cs_value cs_map_from_pairs(cs_vm* vm, const char* const* keys, const cs_value* vals, size_t count) {
+    size_t cap = 8;
+    while (cap * 7 / 10 < count + 1) cap *= 2;
+    cs_map_obj* m = map_new_ex(vm, cap, 0);
+    if (!m) return cs_nil();
+    cs_value mv; mv.type = CS_T_MAP; mv.as.p = m;
+    for (size_t i = 0; i < count; i++) {
+        if (!keys[i]) continue;
+        // keys are treated as field names: interned once, shared by every map built this way
+        cs_string* k = vm_intern_cstr(vm, keys[i]);
+        if (!k || !map_set_strkey(m, k, vals[i])) { cs_value_release(mv); return cs_nil(); }
+    }
+    return mv;
+}
+
+size_t cs_list_to_int64s(cs_value list_val, int64_t* out, size_t cap) {
+    if (list_val.type != CS_T_LIST || !out) return 0;
+    cs_list_obj* l = as_list(list_val);
+    if (!l) return 0;
+    size_t n = l->len < cap ? l->len : cap;
+    for (size_t i = 0; i < n; i++) {
+        if (l->items[i].type != CS_T_INT) return i;
+        out[i] = l->items[i].as.i;
+    }
+    return n;
+}
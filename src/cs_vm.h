@@ -5,6 +5,15 @@
 #include "cs_parser.h"
 #include "cs_value.h"
 #include "cs_event_loop.h"
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+// A binding shared between a defining scope and the closures that capture it.
+typedef struct cs_cell {
+    int ref;
+    cs_value v;
+} cs_cell;
 
 typedef struct cs_env {
     int ref;
@@ -12,8 +21,11 @@ typedef struct cs_env {
     char** keys;
     cs_value* vals;
     unsigned char* is_const;
+    cs_cell** cells;         // NULL until a binding is captured; cells[i] overrides vals[i]
     size_t count;
     size_t cap;
+    int persistent;          // globals/module scope: closures look names up here dynamically
+    const struct cs_captures* decls;  // call scopes: what the running function's body declares
 } cs_env;
 
 struct cs_func {
@@ -27,6 +39,7 @@ struct cs_func {
     size_t param_count;
     char* rest_param;        // optional rest parameter name
     ast* body;
+    const struct cs_captures* captures;  // body's capture summary, owned by the AST
     cs_env* closure;
     int is_async;
     int is_generator;
@@ -39,9 +52,46 @@ typedef struct cs_frame {
     int col;
 } cs_frame;
 
+// Generators run on their own coroutine stack so they can suspend at `yield`.
+// Coroutine stacks are reserved with a guard page below them; pages are only
+// committed as they are touched.
+#define CS_GEN_STACK_SIZE (16 * 1024 * 1024)
+#define CS_GEN_STACK_POOL 8
+
+// Programs run with cs_vm_run_slice get a stack sized like a main thread's.
+#define CS_SLICE_STACK_SIZE (8 * 1024 * 1024)
+
+// Evaluation stops with "maximum call depth exceeded" once less than this much of
+// the running stack is left, keeping room for natives and error unwinding.
+#define CS_STACK_RESERVE (256 * 1024)
+
+// Metadata keys of classes and structs, interned once per VM.
+enum {
+    CS_KEY_IS_CLASS, CS_KEY_IS_STRUCT, CS_KEY_CLASS, CS_KEY_STRUCT,
+    CS_KEY_PARENT, CS_KEY_FIELDS, CS_KEY_DEFAULTS, CS_KEY_NEW,
+    CS_KEY_COUNT
+};
+
+// Instances fall back to dictionary mode past these limits.
+#define CS_SHAPE_MAX_SLOTS 64
+#define CS_SHAPE_MAX_TRANSITIONS 32
+
+// File watches registered by watch_file()/watch_dir(), one table per VM.
+#define CS_MAX_WATCHES 256
+
+typedef struct cs_file_watch {
+    int handle_id;
+    int watch_fd;
+    char* path;
+    cs_value callback;
+    int is_directory;
+    int recursive;
+} cs_file_watch;
+
 typedef struct cs_module {
     char* path;
     cs_value exports;
+    cs_env* env;             // module scope, cleared by cs_vm_free
 } cs_module;
 
 typedef enum {
@@ -53,6 +103,7 @@ typedef struct cs_track_node {
     cs_track_type type;
     void* ptr;
     struct cs_track_node* next;
+    struct cs_track_node* prev;
 } cs_track_node;
 
 typedef struct cs_task {
@@ -67,12 +118,24 @@ typedef struct cs_task {
     int col;
 } cs_task;
 
+// A pending sleep/delay. Timers live in a binary min-heap on the VM ordered by
+// (due_ns, seq); index is the timer's slot in the heap so it can be cancelled
+// without a search. Deadlines are CLOCK_MONOTONIC nanoseconds.
 typedef struct cs_timer {
-    struct cs_timer* next;
-    uint64_t due_ms;
+    size_t index;
+    uint64_t due_ns;
+    uint64_t seq;
     cs_promise_obj* promise;
 } cs_timer;
 
+// Work handed to a VM from another thread (worker messages and replies). run() is
+// called on the VM's own thread, from its scheduler or from cs_vm_free (with
+// vm->tearing_down set, where it must not run script), and frees d.
+typedef struct cs_delivery {
+    struct cs_delivery* next;
+    void (*run)(cs_vm* vm, struct cs_delivery* d);
+} cs_delivery;
+
 struct cs_vm {
     cs_env* globals;
     char* last_error;
@@ -103,21 +166,59 @@ struct cs_vm {
     ast** asts;
     size_t ast_count;
     size_t ast_cap;
+    struct cs_code_cache* code_cache;  // shared parsed files (NULL = parse every load)
 
-    // Generator execution state (only active during generator calls)
-    struct cs_list_obj* yield_list;
-    int yield_active;
-    int yield_used;
+    // Generator execution state
+    struct cs_gen_state* gen_current;  // generator whose body is running (NULL outside generators)
+    void* gen_stacks[CS_GEN_STACK_POOL];  // recycled coroutine stacks
+    int gen_stack_count;
+    uintptr_t stack_floor;             // lowest address evaluation may reach on the running stack
+    uintptr_t stack_top;               // top of the running stack (0 = host stack not measured yet)
+    int stack_coroutine;               // the bounds belong to a generator or slice stack
+    int tearing_down;                  // set by cs_vm_free; suspended generators are not resumed to close
+
+    // Instance shapes (hidden classes) and the interned keys they are built from
+    cs_shape* shape_root;
+    cs_string** intern_slots;
+    uint32_t* intern_hashes;
+    size_t intern_count;
+    size_t intern_cap;
+    uint64_t ic_epoch;                 // bumped when a map an inline cache depends on changes
+    cs_string* keys[CS_KEY_COUNT];     // borrowed from the intern table
 
     // Async scheduler
     cs_task* task_head;
     cs_task* task_tail;
-    cs_timer* timers;
+    cs_timer** timers;                 // min-heap, timers[0] is due first
+    size_t timer_count;
+    size_t timer_cap;
+    uint64_t timer_seq;
 
     // Network I/O pending operations
     cs_pending_io* pending_io;
     int pending_io_count;
+    struct cs_io_table* io_table;     // fd -> operations and the poller (cs_event_loop.c)
     uint64_t net_default_timeout_ms;  // default 30000 (30 seconds)
+    struct cs_http_pool* http_pool;   // idle keep-alive connections (cs_http.c)
+    struct cs_socket_table* sockets;  // open socket handles by slot (cs_net.c)
+    struct cs_http_server* http_server; // innermost running http_serve (cs_http.c)
+
+    // Deliveries from other threads (cs_vm_deliver)
+#if defined(_WIN32)
+    SRWLOCK inbox_lock;
+    CONDITION_VARIABLE inbox_cond;
+#else
+    pthread_mutex_t inbox_lock;
+    pthread_cond_t  inbox_cond;
+#endif
+    cs_delivery* inbox_head;
+    cs_delivery* inbox_tail;
+    int inbox_expected;               // deliveries still owed to this VM; await waits for them
+    int delivery_failed;              // a delivery's callback failed; the await running it fails
+    int wake_armed;                   // the scheduler is blocked and how to wake it (cs_vm.c)
+    int wake_pending;                 // a wakeup arrived while nothing was blocked
+    struct cs_worker* workers;        // spawned by this VM; joined by cs_vm_free
+    struct cs_par_pool* par_pools;    // par_map/par_reduce VMs, one pool per module function
 
 #if defined(__linux__)
     // Background event loop primitives (Linux only)
@@ -127,6 +228,11 @@ struct cs_vm {
     int             loop_running;    // 0 = stopped, 1 = running
 #endif
 
+    // File watching (inotify on Linux); released by cs_vm_free
+    int inotify_fd;                   // -1 until the first watch
+    int next_watch_handle;
+    cs_file_watch** watches;          // CS_MAX_WATCHES slots, allocated with the first watch
+
     // GC auto-collect policy
     size_t gc_threshold;            // collect when tracked_count >= threshold; 0 = disabled
     size_t gc_allocations;          // total allocations since last GC
@@ -140,6 +246,7 @@ struct cs_vm {
     uint64_t exec_start_ms;         // execution start time
     uint64_t exec_timeout_ms;       // 0 = unlimited
     int interrupt_requested;        // set by host to abort execution
+    struct cs_slice* slice;         // program loaded for time-sliced execution (NULL when none)
 
     // Profiling counters
     uint64_t prof_string_ops;
@@ -150,6 +257,8 @@ struct cs_vm {
     uint64_t prof_match_ms;
     uint64_t prof_optchain_ops;
     uint64_t prof_optchain_ms;
+    uint64_t prof_ic_hits;
+    uint64_t prof_ic_misses;
 
     // String interpolation cache (reusable strbuf to reduce allocations)
     struct cs_strbuf_obj* interp_cache;
@@ -162,9 +271,27 @@ cs_value cs_promise_new(cs_vm* vm);
 int cs_promise_resolve(cs_vm* vm, cs_value promise, cs_value value);
 int cs_promise_reject(cs_vm* vm, cs_value promise, cs_value value);
 int cs_promise_is_pending(cs_value promise);
-void cs_schedule_timer(cs_vm* vm, cs_value promise, uint64_t due_ms);
+// Resolves notify with nil once promise settles (at once if it has), replacing the
+// notify promise an earlier call set. Lets native code wait on several promises.
+int cs_promise_notify(cs_vm* vm, cs_value promise, cs_value notify);
+void cs_schedule_timer(cs_vm* vm, cs_value promise, uint64_t due_ms);   // due_ms on the now_ms() clock
+int  cs_schedule_timer_ns(cs_vm* vm, cs_value promise, uint64_t delay_ns); // 0 on out of memory
+int  cs_cancel_timer(cs_vm* vm, cs_value promise);  // 1 if an armed timer was removed
+uint64_t cs_monotonic_ns(void);
 cs_value cs_wait_promise(cs_vm* vm, cs_value promise, int* ok);
 
+// Cross-thread deliveries (worker support). cs_vm_deliver may be called from any
+// thread; the others only from the VM's own thread.
+void cs_vm_deliver(cs_vm* vm, cs_delivery* d);
+int  cs_vm_run_deliveries(cs_vm* vm);                         // returns how many ran
+int  cs_vm_wait_deliveries(cs_vm* vm, uint64_t timeout_ms);   // 1 if something is queued
+
+// Lazy iterators (internal stdlib support)
+cs_value cs_iter_new(cs_vm* vm, cs_iter_next_fn next, cs_value src, cs_value arg); // copies src/arg
+cs_value cs_iter_from(cs_vm* vm, cs_value v);  // list/range/map/set/string/iterator -> iterator, nil otherwise
+int cs_iter_next(cs_vm* vm, cs_value it, cs_value* out); // 1 = value, 0 = exhausted, -1 = error
+cs_list_obj* cs_iter_items(cs_vm* vm, cs_value it);      // drained values, cached (borrowed); NULL = error
+
 // Event loop control (Linux: background thread, other platforms: returns false)
 int cs_event_loop_start(cs_vm* vm);    // Start background event loop, returns 1 on success
 int cs_event_loop_stop(cs_vm* vm);     // Stop background event loop, returns 1 on success
@@ -0,0 +1,1120 @@
+#include "cs_worker.h"
+#include "cs_vm.h"
+#include "cs_value.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// ---------- messages ----------
+// A message is a VM-independent copy of a value: built on the sending thread and
+// turned back into values on the receiving one. Everything is copied, except malloc'd
+// bytes buffers the sender lists in `transfer` or that nothing else references: those
+// change hands without a copy and leave the sender's value empty.
+
+#define CS_MSG_MAX_DEPTH 512
+
+typedef struct cs_msg {
+    cs_type type;
+    size_t len;                 // string/bytes length, or element count
+    union {
+        int b;
+        int64_t i;
+        double f;
+        char* str;
+        unsigned char* bytes;
+        struct cs_msg* items;   // list/tuple: len items; map/set: len key, value pairs
+    } as;
+    char** names;               // tuple field names (NULL entries are positional)
+} cs_msg;
+
+static size_t msg_item_count(const cs_msg* m) {
+    return (m->type == CS_T_MAP || m->type == CS_T_SET) ? m->len * 2 : m->len;
+}
+
+static void msg_clear(cs_msg* m) {
+    switch (m->type) {
+        case CS_T_STR: free(m->as.str); break;
+        case CS_T_BYTES: free(m->as.bytes); break;
+        case CS_T_LIST:
+        case CS_T_MAP:
+        case CS_T_SET:
+        case CS_T_TUPLE:
+            if (m->as.items) {
+                size_t n = msg_item_count(m);
+                for (size_t i = 0; i < n; i++) msg_clear(&m->as.items[i]);
+                free(m->as.items);
+            }
+            if (m->names) {
+                for (size_t i = 0; i < m->len; i++) free(m->names[i]);
+                free(m->names);
+            }
+            break;
+        default: break;
+    }
+    memset(m, 0, sizeof(*m));
+}
+
+// Validate before building so a rejected message never moves the sender's bytes.
+static int msg_check(cs_vm* vm, const char* fname, cs_value v, int depth) {
+    char buf[128];
+    if (depth > CS_MSG_MAX_DEPTH) {
+        snprintf(buf, sizeof(buf), "%s(): message nests too deeply (cyclic?)", fname);
+        cs_error(vm, buf);
+        return 0;
+    }
+    switch (v.type) {
+        case CS_T_NIL:
+        case CS_T_BOOL:
+        case CS_T_INT:
+        case CS_T_FLOAT:
+        case CS_T_STR:
+        case CS_T_BYTES:
+            return 1;
+        case CS_T_LIST: {
+            cs_list_obj* l = (cs_list_obj*)v.as.p;
+            for (size_t i = 0; i < l->len; i++) {
+                if (!msg_check(vm, fname, l->items[i], depth + 1)) return 0;
+            }
+            return 1;
+        }
+        case CS_T_MAP:
+        case CS_T_SET: {
+            cs_map_obj* m = (cs_map_obj*)v.as.p;
+            for (size_t i = 0; i < m->cap; i++) {
+                if (!m->entries[i].in_use) continue;
+                if (!msg_check(vm, fname, m->entries[i].key, depth + 1)) return 0;
+                if (!msg_check(vm, fname, m->entries[i].val, depth + 1)) return 0;
+            }
+            return 1;
+        }
+        case CS_T_TUPLE: {
+            cs_tuple_obj* t = (cs_tuple_obj*)v.as.p;
+            for (size_t i = 0; i < t->len; i++) {
+                if (!msg_check(vm, fname, t->fields[i].value, depth + 1)) return 0;
+            }
+            return 1;
+        }
+        default:
+            snprintf(buf, sizeof(buf), "%s(): cannot send a %s to another VM", fname, cs_type_name(v.type));
+            cs_error(vm, buf);
+            return 0;
+    }
+}
+
+// Reads the sender's options: {transfer: [bytes, ...]} lists buffers to move rather than
+// copy. *transfer is nil or a list the caller releases.
+static int msg_transfer_opt(cs_vm* vm, const char* fname, cs_value opts, cs_value* transfer) {
+    char buf[128];
+    *transfer = cs_nil();
+    if (opts.type == CS_T_NIL) return 1;
+    if (opts.type == CS_T_MAP) *transfer = cs_map_get(opts, "transfer");
+    if (opts.type != CS_T_MAP || (transfer->type != CS_T_NIL && transfer->type != CS_T_LIST)) {
+        cs_value_release(*transfer);
+        *transfer = cs_nil();
+        snprintf(buf, sizeof(buf), "%s(): options must be a map like {transfer: [bytes]}", fname);
+        cs_error(vm, buf);
+        return 0;
+    }
+    if (transfer->type == CS_T_NIL) return 1;
+    cs_list_obj* l = (cs_list_obj*)transfer->as.p;
+    for (size_t i = 0; i < l->len; i++) {
+        if (l->items[i].type == CS_T_BYTES) continue;
+        cs_value_release(*transfer);
+        *transfer = cs_nil();
+        snprintf(buf, sizeof(buf), "%s(): transfer expects a list of bytes", fname);
+        cs_error(vm, buf);
+        return 0;
+    }
+    return 1;
+}
+
+static char* msg_dup(const char* s, size_t n) {
+    char* out = (char*)malloc(n + 1);
+    if (!out) return NULL;
+    if (n) memcpy(out, s, n);
+    out[n] = 0;
+    return out;
+}
+
+static int msg_transferred(const cs_list_obj* transfer, const cs_bytes_obj* b) {
+    if (!transfer) return 0;
+    for (size_t i = 0; i < transfer->len; i++) {
+        if (transfer->items[i].type == CS_T_BYTES && transfer->items[i].as.p == b) return 1;
+    }
+    return 0;
+}
+
+// Returns 0 when out of memory; m is left clearable either way. Bytes buffers listed in
+// transfer are taken from the sender instead of copied. With owned set, so is any buffer
+// reached only through single references from v, which the caller holds the only one of.
+static int msg_build(cs_value v, cs_msg* m, const cs_list_obj* transfer, int owned) {
+    memset(m, 0, sizeof(*m));
+    m->type = v.type;
+    switch (v.type) {
+        case CS_T_NIL: return 1;
+        case CS_T_BOOL: m->as.b = v.as.b; return 1;
+        case CS_T_INT: m->as.i = v.as.i; return 1;
+        case CS_T_FLOAT: m->as.f = v.as.f; return 1;
+        case CS_T_STR: {
+            cs_string* s = (cs_string*)v.as.p;
+            m->len = s->len;
+            m->as.str = msg_dup(s->data, s->len);
+            return m->as.str != NULL;
+        }
+        case CS_T_BYTES: {
+            cs_bytes_obj* b = (cs_bytes_obj*)v.as.p;
+            m->len = b->len;
+            int move = !b->release && ((owned && b->ref == 1) || msg_transferred(transfer, b));
+            unsigned char* empty = move ? (unsigned char*)calloc(1, 1) : NULL;
+            if (empty) {
+                // Move: the receiver takes the buffer, the sender is left with zero bytes
+                m->as.bytes = b->data;
+                b->data = empty;
+                b->len = 0;
+                b->cap = 0;
+                return 1;
+            }
+            // Host-owned (cs_bytes_wrap) buffers are always copied
+            m->as.bytes = (unsigned char*)malloc(b->len ? b->len : 1);
+            if (!m->as.bytes) return 0;
+            if (b->len) memcpy(m->as.bytes, b->data, b->len);
+            return 1;
+        }
+        case CS_T_LIST: {
+            cs_list_obj* l = (cs_list_obj*)v.as.p;
+            m->len = l->len;
+            if (!l->len) return 1;
+            m->as.items = (cs_msg*)calloc(l->len, sizeof(cs_msg));
+            if (!m->as.items) { m->len = 0; return 0; }
+            owned = owned && l->ref == 1;
+            for (size_t i = 0; i < l->len; i++) {
+                if (!msg_build(l->items[i], &m->as.items[i], transfer, owned)) return 0;
+            }
+            return 1;
+        }
+        case CS_T_MAP:
+        case CS_T_SET: {
+            cs_map_obj* mo = (cs_map_obj*)v.as.p;
+            size_t n = 0;
+            for (size_t i = 0; i < mo->cap; i++) if (mo->entries[i].in_use) n++;
+            m->len = n;
+            if (!n) return 1;
+            m->as.items = (cs_msg*)calloc(n * 2, sizeof(cs_msg));
+            if (!m->as.items) { m->len = 0; return 0; }
+            size_t w = 0;
+            owned = owned && mo->ref == 1;
+            for (size_t i = 0; i < mo->cap; i++) {
+                if (!mo->entries[i].in_use) continue;
+                if (!msg_build(mo->entries[i].key, &m->as.items[w++], transfer, owned)) return 0;
+                if (!msg_build(mo->entries[i].val, &m->as.items[w++], transfer, owned)) return 0;
+            }
+            return 1;
+        }
+        case CS_T_TUPLE: {
+            cs_tuple_obj* t = (cs_tuple_obj*)v.as.p;
+            m->len = t->len;
+            if (!t->len) return 1;
+            m->as.items = (cs_msg*)calloc(t->len, sizeof(cs_msg));
+            m->names = (char**)calloc(t->len, sizeof(char*));
+            if (!m->as.items || !m->names) return 0;
+            owned = owned && t->ref == 1;
+            for (size_t i = 0; i < t->len; i++) {
+                if (t->fields[i].name) {
+                    m->names[i] = msg_dup(t->fields[i].name, strlen(t->fields[i].name));
+                    if (!m->names[i]) return 0;
+                }
+                if (!msg_build(t->fields[i].value, &m->as.items[i], transfer, owned)) return 0;
+            }
+            return 1;
+        }
+        default:
+            m->type = CS_T_NIL;
+            return 1;
+    }
+}
+
+// Turns m into a value owned by vm; m's buffers are handed over or freed.
+static cs_value msg_take_value(cs_vm* vm, cs_msg* m) {
+    cs_value out = cs_nil();
+    switch (m->type) {
+        case CS_T_BOOL: out = cs_bool(m->as.b); break;
+        case CS_T_INT: out = cs_int(m->as.i); break;
+        case CS_T_FLOAT: out = cs_float(m->as.f); break;
+        case CS_T_STR:
+            out = cs_str_take(vm, m->as.str, m->len);
+            m->as.str = NULL;
+            break;
+        case CS_T_BYTES:
+            out = cs_bytes_take(vm, (uint8_t*)m->as.bytes, m->len);
+            m->as.bytes = NULL;
+            break;
+        case CS_T_LIST:
+            out = cs_list(vm);
+            for (size_t i = 0; i < m->len; i++) {
+                cs_value item = msg_take_value(vm, &m->as.items[i]);
+                cs_list_push(out, item);
+                cs_value_release(item);
+            }
+            break;
+        case CS_T_MAP:
+        case CS_T_SET:
+            out = m->type == CS_T_SET ? cs_set(vm) : cs_map(vm);
+            for (size_t i = 0; i < m->len; i++) {
+                cs_value key = msg_take_value(vm, &m->as.items[i * 2]);
+                cs_value val = msg_take_value(vm, &m->as.items[i * 2 + 1]);
+                cs_map_set_value(out, key, val);
+                cs_value_release(key);
+                cs_value_release(val);
+            }
+            break;
+        case CS_T_TUPLE: {
+            cs_tuple_obj* t = cs_tuple_new(m->len);
+            if (!t) break;
+            for (size_t i = 0; i < m->len; i++) {
+                t->fields[i].name = m->names[i];
+                m->names[i] = NULL;
+                t->fields[i].value = msg_take_value(vm, &m->as.items[i]);
+            }
+            out.type = CS_T_TUPLE;
+            out.as.p = t;
+            break;
+        }
+        default: break;
+    }
+    msg_clear(m);
+    return out;
+}
+
+// ---------- workers ----------
+
+typedef enum {
+    WORKER_REQUEST,     // parent -> worker: worker_post() payload
+    WORKER_REPLY,       // worker -> parent: settles the request's promise
+    WORKER_EVENT,       // worker -> parent: post_message() payload
+    WORKER_STOP         // parent -> worker: leave the message loop
+} worker_msg_kind;
+
+struct cs_worker {
+    struct cs_worker* next;
+    int64_t id;
+    char* path;
+    cs_vm* parent;
+    cs_vm* vm;                  // worker VM; freed by the worker thread when it stops
+#if !defined(_WIN32)
+    pthread_t thread;
+#endif
+    int running;                // parent side: thread started and not yet joined
+
+    // Touched only on the worker thread
+    int stop;
+    char* load_error;           // the script failed; requests are rejected with this
+    cs_value handler;           // on_message(fn)
+
+    // Touched only on the parent thread
+    cs_value on_message;        // worker_on_message(w, fn)
+    cs_value on_error;          // worker_on_error(w, fn)
+};
+
+typedef struct worker_delivery {
+    cs_delivery base;
+    struct cs_worker* w;
+    worker_msg_kind kind;
+    int failed;                 // reply rejects with msg (an error string)
+    cs_msg msg;
+    cs_value promise;           // parent VM promise; carried, never touched, by the worker
+} worker_delivery;
+
+static void run_on_parent(cs_vm* vm, cs_delivery* base);
+
+static worker_delivery* delivery_new(struct cs_worker* w, worker_msg_kind kind) {
+    worker_delivery* d = (worker_delivery*)calloc(1, sizeof(worker_delivery));
+    if (!d) return NULL;
+    d->w = w;
+    d->kind = kind;
+    d->promise = cs_nil();
+    return d;
+}
+
+static void reply_to_parent(struct cs_worker* w, worker_delivery* d, int failed, const char* err) {
+    if (failed) {
+        msg_clear(&d->msg);
+        if (!err) err = "worker request failed";
+        d->msg.type = CS_T_STR;
+        d->msg.len = strlen(err);
+        d->msg.as.str = msg_dup(err, d->msg.len);
+        if (!d->msg.as.str) d->msg.type = CS_T_NIL;
+    }
+    d->kind = WORKER_REPLY;
+    d->failed = failed;
+    d->base.run = run_on_parent;
+    cs_vm_deliver(w->parent, &d->base);
+}
+
+static void run_on_worker(cs_vm* vm, cs_delivery* base) {
+    worker_delivery* d = (worker_delivery*)base;
+    struct cs_worker* w = d->w;
+
+    if (d->kind == WORKER_STOP) {
+        w->stop = 1;
+        free(d);
+        return;
+    }
+
+    if (w->stop || vm->tearing_down) { reply_to_parent(w, d, 1, "worker terminated"); return; }
+    if (w->load_error) { reply_to_parent(w, d, 1, w->load_error); return; }
+    if (w->handler.type == CS_T_NIL) { reply_to_parent(w, d, 1, "worker has no on_message handler"); return; }
+
+    cs_value arg = msg_take_value(vm, &d->msg);
+    cs_value result = cs_nil();
+    int rc = cs_call_value(vm, w->handler, 1, &arg, &result);
+    cs_value_release(arg);
+    if (rc == 0 && result.type == CS_T_PROMISE) {
+        int ok = 1;
+        cs_value settled = cs_wait_promise(vm, result, &ok);
+        cs_value_release(result);
+        result = settled;
+        if (!ok) rc = -1;
+    }
+    if (rc != 0) {
+        cs_value_release(result);
+        reply_to_parent(w, d, 1, cs_vm_last_error(vm));
+        return;
+    }
+    if (!msg_check(vm, "on_message", result, 0)) {
+        cs_value_release(result);
+        reply_to_parent(w, d, 1, cs_vm_last_error(vm));
+        return;
+    }
+    int built = msg_build(result, &d->msg, NULL, 1);
+    cs_value_release(result);
+    if (!built) { reply_to_parent(w, d, 1, "out of memory"); return; }
+    reply_to_parent(w, d, 0, NULL);
+}
+
+// A failing worker_on_message callback is passed to worker_on_error. Without one, or if
+// that fails too, the error stays in the VM and fails the await that delivered it.
+static void worker_event_failed(cs_vm* vm, struct cs_worker* w) {
+    if (!cs_vm_last_error(vm)) cs_error(vm, "worker on_message callback failed");
+    if (w->on_error.type != CS_T_NIL) {
+        cs_value err = cs_str(vm, cs_vm_last_error(vm));
+        cs_value r = cs_nil();
+        int rc = cs_call_value(vm, w->on_error, 1, &err, &r);
+        cs_value_release(r);
+        cs_value_release(err);
+        if (rc == 0) return;
+    }
+    vm->delivery_failed = 1;
+}
+
+static void run_on_parent(cs_vm* vm, cs_delivery* base) {
+    worker_delivery* d = (worker_delivery*)base;
+    if (d->kind == WORKER_REPLY) {
+        vm->inbox_expected--;
+        if (!vm->tearing_down) {
+            cs_value v = msg_take_value(vm, &d->msg);
+            if (d->failed) cs_promise_reject(vm, d->promise, v);
+            else cs_promise_resolve(vm, d->promise, v);
+            cs_value_release(v);
+        }
+        cs_value_release(d->promise);
+    } else if (d->kind == WORKER_EVENT && !vm->tearing_down && d->w->on_message.type != CS_T_NIL) {
+        cs_value v = msg_take_value(vm, &d->msg);
+        cs_value r = cs_nil();
+        if (cs_call_value(vm, d->w->on_message, 1, &v, &r) != 0) worker_event_failed(vm, d->w);
+        cs_value_release(r);
+        cs_value_release(v);
+    }
+    msg_clear(&d->msg);
+    free(d);
+}
+
+// Worker-side natives; userdata is the worker.
+
+static int nf_on_message(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    struct cs_worker* w = (struct cs_worker*)ud;
+    if (argc != 1 || (argv[0].type != CS_T_FUNC && argv[0].type != CS_T_NATIVE)) {
+        cs_error(vm, "on_message() requires a function");
+        return 1;
+    }
+    cs_value_release(w->handler);
+    w->handler = cs_value_copy(argv[0]);
+    if (out) *out = cs_nil();
+    return 0;
+}
+
+static int nf_post_message(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    struct cs_worker* w = (struct cs_worker*)ud;
+    if (argc != 1 && argc != 2) {
+        cs_error(vm, "post_message() requires 1 or 2 arguments (message, opts)");
+        return 1;
+    }
+    cs_value transfer;
+    if (!msg_check(vm, "post_message", argv[0], 0)) return 1;
+    if (!msg_transfer_opt(vm, "post_message", argc > 1 ? argv[1] : cs_nil(), &transfer)) return 1;
+    worker_delivery* d = delivery_new(w, WORKER_EVENT);
+    int built = d && msg_build(argv[0], &d->msg, transfer.type == CS_T_LIST ? (cs_list_obj*)transfer.as.p : NULL, 0);
+    cs_value_release(transfer);
+    if (!built) {
+        if (d) { msg_clear(&d->msg); free(d); }
+        cs_error(vm, "post_message(): out of memory");
+        return 1;
+    }
+    d->base.run = run_on_parent;
+    cs_vm_deliver(w->parent, &d->base);
+    if (out) *out = cs_nil();
+    return 0;
+}
+
+#if !defined(_WIN32)
+static void* worker_main(void* arg) {
+    struct cs_worker* w = (struct cs_worker*)arg;
+    cs_vm* vm = w->vm;
+
+    if (cs_vm_run_file(vm, w->path) != 0) {
+        const char* err = cs_vm_last_error(vm);
+        if (!err) err = "worker script failed";
+        w->load_error = msg_dup(err, strlen(err));
+    }
+    while (!w->stop) {
+        cs_vm_wait_deliveries(vm, 1000);
+        cs_vm_run_deliveries(vm);
+    }
+
+    cs_value_release(w->handler);
+    w->handler = cs_nil();
+    // Requests still queued are answered "worker terminated" while the VM tears down
+    cs_vm_free(vm);
+    free(w->load_error);
+    w->load_error = NULL;
+    return NULL;
+}
+#endif
+
+static void worker_stop(struct cs_worker* w) {
+    if (!w->running) return;
+    w->running = 0;
+    // Break out of a handler that is still running. Before the stop message: once the
+    // worker sees that, it frees its VM.
+    cs_vm_interrupt(w->vm);
+    worker_delivery* d = delivery_new(w, WORKER_STOP);
+    if (d) {
+        d->base.run = run_on_worker;
+        cs_vm_deliver(w->vm, &d->base);
+    }
+#if !defined(_WIN32)
+    pthread_join(w->thread, NULL);
+#endif
+    w->vm = NULL;
+}
+
+static void par_pools_free(cs_vm* vm);
+
+void cs_worker_shutdown_all(cs_vm* vm) {
+    if (!vm) return;
+    par_pools_free(vm);
+    if (!vm->workers) return;
+    for (struct cs_worker* w = vm->workers; w; w = w->next) worker_stop(w);
+    // Settle the replies the workers sent on their way out
+    cs_vm_run_deliveries(vm);
+    while (vm->workers) {
+        struct cs_worker* w = vm->workers;
+        vm->workers = w->next;
+        cs_value_release(w->on_message);
+        cs_value_release(w->on_error);
+        free(w->path);
+        free(w);
+    }
+}
+
+// Parent-side natives. A worker handle is a map {_worker, path} like socket handles,
+// with post, on_message, on_error and terminate methods bound to the worker's id. The
+// worker_* functions take the handle as their first argument and do the same.
+
+static struct cs_worker* worker_find(cs_vm* vm, const char* fname, int64_t wid) {
+    char buf[128];
+    for (struct cs_worker* w = vm->workers; w; w = w->next) {
+        if (w->id != wid) continue;
+        if (!w->running) {
+            snprintf(buf, sizeof(buf), "%s(): worker has been terminated", fname);
+            cs_error(vm, buf);
+            return NULL;
+        }
+        return w;
+    }
+    snprintf(buf, sizeof(buf), "%s(): not a worker of this VM", fname);
+    cs_error(vm, buf);
+    return NULL;
+}
+
+static struct cs_worker* worker_from_handle(cs_vm* vm, const char* fname, int argc, const cs_value* argv) {
+    char buf[128];
+    if (argc < 1 || argv[0].type != CS_T_MAP) {
+        snprintf(buf, sizeof(buf), "%s() requires a worker handle", fname);
+        cs_error(vm, buf);
+        return NULL;
+    }
+    cs_value id = cs_map_get(argv[0], "_worker");
+    int64_t wid = id.type == CS_T_INT ? id.as.i : -1;
+    cs_value_release(id);
+    return worker_find(vm, fname, wid);
+}
+
+static char* worker_resolve_path(cs_vm* vm, const char* p) {
+    const char* dir = vm->dir_count ? vm->dir_stack[vm->dir_count - 1] : NULL;
+    size_t np = strlen(p);
+    if (!dir || !*dir || p[0] == '/' || p[0] == '\\' || (np > 1 && p[1] == ':')) return msg_dup(p, np);
+    size_t nd = strlen(dir);
+    char* out = (char*)malloc(nd + 1 + np + 1);
+    if (!out) return NULL;
+    memcpy(out, dir, nd);
+    out[nd] = '/';
+    memcpy(out + nd + 1, p, np + 1);
+    return out;
+}
+
+// Operations on a worker; argv holds the arguments after the handle.
+typedef int (*worker_op)(cs_vm* vm, struct cs_worker* w, const char* fname, int argc, const cs_value* argv, cs_value* out);
+
+static int worker_op_post(cs_vm* vm, struct cs_worker* w, const char* fname, int argc, const cs_value* argv, cs_value* out) {
+    char buf[128];
+    if (argc != 1 && argc != 2) {
+        snprintf(buf, sizeof(buf), "%s() requires a message and optional opts", fname);
+        cs_error(vm, buf);
+        return 1;
+    }
+    cs_value transfer;
+    if (!msg_check(vm, fname, argv[0], 0)) return 1;
+    if (!msg_transfer_opt(vm, fname, argc > 1 ? argv[1] : cs_nil(), &transfer)) return 1;
+    worker_delivery* d = delivery_new(w, WORKER_REQUEST);
+    int built = d && msg_build(argv[0], &d->msg, transfer.type == CS_T_LIST ? (cs_list_obj*)transfer.as.p : NULL, 0);
+    cs_value_release(transfer);
+    if (!built) {
+        if (d) { msg_clear(&d->msg); free(d); }
+        snprintf(buf, sizeof(buf), "%s(): out of memory", fname);
+        cs_error(vm, buf);
+        return 1;
+    }
+    d->promise = cs_promise_new(vm);
+    d->base.run = run_on_worker;
+    if (out) *out = cs_value_copy(d->promise);
+    vm->inbox_expected++;
+    cs_vm_deliver(w->vm, &d->base);
+    return 0;
+}
+
+static int worker_set_callback(cs_vm* vm, cs_value* slot, const char* fname, int argc, const cs_value* argv, cs_value* out) {
+    char buf[128];
+    if (argc != 1 || (argv[0].type != CS_T_FUNC && argv[0].type != CS_T_NATIVE && argv[0].type != CS_T_NIL)) {
+        snprintf(buf, sizeof(buf), "%s() requires a function or nil", fname);
+        cs_error(vm, buf);
+        return 1;
+    }
+    cs_value_release(*slot);
+    *slot = cs_value_copy(argv[0]);
+    if (out) *out = cs_nil();
+    return 0;
+}
+
+static int worker_op_on_message(cs_vm* vm, struct cs_worker* w, const char* fname, int argc, const cs_value* argv, cs_value* out) {
+    return worker_set_callback(vm, &w->on_message, fname, argc, argv, out);
+}
+
+static int worker_op_on_error(cs_vm* vm, struct cs_worker* w, const char* fname, int argc, const cs_value* argv, cs_value* out) {
+    return worker_set_callback(vm, &w->on_error, fname, argc, argv, out);
+}
+
+static int worker_op_terminate(cs_vm* vm, struct cs_worker* w, const char* fname, int argc, const cs_value* argv, cs_value* out) {
+    (void)vm; (void)fname; (void)argc; (void)argv;
+    // Outstanding posts are rejected "worker terminated" through the inbox
+    worker_stop(w);
+    if (out) *out = cs_nil();
+    return 0;
+}
+
+static int worker_function(cs_vm* vm, const char* fname, worker_op op, int argc, const cs_value* argv, cs_value* out) {
+    struct cs_worker* w = worker_from_handle(vm, fname, argc, argv);
+    if (!w) return 1;
+    return op(vm, w, fname, argc - 1, argv + 1, out);
+}
+
+static int worker_method(cs_vm* vm, void* ud, const char* fname, worker_op op, int argc, const cs_value* argv, cs_value* out) {
+    struct cs_worker* w = worker_find(vm, fname, (int64_t)(intptr_t)ud);
+    if (!w) return 1;
+    return op(vm, w, fname, argc, argv, out);
+}
+
+static int nf_worker_post(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return worker_function(vm, "worker_post", worker_op_post, argc, argv, out);
+}
+
+static int nf_worker_on_message(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return worker_function(vm, "worker_on_message", worker_op_on_message, argc, argv, out);
+}
+
+static int nf_worker_on_error(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return worker_function(vm, "worker_on_error", worker_op_on_error, argc, argv, out);
+}
+
+static int nf_worker_terminate(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return worker_function(vm, "worker_terminate", worker_op_terminate, argc, argv, out);
+}
+
+static int nf_handle_post(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    return worker_method(vm, ud, "post", worker_op_post, argc, argv, out);
+}
+
+static int nf_handle_on_message(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    return worker_method(vm, ud, "on_message", worker_op_on_message, argc, argv, out);
+}
+
+static int nf_handle_on_error(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    return worker_method(vm, ud, "on_error", worker_op_on_error, argc, argv, out);
+}
+
+static int nf_handle_terminate(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    return worker_method(vm, ud, "terminate", worker_op_terminate, argc, argv, out);
+}
+
+static void handle_set_method(cs_value handle, const char* name, cs_native_fn fn, int64_t wid) {
+    cs_native* nf = (cs_native*)calloc(1, sizeof(cs_native));
+    if (!nf) return;
+    nf->ref = 1;
+    nf->fn = fn;
+    nf->userdata = (void*)(intptr_t)wid;
+    cs_value v; v.type = CS_T_NATIVE; v.as.p = nf;
+    cs_map_set(handle, name, v);
+    cs_value_release(v);
+}
+
+static int nf_worker_spawn(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    if (argc != 1 || argv[0].type != CS_T_STR) {
+        cs_error(vm, "worker_spawn() requires a script path");
+        return 1;
+    }
+#if defined(_WIN32)
+    (void)out;
+    cs_error(vm, "worker_spawn(): workers are not supported on this platform");
+    return 1;
+#else
+    struct cs_worker* w = (struct cs_worker*)calloc(1, sizeof(struct cs_worker));
+    if (!w) { cs_error(vm, "worker_spawn(): out of memory"); return 1; }
+    w->path = worker_resolve_path(vm, cs_to_cstr(argv[0]));
+    w->vm = cs_vm_new();
+    if (!w->path || !w->vm) {
+        if (w->vm) cs_vm_free(w->vm);
+        free(w->path);
+        free(w);
+        cs_error(vm, "worker_spawn(): out of memory");
+        return 1;
+    }
+    w->parent = vm;
+    w->handler = cs_nil();
+    w->on_message = cs_nil();
+    w->on_error = cs_nil();
+    w->id = vm->workers ? vm->workers->id + 1 : 1;
+
+    // Set up on this thread; the worker thread owns the VM from pthread_create on
+    cs_register_stdlib(w->vm);
+    cs_vm_set_code_cache(w->vm, vm->code_cache);
+    cs_register_native(w->vm, "on_message", nf_on_message, w);
+    cs_register_native(w->vm, "post_message", nf_post_message, w);
+
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+        cs_vm_free(w->vm);
+        free(w->path);
+        free(w);
+        cs_error(vm, "worker_spawn(): cannot start thread");
+        return 1;
+    }
+    w->running = 1;
+    w->next = vm->workers;
+    vm->workers = w;
+
+    if (out) {
+        *out = cs_map(vm);
+        cs_map_set(*out, "_worker", cs_int(w->id));
+        cs_value path = cs_str(vm, w->path);
+        cs_map_set(*out, "path", path);
+        cs_value_release(path);
+        handle_set_method(*out, "post", nf_handle_post, w->id);
+        handle_set_method(*out, "on_message", nf_handle_on_message, w->id);
+        handle_set_method(*out, "on_error", nf_handle_on_error, w->id);
+        handle_set_method(*out, "terminate", nf_handle_terminate, w->id);
+    }
+    return 0;
+#endif
+}
+
+// ---------- parallel map / reduce ----------
+// par_map and par_reduce split a list into chunks and run a module function over the
+// chunks on a pool of VMs, one thread per VM. A pool is kept per (module, function),
+// so each VM loads the module once; module globals persist between calls.
+
+#define CS_PAR_MAX_WORKERS 256
+#define CS_PAR_CHUNKS_PER_WORKER 4
+
+typedef struct cs_par_pool {
+    struct cs_par_pool* next;
+    char* module;
+    char* fn_name;
+    int size;
+    cs_vm** vms;                // slot stays NULL until its thread first loads it
+    cs_value* fns;
+} cs_par_pool;
+
+typedef struct par_job {
+    cs_par_pool* pool;
+    struct cs_code_cache* cache;
+    const char* fname;
+    int reduce;
+    cs_msg* items;
+    size_t count;
+    size_t chunk;
+    size_t nchunks;
+    cs_msg* results;            // par_map: one per item; par_reduce: one per chunk
+#if !defined(_WIN32)
+    pthread_mutex_t lock;
+#endif
+    size_t next_chunk;
+    char* error;                // first failure; the other threads stop claiming chunks
+} par_job;
+
+static void par_pools_free(cs_vm* vm) {
+    while (vm->par_pools) {
+        cs_par_pool* p = vm->par_pools;
+        vm->par_pools = p->next;
+        for (int i = 0; i < p->size; i++) {
+            if (!p->vms[i]) continue;
+            cs_value_release(p->fns[i]);
+            cs_vm_free(p->vms[i]);
+        }
+        free(p->vms);
+        free(p->fns);
+        free(p->module);
+        free(p->fn_name);
+        free(p);
+    }
+}
+
+static cs_par_pool* par_pool_get(cs_vm* vm, const char* module, const char* fn_name, int size) {
+    cs_par_pool* p = vm->par_pools;
+    while (p && (strcmp(p->module, module) != 0 || strcmp(p->fn_name, fn_name) != 0)) p = p->next;
+    if (!p) {
+        p = (cs_par_pool*)calloc(1, sizeof(cs_par_pool));
+        if (!p) return NULL;
+        p->module = msg_dup(module, strlen(module));
+        p->fn_name = msg_dup(fn_name, strlen(fn_name));
+        if (!p->module || !p->fn_name) {
+            free(p->module);
+            free(p->fn_name);
+            free(p);
+            return NULL;
+        }
+        p->next = vm->par_pools;
+        vm->par_pools = p;
+    }
+    if (p->size < size) {
+        cs_vm** vms = (cs_vm**)realloc(p->vms, (size_t)size * sizeof(cs_vm*));
+        if (!vms) return NULL;
+        p->vms = vms;
+        cs_value* fns = (cs_value*)realloc(p->fns, (size_t)size * sizeof(cs_value));
+        if (!fns) return NULL;
+        p->fns = fns;
+        for (int i = p->size; i < size; i++) {
+            p->vms[i] = NULL;
+            p->fns[i] = cs_nil();
+        }
+        p->size = size;
+    }
+    return p;
+}
+
+// The pool VM's error without its stack trace, which points into the pool VM.
+static char* par_last_error(cs_vm* vm, const char* fallback) {
+    const char* err = cs_vm_last_error(vm);
+    if (!err) err = fallback;
+    const char* nl = strchr(err, '\n');
+    return msg_dup(err, nl ? (size_t)(nl - err) : strlen(err));
+}
+
+// Creates the VM for one pool slot; returns an error string or NULL.
+static char* par_load(par_job* job, int slot) {
+    cs_par_pool* pool = job->pool;
+    cs_vm* vm = cs_vm_new();
+    if (!vm) return msg_dup("out of memory", 13);
+    cs_register_stdlib(vm);
+    cs_vm_set_code_cache(vm, job->cache);
+
+    cs_value exports = cs_nil();
+    if (cs_vm_require_module(vm, pool->module, &exports) != 0) {
+        char* err = par_last_error(vm, "cannot load module");
+        cs_vm_free(vm);
+        return err;
+    }
+    cs_value fn = cs_map_get(exports, pool->fn_name);
+    cs_value_release(exports);
+    if (fn.type != CS_T_FUNC && fn.type != CS_T_NATIVE) {
+        cs_value_release(fn);
+        cs_vm_free(vm);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s does not export a function '%s'", pool->module, pool->fn_name);
+        return msg_dup(buf, strlen(buf));
+    }
+    pool->vms[slot] = vm;
+    pool->fns[slot] = fn;
+    return NULL;
+}
+
+// Calls fn on one chunk; par_map stores a result per item, par_reduce one per chunk.
+static char* par_run_chunk(par_job* job, cs_vm* vm, cs_value fn, size_t c) {
+    size_t lo = c * job->chunk;
+    size_t hi = lo + job->chunk < job->count ? lo + job->chunk : job->count;
+    cs_value acc = cs_nil();
+    if (job->reduce) acc = msg_take_value(vm, &job->items[lo++]);
+
+    for (size_t i = lo; i < hi; i++) {
+        cs_value args[2];
+        int argc = 0;
+        if (job->reduce) args[argc++] = acc;
+        args[argc++] = msg_take_value(vm, &job->items[i]);
+        cs_value ret = cs_nil();
+        int rc = cs_call_value(vm, fn, argc, args, &ret);
+        for (int k = 0; k < argc; k++) cs_value_release(args[k]);
+        acc = cs_nil();
+        if (rc != 0) return par_last_error(vm, "call failed");
+        if (job->reduce) { acc = ret; continue; }
+
+        int sendable = msg_check(vm, job->fname, ret, 0);
+        int built = sendable && msg_build(ret, &job->results[i], NULL, 1);
+        cs_value_release(ret);
+        if (!sendable) return par_last_error(vm, "result cannot be sent");
+        if (!built) return msg_dup("out of memory", 13);
+    }
+    if (!job->reduce) return NULL;
+
+    int sendable = msg_check(vm, job->fname, acc, 0);
+    int built = sendable && msg_build(acc, &job->results[c], NULL, 1);
+    cs_value_release(acc);
+    if (!sendable) return par_last_error(vm, "result cannot be sent");
+    if (!built) return msg_dup("out of memory", 13);
+    return NULL;
+}
+
+#if !defined(_WIN32)
+typedef struct par_thread {
+    par_job* job;
+    int slot;
+    pthread_t thread;
+} par_thread;
+
+static void par_fail(par_job* job, char* err) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->error) { job->error = err; err = NULL; }
+    pthread_mutex_unlock(&job->lock);
+    free(err);
+}
+
+static int par_claim(par_job* job, size_t* c) {
+    pthread_mutex_lock(&job->lock);
+    int ok = !job->error && job->next_chunk < job->nchunks;
+    if (ok) *c = job->next_chunk++;
+    pthread_mutex_unlock(&job->lock);
+    return ok;
+}
+
+static void* par_main(void* arg) {
+    par_thread* t = (par_thread*)arg;
+    par_job* job = t->job;
+    cs_par_pool* pool = job->pool;
+    if (!pool->vms[t->slot]) {
+        char* err = par_load(job, t->slot);
+        if (err) { par_fail(job, err); return NULL; }
+    }
+    size_t c;
+    while (par_claim(job, &c)) {
+        char* err = par_run_chunk(job, pool->vms[t->slot], pool->fns[t->slot], c);
+        if (err) { par_fail(job, err); break; }
+    }
+    return NULL;
+}
+
+static int par_default_workers(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > CS_PAR_MAX_WORKERS ? CS_PAR_MAX_WORKERS : (int)n;
+}
+#endif
+
+static void par_error(cs_vm* vm, const char* fname, const char* err) {
+    size_t n = strlen(fname) + strlen(err) + 8;
+    char* buf = (char*)malloc(n);
+    if (!buf) { cs_error(vm, err); return; }
+    snprintf(buf, n, "%s(): %s", fname, err);
+    cs_error(vm, buf);
+    free(buf);
+}
+
+// par_map(list, fn_name, module_path, opts?) / par_reduce(...): opts is
+// {workers, chunk} and, for par_reduce, init.
+static int par_call(cs_vm* vm, int reduce, int argc, const cs_value* argv, cs_value* out) {
+    const char* fname = reduce ? "par_reduce" : "par_map";
+    char buf[160];
+    if (argc < 3 || argc > 4 || argv[0].type != CS_T_LIST || argv[1].type != CS_T_STR || argv[2].type != CS_T_STR ||
+        (argc == 4 && argv[3].type != CS_T_MAP && argv[3].type != CS_T_NIL)) {
+        snprintf(buf, sizeof(buf), "%s() requires (list, fn_name, module_path, opts?)", fname);
+        cs_error(vm, buf);
+        return 1;
+    }
+#if defined(_WIN32)
+    (void)out;
+    par_error(vm, fname, "parallel workers are not supported on this platform");
+    return 1;
+#else
+    cs_value init = cs_nil();
+    int has_init = 0;
+    int64_t workers = par_default_workers();
+    int64_t chunk = 0;
+    if (argc == 4 && argv[3].type == CS_T_MAP) {
+        cs_value v = cs_map_get(argv[3], "workers");
+        if (v.type == CS_T_INT) workers = v.as.i;
+        cs_value_release(v);
+        v = cs_map_get(argv[3], "chunk");
+        if (v.type == CS_T_INT) chunk = v.as.i;
+        cs_value_release(v);
+        if (reduce && cs_map_has(argv[3], "init")) {
+            init = cs_map_get(argv[3], "init");
+            has_init = 1;
+        }
+    }
+    if (workers < 1 || workers > CS_PAR_MAX_WORKERS || chunk < 0) {
+        cs_value_release(init);
+        par_error(vm, fname, "workers must be 1..256 and chunk >= 0");
+        return 1;
+    }
+
+    cs_list_obj* list = (cs_list_obj*)argv[0].as.p;
+    size_t count = list->len;
+    if (count == 0) {
+        if (out) *out = reduce ? init : cs_list(vm);
+        else cs_value_release(init);
+        return 0;
+    }
+    if (!msg_check(vm, fname, argv[0], 0) || (has_init && !msg_check(vm, fname, init, 0))) {
+        cs_value_release(init);
+        return 1;
+    }
+
+    char* module = worker_resolve_path(vm, cs_to_cstr(argv[2]));
+    cs_par_pool* pool = module ? par_pool_get(vm, module, cs_to_cstr(argv[1]), (int)workers) : NULL;
+    free(module);
+    if (!pool) {
+        cs_value_release(init);
+        par_error(vm, fname, "out of memory");
+        return 1;
+    }
+
+    par_job job;
+    memset(&job, 0, sizeof(job));
+    job.pool = pool;
+    job.cache = vm->code_cache;
+    job.fname = fname;
+    job.reduce = reduce;
+    job.count = count;
+    job.chunk = chunk > 0 ? (size_t)chunk : (count + (size_t)workers * CS_PAR_CHUNKS_PER_WORKER - 1) / ((size_t)workers * CS_PAR_CHUNKS_PER_WORKER);
+    job.nchunks = (count + job.chunk - 1) / job.chunk;
+    job.items = (cs_msg*)calloc(count, sizeof(cs_msg));
+    job.results = (cs_msg*)calloc(reduce ? job.nchunks : count, sizeof(cs_msg));
+    int nthreads = (size_t)workers < job.nchunks ? (int)workers : (int)job.nchunks;
+    par_thread* threads = (par_thread*)calloc((size_t)nthreads, sizeof(par_thread));
+    int built = job.items && job.results && threads;
+    for (size_t i = 0; built && i < count; i++) built = msg_build(list->items[i], &job.items[i], NULL, 0);
+
+    int started = 0;
+    if (built) {
+        pthread_mutex_init(&job.lock, NULL);
+        for (int i = 0; i < nthreads; i++) {
+            threads[i].job = &job;
+            threads[i].slot = i;
+            if (pthread_create(&threads[i].thread, NULL, par_main, &threads[i]) != 0) break;
+            started++;
+        }
+        for (int i = 0; i < started; i++) pthread_join(threads[i].thread, NULL);
+        pthread_mutex_destroy(&job.lock);
+    }
+    if (job.items) for (size_t i = 0; i < count; i++) msg_clear(&job.items[i]);
+    free(job.items);
+    free(threads);
+
+    const char* err = job.error;
+    if (!built) err = "out of memory";
+    else if (!started) err = "cannot start threads";
+
+    cs_value result = cs_nil();
+    if (!err && !reduce) {
+        result = cs_list(vm);
+        for (size_t i = 0; i < count; i++) {
+            cs_value item = msg_take_value(vm, &job.results[i]);
+            cs_list_push(result, item);
+            cs_value_release(item);
+        }
+    } else if (!err) {
+        // Fold the per-chunk results in order on slot 0's VM; its thread has finished.
+        // Its errors are reported like the workers', without that VM's stack trace.
+        cs_vm* rvm = pool->vms[0];
+        cs_msg m;
+        size_t c = 0;
+        cs_value acc = cs_nil();
+        if (!has_init) acc = msg_take_value(rvm, &job.results[c++]);
+        else if (msg_build(init, &m, NULL, 0)) acc = msg_take_value(rvm, &m);
+        else err = "out of memory";
+        for (; c < job.nchunks && !err; c++) {
+            cs_value args[2] = { acc, msg_take_value(rvm, &job.results[c]) };
+            if (cs_call_value(rvm, pool->fns[0], 2, args, &acc) != 0) err = job.error = par_last_error(rvm, "reduce failed");
+            cs_value_release(args[0]);
+            cs_value_release(args[1]);
+        }
+        if (!err && !msg_check(rvm, fname, acc, 0)) err = job.error = par_last_error(rvm, "result cannot be sent");
+        if (!err && !msg_build(acc, &m, NULL, 1)) err = "out of memory";
+        cs_value_release(acc);
+        if (!err) result = msg_take_value(vm, &m);
+    }
+    if (err) par_error(vm, fname, err);
+
+    if (job.results) for (size_t i = 0; i < (reduce ? job.nchunks : count); i++) msg_clear(&job.results[i]);
+    free(job.results);
+    free(job.error);
+    cs_value_release(init);
+    if (err) { cs_value_release(result); return 1; }
+    if (out) *out = result;
+    else cs_value_release(result);
+    return 0;
+#endif
+}
+
+static int nf_par_map(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return par_call(vm, 0, argc, argv, out);
+}
+
+static int nf_par_reduce(cs_vm* vm, void* ud, int argc, const cs_value* argv, cs_value* out) {
+    (void)ud;
+    return par_call(vm, 1, argc, argv, out);
+}
+
+void cs_register_worker_stdlib(cs_vm* vm) {
+    cs_register_native(vm, "worker_spawn", nf_worker_spawn, NULL);
+    cs_register_native(vm, "worker_post", nf_worker_post, NULL);
+    cs_register_native(vm, "worker_on_message", nf_worker_on_message, NULL);
+    cs_register_native(vm, "worker_on_error", nf_worker_on_error, NULL);
+    cs_register_native(vm, "worker_terminate", nf_worker_terminate, NULL);
+    cs_register_native(vm, "par_map", nf_par_map, NULL);
+    cs_register_native(vm, "par_reduce", nf_par_reduce, NULL);
+}
@@ -0,0 +1,16 @@
+#ifndef CS_WORKER_H
+#define CS_WORKER_H
+
+#include "cupidscript.h"
+
+// Worker threads: worker_spawn(path) runs a script in a fresh VM on its own thread.
+// Values sent between VMs are copied; bytes buffers are moved.
+
+// Register worker_* stdlib functions
+void cs_register_worker_stdlib(cs_vm* vm);
+
+// Stop and join every worker spawned by vm, then settle their replies. Called by
+// cs_vm_free with vm->tearing_down set.
+void cs_worker_shutdown_all(cs_vm* vm);
+
+#endif
@@ -25,7 +25,8 @@ typedef enum {
     CS_T_FUNC,
     CS_T_NATIVE,
     CS_T_PROMISE,
-    CS_T_TUPLE
+    CS_T_TUPLE,
+    CS_T_ITER
 } cs_type;
 
 typedef struct {
@@ -56,6 +57,17 @@ int cs_vm_run_string(cs_vm* vm, const char* code, const char* virtual_name);
 // Module loader: executes a file once and returns its exports map.
 // Path should generally be absolute or already resolved by the host.
 int cs_vm_require_module(cs_vm* vm, const char* path, cs_value* exports_out);
+// Shared code cache: parsed files are kept once and reused by every VM attached to the
+// cache, including VMs running on other threads. Each VM still gets a private copy of
+// the tree, so nothing a script does is visible to other VMs. Entries are re-parsed
+// when the file's size or modification time changes. The cache is reference counted:
+// cs_code_cache_free drops the creator's reference and each attached VM holds one.
+typedef struct cs_code_cache cs_code_cache;
+cs_code_cache* cs_code_cache_new(void);
+void cs_code_cache_free(cs_code_cache* cache);
+void cs_code_cache_stats(cs_code_cache* cache, uint64_t* hits, uint64_t* misses);
+// Attach before loading code; NULL detaches. Used by run_file, load_file and require.
+void cs_vm_set_code_cache(cs_vm* vm, cs_code_cache* cache);
 // Cycle collection for refcounted containers (lists/maps). Returns number of objects collected.
 size_t cs_vm_collect_cycles(cs_vm* vm);
 
@@ -67,6 +79,14 @@ void cs_vm_set_gc_alloc_trigger(cs_vm* vm, size_t interval); // collect every N
 int cs_call(cs_vm* vm, const char* func_name, int argc, const cs_value* argv, cs_value* out);
 int cs_call_value(cs_vm* vm, cs_value callee, int argc, const cs_value* argv, cs_value* out);
 
+// Prepared calls: resolve a global function once and invoke it repeatedly without the
+// per-call name lookup. The handle pins the function value it found; free it before
+// cs_vm_free. Returns NULL if the name is undefined or not callable.
+typedef struct cs_callable cs_callable;
+cs_callable* cs_prepare_call(cs_vm* vm, const char* func_name);
+int  cs_callable_invoke(cs_vm* vm, cs_callable* h, int argc, const cs_value* argv, cs_value* out);
+void cs_callable_free(cs_callable* h);
+
 // Register native functions (for CupidFM to expose API)
 void cs_register_native(cs_vm* vm, const char* name, cs_native_fn fn, void* userdata);
 // Register global values (constants, etc.)
@@ -88,6 +108,14 @@ cs_value cs_set(cs_vm* vm);
 cs_value cs_strbuf(cs_vm* vm);
 cs_value cs_bytes(cs_vm* vm, const uint8_t* data, size_t len);
 cs_value cs_bytes_take(cs_vm* vm, uint8_t* owned, size_t len);
+// Wrap a host buffer without copying. release(userdata, data, len) runs when the
+// value is freed, or when a script write grows it past len (it is copied first).
+// In-place writes from script land in the host buffer.
+// With release == NULL the VM owns data exactly as with cs_bytes_take: it may
+// realloc() it and free()s it at the end, so it must come from malloc(). Never
+// pass stack, arena or static memory without a release callback.
+typedef void (*cs_bytes_release_fn)(void* userdata, uint8_t* data, size_t len);
+cs_value cs_bytes_wrap(cs_vm* vm, uint8_t* data, size_t len, cs_bytes_release_fn release, void* userdata);
 
 // Tuple operations
 cs_value cs_tuple(cs_vm* vm, size_t field_count); // Create empty tuple
@@ -127,6 +155,14 @@ int cs_map_has(cs_value map_val, const char* key);  // returns 1 if key exists
 int cs_map_del(cs_value map_val, const char* key);  // returns 0 on success
 cs_value cs_map_keys(cs_vm* vm, cs_value map_val);  // returns list of keys
 
+// Bulk marshalling (one allocation per container instead of one push/set per item)
+cs_value cs_list_from_int64s(cs_vm* vm, const int64_t* items, size_t count);
+cs_value cs_list_from_cstrs(cs_vm* vm, const char* const* items, size_t count);  // NULL items become nil
+// Keys are interned like field names (use it for records, not for unbounded key sets).
+cs_value cs_map_from_pairs(cs_vm* vm, const char* const* keys, const cs_value* vals, size_t count);
+// Copies leading int items into out (up to cap); returns how many were copied.
+size_t cs_list_to_int64s(cs_value list_val, int64_t* out, size_t cap);
+
 // Generalized key variants (use any value as key)
 cs_value cs_map_get_value(cs_value map_val, cs_value key);  // returns cs_nil() if missing
 int cs_map_set_value(cs_value map_val, cs_value key, cs_value value);  // returns 0 on success
@@ -143,6 +179,18 @@ void cs_vm_interrupt(cs_vm* vm);
 // Get current instruction count (useful for profiling).
 uint64_t cs_vm_get_instruction_count(cs_vm* vm);
 
+// Time-sliced execution (for hosts with a frame or event loop of their own)
+#define CS_YIELDED 1
+// Parse a program and queue it without running it. Only one program can be queued.
+int cs_vm_load_string(cs_vm* vm, const char* code, const char* virtual_name);
+int cs_vm_load_file(cs_vm* vm, const char* path);
+// Run the queued program for about budget_us microseconds (0 = until it finishes).
+// Returns CS_YIELDED when the budget ran out, 0 once the program has finished
+// (or when nothing is queued), and -1 on error.
+int cs_vm_run_slice(cs_vm* vm, uint64_t budget_us);
+// Continue the queued program with the budget of the previous slice.
+int cs_vm_resume(cs_vm* vm);
+
 #ifdef __cplusplus
 }
 #endif
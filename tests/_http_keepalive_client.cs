@@ -0,0 +1,61 @@
+// Worker script for the http_* tests: the client side, so the main VM can serve.
+
+// True once data holds complete responses up to one that closes the connection. Reading
+// to EOF would need a catch around socket_recv, which rejects once the peer has closed.
+fn closed_response(data) {
+  let rest = data;
+  while (true) {
+    let head_end = str_find(rest, "\r\n\r\n");
+    if (head_end < 0) { return false; }
+    let head = str_lower(substr(rest, 0, head_end));
+    let body_len = 0;
+    let at = str_find(head, "content-length: ");
+    if (at >= 0) {
+      let value = substr(head, at + 16, len(head));
+      let eol = str_find(value, "\r\n");
+      body_len = to_int(eol < 0 ? value : substr(value, 0, eol));
+    }
+    let used = head_end + 4 + body_len;
+    if (len(rest) < used) { return false; }
+    if (str_find(head, "connection: close") >= 0) { return true; }
+    rest = substr(rest, used, len(rest));
+  }
+}
+
+// Sends data on a new connection and returns what arrives up to the closing response.
+// A list of strings is sent in parts, a little apart.
+async fn raw(port, data) {
+  let s = await tcp_connect("127.0.0.1", port);
+  if (typeof(data) == "list") {
+    for i in range(len(data)) {
+      if (i > 0) { await sleep(20); }
+      await socket_send(s, data[i]);
+    }
+  } else {
+    await socket_send(s, data);
+  }
+  let got = "";
+  while (!closed_response(got)) { got = got + await socket_recv(s, 65536); }
+  socket_close(s);
+  return got;
+}
+
+async fn run(msg) {
+  if (msg.config != nil) { http_pool_config(msg.config); }
+  if (msg.delay != nil) { await sleep(msg.delay); }
+  let out = [];
+  if (msg.raw != nil) {
+    for data in msg.raw { push(out, await raw(msg.port, data)); }
+  } else if (msg.parallel) {
+    let ps = [];
+    for opts in msg.reqs { push(ps, http_request_async(opts)); }
+    out = await await_all(ps);
+  } else {
+    for opts in msg.reqs {
+      push(out, msg.sync ? http_request(opts) : await http_request_async(opts));
+    }
+  }
+  return {resps: out, stats: http_pool_stats()};
+}
+
+on_message(fn(msg) { return run(msg); });
@@ -0,0 +1,18 @@
+// Module for par_map.cs; loaded once into every pool VM.
+
+let loads = 0;
+loads += 1;
+
+export square = fn(x) { return x * x; };
+export add = fn(a, b) { return a + b; };
+export size = fn(b) { return len(b); };
+export word_count = fn(doc) { return len(str_split(doc.text, " ")); };
+export loaded = fn(x) { return loads; };
+export fold_fail = fn(a, b) {
+  if (len(a) > 1 && len(b) > 1) { throw "bad fold"; }
+  return a + b;
+};
+export fail = fn(x) {
+  if (x == 3) { throw "bad item"; }
+  return x;
+};
@@ -0,0 +1,4 @@
+// Worker script for tls_resume.cs: runs a server script in the foreground so this
+// process stays its parent and reaps it once it is killed.
+
+on_message(fn(msg) { return subprocess("sh", [msg.script]).code; });
@@ -0,0 +1,29 @@
+// Worker script for workers.cs: answers worker_post() requests.
+
+let calls = 0;
+
+async fn slow_double(x) {
+  await sleep(5);
+  return x * 2;
+}
+
+on_message(fn(msg) {
+  calls += 1;
+  if (msg.op == "echo") { return msg.value; }
+  if (msg.op == "sum") {
+    let total = 0;
+    for i in range(msg.n) { total += i; }
+    return total;
+  }
+  if (msg.op == "double") { return slow_double(msg.value); }
+  if (msg.op == "progress") {
+    for i in range(3) { post_message({step: i}); }
+    return "done";
+  }
+  if (msg.op == "size") { return len(msg.value); }
+  if (msg.op == "calls") { return calls; }
+  if (msg.op == "fail") { throw "bad request"; }
+  if (msg.op == "leak") { return fn() => 1; }
+  if (msg.op == "spin") { while (true) { } }
+  return nil;
+});
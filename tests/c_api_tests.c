@@ -3,6 +3,12 @@
 #include "cs_parser.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 static cs_value g_stored = {0};
 
@@ -28,6 +34,60 @@ static int expect_true(int cond, const char* msg) {
     return 0;
 }
 
+static int g_released = 0;
+
+static void release_buf(void* ud, uint8_t* data, size_t len) {
+    (void)data; (void)len;
+    g_released += *(int*)ud;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+#if !defined(_WIN32)
+// One thread of the isolate stress test: several VMs in turn, all sharing one code cache.
+typedef struct {
+    cs_code_cache* cache;
+    const char* path;
+    int seed;
+    int failures;
+} iso_job;
+
+static void* iso_worker(void* p) {
+    iso_job* job = (iso_job*)p;
+    for (int round = 0; round < 4; round++) {
+        cs_vm* v = cs_vm_new();
+        if (!v) { job->failures++; continue; }
+        cs_register_stdlib(v);
+        cs_vm_set_code_cache(v, job->cache);
+        int64_t seed = job->seed * 10 + round;
+        cs_value arg = cs_int(seed), out = cs_nil();
+        if (cs_vm_run_file(v, job->path) != 0 || cs_call(v, "run", 1, &arg, &out) != 0) {
+            fprintf(stderr, "isolate error: %s\n", cs_vm_last_error(v));
+            job->failures++;
+        } else {
+            int64_t n = seed * seed + 4 + seed + 2997;
+            int digits = 0;
+            for (int64_t t = n; t > 0; t /= 10) digits++;
+            if (out.type != CS_T_INT || out.as.i != n + 1 + digits) job->failures++;
+        }
+        cs_value_release(out);
+        cs_vm_free(v);
+    }
+    return NULL;
+}
+
+static int write_text(const char* path, const char* text) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    fputs(text, f);
+    return fclose(f);
+}
+#endif
+
 int main(void) {
     int rc = 0;
 
@@ -113,6 +173,314 @@ int main(void) {
         cs_value_release(out);
     }
 
+    // Prepared call handles resolve once and are reused across invocations.
+    cs_vm_set_instruction_limit(vm, 0);
+    cs_vm_set_timeout(vm, 0);
+    const char* hooks =
+        "let seen = 0;\n"
+        "fn on_event(kind, n) { seen += n; return kind + \":\" + to_str(seen); }\n"
+        "fn make_counter(start) { let c = start; return fn() { c += 1; return c; }; }\n"
+        "fn on_tick(n) { return n; }\n";
+
+    if (cs_vm_run_string(vm, hooks, "<c_api_tests>") != 0) {
+        fprintf(stderr, "script error: %s\n", cs_vm_last_error(vm));
+        rc |= 1;
+    } else {
+        rc |= expect_true(cs_prepare_call(vm, "no_such_fn") == NULL, "cs_prepare_call undefined");
+        rc |= expect_true(cs_prepare_call(vm, "seen") == NULL, "cs_prepare_call non-function");
+
+        cs_callable* ev = cs_prepare_call(vm, "on_event");
+        rc |= expect_true(ev != NULL, "cs_prepare_call");
+        if (ev) {
+            cs_value out = cs_nil();
+            cs_value argv[2] = { cs_str(vm, "key"), cs_int(2) };
+            rc |= expect_true(cs_callable_invoke(vm, ev, 2, argv, &out) == 0, "cs_callable_invoke rc");
+            rc |= expect_true(out.type == CS_T_STR && strcmp(cs_to_cstr(out), "key:2") == 0, "cs_callable_invoke result");
+            cs_value_release(out);
+            rc |= expect_true(cs_callable_invoke(vm, ev, 2, argv, &out) == 0, "cs_callable_invoke again");
+            rc |= expect_true(out.type == CS_T_STR && strcmp(cs_to_cstr(out), "key:4") == 0, "cs_callable_invoke reuses state");
+            cs_value_release(out);
+            rc |= expect_true(cs_callable_invoke(vm, ev, 0, NULL, &out) != 0, "cs_callable_invoke argc error");
+
+            cs_value_release(argv[0]);
+            cs_callable_free(ev);
+        }
+
+        // Measure per-call latency of a trivial hook against name lookup through cs_call.
+        cs_callable* tick = cs_prepare_call(vm, "on_tick");
+        rc |= expect_true(tick != NULL, "cs_prepare_call on_tick");
+        if (tick) {
+            const int iters = 50000;
+            int failures = 0;
+            cs_value arg = cs_int(7);
+            double t0 = now_ns();
+            for (int i = 0; i < iters; i++) failures += cs_call(vm, "on_tick", 1, &arg, NULL) != 0;
+            double t1 = now_ns();
+            for (int i = 0; i < iters; i++) failures += cs_callable_invoke(vm, tick, 1, &arg, NULL) != 0;
+            double t2 = now_ns();
+            rc |= expect_true(failures == 0, "timed calls succeed");
+            printf("cs_call: %.0f ns/call, cs_callable_invoke: %.0f ns/call\n",
+                   (t1 - t0) / iters, (t2 - t1) / iters);
+            cs_callable_free(tick);
+        }
+
+        // Closures created during a prepared call outlive the reused call env.
+        cs_callable* mk = cs_prepare_call(vm, "make_counter");
+        rc |= expect_true(mk != NULL, "cs_prepare_call make_counter");
+        if (mk) {
+            cs_value c1 = cs_nil(), c2 = cs_nil(), out = cs_nil();
+            cs_value a1 = cs_int(10), a2 = cs_int(100);
+            rc |= expect_true(cs_callable_invoke(vm, mk, 1, &a1, &c1) == 0, "make_counter 1");
+            rc |= expect_true(cs_callable_invoke(vm, mk, 1, &a2, &c2) == 0, "make_counter 2");
+            (void)cs_call_value(vm, c1, 0, NULL, &out);
+            rc |= expect_true(out.type == CS_T_INT && out.as.i == 11, "first counter kept its binding");
+            (void)cs_call_value(vm, c2, 0, NULL, &out);
+            rc |= expect_true(out.type == CS_T_INT && out.as.i == 101, "second counter kept its binding");
+            cs_value_release(c1);
+            cs_value_release(c2);
+            cs_callable_free(mk);
+        }
+        cs_callable_free(NULL);
+    }
+
+    // Bulk marshalling helpers.
+    {
+        int64_t nums[5] = { 1, -2, 3, 40000000000LL, 5 };
+        cs_value li = cs_list_from_int64s(vm, nums, 5);
+        rc |= expect_true(cs_list_len(li) == 5, "cs_list_from_int64s len");
+        int64_t back[8] = {0};
+        rc |= expect_true(cs_list_to_int64s(li, back, 8) == 5 && back[3] == 40000000000LL, "cs_list_to_int64s");
+        rc |= expect_true(cs_list_to_int64s(li, back, 2) == 2, "cs_list_to_int64s cap");
+        cs_list_set(li, 2, cs_float(1.5));
+        rc |= expect_true(cs_list_to_int64s(li, back, 8) == 2, "cs_list_to_int64s stops at non-int");
+        cs_value_release(li);
+
+        const char* names[3] = { "a.txt", NULL, "c" };
+        cs_value ls = cs_list_from_cstrs(vm, names, 3);
+        cs_value s0 = cs_list_get(ls, 0), s1 = cs_list_get(ls, 1);
+        rc |= expect_true(s0.type == CS_T_STR && strcmp(cs_to_cstr(s0), "a.txt") == 0, "cs_list_from_cstrs item");
+        rc |= expect_true(s1.type == CS_T_NIL, "cs_list_from_cstrs NULL item");
+        cs_value_release(s0);
+        cs_value_release(ls);
+
+        const char* keys[3] = { "name", "size", "name" };
+        cs_value vals[3] = { cs_str(vm, "x"), cs_int(12), cs_str(vm, "y") };
+        cs_value mp = cs_map_from_pairs(vm, keys, vals, 3);
+        cs_value got = cs_map_get(mp, "name");
+        rc |= expect_true(cs_map_len(mp) == 2 && got.type == CS_T_STR && strcmp(cs_to_cstr(got), "y") == 0, "cs_map_from_pairs last key wins");
+        cs_value_release(got);
+        cs_value_release(vals[0]);
+        cs_value_release(vals[2]);
+        cs_value_release(mp);
+
+        uint8_t host_buf[4] = { 1, 2, 3, 4 };
+        int one = 1;
+        cs_value wb = cs_bytes_wrap(vm, host_buf, 4, release_buf, &one);
+        rc |= expect_true(wb.type == CS_T_BYTES, "cs_bytes_wrap type");
+        cs_register_global(vm, "wrapped", wb);
+        const char* touch =
+            "assert(len(wrapped) == 4 && wrapped[3] == 4, \"wrapped read\");\n"
+            "wrapped[0] = 9;\n"
+            "wrapped[6] = 7;\n"
+            "assert(len(wrapped) == 7 && wrapped[0] == 9 && wrapped[2] == 3, \"wrapped grow\");\n";
+        if (cs_vm_run_string(vm, touch, "<c_api_tests>") != 0) {
+            fprintf(stderr, "script error: %s\n", cs_vm_last_error(vm));
+            rc |= 1;
+        }
+        rc |= expect_true(host_buf[0] == 9, "cs_bytes_wrap writes land in host buffer");
+        rc |= expect_true(g_released == 1, "cs_bytes_wrap released on grow");
+        cs_value_release(wb);
+
+        int two = 2;
+        cs_value wb2 = cs_bytes_wrap(vm, host_buf, 4, release_buf, &two);
+        cs_value_release(wb2);
+        rc |= expect_true(g_released == 3, "cs_bytes_wrap released on free");
+    }
+
+    // Time-sliced execution: a long program pauses at its budget and resumes in place.
+    {
+        rc |= expect_true(cs_vm_run_slice(vm, 1000) == 0, "cs_vm_run_slice with nothing loaded");
+        const char* prog =
+            "fn slice_sum(n) { let t = 0; for i in range(n) { t += i; } return t; }\n"
+            "fn slice_gen(n) { for i in range(n) { yield i * 2; } }\n"
+            "async fn slice_later() { await sleep(20); return 7; }\n"
+            "let a = slice_sum(200000);\n"
+            "let b = 0;\n"
+            "for v in slice_gen(100000) { b += v; }\n"
+            "let c = await slice_later();\n"
+            "store([a, b, c]);\n";
+        rc |= expect_true(cs_vm_load_string(vm, prog, "<slice>") == 0, "cs_vm_load_string");
+        rc |= expect_true(cs_vm_load_string(vm, "1;", "<slice2>") != 0, "only one program can be loaded");
+
+        int slices = 1;
+        double worst = 0;
+        double t0 = now_ns();
+        int r = cs_vm_run_slice(vm, 2000);
+        worst = now_ns() - t0;
+        while (r == CS_YIELDED && slices < 100000) {
+            // The host can call into the VM between slices.
+            cs_value arg = cs_int(3), out = cs_nil();
+            if (cs_call(vm, "on_tick", 1, &arg, &out) != 0 || out.type != CS_T_INT || out.as.i != 3) {
+                rc |= expect_true(0, "host call between slices");
+                break;
+            }
+            t0 = now_ns();
+            r = cs_vm_resume(vm);
+            double dt = now_ns() - t0;
+            if (dt > worst) worst = dt;
+            slices++;
+        }
+        if (r != 0) fprintf(stderr, "slice error: %s\n", cs_vm_last_error(vm));
+        rc |= expect_true(r == 0, "sliced program finishes");
+        rc |= expect_true(slices > 1, "sliced program yielded");
+        rc |= expect_true(cs_vm_resume(vm) == 0, "resume after finish is a no-op");
+        cs_value a = cs_list_get(g_stored, 0), b = cs_list_get(g_stored, 1), c = cs_list_get(g_stored, 2);
+        rc |= expect_true(a.type == CS_T_INT && a.as.i == 19999900000LL, "sliced loop result");
+        rc |= expect_true(b.type == CS_T_INT && b.as.i == 9999900000LL, "sliced generator result");
+        rc |= expect_true(c.type == CS_T_INT && c.as.i == 7, "sliced await result");
+        printf("time slices: %d slices of 2ms, longest %.2fms\n", slices, worst / 1e6);
+
+        rc |= expect_true(cs_vm_load_string(vm, "let boom = 1;\nthrow \"sliced\";\n", "<slice3>") == 0, "load failing program");
+        r = cs_vm_run_slice(vm, 0);
+        rc |= expect_true(r == -1 && strstr(cs_vm_last_error(vm), "sliced") != NULL, "sliced program error");
+
+        // Recursion on the slice stack: deep is fine, runaway stops with an error
+        rc |= expect_true(cs_vm_load_string(vm,
+            "fn rec(n) { if (n == 0) { return 0; } return 1 + rec(n - 1); }\n"
+            "assert(rec(3000) == 3000, \"deep\");\n"
+            "rec(100000000);\n", "<slice4>") == 0, "load recursive program");
+        r = cs_vm_run_slice(vm, 0);
+        rc |= expect_true(r == -1 && strstr(cs_vm_last_error(vm), "maximum call depth exceeded") != NULL, "sliced recursion limit");
+    }
+
+    // Isolates: 64 threads, each running VMs that share one parsed-code cache.
+#if !defined(_WIN32)
+    {
+        char dir[] = "/tmp/cs_isolatesXXXXXX";
+        char lib_path[64], plugin_path[64];
+        rc |= expect_true(mkdtemp(dir) != NULL, "mkdtemp");
+        snprintf(lib_path, sizeof(lib_path), "%s/iso_lib.cs", dir);
+        snprintf(plugin_path, sizeof(plugin_path), "%s/plugin.cs", dir);
+        write_text(lib_path,
+            "class Counter {\n"
+            "  fn new(start) { self.n = start; }\n"
+            "  fn add(k) { self.n = self.n + k; return self; }\n"
+            "}\n"
+            "struct Pt { x, y = 0 }\n"
+            "export make = fn(start) => Counter(start);\n"
+            "export pt = fn(x, y) => Pt(x, y);\n"
+            "export norm = fn(p) { return p.x * p.x + p.y * p.y; };\n");
+        write_text(plugin_path,
+            "let lib = require(\"iso_lib.cs\");\n"
+            "fn run(seed) {\n"
+            "  let c = lib.make(seed);\n"
+            "  for i in range(1000) { c.add(i % 7); }\n"
+            "  let add = fn(x) => x + c.n;\n"
+            "  let v = add(lib.norm(lib.pt(seed, 2)));\n"
+            "  let s = \"v\" + to_str(v);\n"
+            "  return v + len(s);\n"
+            "}\n");
+
+        cs_code_cache* cache = cs_code_cache_new();
+        rc |= expect_true(cache != NULL, "cs_code_cache_new");
+        enum { ISO_THREADS = 64 };
+        pthread_t threads[ISO_THREADS];
+        iso_job jobs[ISO_THREADS];
+        double t0 = now_ns();
+        for (int i = 0; i < ISO_THREADS; i++) {
+            jobs[i].cache = cache;
+            jobs[i].path = plugin_path;
+            jobs[i].seed = i;
+            jobs[i].failures = 0;
+            if (pthread_create(&threads[i], NULL, iso_worker, &jobs[i]) != 0) {
+                jobs[i].failures = 1;
+                threads[i] = pthread_self();
+            }
+        }
+        int failures = 0;
+        for (int i = 0; i < ISO_THREADS; i++) {
+            if (!pthread_equal(threads[i], pthread_self())) pthread_join(threads[i], NULL);
+            failures += jobs[i].failures;
+        }
+        double elapsed = now_ns() - t0;
+        uint64_t hits = 0, misses = 0;
+        cs_code_cache_stats(cache, &hits, &misses);
+        rc |= expect_true(failures == 0, "isolated VMs on threads");
+        rc |= expect_true(hits + misses == ISO_THREADS * 4 * 2 && hits >= misses, "shared code cache hits");
+        printf("isolates: %d threads x 4 VMs in %.1fms, cache %llu hits / %llu misses\n",
+               ISO_THREADS, elapsed / 1e6, (unsigned long long)hits, (unsigned long long)misses);
+
+        // A changed file is parsed again; VMs still holding the old tree are unaffected.
+        cs_vm* held = cs_vm_new();
+        cs_register_stdlib(held);
+        cs_vm_set_code_cache(held, cache);
+        rc |= expect_true(cs_vm_run_file(held, plugin_path) == 0, "run plugin before edit");
+        write_text(lib_path, "export make = fn(s) { return {n: -1, add: fn(k) => nil}; };\nexport pt = fn(x, y) => x;\nexport norm = fn(p) => 0;\n");
+        cs_vm* fresh = cs_vm_new();
+        cs_register_stdlib(fresh);
+        cs_vm_set_code_cache(fresh, cache);
+        cs_code_cache_free(cache);  // the VMs keep it alive
+        cs_value arg = cs_int(3), out = cs_nil();
+        rc |= expect_true(cs_vm_run_file(fresh, plugin_path) == 0 && cs_call(fresh, "run", 1, &arg, &out) == 0, "run plugin after edit");
+        rc |= expect_true(out.type == CS_T_INT && out.as.i == -1 + 3, "edited module re-parsed");
+        cs_value_release(out);
+        rc |= expect_true(cs_call(held, "run", 1, &arg, &out) == 0 && out.type == CS_T_INT && out.as.i == 3013 + 5, "old tree still runs");
+        cs_value_release(out);
+        cs_vm_free(fresh);
+        cs_vm_free(held);
+        remove(lib_path);
+        remove(plugin_path);
+        rmdir(dir);
+    }
+#endif
+
+    // A field key interned by one VM is still found by content in another VM's instance shapes.
+    {
+        cs_vm* a = cs_vm_new();
+        cs_vm* b = cs_vm_new();
+        cs_register_stdlib(a);
+        cs_register_stdlib(b);
+        cs_value rec = cs_nil(), keys = cs_nil(), out = cs_nil();
+        int ok = cs_vm_run_string(a, "fn rec() { return {name: 1}; }", "<shape_a>") == 0
+              && cs_vm_run_string(b, "struct P { name }\nfn get(k) { let p = P(2); return p[k]; }", "<shape_b>") == 0
+              && cs_call(a, "rec", 0, NULL, &rec) == 0;
+        if (ok) {
+            keys = cs_map_keys(a, rec);
+            cs_value k = cs_list_get(keys, 0);
+            ok = cs_call(b, "get", 1, &k, &out) == 0;
+        }
+        rc |= expect_true(ok && out.type == CS_T_INT && out.as.i == 2, "foreign interned key lookup");
+        cs_value_release(out);
+        cs_value_release(keys);
+        cs_value_release(rec);
+        cs_vm_free(b);
+        cs_vm_free(a);
+    }
+
+    // Arity errors release the call env once on every call path; repeat them so a double
+    // free reliably aborts instead of slipping through as an expected failure.
+    {
+        cs_vm* v = cs_vm_new();
+        cs_register_stdlib(v);
+        const char* defs =
+            "fn two(a, b = 1) { return a + b; }\n"
+            "fn gen(a) { yield a; }\n"
+            "class C { fn new(a) { self.a = a; } fn m(a, b) { return a; } }\n"
+            "class D : C { fn new(a) { super.new(a); } }\n"
+            "let o = {f: fn(a, b) { return a + b; }};\n"
+            "let c = C(1);\n"
+            "let f = two;\n";
+        const char* calls[] = { "two();", "f();", "gen();", "C();", "D();", "c.m(1);", "c[\"m\"](1);", "o.f(1);" };
+        int ok = cs_vm_run_string(v, defs, "<arity>") == 0;
+        for (int round = 0; ok && round < 50; round++) {
+            for (size_t i = 0; i < sizeof(calls) / sizeof(calls[0]); i++) {
+                if (cs_vm_run_string(v, calls[i], "<arity>") == 0) ok = 0;
+            }
+        }
+        rc |= expect_true(ok && strstr(cs_vm_last_error(v), "argument") != NULL, "arity errors on every call path");
+        cs_vm_free(v);
+    }
+
     // Exercise stack trace capture (basic sanity: returns a value).
     cs_value st = cs_capture_stack_trace(vm);
     rc |= expect_true(st.type == CS_T_LIST || st.type == CS_T_NIL, "cs_capture_stack_trace type");
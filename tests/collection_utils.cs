@@ -5,6 +5,40 @@ let uniq = list_unique(xs);
 assert(len(uniq) == 3, "list_unique len");
 assert(uniq[0] == 1 && uniq[1] == 2 && uniq[2] == 3, "list_unique order");
 
+// hash-indexed dedup keeps first occurrence; int/float and deep-equal lists collapse
+let mixed = list_unique([3, "a", 3.0, [1, 2], "a", [1, 2], nil, nil, 7]);
+assert(len(mixed) == 5, "list_unique mixed len");
+assert(typeof(mixed[0]) == "int" && mixed[1] == "a" && len(mixed[2]) == 2 && mixed[3] == nil && mixed[4] == 7, "list_unique mixed order");
+
+let big = [];
+for i in range(20000) { push(big, i % 1000); }
+assert(len(list_unique(big)) == 1000, "list_unique large");
+
+let inter = list_intersection([5, 1, 2, 5, 3, [9]], [3, 5, [9], 8]);
+assert(len(inter) == 3 && inter[0] == 5 && inter[1] == 3 && inter[2][0] == 9, "list_intersection order");
+let inter_set = list_intersection([4, 1, 2, 4], set([4, 2]));
+assert(len(inter_set) == 2 && inter_set[0] == 4 && inter_set[1] == 2, "list_intersection with set");
+
+let diff = list_difference([1, 2, 2, 3], set([3]));
+assert(len(diff) == 3 && diff[2] == 2, "list_difference with set keeps duplicates");
+
+let uni = list_union([2, 1, 2], [1, 3, 3, 4]);
+assert(len(uni) == 4 && uni[0] == 2 && uni[1] == 1 && uni[2] == 3 && uni[3] == 4, "list_union order");
+assert(len(list_union([1], set([1, 2, 3]))) == 3, "list_union with set");
+
+let parts = list_partition([1, 2, 3, 4, 5], set([2, 4]));
+assert(len(parts[0]) == 2 && parts[0][0] == 2 && len(parts[1]) == 3, "list_partition by set");
+let parts2 = list_partition(["a", "b", "c"], ["c", "a"]);
+assert(parts2[0][0] == "a" && parts2[0][1] == "c" && parts2[1][0] == "b", "list_partition by list");
+
+// Containers are indexed by content, and map key order does not matter
+let recs = [{id: 1, tags: ["a"]}, {id: 2, tags: []}, {tags: ["a"], id: 1}, [1, [2]], [1, [2]], [1, 2.0]];
+let ru = list_unique(recs);
+assert(len(ru) == 4 && ru[2][1][0] == 2 && ru[3][1] == 2.0, "list_unique on containers");
+let ri = list_intersection(recs, [{id: 2, tags: []}, [1, 2], {id: 1}]);
+assert(len(ri) == 2 && ri[0].id == 2 && ri[1][1] == 2.0, "list_intersection on containers");
+assert(len(list_difference(recs, [{tags: ["a"], id: 1}])) == 4, "list_difference on containers");
+
 let flat = list_flatten([1, [2, 3], [4], 5]);
 assert(len(flat) == 5, "list_flatten len");
 assert(flat[1] == 2 && flat[2] == 3, "list_flatten items");
@@ -0,0 +1,40 @@
+// Work handed to a blocked scheduler wakes it at once instead of on its next poll tick.
+
+set_instruction_limit(0);
+
+async fn noop(x) { return x; }
+
+// Tasks queued by the main thread for the background loop thread
+event_loop_start();
+let t0 = now_ms();
+let total = 0;
+for i in range(100) { total += await noop(i); }
+let loop_ms = now_ms() - t0;
+event_loop_stop();
+assert(total == 4950, "loop thread ran every task");
+assert(loop_ms < 80, "loop thread picks up tasks without a sleep tick");
+
+// A worker reply while a recv is parked in the poller
+let port = 46000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+let c = await tcp_connect("127.0.0.1", port);
+let s = await socket_accept(srv);
+let parked = socket_recv(s, 16);
+
+let w = worker_spawn("_worker_echo.cs");
+t0 = now_ms();
+for i in range(50) {
+  assert(await worker_post(w, {op: "echo", value: i}) == i, "echo");
+}
+let reply_ms = now_ms() - t0;
+assert(reply_ms < 80, "a delivery cuts the poll short");
+worker_terminate(w);
+
+// The parked recv still completes after all that
+await socket_send(c, "hi");
+assert(await parked == "hi", "parked recv");
+
+socket_close(c);
+socket_close(s);
+socket_close(srv);
+print("event loop wakeup ok");
@@ -0,0 +1,123 @@
+// Closures capture the bindings they use; captured variables stay shared and mutable.
+
+fn counter() {
+  let n = 0;
+  let big = [];
+  for i in range(1000) { push(big, i); }
+  let inc = fn() { n += 1; return n; };
+  let get = fn() => n;
+  n = 10;
+  return [inc, get];
+}
+let c = counter();
+assert(c[0]() == 11 && c[0]() == 12, "writes through the closure");
+assert(c[1]() == 12, "sibling closures share the binding");
+
+// The defining scope sees writes made by the closure and vice versa
+fn roundtrip() {
+  let x = 1;
+  let bump = fn() { x = x * 2; };
+  bump();
+  x += 1;
+  bump();
+  return x;
+}
+assert(roundtrip() == 6, "shared in both directions");
+
+// Each loop iteration gets its own binding
+fn makers() {
+  let out = [];
+  for i in range(3) {
+    let j = i * 10;
+    push(out, fn() => j);
+  }
+  return out;
+}
+let ms = makers();
+assert(ms[0]() == 0 && ms[2]() == 20, "per-iteration capture");
+
+// Nested closures reach through an intermediate function
+fn outer(a) {
+  let b = a + 1;
+  return fn(c) {
+    return fn() => a + b + c;
+  };
+}
+assert(outer(1)(10)() == 13, "nested capture");
+
+// Recursive local functions and helpers defined later in the same scope
+fn local_fact(n) {
+  fn fact(k) { return k <= 1 ? 1 : k * fact(k - 1); }
+  return fact(n);
+}
+assert(local_fact(5) == 120, "recursive local fn");
+
+fn later() {
+  let f = fn() => helper(2);
+  fn helper(v) { return v * 3; }
+  return f();
+}
+assert(later() == 6, "forward reference to a local");
+
+// Globals are still looked up when the closure runs
+fn reader() { return fn() => late_global; }
+let r = reader();
+let late_global = "seen";
+assert(r() == "seen", "global defined after closure creation");
+
+// Methods and self inside closures
+class Box {
+  fn new(v) { self.v = v; }
+  fn adder() { return fn(d) => self.v + d; }
+}
+assert(Box(5).adder()(2) == 7, "self captured");
+
+// Constants stay constant through the capture
+fn consts() {
+  const k = 3;
+  let f = fn() { k = 4; };
+  let g = fn() => k;
+  return g();
+}
+assert(consts() == 3, "const capture");
+
+// Locals the closure never names are released with the defining call
+fn make_cb(i) {
+  let junk = [{k: j} for j in range(20)];
+  let tag = i;
+  return fn() => tag;
+}
+let before = gc_stats().tracked;
+let cbs = [];
+for i in range(50) { push(cbs, make_cb(i)); }
+assert(gc_stats().tracked - before < 50, "unused locals are not retained");
+assert(cbs[49]() == 49, "captured local kept");
+
+// A local declared after the closure is created shadows the outer binding
+let shadowed = "global";
+fn shadow_later() {
+  let f = fn() => shadowed;
+  let shadowed = "local";
+  return f();
+}
+assert(shadow_later() == "local", "later local shadows a global");
+
+fn shadow_block() {
+  let y = 1;
+  if (true) {
+    let f = fn() => y;
+    let y = 2;
+    return f();
+  }
+}
+assert(shadow_block() == 2, "later block local shadows a function local");
+
+fn shadow_caller() {
+  let make = fn() { return fn() => shadowed; };
+  let f = make();
+  let shadowed = "caller";
+  return f();
+}
+assert(shadow_caller() == "caller", "later local in an enclosing function");
+
+print("flat closures ok");
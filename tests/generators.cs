@@ -10,5 +10,108 @@ let xs = range(4);
 assert(len(xs) == 4, "generator length");
 assert(xs[0] == 0, "generator first");
 assert(xs[3] == 3, "generator last");
+let xl = collect(range(4));
+assert(typeof(xl) == "list" && len(xl) == 4 && xl[3] == 3, "collect into a list");
+assert(typeof(range(4)) == "iterator", "generator returns iterator");
+
+// next() protocol
+let g = range(2);
+assert(next(g) == 0, "next first");
+assert(next(g) == 1, "next second");
+assert(next(g) == nil, "next exhausted");
+assert(next(g, "done") == "done", "next default");
+
+// Body does not run until the first next()
+let started = false;
+fn lazy() {
+  started = true;
+  yield 1;
+}
+let lz = lazy();
+assert(!started, "generator body is deferred");
+assert(next(lz) == 1, "lazy first value");
+assert(started, "generator body ran on next");
+
+// Infinite generators with early termination
+fn naturals() {
+  let i = 0;
+  while (true) {
+    yield i;
+    i += 1;
+  }
+}
+let seen = [];
+for n in naturals() {
+  if (n >= 3) { break; }
+  push(seen, n);
+}
+assert(len(seen) == 3 && seen[2] == 2, "for-in consumes lazily");
+
+let squares = collect(take(map(naturals(), fn(x) => x * x), 4));
+assert(squares[3] == 9, "generator feeds lazy pipeline");
+
+let evens = [x for x in take(filter(naturals(), fn(x) => x % 2 == 0), 3)];
+assert(len(evens) == 3 && evens[2] == 4, "generator in comprehension");
+
+// Dropping a suspended generator runs its finally blocks
+let cleaned = false;
+fn guarded() {
+  try {
+    yield 1;
+    yield 2;
+  } catch (e) {
+  } finally {
+    cleaned = true;
+  }
+}
+for v in guarded() { break; }
+assert(cleaned, "finally runs when generator is dropped");
+
+// Throws inside the body reach the consumer
+fn failing() {
+  yield 1;
+  throw "boom";
+}
+let caught = nil;
+try {
+  for v in failing() { }
+} catch (e) {
+  caught = e;
+}
+assert(caught == "boom", "throw propagates through for-in");
+
+// Generators delegating to generators
+fn chain(a, b) {
+  for v in a { yield v; }
+  for v in b { yield v; }
+}
+let joined = collect(chain(range(2), range(3)));
+assert(len(joined) == 5 && joined[4] == 2, "nested generators");
+
+// Results used like the lists generators used to return are drained once and cached
+fn three() { yield "a"; yield "b"; yield "c"; }
+let g3 = three();
+assert(len(g3) == 3 && g3[0] == "a" && g3[2] == "c" && g3[3] == nil, "len and indexing");
+let seen3 = [];
+for v in g3 { push(seen3, v); }
+assert(len(seen3) == 3 && len(g3) == 3, "iteration after len walks the cached values");
+assert(three()[1] == "b", "index a fresh call");
+let spread3 = [0, ...three(), 4];
+assert(len(spread3) == 5 && spread3[3] == "c", "spread");
+let ext3 = ["x"];
+extend(ext3, three());
+assert(len(ext3) == 4 && ext3[1] == "a", "extend");
+let partial = three();
+next(partial);
+assert(len(partial) == 2 && partial[0] == "b", "only the remaining values");
+let drained_err = nil;
+try { len(failing()); } catch (e) { drained_err = e; }
+assert(drained_err == "boom", "throw while draining");
+
+// Generator bodies get a full-size stack for ordinary recursion
+fn rec(n) { if (n == 0) { return 0; } return 1 + rec(n - 1); }
+fn deep(n) { yield rec(n); }
+for v in deep(600) { assert(v == 600, "recursion inside a generator"); }
+assert(collect(deep(3000))[0] == 3000, "deep recursion inside a generator");
 
 print("generators ok");
@@ -0,0 +1,111 @@
+// http_request_async against a local server: requests overlap, and failures reject.
+
+let port = 47000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+let base = "http://127.0.0.1:" + to_str(port);
+
+async fn read_request(s) {
+  let req = "";
+  while (str_find(req, "\r\n\r\n") < 0) {
+    req = req + await socket_recv(s, 4096);
+  }
+  return req;
+}
+
+// Accepts n connections, then answers them in reverse order of arrival
+async fn serve_reversed(n) {
+  let conns = [];
+  for i in range(n) {
+    let s = await socket_accept(srv);
+    let req = await read_request(s);
+    push(conns, [s, str_split(req, " ")[1]]);
+  }
+  for i in range(n) {
+    let c = conns[n - 1 - i];
+    let body = "path=" + c[1];
+    await socket_send(c[0], "HTTP/1.1 200 OK\r\nContent-Length: " + to_str(len(body)) + "\r\nX-Seq: " + to_str(i) + "\r\n\r\n" + body);
+    socket_close(c[0]);
+  }
+}
+
+// All requests are in flight before the server answers the first
+let n = 20;
+let server = serve_reversed(n);
+let reqs = [];
+for i in range(n) { push(reqs, http_get_async(base + "/item/" + to_str(i))); }
+let resps = await await_all(reqs);
+await server;
+for i in range(n) {
+  assert(resps[i].status == 200, "status " + to_str(i));
+  assert(resps[i].body == "path=/item/" + to_str(i), "body " + to_str(i));
+}
+assert(resps[n - 1].headers["X-Seq"] == "0", "last request answered first");
+
+// POST with a body, chunked response, host name resolved off the loop thread
+async fn serve_echo() {
+  let s = await socket_accept(srv);
+  let req = await read_request(s);
+  let parts = str_split(req, "\r\n\r\n");
+  let body = parts[1];
+  while (len(body) < 11) { body = body + await socket_recv(s, 4096); }
+  await socket_send(s, "HTTP/1.1 201 Created\r\nTransfer-Encoding: chunked\r\n\r\n5\r\necho:\r\n" +
+    "b\r\n" + body + "\r\n0\r\n\r\n");
+  socket_close(s);
+}
+let echo = serve_echo();
+let r = await http_request_async({url: "http://localhost:" + to_str(port) + "/post", method: "POST", body: "hello world"});
+await echo;
+assert(r.status == 201 && r.status_text == "Created", "post status");
+assert(r.body == "echo:hello world", "chunked body");
+
+// Other tasks keep running while a request waits on the server
+async fn serve_slow() {
+  let s = await socket_accept(srv);
+  await read_request(s);
+  await sleep(50);
+  await socket_send(s, "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n");
+  socket_close(s);
+}
+let slow = serve_slow();
+let ticks = 0;
+async fn ticker() { for i in range(5) { await sleep(5); ticks += 1; } }
+let tk = ticker();
+let pending = http_post_async(base + "/slow", "x");
+assert((await pending).status == 204, "slow request");
+await tk;
+await slow;
+assert(ticks == 5, "ticker ran while the request waited");
+
+// Failures reject the promise with a code
+let err = nil;
+try { await http_get_async("http://127.0.0.1:1/"); } catch (e) { err = e; }
+assert(err != nil && err.code == "NET_CONNECT", "connection refused");
+
+err = nil;
+try { await http_get_async("http://nonexistent.invalid/"); } catch (e) { err = e; }
+assert(err != nil && err.code == "NET_RESOLVE", "unknown host");
+
+async fn serve_silent() {
+  let s = await socket_accept(srv);
+  await read_request(s);
+  return s;
+}
+let silent = serve_silent();
+err = nil;
+try { await http_request_async({url: base + "/silent", timeout: 100}); } catch (e) { err = e; }
+assert(err != nil && err.code == "NET_TIMEOUT", "request timeout");
+socket_close(await silent);
+
+async fn serve_hangup() {
+  let s = await socket_accept(srv);
+  await read_request(s);
+  socket_close(s);
+}
+let hang = serve_hangup();
+err = nil;
+try { await http_get_async(base + "/hangup"); } catch (e) { err = e; }
+await hang;
+assert(err != nil && err.code == "NET_CLOSED", "closed without a response");
+
+socket_close(srv);
+print("http async ok");
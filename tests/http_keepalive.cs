@@ -0,0 +1,166 @@
+// HTTP keep-alive: framed responses leave the connection in the pool for the next request.
+
+let port = 45000 + random_int(0, 1500);
+let srv = tcp_listen("127.0.0.1", port);
+let base = "http://127.0.0.1:" + to_str(port);
+let client = worker_spawn("_http_keepalive_client.cs");
+
+async fn read_request(s) {
+  let req = "";
+  while (str_find(req, "\r\n\r\n") < 0) {
+    let chunk = await socket_recv(s, 4096);
+    if (chunk == "") { return nil; }
+    req = req + chunk;
+  }
+  return req;
+}
+
+fn ok(body) { return "HTTP/1.1 200 OK\r\nContent-Length: " + to_str(len(body)) + "\r\n\r\n" + body; }
+fn get(path) { return {url: base + path}; }
+
+// Answers requests on s with responses in order; nil hangs up instead of answering
+async fn answer(s, responses) {
+  let reqs = [];
+  for r in responses {
+    push(reqs, await read_request(s));
+    if (r == nil) { socket_close(s); return reqs; }
+    await socket_send(s, r);
+  }
+  return reqs;
+}
+
+// Accepts one connection and answers on it; the socket stays open
+async fn serve(responses) {
+  let s = await socket_accept(srv);
+  return {sock: s, reqs: await answer(s, responses)};
+}
+
+// Awaits nest on the caller's stack, so each step posts to the client first and then
+// waits only on the server task; the worker's reply has arrived by the time it ends
+let stats = {hits: 0, misses: 0, stale: 0, idle: 0};
+let last = stats;
+fn record(res) {
+  last = stats;
+  stats = res.stats;
+  return res.resps;
+}
+fn delta(key) { return stats[key] - last[key]; }
+
+// Three requests share one connection: Content-Length, chunked with trailers, no body
+let reply = worker_post(client, {reqs: [get("/a"), get("/b"), get("/c")]});
+let conn = await serve([
+  ok("one"),
+  "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\ntwo\r\n0\r\nX-Trailer: t\r\n\r\n",
+  "HTTP/1.1 204 No Content\r\n\r\n"]);
+let r = record(await reply);
+assert(r[0].body == "one" && r[1].body == "two" && r[2].status == 204 && r[2].body == "", "bodies");
+assert(len(conn.reqs) == 3 && str_split(conn.reqs[2], " ")[1] == "/c", "one connection");
+assert(str_find(conn.reqs[0], "Connection: close") < 0, "no close header");
+assert(delta("misses") == 1 && delta("hits") == 2 && stats.idle == 1, "reuse counted");
+
+// A parked connection the server closed is noticed and replaced
+socket_close(conn.sock);
+await sleep(10);
+reply = worker_post(client, {reqs: [get("/d")]});
+conn = await serve([ok("fresh")]);
+r = record(await reply);
+assert(r[0].body == "fresh", "new connection");
+assert(delta("stale") == 1 && delta("misses") == 1, "stale dropped");
+
+// The server hangs up on a reused connection without answering: sent again once
+async fn hang_up_then_serve(s) {
+  await answer(s, [nil]);
+  return await serve([ok("retried")]);
+}
+reply = worker_post(client, {reqs: [{url: base + "/e", method: "POST", body: "x"}]});
+conn = await hang_up_then_serve(conn.sock);
+r = record(await reply);
+assert(r[0].body == "retried" && str_find(conn.reqs[0], "POST /e") == 0, "retried on a new connection");
+assert(delta("hits") == 1 && delta("stale") == 1, "retry counted");
+
+reply = worker_post(client, {sync: true, reqs: [get("/f")]});
+conn = await hang_up_then_serve(conn.sock);
+r = record(await reply);
+assert(r[0].body == "retried" && delta("hits") == 1 && delta("stale") == 1, "blocking request retried");
+
+// HEAD and interim 100 responses end without reading to close
+reply = worker_post(client, {reqs: [{url: base + "/head", method: "HEAD"}, get("/continue")]});
+await answer(conn.sock, [
+  "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n",
+  "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok"]);
+r = record(await reply);
+assert(r[0].status == 200 && r[0].body == "" && r[0].headers["Content-Length"] == "5", "head");
+assert(r[1].status == 200 && r[1].body == "ok", "interim response skipped");
+assert(delta("hits") == 2 && stats.idle == 1, "reused after head");
+socket_close(conn.sock);
+await sleep(10);
+
+// Connection: close and bodies delimited by the close are not pooled
+async fn serve_and_close(responses) {
+  for resp in responses {
+    let s = await socket_accept(srv);
+    await read_request(s);
+    await socket_send(s, resp);
+    socket_close(s);
+  }
+}
+reply = worker_post(client, {reqs: [get("/close"), get("/stream")]});
+await serve_and_close([
+  "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 3\r\n\r\nbye",
+  "HTTP/1.1 200 OK\r\n\r\nstreamed until close"]);
+r = record(await reply);
+assert(r[0].body == "bye" && r[1].body == "streamed until close", "close bodies");
+assert(stats.idle == 0 && delta("misses") == 2 && delta("hits") == 0, "not pooled");
+
+// keep_alive: false asks the server to close
+reply = worker_post(client, {reqs: [{url: base + "/once", keep_alive: false}]});
+conn = await serve([ok("once")]);
+r = record(await reply);
+assert(r[0].body == "once" && str_find(conn.reqs[0], "Connection: close") >= 0, "opt out");
+assert(stats.idle == 0, "opt out not pooled");
+socket_close(conn.sock);
+
+// Blocking requests use the same pool
+reply = worker_post(client, {sync: true, reqs: [get("/s1"), get("/s2")]});
+conn = await serve([ok("s1"), ok("s2")]);
+r = record(await reply);
+assert(r[0].body == "s1" && r[1].body == "s2", "sync bodies");
+assert(delta("misses") == 1 && delta("hits") == 1, "sync reuse");
+socket_close(conn.sock);
+await sleep(10);
+
+// max_per_host limits what stays parked
+async fn serve_pair() {
+  let a = await socket_accept(srv);
+  let b = await socket_accept(srv);
+  await read_request(a);
+  await read_request(b);
+  await socket_send(a, ok("p"));
+  await socket_send(b, ok("p"));
+  return [a, b];
+}
+reply = worker_post(client, {config: {max_per_host: 1}, parallel: true, reqs: [get("/p1"), get("/p2")]});
+let pair = await serve_pair();
+r = record(await reply);
+assert(r[0].body == "p" && r[1].body == "p" && stats.idle == 1, "one kept per host");
+
+// idle_timeout expires parked connections
+reply = worker_post(client, {config: {idle_timeout: 20}, delay: 40, reqs: [get("/late")]});
+conn = await serve([ok("late")]);
+r = record(await reply);
+assert(r[0].body == "late" && delta("misses") == 1 && delta("hits") == 0, "expired connection not reused");
+socket_close(pair[0]);
+socket_close(pair[1]);
+socket_close(conn.sock);
+
+// max_per_host 0 turns pooling off and closes what is parked
+reply = worker_post(client, {config: {max_per_host: 0, idle_timeout: 30000}, reqs: [get("/off")]});
+conn = await serve([ok("off")]);
+r = record(await reply);
+assert(r[0].body == "off" && str_find(conn.reqs[0], "Connection: close") >= 0, "close when off");
+assert(stats.idle == 0, "pool emptied");
+socket_close(conn.sock);
+
+worker_terminate(client);
+socket_close(srv);
+print("http keepalive ok");
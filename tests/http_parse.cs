@@ -0,0 +1,44 @@
+// http_parse: responses and requests from a string, split at every byte.
+
+let resp = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nX-Long: " + str_repeat("v", 70) +
+  "\r\nSet-Cookie: a=1\r\nset-cookie: b=2\r\nContent-Length: 5\r\n\r\nhello";
+let r = http_parse(resp + "HTTP/1.1 204 No Content\r\n\r\n");
+assert(r.status == 200 && r.status_text == "OK" && r.body == "hello", "status and body");
+assert(r.headers["Content-Type"] == "text/plain" && len(r.headers["X-Long"]) == 70, "headers as sent");
+assert(r.headers["Set-Cookie"] == "a=1" && r.headers["set-cookie"] == "b=2", "names keep their case");
+assert(r.used == len(resp), "stops at the end of the message");
+
+// Every prefix is incomplete; the scanner must not see past the bytes it was given
+let i = 0;
+while (i < len(resp)) {
+  assert(http_parse(substr(resp, 0, i)) == nil, "prefix " + to_str(i));
+  i += 1;
+}
+
+// Bare LF line ends, whitespace around values, 1xx interim responses, chunked bodies
+r = http_parse("HTTP/1.1 100 Continue\n\nHTTP/1.1 200 OK\nA:   b c \t\nTransfer-Encoding: chunked\n\n3\r\nabc\r\n0\r\n\r\n");
+assert(r.status == 200 && r.headers.A == "b c" && r.body == "abc", "interim and chunked");
+r = http_parse("HTTP/1.0 404 Not Found\r\nServer: t\r\n\r\nto the end");
+assert(r.status == 404 && r.body == "to the end", "body runs to the end of data");
+
+// The raw head skips the map; http_header searches it
+r = http_parse(resp, {headers: false});
+assert(r.headers == nil && str_startswith(r.head, "Content-Type: text/plain\r\n"), "raw head");
+assert(http_header(r, "content-length") == "5" && http_header(r, "SET-COOKIE") == "a=1", "raw lookup");
+assert(http_header(r, "x-missing") == nil, "raw lookup miss");
+
+// Requests: lower-case names, repeats joined
+let req = "\r\nPOST /items?id=7 HTTP/1.1\r\nHost: x\r\nAccept: a\r\naccept: b\r\nContent-Length: 3\r\n\r\nabcGET";
+r = http_parse(req, {request: true});
+assert(r.method == "POST" && r.path == "/items" && r.query == "id=7" && r.version == "HTTP/1.1", "request line");
+assert(r.headers.accept == "a, b" && r.headers.host == "x" && r.body == "abc", "request headers");
+assert(r.used == len(req) - 3, "pipelined bytes left over");
+assert(http_parse("GET / HTTP/1.1\r\nHost: x\r\n", {request: true}) == nil, "incomplete request");
+
+// Transfer-Encoding wins over Content-Length in a response; equal repeated lengths are one
+r = http_parse("HTTP/1.1 200 OK\r\nContent-Length: 99\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nok\r\n0\r\n\r\n");
+assert(r.status == 200 && r.body == "ok", "chunked beats content-length");
+r = http_parse("HTTP/1.1 200 OK\r\nContent-Length: 2, 2\r\n\r\nok", {headers: false});
+assert(r.body == "ok", "content-length list of one value");
+
+print("http parse ok");
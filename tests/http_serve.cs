@@ -0,0 +1,138 @@
+// http_serve: keep-alive, pipelining, size limits and handler results.
+
+let client = worker_spawn("_http_keepalive_client.cs");
+
+// The worker is the client: on_listen posts to it once the port is known, and the
+// reply is awaited after http_serve returns
+fn serve(handler, opts, make_msg) {
+  let reply = nil;
+  opts.on_listen = fn(port) { reply = worker_post(client, make_msg(port)); };
+  let stats = http_serve(0, handler, opts);
+  return {stats: stats, out: (await reply).resps};
+}
+
+fn get(port, path) { return {url: "http://127.0.0.1:" + to_str(port) + path}; }
+
+fn app(req) {
+  if (req.path == "/text") { return "hello " + req.query; }
+  if (req.path == "/empty") { return nil; }
+  if (req.path == "/echo") {
+    return {status: 201, headers: {"X-Method": req.method, "Content-Type": "application/json"},
+            body: json_stringify({body: req.body, type: req.headers["content-type"] ?? ""})};
+  }
+  if (req.path == "/stop") { http_serve_stop(); return "stopping"; }
+  return {status: 404, body: "no " + req.path};
+}
+
+// Requests from one client share a keep-alive connection
+let r = serve(app, {max_requests: 5}, fn(port) {
+  return {reqs: [get(port, "/text?x=1"), get(port, "/empty"), get(port, "/missing"),
+                 {url: get(port, "/echo").url, method: "POST", body: "data", headers: {"Content-Type": "text/csv"}},
+                 {url: get(port, "/text").url, method: "HEAD"}]};
+});
+let out = r.out;
+assert(out[0].status == 200 && out[0].body == "hello x=1", "string result");
+assert(http_header(out[0], "content-type") == "text/plain; charset=utf-8", "default content type");
+assert(http_header(out[0], "date") != nil, "date header");
+assert(out[1].status == 204 && out[1].body == "", "nil result");
+assert(out[2].status == 404 && out[2].body == "no /missing", "status from map");
+let echoed = json_parse(out[3].body);
+assert(out[3].status == 201 && echoed.body == "data" && echoed.type == "text/csv", "request body and headers");
+assert(http_header(out[3], "X-METHOD") == "POST" && http_header(out[3], "content-type") == "application/json", "response headers");
+assert(out[4].status == 200 && out[4].body == "" && http_header(out[4], "content-length") == "6", "head");
+assert(r.stats.requests == 5 && r.stats.connections == 1, "one connection");
+
+// Pipelined requests in one write are answered in order; Connection: close ends it
+let pipelined = "GET /text?a HTTP/1.1\r\nHost: t\r\n\r\n" +
+  "POST /echo HTTP/1.1\r\nHost: t\r\nContent-Length: 3\r\n\r\nabc" +
+  "POST /echo HTTP/1.1\r\nHost: t\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nxy\r\n1\r\nz\r\n0\r\n\r\n" +
+  "GET /text?b HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n" +
+  "GET /never HTTP/1.1\r\nHost: t\r\n\r\n";
+r = serve(app, {max_requests: 4}, fn(port) { return {port: port, raw: [pipelined]}; });
+let text = r.out[0];
+let a = str_find(text, "hello a");
+let abc = str_find(text, "\"abc\"");
+let xyz = str_find(text, "\"xyz\"");
+let b = str_find(text, "hello b");
+assert(a > 0 && abc > a && xyz > abc && b > xyz, "pipelined responses in order");
+assert(str_find(text, "never") < 0 && str_find(text, "Connection: close") > 0, "closed after close");
+assert(r.stats.connections == 1, "pipelined on one connection");
+
+// Oversized and malformed requests get an error and a closed connection
+let big_header = "GET / HTTP/1.1\r\nX-Big: " + str_repeat("a", 300) + "\r\n\r\n";
+let big_body = "POST / HTTP/1.1\r\nContent-Length: 100\r\n\r\n" + str_repeat("b", 100);
+let big_chunks = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n40\r\n" + str_repeat("c", 64) + "\r\n40\r\n" + str_repeat("c", 64) + "\r\n0\r\n\r\n";
+r = serve(app, {max_head: 200, max_body: 64}, fn(port) {
+  return {port: port, raw: [big_header, big_body, big_chunks, "NONSENSE\r\n\r\n",
+                            "GET /text?ok HTTP/1.0\r\n\r\n", "GET /stop HTTP/1.1\r\nConnection: close\r\n\r\n"]};
+});
+out = r.out;
+assert(str_find(out[0], "HTTP/1.1 431 ") == 0 && str_find(out[0], "Connection: close") > 0, "head too large");
+assert(str_find(out[1], "HTTP/1.1 413 ") == 0, "body too large");
+assert(str_find(out[2], "HTTP/1.1 413 ") == 0, "chunked body too large");
+assert(str_find(out[3], "HTTP/1.1 400 ") == 0, "malformed request line");
+assert(str_find(out[4], "hello ok") > 0 && str_find(out[4], "Connection: close") > 0, "HTTP/1.0 closes");
+assert(r.stats.rejected == 4 && r.stats.requests == 2, "rejections counted");
+
+// Ambiguous body framing is rejected before the size check can be bypassed
+let wrapped = "POST / HTTP/1.1\r\nContent-Length: 18446744073709551619\r\n\r\nabc";
+let conflict = "POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 2\r\n\r\nhello";
+let both = "POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n";
+let same = "POST /echo HTTP/1.1\r\nConnection: close\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nok";
+r = serve(app, {max_body: 64}, fn(port) {
+  return {port: port, raw: [wrapped, conflict, both, same, "GET /stop HTTP/1.1\r\nConnection: close\r\n\r\n"]};
+});
+out = r.out;
+assert(str_find(out[0], "HTTP/1.1 400 ") == 0, "overflowing length");
+assert(str_find(out[1], "HTTP/1.1 400 ") == 0, "conflicting lengths");
+assert(str_find(out[2], "HTTP/1.1 400 ") == 0, "transfer-encoding with content-length");
+assert(str_find(out[3], "HTTP/1.1 201 ") == 0 && str_find(out[3], "\"ok\"") > 0, "repeated equal lengths");
+assert(r.stats.rejected == 3, "framing rejections counted");
+
+// Expect: 100-continue gets the interim response once the head is in
+r = serve(app, {max_requests: 1}, fn(port) {
+  return {port: port, raw: [["POST /echo HTTP/1.1\r\nHost: t\r\nExpect: 100-continue\r\nContent-Length: 2\r\n" +
+                             "Connection: close\r\n\r\n", "ok"]]};
+});
+assert(str_find(r.out[0], "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 ") == 0, "100 continue before the response");
+
+// headers: false leaves the raw head for http_header to search; async handlers await
+async fn lookup(req) {
+  await sleep(1);
+  return to_str(req.headers == nil) + " " + http_header(req, "x-token") + " " + to_str(http_header(req, "missing"));
+}
+r = serve(lookup, {headers: false, max_requests: 1}, fn(port) {
+  return {reqs: [{url: get(port, "/").url, headers: {"X-Token": "t0k"}, raw_head: true}]};
+});
+assert(r.out[0].body == "true t0k nil", "raw head lookup");
+assert(r.out[0].headers == nil && http_header(r.out[0], "Content-Length") == "12", "raw response head");
+r = serve(lookup, {headers: false, max_requests: 1}, fn(port) {
+  return {sync: true, reqs: [{url: get(port, "/").url, headers: {"X-Token": "s1"}, raw_head: true}]};
+});
+assert(r.out[0].body == "true s1 nil", "raw head lookup, blocking client");
+assert(r.out[0].headers == nil && http_header(r.out[0], "Content-Length") == "11", "raw response head, blocking client");
+
+// A handler that awaits parks its request: other connections are answered meanwhile,
+// and later requests on its own connection wait behind it
+let gate = promise();
+async fn gated(req) {
+  if (req.path == "/wait") { await gate; return "waited"; }
+  if (req.path == "/open") { resolve(gate, true); return "opened"; }
+  if (req.path == "/nap") { await sleep(20); return "napped"; }
+  return "after";
+}
+r = serve(gated, {max_requests: 2}, fn(port) {
+  return {parallel: true, reqs: [get(port, "/wait"), get(port, "/open")]};
+});
+assert(r.out[0].body == "waited" && r.out[1].body == "opened", "awaiting handler does not block others");
+assert(r.stats.connections == 2, "parallel connections");
+r = serve(gated, {max_requests: 2}, fn(port) {
+  return {port: port, raw: ["GET /nap HTTP/1.1\r\nHost: t\r\n\r\nGET /x HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n"]};
+});
+text = r.out[0];
+assert(str_find(text, "napped") > 0 && str_find(text, "after") > str_find(text, "napped"), "parked request answered first");
+
+assert(http_serve_stop() == false, "nothing to stop");
+
+worker_terminate(client);
+print("http serve ok");
@@ -0,0 +1,112 @@
+// Streamed HTTP bodies: on_chunk and output take the body as it arrives, gzip inflated on the fly.
+
+let port = 43000 + random_int(0, 1500);
+let srv = tcp_listen("127.0.0.1", port);
+let base = "http://127.0.0.1:" + to_str(port);
+
+let text = "";
+for i in range(3000) { text = text + "line " + to_str(i) + " of the streamed body\n"; }
+write_file("test_http_stream.txt", text);
+gzip_compress("test_http_stream.txt", "test_http_stream.txt.gz");
+let gz = read_file("test_http_stream.txt.gz");
+
+async fn read_request(s) {
+  let req = "";
+  while (str_find(req, "\r\n\r\n") < 0) { req = req + await socket_recv(s, 4096); }
+  return req;
+}
+
+fn hex(n) {
+  let digits = "0123456789abcdef";
+  let out = "";
+  while (n > 0) { out = substr(digits, n % 16, 1) + out; n = floor(n / 16); }
+  return out;
+}
+
+// Serves one request with body, chunked in pieces of step bytes when step > 0
+async fn serve(body, encoding, step) {
+  let s = await socket_accept(srv);
+  let req = await read_request(s);
+  let head = "HTTP/1.1 200 OK\r\nConnection: close\r\n";
+  if (encoding != nil) { head = head + "Content-Encoding: " + encoding + "\r\n"; }
+  if (step > 0) {
+    await socket_send(s, head + "Transfer-Encoding: chunked\r\n\r\n");
+    let at = 0;
+    while (at < len(body)) {
+      let piece = substr(body, at, step);
+      await socket_send(s, hex(len(piece)) + "\r\n" + piece + "\r\n");
+      at += step;
+    }
+    await socket_send(s, "0\r\n\r\n");
+  } else {
+    await socket_send(s, head + "Content-Length: " + to_str(len(body)) + "\r\n\r\n" + body);
+  }
+  socket_close(s);
+  return req;
+}
+
+// A gzip body over chunked framing reaches on_chunk inflated, piece by piece
+let chunks = [];
+let p = http_request_async({url: base + "/gz", decompress: true, on_chunk: fn(c) { push(chunks, c); }});
+let req = await serve(gz, "gzip", 1000);
+let r = await p;
+assert(str_find(req, "Accept-Encoding: gzip") >= 0, "asks for gzip");
+assert(r.status == 200 && r.body == "" && r.size == len(text), "streamed response");
+assert(len(chunks) > 1, "several chunks");
+let joined = "";
+for c in chunks { joined = joined + c; }
+assert(joined == text, "inflated chunks");
+
+// Straight to a file
+p = http_request_async({url: base + "/file", decompress: true, output: "test_http_stream.out"});
+await serve(gz, "gzip", 0);
+r = await p;
+assert(r.size == len(text) && read_file("test_http_stream.out") == text, "written to file");
+
+// Without decompress the body stays encoded; with it a buffered body is inflated
+p = http_request_async({url: base + "/raw"});
+req = await serve(gz, "gzip", 0);
+r = await p;
+assert(str_find(req, "Accept-Encoding") < 0 && r.body == gz, "raw body");
+p = http_request_async({url: base + "/buffered", decompress: true});
+await serve(gz, "gzip", 700);
+assert((await p).body == text, "buffered and inflated");
+
+// An uncompressed body streams as it is
+chunks = [];
+p = http_request_async({url: base + "/plain", on_chunk: fn(c) { push(chunks, c); }});
+await serve("plain body", nil, 4);
+assert((await p).size == 10 && len(chunks) >= 1, "plain stream");
+
+// Blocking requests stream the same way
+let w = worker_spawn("_http_keepalive_client.cs");
+let out = path_join(cwd(), "test_http_stream_sync.out");  // the worker has no script directory
+let reply = worker_post(w, {sync: true, reqs: [{url: base + "/sync", decompress: true, output: out}]});
+await serve(gz, "gzip", 4096);
+r = (await reply).resps[0];
+assert(r.size == len(text) && read_file("test_http_stream_sync.out") == text, "blocking download");
+worker_terminate(w);
+
+// A callback that throws, an output that can't be written, a corrupt body
+let err = nil;
+p = http_request_async({url: base + "/throw", on_chunk: fn(c) { throw "stop"; }});
+await serve("abc", nil, 0);
+try { await p; } catch (e) { err = e; }
+assert(err != nil && err.code == "HTTP_CALLBACK", "callback error rejects");
+
+err = nil;
+try { await http_request_async({url: base + "/nowhere", output: "no_such_dir/x.out"}); } catch (e) { err = e; }
+assert(err != nil && err.code == "HTTP_OUTPUT", "output not writable");
+
+err = nil;
+p = http_request_async({url: base + "/corrupt", decompress: true});
+await serve("not gzip at all", "gzip", 0);
+try { await p; } catch (e) { err = e; }
+assert(err != nil && err.code == "HTTP_PARSE", "corrupt gzip");
+
+rm("test_http_stream.txt");
+rm("test_http_stream.txt.gz");
+rm("test_http_stream.out");
+rm("test_http_stream_sync.out");
+socket_close(srv);
+print("http stream ok");
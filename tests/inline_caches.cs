@@ -0,0 +1,69 @@
+// Call-site caches must follow receivers of different classes and see class mutation.
+
+class Shape {
+  fn new(n) { self.n = n; }
+  fn name() { return "shape"; }
+  fn sides() { return self.n; }
+}
+
+class Square : Shape {
+  fn new() { super.new(4); }
+  fn name() { return "square"; }
+}
+
+class Tri : Shape {
+  fn new() { super.new(3); }
+}
+
+fn describe(s) { return s.name() + ":" + to_str(s.sides()); }
+
+// One call site sees several receiver classes (polymorphic)
+let out = [];
+for s in [Square(), Tri(), Shape(0), Square(), Tri()] { push(out, describe(s)); }
+assert(out[0] == "square:4" && out[1] == "shape:3" && out[2] == "shape:0", "polymorphic site");
+assert(out[3] == "square:4" && out[4] == "shape:3", "polymorphic site repeat");
+
+fn call_name(x) { return x.name(); }
+
+// Replacing a method on a class invalidates cached lookups
+let sq = Square();
+assert(call_name(sq) == "square", "before patch");
+assert(call_name(sq) == "square", "cached");
+Square.name = fn() => "patched";
+assert(call_name(sq) == "patched", "class mutation seen");
+
+// Patching a parent reaches subclasses that inherit the method
+let t = Tri();
+assert(call_name(t) == "shape", "inherited before patch");
+Shape.name = fn() => "base-patched";
+assert(call_name(t) == "base-patched", "parent mutation seen");
+
+// An instance field shadows the class method at the same site
+let plain = Tri();
+let own = Tri();
+own.name = fn() => "own";
+assert(call_name(plain) == "base-patched", "class method");
+assert(call_name(own) == "own", "own field wins");
+assert(call_name(plain) == "base-patched", "class method again");
+
+// Adding and deleting overrides is seen by a warm site
+fn area_of(x) { return x.area(); }
+let sq2 = Square();
+Square.area = fn() => 1;
+assert(area_of(sq2) == 1, "added method");
+Shape.area = fn() => self.n * 10;
+assert(area_of(sq2) == 1 && area_of(Tri()) == 30, "override kept");
+mdel(Square, "area");
+assert(area_of(sq2) == 40, "deleted override falls back to parent");
+
+// Field reads through one site over differently shaped receivers
+fn get_n(x) { return x.n; }
+let mixed = [Tri(), {n: 7}, Square(), {m: 1, n: 9}];
+let ns = [];
+for m in mixed { push(ns, get_n(m)); }
+assert(ns[0] == 3 && ns[1] == 7 && ns[2] == 4 && ns[3] == 9, "field site");
+
+let st = prof_stats();
+assert(st.ic_hits > 0 && st.ic_misses > 0, "ic counters exposed");
+
+print("inline caches ok");
@@ -0,0 +1,58 @@
+// Instances share shapes until they diverge; behaviour must match plain maps.
+
+struct Vec { x, y, z = 0 }
+
+let a = Vec(1, 2);
+let b = Vec(3, 4, 5);
+assert(a.x == 1 && a.y == 2 && a.z == 0, "struct fields");
+assert(b.z == 5, "struct positional z");
+
+let ks = keys(a);
+assert(len(ks) == 4, "struct keys include __struct");
+assert(ks[1] == "x" && ks[2] == "y" && ks[3] == "z", "slot order is declaration order");
+
+// Writes to existing slots stay per-instance
+a.x = 10;
+assert(a.x == 10 && b.x == 3, "slot write is per instance");
+a["y"] = 20;
+assert(a.y == 20, "index write hits the same slot");
+
+// Ad-hoc keys extend one instance only
+b.tag = "hot";
+assert(b.tag == "hot", "added field");
+assert(a.tag == nil, "other instance unchanged");
+b.tag = "cold";
+assert(b.tag == "cold", "added field rewrite");
+
+// Deleting and non-string keys switch to dictionary mode
+mdel(b, "tag");
+assert(b.tag == nil && b.x == 3 && b.z == 5, "delete keeps remaining fields");
+b.tag = "again";
+assert(b.tag == "again", "insert after delete");
+a[1] = "one";
+assert(a[1] == "one" && a.x == 10, "non-string key");
+
+class Particle {
+  fn new(x, y) {
+    self.x = x;
+    self.y = y;
+  }
+
+  fn step(dx) {
+    self.x = self.x + dx;
+    return self;
+  }
+}
+
+let ps = [];
+for i in range(100) { push(ps, Particle(i, -i)); }
+for p in ps { p.step(1); }
+assert(ps[0].x == 1 && ps[99].x == 100 && ps[99].y == -99, "class instances");
+
+// Many distinct ad-hoc keys overflow the shape tree and still work
+let bag = Particle(0, 0);
+for i in range(100) { bag["k" + to_str(i)] = i; }
+assert(bag.k0 == 0 && bag.k99 == 99 && bag.x == 0, "large instance");
+assert(len(keys(bag)) == 103, "large instance key count");
+
+print("instance shapes ok");
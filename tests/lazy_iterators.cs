@@ -0,0 +1,57 @@
+// Lazy iterator pipelines
+
+let data = [];
+for i in range(100) { push(data, i); }
+
+// Stages are fused and short-circuit: only the items needed for take() are pulled
+let calls = [0];
+fn is_even(x) { calls[0] = calls[0] + 1; return x % 2 == 0; }
+let out = data |> iter() |> filter(_, is_even) |> map(_, fn(x) => x * 10) |> take(_, 3) |> collect();
+assert(len(out) == 3 && out[0] == 0 && out[1] == 20 && out[2] == 40, "fused pipeline result");
+assert(calls[0] == 5, "filter stopped after the fifth item");
+
+// Nothing runs until the iterator is consumed
+calls[0] = 0;
+let pending = map(iter(data), fn(x) => is_even(x));
+assert(calls[0] == 0, "stages are lazy");
+assert(typeof(pending) == "iterator", "typeof iterator");
+
+// Ranges are lazy sources, even huge ones
+let squares = map(range(1, 1000000000000), fn(x) => x * x) |> drop(_, 2) |> take(_, 3);
+let got = [];
+for v, i in squares {
+  push(got, v);
+  assert(i == len(got) - 1, "second loop var is the iteration count");
+}
+assert(len(got) == 3 && got[0] == 9 && got[2] == 25, "for-in over iterator");
+
+// An iterator is single-pass
+let once = iter([1, 2, 3]);
+assert(len(collect(once)) == 3, "first pass");
+assert(len(collect(once)) == 0, "exhausted");
+
+// Comprehensions consume iterators
+let doubled = [x * 2 for x in take(range(0, 1000000000), 4)];
+assert(len(doubled) == 4 && doubled[3] == 6, "list comprehension over iterator");
+let idx = {k: v for [k, v] in enumerate(iter(["a", "b"]))};
+assert(idx[0] == "a" && idx[1] == "b", "map comprehension over enumerate iterator");
+let mods = {x % 3 for x in iter(range(0, 10))};
+assert(len(mods) == 3, "set comprehension over iterator");
+
+// zip mixes lists and iterators, stopping at the shorter side
+let zs = collect(zip(range(0, 100), ["x", "y"]));
+assert(len(zs) == 2 && zs[1][0] == 1 && zs[1][1] == "y", "zip lazy");
+
+// reduce is a terminal operation
+assert(reduce(range(1, 101), fn(a, b) => a + b, 0) == 5050, "reduce over range");
+assert(reduce(iter([]), fn(a, b) => a + b) == nil, "reduce empty iterator");
+
+// Other sources
+let chars = collect(iter("abc"));
+assert(len(chars) == 3 && chars[2] == "c", "string iterator");
+assert(collect(iter({a: 1}))[0] == "a", "map iterator yields keys");
+
+// Lists keep the eager behavior
+assert(typeof(map([1, 2], fn(x) => x)) == "list", "map over list stays eager");
+
+print("lazy_iterators ok");
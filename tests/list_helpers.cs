@@ -38,4 +38,29 @@ let nums2 = [1, 3, 2];
 sort(nums2, desc, "quick");
 assert(nums2[0] == 3 && nums2[1] == 2 && nums2[2] == 1, "sort custom comparator");
 
+// parallel sort must match the sequential (stable) merge order
+let big_p = [];
+let big_m = [];
+for i in range(40000) {
+  let v = random_int(0, 1000);
+  if (i % 3 == 0) { v = v + 0.0; }
+  push(big_p, v);
+  push(big_m, v);
+}
+sort(big_p, "parallel");
+sort(big_m, "merge");
+let same = true;
+for i in range(40000) {
+  if (big_p[i] != big_m[i] || typeof(big_p[i]) != typeof(big_m[i])) { same = false; break; }
+}
+assert(same, "sort parallel matches merge");
+
+let words_p = ["pear", "apple", "fig", "apple", "kiwi"];
+sort(words_p, "parallel");
+assert(words_p[0] == "apple" && words_p[4] == "pear", "sort parallel small strings");
+
+let nums_pd = [1, 3, 2];
+sort(nums_pd, desc, "parallel");
+assert(nums_pd[0] == 3 && nums_pd[2] == 1, "sort parallel with comparator");
+
 print("list_helpers ok");
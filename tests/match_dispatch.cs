@@ -0,0 +1,136 @@
+// Table-driven match/switch dispatch must keep first-match order and guards.
+
+fn route(msg) {
+  return match (msg) {
+    case "ping": "pong";
+    case "get": "read";
+    case "put": "write";
+    case "del": "delete";
+    case "list": "scan";
+    case "stat": "info";
+    case "quit": "bye";
+    case _: "unknown";
+  };
+}
+assert(route("put") == "write" && route("quit") == "bye", "string arms");
+assert(route("nope") == "unknown" && route(42) == "unknown", "fallback arm");
+
+// Arms that are not literals interleave with keyed arms in source order
+fn classify(v) {
+  return match (v) {
+    case 0: "zero";
+    case int(n) if n > 100: "big";
+    case 7: "seven";
+    case 7: "unreachable";
+    case 200: "shadowed";
+    case string(s): "str:" + s;
+    case [a, b]: "pair";
+    case {kind}: "kind:" + kind;
+    default: "other";
+  };
+}
+assert(classify(0) == "zero", "first literal");
+assert(classify(7) == "seven", "duplicate literal keeps first");
+assert(classify(200) == "big", "guarded type arm before literal");
+assert(classify(7.0) == "seven", "float subject matches int literal");
+assert(classify("x") == "str:x", "type arm");
+assert(classify([1, 2]) == "pair" && classify([1]) == "other", "list arm");
+assert(classify({kind: "a"}) == "kind:a" && classify({}) == "other", "map arm");
+assert(classify(nil) == "other", "default");
+
+// Duplicate keys with guards fall through to the next equal arm
+fn pick(v, flag) {
+  return match (v) {
+    case "a" if flag: 1;
+    case _ if false: 0;
+    case "a": 2;
+    default: 3;
+  };
+}
+assert(pick("a", true) == 1 && pick("a", false) == 2 && pick("b", true) == 3, "guards");
+
+// Wildcard before literals wins
+let w = match (3) { case _: "any"; case 3: "three"; };
+assert(w == "any", "wildcard first");
+
+// switch over enum members
+enum Op { Add, Sub, Mul = 10, Neg = -1 }
+
+fn apply(op, a, b) {
+  let out = nil;
+  switch (op) {
+    case Op.Add { out = a + b; break; }
+    case Op.Sub { out = a - b; break; }
+    case Op.Mul { out = a * b; break; }
+    case -1 { out = -a; break; }
+    default { out = "bad"; }
+  }
+  return out;
+}
+assert(apply(Op.Add, 2, 3) == 5 && apply(Op.Sub, 2, 3) == -1, "enum switch");
+assert(apply(Op.Mul, 2, 3) == 6 && apply(Op.Neg, 2, 3) == -2, "enum switch values");
+assert(apply(99, 1, 1) == "bad", "enum switch default");
+
+// Changing the enum map is seen by a warm switch
+Op.Mul = 11;
+assert(apply(11, 2, 3) == 6 && apply(10, 2, 3) == "bad", "enum mutation");
+
+// The same switch reached with a different binding for the enum name
+fn apply_local(op) {
+  let Op = {Add: 100, Sub: 101, Mul: 102};
+  return apply_with(Op, op);
+}
+fn apply_with(Op, op) {
+  switch (op) {
+    case Op.Add { return "add"; }
+    case Op.Sub { return "sub"; }
+  }
+  return "none";
+}
+assert(apply_with({Add: 1, Sub: 2}, 2) == "sub", "first binding");
+assert(apply_with({Add: 5, Sub: 6}, 2) == "none" && apply_with({Add: 5, Sub: 6}, 5) == "add", "rebinding");
+
+// Non-constant case expressions are still evaluated in order
+let calls = [];
+fn k(v) { push(calls, v); return v; }
+switch (2) {
+  case 0 + k(1) { }
+  case 0 + k(2) { }
+  case 0 + k(3) { }
+}
+assert(len(calls) == 2 && calls[1] == 2, "case expressions evaluated lazily");
+
+// Destructuring arms are filtered on length and required keys, in source order
+fn shape(v) {
+  return match (v) {
+    case [a]: "one";
+    case [a, b, ...rest]: "many:" + to_str(len(rest));
+    case {op, lhs, rhs}: "bin:" + op;
+    case {op, arg}: "un:" + op;
+    case {op}: "op:" + op;
+    case [...items]: "empty";
+    default: "other";
+  };
+}
+assert(shape([1]) == "one" && shape([1, 2]) == "many:0" && shape([1, 2, 3, 4]) == "many:2", "list lengths");
+assert(shape([]) == "empty", "rest-only list arm");
+assert(shape({op: "+", lhs: 1, rhs: 2}) == "bin:+" && shape({op: "-", arg: 1}) == "un:-", "map keys");
+assert(shape({op: "x", lhs: 1}) == "op:x" && shape({lhs: 1}) == "other", "shared key tests");
+
+// A guard that changes the subject is seen by later arms
+fn grow(v) {
+  return match (v) {
+    case {b, c}: "bc";
+    case {a} if set_b(v): "a";
+    case {b}: "b";
+    case [x] if add_item(v): "one";
+    case [x, y]: "two";
+    default: "none";
+  };
+}
+fn set_b(m) { m.b = 1; return false; }
+fn add_item(l) { push(l, 2); return false; }
+assert(grow({a: 1}) == "b", "key added by a guard");
+assert(grow([1]) == "two", "item added by a guard");
+
+print("match dispatch ok");
@@ -23,4 +23,11 @@ let r4 = match (nil) {
 };
 assert(r4 == 1, "wildcard matches");
 
+let r5 = match ("get") {
+  case "put": 1;
+  case "get": 2;
+  default: 0;
+};
+assert(r5 == 2, "string literal pattern");
+
 print("match_patterns ok");
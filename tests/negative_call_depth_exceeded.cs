@@ -0,0 +1,8 @@
+// EXPECT_FAIL
+// Runaway recursion stops with "maximum call depth exceeded" instead of overflowing
+// the generator's stack
+
+fn down(n) { return down(n + 1); }
+fn gen() { yield down(0); }
+
+for v in gen() { print(v); }
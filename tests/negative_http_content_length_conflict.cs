@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+// Two different Content-Length values make the body's end ambiguous
+
+http_parse("POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 5\r\nContent-Length: 2\r\n\r\nhello", {request: true});
@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+// A Content-Length too large for the parser is rejected instead of wrapping around
+
+http_parse("POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 18446744073709551619\r\n\r\nabc", {request: true});
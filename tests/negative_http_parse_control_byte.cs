@@ -0,0 +1,5 @@
+// EXPECT_FAIL
+// Control bytes inside a header line are rejected, wherever they fall in the line
+
+let line = "X-Pad: " + str_repeat("p", 40) + "\x01" + str_repeat("p", 40);
+http_parse("HTTP/1.1 200 OK\r\n" + line + "\r\nContent-Length: 0\r\n\r\n");
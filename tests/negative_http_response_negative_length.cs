@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+// A negative Content-Length in a response is a parse error, not an empty body
+
+http_parse("HTTP/1.1 200 OK\r\nContent-Length: -5\r\n\r\nhello");
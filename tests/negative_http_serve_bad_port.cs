@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+// A port outside 0-65535 is an error instead of wrapping to another port
+
+http_serve(70000, fn(req) { return "never"; }, {max_requests: 1});
@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+// A request framed by both Transfer-Encoding and Content-Length is rejected
+
+http_parse("POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", {request: true});
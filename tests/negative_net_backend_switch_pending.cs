@@ -0,0 +1,7 @@
+// EXPECT_FAIL
+// The backend cannot change under waiting operations
+
+let port = 45000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+let waiting = socket_accept(srv);
+net_set_poll_backend(net_poll_backend() == "io_uring" ? "epoll" : "io_uring");
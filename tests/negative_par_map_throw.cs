@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+
+// An error in any chunk fails the whole call
+par_map([1, 2, 3, 4], "fail", "_par_lib.cs", {workers: 2, chunk: 1});
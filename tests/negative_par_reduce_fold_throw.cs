@@ -0,0 +1,4 @@
+// EXPECT_FAIL
+
+// An error while folding the chunk results fails the whole call
+par_reduce(["a", "b", "c", "d"], "fold_fail", "_par_lib.cs", {workers: 2, chunk: 2});
@@ -0,0 +1,8 @@
+// EXPECT_FAIL
+// A socket's handle is dead after socket_close
+
+let port = 43000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+let c = await tcp_connect("127.0.0.1", port);
+socket_close(c);
+socket_send(c, "late");
@@ -0,0 +1,7 @@
+// EXPECT_FAIL
+
+// Without worker_on_error, a failing event callback fails the await that delivered it
+let w = worker_spawn("_worker_echo.cs");
+worker_on_message(w, fn(m) { throw "bad event"; });
+await worker_post(w, {op: "progress"});
+print("unreachable");
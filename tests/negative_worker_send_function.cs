@@ -0,0 +1,5 @@
+// EXPECT_FAIL
+
+// Functions cannot be copied into another VM
+let w = worker_spawn("_worker_echo.cs");
+worker_post(w, {op: "echo", value: fn() => 1});
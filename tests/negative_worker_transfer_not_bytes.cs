@@ -0,0 +1,5 @@
+// EXPECT_FAIL
+
+// Only bytes buffers can be transferred
+let w = worker_spawn("_worker_echo.cs");
+worker_post(w, {op: "echo", value: "x"}, {transfer: ["x"]});
@@ -0,0 +1,94 @@
+// Sockets and files on the io_uring backend; the same script runs on the readiness
+// backend where the kernel has no io_uring.
+
+let readiness = net_poll_backend();
+let backend = net_set_poll_backend("io_uring");
+assert(backend == "io_uring" || backend == readiness, "io_uring or fallback");
+assert(net_poll_backend() == backend, "backend reported");
+
+let port = 43000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+
+fn pair() {
+  let c = await tcp_connect("127.0.0.1", port);
+  let s = await socket_accept(srv);
+  return [c, s];
+}
+
+// Accept waiting before the connect arrives
+let waiting = socket_accept(srv);
+let c0 = await tcp_connect("127.0.0.1", port);
+let s0 = await waiting;
+assert(s0.host == "127.0.0.1" && s0.port > 0, "accepted socket");
+
+// Receives queued before the data is sent, on many connections at once
+let conns = [];
+let recvs = [];
+for i in range(40) {
+  let p = pair();
+  push(conns, p);
+  push(recvs, socket_recv(p[1], 64));
+}
+for i in range(40) { socket_send(conns[i][0], "m" + to_str(i)); }
+for i in range(40) { assert(await recvs[i] == "m" + to_str(i), "recv " + to_str(i)); }
+
+// A large send completes and arrives whole
+let big = "";
+for i in range(2000) { big = big + "0123456789abcdef"; }
+let sent = await socket_send(c0, big);
+assert(sent == len(big), "send count");
+let got = "";
+while (len(got) < len(big)) { got = got + await socket_recv(s0, 65536); }
+assert(got == big, "large payload");
+
+// Closing drops a recv the kernel still holds; the fd is reused afterwards
+let d = pair();
+socket_recv(d[1], 64);
+socket_close(d[1]);
+socket_close(d[0]);
+let e = pair();
+await socket_send(e[0], "reused");
+assert(await socket_recv(e[1], 64) == "reused", "reuse after close");
+
+// Hangup and timeout
+let closed = socket_recv(e[1], 64);
+socket_close(e[0]);
+let err = nil;
+try { await closed; } catch (x) { err = x; }
+assert(err != nil && err.code == "NET_CLOSED", "hangup rejects recv");
+
+net_set_default_timeout(50);
+let f = pair();
+err = nil;
+try { await socket_recv(f[1], 64); } catch (x) { err = x; }
+assert(err != nil && err.code == "NET_TIMEOUT", "recv timeout");
+net_set_default_timeout(0);
+
+// Files
+let path = "/tmp/cs_io_uring_" + to_str(random_int(0, 1000000)) + ".txt";
+let body = "";
+for i in range(5000) { body = body + "line " + to_str(i) + "\n"; }
+assert(await write_file_async(path, body) == true, "async write");
+assert(await read_file_async(path) == body, "async read");
+assert(read_file(path) == body, "sync read of async write");
+let reads = [];
+for i in range(8) { push(reads, read_file_async(path)); }
+for r in reads { assert(await r == body, "concurrent reads"); }
+assert(await write_file_async(path, "") == true && await read_file_async(path) == "", "empty file");
+assert(await read_file_async(path + ".missing") == nil, "missing file");
+assert(await write_file_async("/nonexistent-dir/x", "x") == false, "unwritable path");
+rm(path);
+
+for c in conns { socket_close(c[0]); socket_close(c[1]); }
+socket_close(f[0]);
+socket_close(f[1]);
+socket_close(c0);
+socket_close(s0);
+
+// Back to readiness once nothing is pending
+assert(net_set_poll_backend(readiness) == readiness, "switch back");
+let g = pair();
+await socket_send(g[0], "again");
+assert(await socket_recv(g[1], 64) == "again", "readiness after io_uring");
+socket_close(srv);
+print("net io_uring ok");
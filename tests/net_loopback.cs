@@ -0,0 +1,80 @@
+// Sockets over 127.0.0.1: many waiting operations, readiness, close and timeouts.
+
+let backend = net_poll_backend();
+assert(backend == "io_uring" || backend == "epoll" || backend == "poll" || backend == "select", "backend name");
+
+let port = 41000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+
+fn pair() {
+  let c = await tcp_connect("127.0.0.1", port);
+  let s = await socket_accept(srv);
+  return [c, s];
+}
+
+// Idle connections each with a recv waiting on the server side
+let idle = [];
+let idle_recvs = [];
+for i in range(50) {
+  let p = pair();
+  push(idle, p);
+  push(idle_recvs, socket_recv(p[1], 64));
+}
+
+// Active connections ping-pong while the idle ones keep waiting
+let a = pair();
+for i in range(20) {
+  await socket_send(a[0], "ping" + to_str(i));
+  let got = await socket_recv(a[1], 64);
+  assert(got == "ping" + to_str(i), "server got ping");
+  await socket_send(a[1], "pong");
+  assert(await socket_recv(a[0], 64) == "pong", "client got pong");
+}
+
+// Wake idle connections in reverse order; each settles its own promise
+let n = len(idle);
+for i in range(n) {
+  let k = n - 1 - i;
+  await socket_send(idle[k][0], "wake" + to_str(k));
+}
+for i in range(n) {
+  assert(await idle_recvs[i] == "wake" + to_str(i), "idle recv " + to_str(i));
+}
+
+// Read and write waiting on the same socket at once
+let b = pair();
+let pending_read = socket_recv(b[0], 64);
+await socket_send(b[0], "both");
+assert(await socket_recv(b[1], 64) == "both", "write while a read waits");
+await socket_send(b[1], "back");
+assert(await pending_read == "back", "read still delivered");
+
+// Closing drops a waiting recv; the fd can be reused by a new connection
+let c = pair();
+socket_recv(c[1], 64);
+socket_close(c[1]);
+socket_close(c[0]);
+let d = pair();
+await socket_send(d[0], "reused");
+assert(await socket_recv(d[1], 64) == "reused", "new connection after close");
+
+// Peer hangup rejects a waiting recv
+let e = pair();
+let closed = socket_recv(e[1], 64);
+socket_close(e[0]);
+let err = nil;
+try { await closed; } catch (x) { err = x; }
+assert(err != nil && err.code == "NET_CLOSED", "hangup rejects recv");
+
+// Waiting operations time out
+net_set_default_timeout(50);
+let f = pair();
+let t0 = now_ms();
+err = nil;
+try { await socket_recv(f[1], 64); } catch (x) { err = x; }
+assert(err != nil && err.code == "NET_TIMEOUT", "recv timeout");
+assert(now_ms() - t0 < 1000, "timeout is prompt");
+
+for p in idle { socket_close(p[0]); socket_close(p[1]); }
+socket_close(srv);
+print("net loopback ok");
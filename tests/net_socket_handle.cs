@@ -0,0 +1,45 @@
+// Socket handles: counters, closing, and handles that outlive their socket.
+
+let port = 43000 + random_int(0, 2000);
+let srv = tcp_listen("127.0.0.1", port);
+
+fn pair() {
+  let c = await tcp_connect("127.0.0.1", port);
+  let s = await socket_accept(srv);
+  return [c, s];
+}
+
+let p = pair();
+let c = p[0];
+let s = p[1];
+assert(s.host == "127.0.0.1" && s.port > 0 && c.port == port, "host and port");
+
+// Counters cover immediate and waiting operations
+let waiting = socket_recv(s, 64);
+await socket_send(c, "hello");
+assert(await waiting == "hello", "waiting recv");
+await socket_send(c, "again");
+await sleep(20);
+assert(await socket_recv(s, 64) == "again", "second recv");
+let cs = socket_stats(c);
+let ss = socket_stats(s);
+assert(cs.bytes_sent == 10 && cs.sends == 2 && cs.bytes_received == 0, "sender stats");
+assert(ss.bytes_received == 10 && ss.recvs == 2 && ss.secure == false, "receiver stats");
+
+// Closing twice is harmless; a new socket that reuses the descriptor starts afresh
+// (negative_socket_closed_handle.cs covers using the old handle)
+socket_close(s);
+socket_close(s);
+let q = pair();
+await socket_send(q[0], "fresh");
+assert(await socket_recv(q[1], 64) == "fresh", "new socket works");
+assert(socket_stats(q[1]).bytes_received == 5, "new socket has its own stats");
+
+// The peer of the closed socket reads end of stream
+assert(await socket_recv(c, 64) == nil, "hangup");
+
+socket_close(c);
+socket_close(q[0]);
+socket_close(q[1]);
+socket_close(srv);
+print("net socket handle ok");
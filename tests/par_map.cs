@@ -0,0 +1,36 @@
+// par_map/par_reduce run a module function over list chunks on a pool of VMs.
+
+let xs = [x for x in range(1000)];
+
+let sq = par_map(xs, "square", "_par_lib.cs");
+assert(len(sq) == 1000 && sq[0] == 0 && sq[999] == 998001, "results keep input order");
+
+// Pool and chunk sizes are configurable
+let small = par_map(xs, "square", "_par_lib.cs", {workers: 3, chunk: 7});
+assert(small[500] == 250000 && small[999] == 998001, "small chunks");
+let one = par_map(xs, "square", "_par_lib.cs", {workers: 1});
+assert(one[10] == 100, "single worker");
+
+// Structured items are copied into the pool
+let docs = [{text: "a b c"}, {text: "d"}, {text: "e f"}];
+let counts = par_map(docs, "word_count", "_par_lib.cs", {workers: 2, chunk: 1});
+assert(counts[0] == 3 && counts[1] == 1 && counts[2] == 2, "map items");
+
+// Reductions fold chunks in order, so associative functions match reduce()
+assert(par_reduce(xs, "add", "_par_lib.cs") == reduce(xs, fn(a, b) => a + b), "sum");
+assert(par_reduce(xs, "add", "_par_lib.cs", {init: 5, chunk: 10}) == 499505, "sum with init");
+let words = ["a", "b", "c", "d", "e", "f", "g"];
+assert(par_reduce(words, "add", "_par_lib.cs", {workers: 3, chunk: 2}) == "abcdefg", "ordered fold");
+assert(par_reduce([], "add", "_par_lib.cs", {init: 9}) == 9, "empty reduce");
+assert(len(par_map([], "square", "_par_lib.cs")) == 0, "empty map");
+
+// Bytes inputs are copied, not moved out of the caller's list
+let bufs = [bytes([1, 2]), bytes([3])];
+let sizes = par_map(bufs, "size", "_par_lib.cs", {workers: 1});
+assert(sizes[0] == 2 && sizes[1] == 1 && len(bufs[0]) == 2, "bytes copied");
+
+// Pool VMs are reused: the module ran once per VM
+let l = par_map([1, 2, 3, 4], "loaded", "_par_lib.cs", {workers: 2, chunk: 1});
+assert(l[0] == 1 && l[3] == 1, "module loaded once per pool VM");
+
+print("par map ok");
@@ -34,7 +34,9 @@ for t in "${tests[@]}"; do
     expect_fail=1
   fi
 
-  if "$BIN" "$path" >"$tmp_out" 2>&1; then
+  status=0
+  "$BIN" "$path" >"$tmp_out" 2>&1 || status=$?
+  if [[ $status -eq 0 ]]; then
     if [[ $expect_fail -eq 1 ]]; then
       echo "FAIL $t (expected failure, got success)"
       cat "$tmp_out"
@@ -44,7 +46,8 @@ for t in "${tests[@]}"; do
       pass=$((pass + 1))
     fi
   else
-    if [[ $expect_fail -eq 1 ]]; then
+    # A crash (abort, segfault) is never the failure a negative test expects
+    if [[ $expect_fail -eq 1 && $status -lt 128 ]]; then
       echo "PASS $t (expected failure)"
       pass=$((pass + 1))
     else
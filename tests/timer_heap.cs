@@ -0,0 +1,46 @@
+// Timers fire in deadline order, equal deadlines in arming order, and can be cancelled.
+
+// Armed out of order; once one fires, every earlier deadline has fired and
+// every later one is still armed (cancel_timer reports which)
+let ms = [90, 30, 60, 10, 120, 50];
+let ps = [];
+for m in ms { push(ps, sleep(m)); }
+await ps[5];
+assert(!cancel_timer(ps[1]) && !cancel_timer(ps[3]), "earlier deadlines fired");
+assert(cancel_timer(ps[2]) && cancel_timer(ps[4]), "later deadlines still armed");
+await ps[0];
+
+// Many outstanding timers
+let many = [];
+for i in 0..5000 { push(many, sleep(i % 7)); }
+await_all(many);
+assert(true, "5000 timers settled");
+
+// Cancelling rejects the promise and only works while it is armed
+let t = sleep(10000);
+assert(cancel_timer(t), "cancel armed timer");
+assert(!cancel_timer(t), "second cancel is a no-op");
+let caught = nil;
+try { await t; } catch (e) { caught = e; }
+assert(caught == "cancelled", "awaiting a cancelled timer throws");
+
+let fired = sleep(1);
+await fired;
+assert(!cancel_timer(fired), "fired timer cannot be cancelled");
+assert(!cancel_timer(promise()) && !cancel_timer(5), "not a timer");
+
+// Cancelling from the middle of the heap keeps the rest ordered
+let keep = [sleep(40), sleep(20), sleep(60)];
+let drop = [sleep(30), sleep(50), sleep(10)];
+for d in drop { cancel_timer(d); }
+await keep[1];
+assert(cancel_timer(keep[0]) && cancel_timer(keep[2]), "order after cancels");
+
+// Sub-millisecond sleeps use the monotonic clock
+let t0 = now_ns();
+await sleep(0.25);
+let waited = now_ns() - t0;
+assert(waited >= 250000, "slept at least 250us");
+assert(now_ns() >= t0, "monotonic");
+
+print("timer heap ok");
@@ -0,0 +1,73 @@
+// TLS session resumption against a local openssl s_server (skipped without openssl).
+
+fn sh(cmd) { return subprocess("sh", ["-c", cmd]); }
+
+// assert() errors skip finally blocks; checks made while s_server runs throw instead
+fn check(ok, msg) {
+  if (!ok) { throw "check failed: " + msg; }
+}
+
+// s_server -www answers with a status page ending in </HTML> and then closes
+async fn status_page(port) {
+  let s = await tls_connect("127.0.0.1", port);
+  let info = tls_info(s);
+  await socket_send(s, "GET / HTTP/1.0\r\n\r\n");
+  let got = "";
+  while (str_find(got, "</HTML>") < 0) { got = got + await socket_recv(s, 65536); }
+  socket_close(s);
+  return info;
+}
+
+async fn wait_listening(port) {
+  for i in range(100) {
+    try {
+      socket_close(await tcp_connect("127.0.0.1", port));
+      return true;
+    } catch (e) { await sleep(50); }
+  }
+  return false;
+}
+
+if (sh("command -v openssl").code != 0) {
+  print("tls resume skipped (no openssl)");
+} else {
+  let dir = temp_dir("tls_resume_");
+  let made = sh("cd '" + dir + "' && openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 " +
+                "-nodes -keyout key.pem -out cert.pem -days 1 -subj /CN=127.0.0.1 2>&1");
+  assert(made.code == 0, "certificate: " + made.out);
+  tls_config({ca_file: dir + "/cert.pem"});
+
+  let port = 46000 + random_int(0, 2000);
+  // serve.sh execs s_server from the worker's subprocess call, so the pid it writes is
+  // the server's and the worker's shell reaps it once it is killed
+  write_file(dir + "/serve.sh", "cd '" + dir + "' && echo $$ > pid && exec openssl s_server -accept 127.0.0.1:" +
+             to_str(port) + " -cert cert.pem -key key.pem -www -quiet >/dev/null 2>&1\n");
+  let server = worker_spawn("_tls_server.cs");
+  let served = server.post({script: dir + "/serve.sh"});
+  try {
+    check(await wait_listening(port), "s_server listening");
+
+    // The first connection does a full handshake; its ticket lets the next one resume
+    let first = await status_page(port);
+    let second = await status_page(port);
+    check(first.resumed == false && second.resumed == true, "tls_connect resumes");
+
+    // The HTTP client shares the cache
+    let r = http_get("https://127.0.0.1:" + to_str(port) + "/");
+    check(r.status == 200 && str_find(r.body, "</HTML>") > 0, "https request");
+    r = await http_get_async("https://127.0.0.1:" + to_str(port) + "/");
+    check(r.status == 200 && http_pool_stats().tls_resumed == 2, "http client resumes");
+
+    // With the cache off every handshake is a full one
+    check(tls_config({session_cache: false}).sessions == 0, "cache emptied");
+    check((await status_page(port)).resumed == false, "no resumption when disabled");
+    tls_config({session_cache: true});
+  } catch (e) {
+    throw e;
+  } finally {
+    if (exists(dir + "/pid")) { sh("kill " + str_trim(read_file(dir + "/pid"))); }
+    await served;
+    server.terminate();
+  }
+  print("tls resume ok");
+}
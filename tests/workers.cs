@@ -0,0 +1,82 @@
+// Worker VMs run on their own threads; messages are copied unless bytes are transferred.
+
+let w = worker_spawn("_worker_echo.cs");
+assert(w.path != nil, "handle has path");
+
+// Structured values survive the round trip
+let sent = {n: 1, f: 2.5, s: "hi", l: [1, [2, 3]], set: #{1, 2}, t: (x: 1, y: 2), none: nil, ok: true};
+let back = await worker_post(w, {op: "echo", value: sent});
+assert(back.n == 1 && back.f == 2.5 && back.s == "hi", "scalars");
+assert(back.l[1][1] == 3 && len(back.l) == 2, "nested list");
+assert(typeof(back.set) == "set" && back.set.contains(2), "set");
+assert(typeof(back.t) == "tuple" && back.t.y == 2, "named tuple");
+assert(back.none == nil && back.ok == true, "nil and bool");
+
+// Bytes are copied by default; buffers listed in transfer are moved and left empty
+let buf = bytes([1, 2, 3, 4]);
+assert(await worker_post(w, {op: "size", value: buf}) == 4, "bytes arrive");
+assert(len(buf) == 4 && buf[3] == 4, "sent bytes are kept");
+let moved = bytes([5, 6, 7]);
+let pair = await worker_post(w, {op: "echo", value: [moved, buf]}, {transfer: [moved]});
+assert(len(pair[0]) == 3 && pair[0][2] == 7 && len(pair[1]) == 4, "transferred bytes arrive");
+assert(len(moved) == 0 && len(buf) == 4, "only transferred bytes are detached");
+let echoed = await worker_post(w, {op: "echo", value: bytes("abc")});
+assert(is_bytes(echoed) && len(echoed) == 3, "bytes come back");
+
+// Handlers may be async
+assert(await worker_post(w, {op: "double", value: 21}) == 42, "async handler");
+
+// Several requests in flight settle in order
+let ps = [];
+for i in range(5) { push(ps, worker_post(w, {op: "sum", n: i * 10})); }
+let sums = await await_all(ps);
+assert(sums[0] == 0 && sums[1] == 45 && sums[4] == 780, "pipelined requests");
+
+// Unsolicited messages reach worker_on_message while awaiting
+let steps = [];
+worker_on_message(w, fn(m) { push(steps, m.step); });
+assert(await worker_post(w, {op: "progress"}) == "done", "progress reply");
+assert(len(steps) == 3 && steps[2] == 2, "events delivered before the reply");
+
+// A failing event callback is passed to worker_on_error
+let event_errors = [];
+worker_on_message(w, fn(m) { throw "bad event " + to_str(m.step); });
+worker_on_error(w, fn(e) { push(event_errors, e); });
+assert(await worker_post(w, {op: "progress"}) == "done", "reply after failing events");
+assert(len(event_errors) == 3 && contains(event_errors[1], "bad event 1"), "event errors reported");
+worker_on_message(w, nil);
+worker_on_error(w, nil);
+
+// Errors in the worker reject the promise
+let err = nil;
+try { await worker_post(w, {op: "fail"}); } catch (e) { err = e; }
+assert(err != nil && contains(to_str(err), "bad request"), "handler throw rejects");
+
+err = nil;
+try { await worker_post(w, {op: "leak"}); } catch (e) { err = e; }
+assert(err != nil && contains(to_str(err), "cannot send"), "function reply rejects");
+
+// The handle's methods are the same operations
+let events = [];
+w.on_message(fn(m) { push(events, m.step); });
+assert(await w.post({op: "progress"}) == "done" && len(events) == 3, "handle methods");
+let kept = bytes([1, 2]);
+assert(len(await w.post({op: "echo", value: kept}, {transfer: [kept]})) == 2 && len(kept) == 0, "method transfer");
+w.on_message(nil);
+
+// Each worker has its own globals
+let w2 = worker_spawn("_worker_echo.cs");
+assert(await worker_post(w2, {op: "calls"}) == 1, "fresh worker state");
+assert(await worker_post(w, {op: "calls"}) > 5, "first worker state kept");
+
+// Terminating interrupts a busy worker and rejects what is still pending
+let spinning = worker_post(w2, {op: "spin"});
+let queued = worker_post(w2, {op: "calls"});
+w2.terminate();
+let rejected = 0;
+for p in [spinning, queued] {
+  try { await p; } catch (e) { rejected += 1; }
+}
+assert(rejected == 2, "pending posts rejected");
+
+print("workers ok");